@@ -97,6 +97,22 @@ typedef struct {
  */
 typedef bool (*bsp_sys_get_sleep_mode)();
 
+/**
+ * @brief Sleep mode change notification
+ *
+ * @param sleeping: true when entering sleep (before the codec stops), false when leaving it (after the codec resumes)
+ * @param arg: User argument given to set_sleep_cb
+ */
+typedef void (*bsp_sys_sleep_cb_t)(bool sleeping, void *arg);
+
+/**
+ * @brief Set the sleep mode change callback, called from the sensor monitor task
+ *
+ * @param cb: Callback, NULL to remove it
+ * @param arg: User argument passed to the callback
+ */
+typedef void (*bsp_sys_set_sleep_cb)(bsp_sys_sleep_cb_t cb, void *arg);
+
 /**
  * @brief Get radar status
  *
@@ -219,6 +235,7 @@ esp_err_t bsp_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, u
 
 typedef struct {
     bsp_sys_get_sleep_mode get_sleep_mode;
+    bsp_sys_set_sleep_cb set_sleep_cb;
     bsp_sys_get_bottom_id get_bottom_id;
 
     bsp_bottom_set_radar_enable set_radar_enable;
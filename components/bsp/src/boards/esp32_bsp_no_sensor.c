@@ -15,6 +15,11 @@ static bool bsp_get_sleep_mode()
     return false;
 }
 
+static void bsp_set_sleep_cb(bsp_sys_sleep_cb_t cb, void *arg)
+{
+    return;
+}
+
 static bottom_id_t bsp_get_bottom_id()
 {
     return BOTTOM_ID_UNKNOW;
@@ -40,6 +45,7 @@ esp_err_t bsp_sensor_init(bsp_bottom_property_t *handle)
     ESP_LOGW(TAG, "This example don't support Sensor!!");
 
     handle->get_sleep_mode = bsp_get_sleep_mode;
+    handle->set_sleep_cb = bsp_set_sleep_cb;
     handle->get_bottom_id = bsp_get_bottom_id;
     handle->get_radar_status = bsp_sensor_get_radar_status;
     handle->set_radar_enable = bsp_sensor_set_radar_enable;
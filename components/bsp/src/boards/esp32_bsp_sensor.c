@@ -19,6 +19,8 @@
 #define RADAE_FUNC_STOP                 (RADAE_POWER_DELAY + 1)
 
 static bool sys_sleep_entered = false;
+static bsp_sys_sleep_cb_t sys_sleep_cb = NULL;
+static void *sys_sleep_cb_arg = NULL;
 static bottom_id_t sys_bottom_id;
 
 static float sys_temp_result;
@@ -43,6 +45,21 @@ static bool bsp_get_sleep_mode()
     return sys_sleep_entered;
 }
 
+static void bsp_set_sleep_cb(bsp_sys_sleep_cb_t cb, void *arg)
+{
+    sys_sleep_cb = NULL;
+    sys_sleep_cb_arg = arg;
+    sys_sleep_cb = cb;
+}
+
+static void bsp_notify_sleep(bool sleeping)
+{
+    bsp_sys_sleep_cb_t cb = sys_sleep_cb;
+    if (cb) {
+        cb(sleeping, sys_sleep_cb_arg);
+    }
+}
+
 static bottom_id_t bsp_get_bottom_id()
 {
     return sys_bottom_id;
@@ -126,9 +143,11 @@ static void low_power_monitor_task(void *arg)
             iot_button_resume();
             bsp_codec_dev_resume();
             sys_sleep_entered = false;
+            bsp_notify_sleep(false);
         } else if ((1 == power_off_delay) && (BOTTOM_ID_SENSOR == sys_bottom_id)) {
             ESP_LOGD(TAG, "power off");
             sys_sleep_entered = true;
+            bsp_notify_sleep(true);
             bsp_display_enter_sleep();
 
             lvgl_port_stop();
@@ -299,6 +318,7 @@ esp_err_t bsp_sensor_init(bsp_bottom_property_t *handle)
     }
 
     handle->get_sleep_mode = bsp_get_sleep_mode;
+    handle->set_sleep_cb = bsp_set_sleep_cb;
     handle->get_bottom_id = bsp_get_bottom_id;
     handle->get_radar_status = bsp_sensor_get_radar_status;
     handle->set_radar_enable = bsp_sensor_set_radar_onoff;
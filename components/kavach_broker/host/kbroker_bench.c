@@ -0,0 +1,375 @@
+/*
+ * kbroker benchmark: the broker runs in a thread on a free port, clients are threads with blocking
+ * sockets speaking just enough MQTT. Each message carries its send time, so subscribers measure the
+ * publish-to-delivery latency.
+ *
+ *   fan-in:  many publishers (like the nodes), one subscriber on "bench/#" (like the box)
+ *   fan-out: one publisher, many subscribers on the same topic
+ *
+ * "burst" runs send as fast as the sockets allow (throughput); "paced" runs send at a fixed total rate
+ * well below it (latency as the home would see it).
+ *
+ *   kbroker_bench [clients] [messages per publisher]
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "kbroker.h"
+
+#define PAYLOAD_LEN     64          /* about a node's JSON report */
+#define RECV_TIMEOUT_S  5
+
+static uint16_t s_port;
+static atomic_bool s_stop;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* ---- minimal blocking client ---- */
+
+typedef struct {
+    int fd;
+    uint8_t buf[4096];
+} client_t;
+
+static int send_all(int fd, const uint8_t *p, size_t n)
+{
+    while (n) {
+        ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+        if (k <= 0) {
+            if (k < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += k;
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, uint8_t *p, size_t n)
+{
+    while (n) {
+        ssize_t k = recv(fd, p, n, 0);
+        if (k <= 0) {
+            if (k < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += k;
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+/* Read one packet; body in c->buf. Returns the first header byte, or -1. */
+static int read_packet(client_t *c, size_t *len)
+{
+    uint8_t hdr, b;
+    size_t rem = 0, mul = 1;
+    if (recv_all(c->fd, &hdr, 1) < 0) {
+        return -1;
+    }
+    do {
+        if (recv_all(c->fd, &b, 1) < 0) {
+            return -1;
+        }
+        rem += (b & 127) * mul;
+        mul *= 128;
+    } while (b & 128);
+    if (rem > sizeof(c->buf) || recv_all(c->fd, c->buf, rem) < 0) {
+        return -1;
+    }
+    *len = rem;
+    return hdr;
+}
+
+static size_t put_str(uint8_t *p, const char *s)
+{
+    size_t n = strlen(s);
+    p[0] = (uint8_t)(n >> 8);
+    p[1] = (uint8_t)n;
+    memcpy(p + 2, s, n);
+    return n + 2;
+}
+
+static int client_connect(client_t *c, const char *id)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(s_port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        return -1;
+    }
+    int one = 1;
+    struct timeval tv = { .tv_sec = RECV_TIMEOUT_S };
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    uint8_t p[256];
+    size_t i = 2;
+    i += put_str(p + i, "MQTT");
+    p[i++] = 4;
+    p[i++] = 0x02;      /* clean session */
+    p[i++] = 0;
+    p[i++] = 60;
+    i += put_str(p + i, id);
+    p[0] = 0x10;
+    p[1] = (uint8_t)(i - 2);
+    size_t len;
+    if (send_all(c->fd, p, i) < 0 || read_packet(c, &len) != 0x20 || len != 2 || c->buf[1] != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int client_subscribe(client_t *c, const char *filter, int qos)
+{
+    uint8_t p[256];
+    size_t i = 2;
+    p[i++] = 0;
+    p[i++] = 1;
+    i += put_str(p + i, filter);
+    p[i++] = (uint8_t)qos;
+    p[0] = 0x82;
+    p[1] = (uint8_t)(i - 2);
+    size_t len;
+    return send_all(c->fd, p, i) < 0 || read_packet(c, &len) != 0x90 ? -1 : 0;
+}
+
+static int client_publish(client_t *c, const char *topic, int qos, uint16_t pid)
+{
+    uint8_t p[256];
+    size_t i = 2;
+    i += put_str(p + i, topic);
+    if (qos) {
+        p[i++] = pid >> 8;
+        p[i++] = pid & 0xff;
+    }
+    int64_t t = now_ns();
+    memset(p + i, 'x', PAYLOAD_LEN);
+    memcpy(p + i, &t, sizeof(t));
+    i += PAYLOAD_LEN;
+    p[0] = 0x30 | (uint8_t)(qos << 1);
+    p[1] = (uint8_t)(i - 2);
+    if (send_all(c->fd, p, i) < 0) {
+        return -1;
+    }
+    if (qos) {
+        size_t len;
+        return read_packet(c, &len) == 0x40 ? 0 : -1;   /* wait for PUBACK, as a node would */
+    }
+    return 0;
+}
+
+/* ---- run ---- */
+
+typedef struct {
+    int pubs, subs, qos, msgs;
+    int64_t interval_ns;        /* per publisher; 0: burst */
+} run_cfg_t;
+
+typedef struct {
+    const run_cfg_t *cfg;
+    int index;
+    pthread_barrier_t *ready;
+    int64_t *lat;               /* subscriber: latencies */
+    size_t lat_num;
+    int64_t last_ns;            /* subscriber: last delivery */
+    int errors;
+} worker_t;
+
+static void *publisher(void *arg)
+{
+    worker_t *w = arg;
+    client_t *c = malloc(sizeof(*c));
+    char id[32], topic[32];
+    snprintf(id, sizeof(id), "pub-%d", w->index);
+    snprintf(topic, sizeof(topic), w->cfg->pubs > 1 ? "bench/node%d/gas" : "bench/fan", w->index);
+    int rc = client_connect(c, id);
+    pthread_barrier_wait(w->ready);
+    int64_t next = now_ns();
+    for (int i = 0; rc == 0 && i < w->cfg->msgs; i++) {
+        if (w->cfg->interval_ns) {
+            next += w->cfg->interval_ns;
+            while (now_ns() < next) {
+                struct timespec ts = { 0, 20000 };
+                nanosleep(&ts, NULL);
+            }
+        }
+        rc = client_publish(c, topic, w->cfg->qos, (uint16_t)(i % 65535 + 1));
+    }
+    w->errors = rc != 0;
+    if (c->fd >= 0) {
+        shutdown(c->fd, SHUT_WR);
+        size_t len;
+        while (read_packet(c, &len) >= 0) {
+        }
+        close(c->fd);
+    }
+    free(c);
+    return NULL;
+}
+
+static void *subscriber(void *arg)
+{
+    worker_t *w = arg;
+    client_t *c = malloc(sizeof(*c));
+    char id[32];
+    snprintf(id, sizeof(id), "sub-%d", w->index);
+    size_t expect = (size_t)w->cfg->msgs * (w->cfg->subs > 1 ? 1 : (size_t)w->cfg->pubs);
+    w->lat = malloc(expect * sizeof(int64_t));
+    int rc = client_connect(c, id);
+    if (rc == 0) {
+        rc = client_subscribe(c, w->cfg->subs > 1 ? "bench/fan" : "bench/#", w->cfg->qos);
+    }
+    pthread_barrier_wait(w->ready);
+    while (rc == 0 && w->lat_num < expect) {
+        size_t len;
+        int hdr = read_packet(c, &len);
+        if (hdr < 0) {
+            break;      /* timeout: messages were dropped */
+        }
+        if ((hdr >> 4) != 3) {
+            continue;
+        }
+        size_t off = 2 + ((size_t)c->buf[0] << 8 | c->buf[1]);
+        int qos = (hdr >> 1) & 3;
+        if (qos) {
+            uint8_t ack[4] = { 0x40, 2, c->buf[off], c->buf[off + 1] };
+            off += 2;
+            send_all(c->fd, ack, sizeof(ack));
+        }
+        int64_t t;
+        memcpy(&t, c->buf + off, sizeof(t));
+        w->last_ns = now_ns();
+        w->lat[w->lat_num++] = w->last_ns - t;
+    }
+    w->errors = rc != 0;
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    free(c);
+    return NULL;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char *name, const run_cfg_t *cfg)
+{
+    int n = cfg->pubs + cfg->subs;
+    pthread_t *th = calloc((size_t)n, sizeof(*th));
+    worker_t *w = calloc((size_t)n, sizeof(*w));
+    pthread_barrier_t ready;
+    pthread_barrier_init(&ready, NULL, (unsigned)n + 1);
+
+    for (int i = 0; i < cfg->subs; i++) {
+        w[i] = (worker_t) { .cfg = cfg, .index = i, .ready = &ready };
+        pthread_create(&th[i], NULL, subscriber, &w[i]);
+    }
+    for (int i = cfg->subs; i < n; i++) {
+        w[i] = (worker_t) { .cfg = cfg, .index = i - cfg->subs, .ready = &ready };
+        pthread_create(&th[i], NULL, publisher, &w[i]);
+    }
+    pthread_barrier_wait(&ready);
+    int64_t t0 = now_ns();
+    for (int i = 0; i < n; i++) {
+        pthread_join(th[i], NULL);
+    }
+    int64_t t1 = t0;
+    for (int i = 0; i < cfg->subs; i++) {
+        t1 = w[i].last_ns > t1 ? w[i].last_ns : t1;     /* not the timeout after a lost message */
+    }
+
+    size_t total = 0, expect = (size_t)cfg->pubs * (size_t)cfg->msgs * (size_t)cfg->subs;
+    int errors = 0;
+    for (int i = 0; i < n; i++) {
+        total += w[i].lat_num;
+        errors += w[i].errors;
+    }
+    int64_t *all = malloc((total ? total : 1) * sizeof(int64_t));
+    size_t k = 0;
+    for (int i = 0; i < cfg->subs; i++) {
+        memcpy(all + k, w[i].lat, w[i].lat_num * sizeof(int64_t));
+        k += w[i].lat_num;
+        free(w[i].lat);
+    }
+    qsort(all, total, sizeof(int64_t), cmp_i64);
+    double secs = (double)(t1 - t0) / 1e9;
+    printf("%-22s %3d pub %3d sub qos %d  %7zu/%-7zu delivered  %9.0f msg/s   p50 %7.1f us  p99 %8.1f us  max %8.1f us%s\n",
+           name, cfg->pubs, cfg->subs, cfg->qos, total, expect, total / secs,
+           total ? all[total / 2] / 1e3 : 0, total ? all[total * 99 / 100] / 1e3 : 0, total ? all[total - 1] / 1e3 : 0,
+           errors ? "  (client errors)" : "");
+    free(all);
+    free(w);
+    free(th);
+    pthread_barrier_destroy(&ready);
+}
+
+static void *broker_thread(void *arg)
+{
+    kbroker_t *kb = arg;
+    while (!atomic_load(&s_stop)) {
+        kbroker_poll(kb, 100);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int clients = argc > 1 ? atoi(argv[1]) : 32;
+    int msgs = argc > 2 ? atoi(argv[2]) : 2000;
+
+    kbroker_config_t cfg;
+    kbroker_config_default(&cfg);
+    cfg.port = 0;
+    cfg.max_conns = (uint16_t)(clients + 8);
+    cfg.tx_max = 256 * 1024;
+    kbroker_t *kb;
+    int err = kbroker_create(&cfg, &kb);
+    if (err) {
+        fprintf(stderr, "kbroker_create: %s\n", strerror(-err));
+        return 1;
+    }
+    s_port = kbroker_port(kb);
+    pthread_t th;
+    pthread_create(&th, NULL, broker_thread, kb);
+
+    const int64_t paced = 1000000000LL / 20;    /* each client 20 msg/s */
+    run("fan-in burst", &(run_cfg_t) { .pubs = clients, .subs = 1, .qos = 0, .msgs = msgs });
+    run("fan-in burst", &(run_cfg_t) { .pubs = clients, .subs = 1, .qos = 1, .msgs = msgs });
+    run("fan-in paced 20/s", &(run_cfg_t) { .pubs = clients, .subs = 1, .qos = 0, .msgs = 100, .interval_ns = paced });
+    run("fan-in paced 20/s", &(run_cfg_t) { .pubs = clients, .subs = 1, .qos = 1, .msgs = 100, .interval_ns = paced });
+    run("fan-out burst", &(run_cfg_t) { .pubs = 1, .subs = clients, .qos = 0, .msgs = msgs });
+    run("fan-out burst", &(run_cfg_t) { .pubs = 1, .subs = clients, .qos = 1, .msgs = msgs });
+    run("fan-out paced 20/s", &(run_cfg_t) { .pubs = 1, .subs = clients, .qos = 1, .msgs = 100, .interval_ns = paced });
+
+    kbroker_stats_t st;
+    kbroker_get_stats(kb, &st);
+    printf("broker: %lu accepted, %lu in, %lu out, %lu dropped, %llu bytes in, %llu bytes out\n",
+           (unsigned long)st.accepted, (unsigned long)st.msgs_in, (unsigned long)st.msgs_out,
+           (unsigned long)st.dropped, (unsigned long long)st.bytes_in, (unsigned long long)st.bytes_out);
+    atomic_store(&s_stop, true);
+    pthread_join(th, NULL);
+    kbroker_destroy(kb);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * kbroker as a PC program, e.g. to try the nodes against the same broker code the box runs.
+ *   kbroker_run [port]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kbroker.h"
+
+static void on_publish(const kbroker_msg_t *msg, void *arg)
+{
+    (void)arg;
+    printf("%s%s (%zu bytes, qos %u): %.*s\n", msg->topic, msg->retain ? " [retained]" : "", msg->len,
+           (unsigned)msg->qos, (int)(msg->len > 120 ? 120 : msg->len), (const char *)msg->payload);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    kbroker_config_t cfg;
+    kbroker_config_default(&cfg);
+    cfg.port = argc > 1 ? (uint16_t)atoi(argv[1]) : 1883;
+    cfg.max_conns = 64;
+    cfg.on_publish = on_publish;
+
+    kbroker_t *kb;
+    int err = kbroker_create(&cfg, &kb);
+    if (err) {
+        fprintf(stderr, "kbroker: cannot listen on %u: %s\n", (unsigned)cfg.port, strerror(-err));
+        return 1;
+    }
+    printf("kbroker listening on %u\n", (unsigned)kbroker_port(kb));
+    fflush(stdout);
+    for (;;) {
+        err = kbroker_poll(kb, 1000);
+        if (err) {
+            fprintf(stderr, "kbroker: select: %s\n", strerror(-err));
+            break;
+        }
+    }
+    kbroker_destroy(kb);
+    return 1;
+}
@@ -0,0 +1,98 @@
+/*
+ * kbroker: small MQTT 3.1.1 broker, so the Kavach box can serve the home's nodes itself when the
+ * external broker is down (app_broker.c), and built on a PC for benchmarks (host/).
+ *
+ * QoS 0 and 1 (QoS 2 publishes are accepted and delivered at QoS 1), retained messages, persistent
+ * sessions (subscriptions and queued messages kept while a clean-session-0 client is away), last will,
+ * keepalive. Plain BSD sockets and select(), so the same code runs on lwIP and on Linux.
+ *
+ * One task runs kbroker_poll() in a loop; kbroker_publish() may be called from any task.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct kbroker kbroker_t;
+
+typedef struct {
+    const char *topic;          /* NUL-terminated */
+    size_t topic_len;
+    const uint8_t *payload;
+    size_t len;
+    uint8_t qos;
+    bool retain;
+} kbroker_msg_t;
+
+/** A client published msg (also a will). Called from kbroker_poll() with no broker lock held. */
+typedef void (*kbroker_publish_cb_t)(const kbroker_msg_t *msg, void *arg);
+
+typedef struct {
+    uint16_t port;              /* 0: any free port (see kbroker_port()) */
+    uint16_t max_conns;         /* client connections */
+    uint16_t max_sessions;      /* sessions, offline persistent ones included; 0: 2 * max_conns */
+    uint32_t max_packet;        /* larger packets close the connection */
+    uint16_t queue_max;         /* messages queued per session */
+    uint16_t inflight_max;      /* unacknowledged QoS 1 messages per connection */
+    uint16_t retained_max;
+    uint32_t tx_max;            /* bytes buffered per connection; beyond it QoS 0 messages are dropped */
+    bool queue_qos0;            /* also queue QoS 0 messages for offline persistent sessions */
+    kbroker_publish_cb_t on_publish;
+    void *arg;
+} kbroker_config_t;
+
+typedef struct {
+    uint32_t conns;             /* open connections */
+    uint32_t sessions;          /* sessions, online and offline */
+    uint32_t retained;
+    uint32_t accepted;          /* connections accepted since start */
+    uint32_t refused;           /* connections closed at once: no free slot */
+    uint32_t msgs_in;           /* PUBLISH received (and kbroker_publish() calls) */
+    uint32_t msgs_out;          /* PUBLISH sent */
+    uint32_t dropped;           /* deliveries dropped: output buffer or session queue full */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} kbroker_stats_t;
+
+/** Fill cfg with defaults for a small device (16 connections, 4 KB packets). */
+void kbroker_config_default(kbroker_config_t *cfg);
+
+/**
+ * Create the broker and start listening.
+ * @return 0, or a negative errno (e.g. -EADDRINUSE, -ENOMEM)
+ */
+int kbroker_create(const kbroker_config_t *cfg, kbroker_t **out);
+
+/** Port the broker listens on. */
+uint16_t kbroker_port(const kbroker_t *kb);
+
+/**
+ * Wait up to timeout_ms for socket activity and handle it: new connections, packets, keepalive
+ * timeouts, queued output. Call in a loop from one task.
+ * @return 0, or a negative errno if select() failed
+ */
+int kbroker_poll(kbroker_t *kb, int timeout_ms);
+
+/**
+ * Publish as the broker itself (e.g. a message bridged from another broker). Any task. Not passed to
+ * on_publish. topic must not contain wildcards.
+ * @return 0, -EINVAL (bad topic or qos), -ENOMEM
+ */
+int kbroker_publish(kbroker_t *kb, const char *topic, const void *payload, size_t len, int qos, bool retain);
+
+void kbroker_get_stats(kbroker_t *kb, kbroker_stats_t *stats);
+
+/** Close all connections and free the broker. No other call may be running. */
+void kbroker_destroy(kbroker_t *kb);
+
+/** MQTT topic filter match ('+' one level, '#' the rest; wildcards do not match "$..." topics). */
+bool kbroker_topic_match(const char *filter, const char *topic, size_t topic_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1314 @@
+/*
+ * Connections and sessions are two fixed tables: a connection is a socket with its input and output
+ * buffers, a session is what a client id keeps across connections (subscriptions, queued messages).
+ * A published message is stored once, reference counted, and shared by every queue and the retained
+ * list it ends up in.
+ *
+ * Delivery checks each session's filters in turn; with a few dozen clients that is cheaper than
+ * keeping an index. QoS 0 messages go straight into the output buffer of online subscribers (dropped if
+ * it is over tx_max); QoS 1 messages go through the session queue, which limits the unacknowledged ones
+ * to inflight_max and keeps them for resending with DUP after a reconnect.
+ *
+ * Locking: kbroker_poll() waits in select() without the lock, then handles everything under it;
+ * kbroker_publish() takes it from other tasks. Sockets are non-blocking, so sending under the lock
+ * never waits. on_publish callbacks are collected under the lock and run after releasing it, so they
+ * may take other locks (e.g. an MQTT client's) that are held while calling kbroker_publish().
+ * Sockets are only closed by kbroker_poll(), never while it may be selecting on them.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "kbroker.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL        0
+#endif
+
+#define PKT_CONNECT         1
+#define PKT_CONNACK         2
+#define PKT_PUBLISH         3
+#define PKT_PUBACK          4
+#define PKT_PUBREC          5
+#define PKT_PUBREL          6
+#define PKT_PUBCOMP         7
+#define PKT_SUBSCRIBE       8
+#define PKT_SUBACK          9
+#define PKT_UNSUBSCRIBE     10
+#define PKT_UNSUBACK        11
+#define PKT_PINGREQ         12
+#define PKT_PINGRESP        13
+#define PKT_DISCONNECT      14
+
+#define CONNACK_OK              0
+#define CONNACK_BAD_PROTOCOL    1
+#define CONNACK_BAD_ID          2
+#define CONNACK_UNAVAILABLE     3
+
+#define CONNECT_TIMEOUT_MS  10000   /* socket open without CONNECT */
+#define CLIENT_ID_MAX       128
+#define QUEUE_MAX           16384   /* queue_max limit (queue arrays hold up to twice as many slots) */
+#define READ_MAX            8192    /* bytes read from one connection per poll round */
+#define HOLD_MAX_MS         1000    /* longest wait for a client that is behind (see kbroker_poll) */
+#define RX_INIT             256
+#define TX_INIT             512
+
+typedef struct {
+    uint32_t refs;
+    uint16_t topic_len;
+    uint32_t len;
+    uint8_t qos;
+    bool retain;            /* as published */
+    char data[];            /* topic, NUL, payload */
+} kb_msg_t;
+
+#define MSG_PAYLOAD(m)      ((const uint8_t *)(m)->data + (m)->topic_len + 1)
+
+typedef struct {
+    kb_msg_t *msg;
+    uint16_t pid;           /* 0 until first sent */
+    uint8_t qos;
+    bool retain;
+    bool sent;              /* QoS 1: sent, waiting for PUBACK */
+} kb_out_t;
+
+typedef struct {
+    char *filter;
+    uint8_t qos;
+} kb_sub_t;
+
+typedef struct kb_conn kb_conn_t;
+
+typedef struct {
+    bool used;
+    bool clean;
+    char *id;
+    kb_conn_t *conn;        /* NULL while offline */
+    kb_sub_t *subs;
+    uint16_t sub_num, sub_cap;
+    kb_out_t *out;          /* queue, oldest first: [out_head, out_end), removed entries have msg NULL */
+    uint16_t out_head, out_end, out_cap;
+    uint16_t out_num;       /* entries not removed */
+    uint16_t inflight;
+    uint16_t next_pid;
+    int64_t offline_ms;
+} kb_session_t;
+
+struct kb_conn {
+    int fd;                 /* -1: free slot */
+    bool closing;
+    bool publish_will;      /* when closing */
+    kb_session_t *sess;     /* NULL until CONNECT */
+    uint8_t *rx;
+    size_t rx_len, rx_cap;
+    uint8_t *tx;
+    size_t tx_len, tx_cap;
+    uint16_t keepalive;
+    int64_t last_rx_ms;
+    int64_t behind_ms;      /* since when this client is behind (0: it is not) */
+    kb_msg_t *will;
+    bool will_retain;
+};
+
+struct kbroker {
+    kbroker_config_t cfg;
+    int listen_fd;
+    uint16_t port;
+    pthread_mutex_t lock;
+    kb_conn_t *conns;
+    kb_session_t *sessions;
+    kb_msg_t **retained;
+    kb_msg_t **cb_msgs;     /* client publishes for on_publish, collected under the lock */
+    uint16_t cb_num, cb_cap;
+    uint32_t anon_seq;
+    kbroker_stats_t stats;
+};
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* ---- messages ---- */
+
+static kb_msg_t *msg_new(const char *topic, size_t topic_len, const void *payload, size_t len, uint8_t qos)
+{
+    kb_msg_t *m = malloc(sizeof(*m) + topic_len + 1 + len);
+    if (!m) {
+        return NULL;
+    }
+    m->refs = 1;
+    m->topic_len = (uint16_t)topic_len;
+    m->len = (uint32_t)len;
+    m->qos = qos;
+    m->retain = false;
+    memcpy(m->data, topic, topic_len);
+    m->data[topic_len] = '\0';
+    if (len) {
+        memcpy(m->data + topic_len + 1, payload, len);
+    }
+    return m;
+}
+
+static void msg_unref(kb_msg_t *m)
+{
+    if (m && --m->refs == 0) {
+        free(m);
+    }
+}
+
+static bool topic_valid(const char *topic, size_t len)
+{
+    if (len == 0 || len > 0xffff) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (topic[i] == '+' || topic[i] == '#' || topic[i] == '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool filter_valid(const char *f, size_t len)
+{
+    if (len == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        bool level_start = (i == 0 || f[i - 1] == '/');
+        bool level_end = (i + 1 == len || f[i + 1] == '/');
+        if (f[i] == '\0' || ((f[i] == '+' || f[i] == '#') && !(level_start && level_end)) ||
+                (f[i] == '#' && i + 1 != len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool kbroker_topic_match(const char *filter, const char *topic, size_t topic_len)
+{
+    const char *t = topic;
+    const char *end = topic + topic_len;
+    if (topic_len > 0 && *t == '$' && (*filter == '+' || *filter == '#')) {
+        return false;
+    }
+    while (*filter) {
+        if (*filter == '#') {
+            return true;
+        }
+        if (*filter == '+') {
+            while (t < end && *t != '/') {
+                t++;
+            }
+            filter++;
+        } else {
+            while (*filter && *filter != '/') {
+                if (t >= end || *t != *filter) {
+                    return false;
+                }
+                t++;
+                filter++;
+            }
+        }
+        if (*filter != '/') {
+            return t == end;
+        }
+        if (t >= end) {
+            return strcmp(filter, "/#") == 0;   /* "a/#" also matches "a" */
+        }
+        if (*t != '/') {
+            return false;
+        }
+        filter++;
+        t++;
+    }
+    return t == end;
+}
+
+/* ---- output ---- */
+
+static size_t put_varint(uint8_t *p, size_t n)
+{
+    size_t i = 0;
+    do {
+        uint8_t b = n % 128;
+        n /= 128;
+        p[i++] = b | (n ? 0x80 : 0);
+    } while (n);
+    return i;
+}
+
+static void flush(kbroker_t *kb, kb_conn_t *c);
+
+/* Room for n more output bytes; beyond tx_max only if force (control packets). */
+static uint8_t *tx_room(kbroker_t *kb, kb_conn_t *c, size_t n, bool force)
+{
+    if (c->closing) {
+        return NULL;
+    }
+    if (!force && c->tx_len + n > kb->cfg.tx_max) {
+        return NULL;
+    }
+    if (c->tx_len + n > c->tx_cap) {
+        size_t cap = c->tx_cap ? c->tx_cap : TX_INIT;
+        while (cap < c->tx_len + n) {
+            cap *= 2;
+        }
+        uint8_t *tx = realloc(c->tx, cap);
+        if (!tx) {
+            return NULL;
+        }
+        c->tx = tx;
+        c->tx_cap = cap;
+    }
+    return c->tx + c->tx_len;
+}
+
+static void send_ack(kbroker_t *kb, kb_conn_t *c, uint8_t hdr, uint16_t pid)
+{
+    uint8_t *p = tx_room(kb, c, 4, true);
+    if (p) {
+        p[0] = hdr;
+        p[1] = 2;
+        p[2] = pid >> 8;
+        p[3] = pid & 0xff;
+        c->tx_len += 4;
+    }
+}
+
+static bool send_publish(kbroker_t *kb, kb_conn_t *c, const kb_msg_t *m, uint8_t qos, uint16_t pid, bool retain,
+                         bool dup, bool force)
+{
+    size_t rem = 2 + m->topic_len + (qos ? 2 : 0) + m->len;
+    uint8_t *p = tx_room(kb, c, 1 + 4 + rem, force);
+    if (!p && c->tx_len && !c->closing) {
+        flush(kb, c);   /* the socket may take some now */
+        p = tx_room(kb, c, 1 + 4 + rem, force);
+    }
+    if (!p) {
+        return false;
+    }
+    size_t i = 0;
+    p[i++] = (PKT_PUBLISH << 4) | (dup ? 0x08 : 0) | (qos << 1) | (retain ? 1 : 0);
+    i += put_varint(p + i, rem);
+    p[i++] = m->topic_len >> 8;
+    p[i++] = m->topic_len & 0xff;
+    memcpy(p + i, m->data, m->topic_len);
+    i += m->topic_len;
+    if (qos) {
+        p[i++] = pid >> 8;
+        p[i++] = pid & 0xff;
+    }
+    memcpy(p + i, MSG_PAYLOAD(m), m->len);
+    c->tx_len += i + m->len;
+    kb->stats.msgs_out++;
+    return true;
+}
+
+static void flush(kbroker_t *kb, kb_conn_t *c)
+{
+    size_t off = 0;
+    while (off < c->tx_len && !c->closing) {
+        ssize_t n = send(c->fd, c->tx + off, c->tx_len - off, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            off += (size_t)n;
+            kb->stats.bytes_out += (uint64_t)n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            c->closing = true;
+            c->publish_will = true;
+        }
+    }
+    if (off > 0) {
+        memmove(c->tx, c->tx + off, c->tx_len - off);
+        c->tx_len -= off;
+    }
+}
+
+/* ---- sessions ---- */
+
+static void session_clear(kb_session_t *s)
+{
+    for (uint16_t i = s->out_head; i < s->out_end; i++) {
+        msg_unref(s->out[i].msg);
+    }
+    s->out_head = s->out_end = s->out_num = 0;
+    s->inflight = 0;
+    for (uint16_t i = 0; i < s->sub_num; i++) {
+        free(s->subs[i].filter);
+    }
+    s->sub_num = 0;
+}
+
+static void session_free(kbroker_t *kb, kb_session_t *s)
+{
+    session_clear(s);
+    free(s->subs);
+    free(s->out);
+    free(s->id);
+    memset(s, 0, sizeof(*s));
+    kb->stats.sessions--;
+}
+
+/* Acknowledged entries are only marked; the head moves past them, so an in-order PUBACK is O(1). */
+static void out_remove(kb_session_t *s, uint16_t i)
+{
+    msg_unref(s->out[i].msg);
+    s->out[i].msg = NULL;
+    s->out_num--;
+    while (s->out_head < s->out_end && !s->out[s->out_head].msg) {
+        s->out_head++;
+    }
+    if (s->out_head == s->out_end) {
+        s->out_head = s->out_end = 0;
+    }
+}
+
+/* Send queued messages while the in-flight window and the output buffer allow. */
+static void session_send(kbroker_t *kb, kb_session_t *s)
+{
+    kb_conn_t *c = s->conn;
+    if (!c) {
+        return;
+    }
+    for (uint16_t i = s->out_head; i < s->out_end; i++) {
+        kb_out_t *o = &s->out[i];
+        if (!o->msg || o->sent) {
+            continue;
+        }
+        if (o->qos && s->inflight >= kb->cfg.inflight_max) {
+            break;
+        }
+        bool dup = (o->pid != 0);
+        if (o->qos && !dup) {
+            if (++s->next_pid == 0) {
+                s->next_pid = 1;
+            }
+            o->pid = s->next_pid;
+        }
+        if (!send_publish(kb, c, o->msg, o->qos, o->pid, o->retain, dup, false)) {
+            break;
+        }
+        if (o->qos) {
+            o->sent = true;
+            s->inflight++;
+        } else {
+            out_remove(s, i);
+        }
+    }
+}
+
+static void session_queue(kbroker_t *kb, kb_session_t *s, kb_msg_t *m, uint8_t qos, bool retain)
+{
+    if (s->out_num >= kb->cfg.queue_max) {
+        uint16_t i = s->out_head;
+        while (i < s->out_end && (!s->out[i].msg || s->out[i].sent)) {
+            i++;    /* keep what is in flight */
+        }
+        kb->stats.dropped++;
+        if (i == s->out_end) {
+            return;
+        }
+        out_remove(s, i);   /* oldest not yet sent */
+    }
+    if (s->out_end == s->out_cap) {
+        uint16_t n = 0;
+        for (uint16_t i = s->out_head; i < s->out_end; i++) {
+            if (s->out[i].msg) {
+                s->out[n++] = s->out[i];
+            }
+        }
+        s->out_head = 0;
+        s->out_end = n;
+        if (n * 2 >= s->out_cap) {  /* mostly live: grow rather than compact again soon */
+            uint32_t cap = s->out_cap ? s->out_cap * 2u : 8u;
+            if (cap > kb->cfg.queue_max * 2u) {
+                cap = kb->cfg.queue_max * 2u;
+            }
+            kb_out_t *out = cap > s->out_cap ? realloc(s->out, cap * sizeof(*out)) : NULL;
+            if (out) {
+                s->out = out;
+                s->out_cap = (uint16_t)cap;
+            } else if (s->out_end == s->out_cap) {
+                kb->stats.dropped++;
+                return;
+            }
+        }
+    }
+    m->refs++;
+    s->out[s->out_end++] = (kb_out_t) { .msg = m, .qos = qos, .retain = retain };
+    s->out_num++;
+}
+
+static int sub_qos(const kb_session_t *s, const kb_msg_t *m)
+{
+    int qos = -1;
+    for (uint16_t i = 0; i < s->sub_num; i++) {
+        if (s->subs[i].qos > qos && kbroker_topic_match(s->subs[i].filter, m->data, m->topic_len)) {
+            qos = s->subs[i].qos;
+        }
+    }
+    return qos;
+}
+
+/* Deliver m to every matching session. */
+static void deliver(kbroker_t *kb, kb_msg_t *m)
+{
+    uint16_t max_sessions = kb->cfg.max_sessions;
+    for (uint16_t i = 0; i < max_sessions; i++) {
+        kb_session_t *s = &kb->sessions[i];
+        if (!s->used || s->sub_num == 0) {
+            continue;
+        }
+        int qos = sub_qos(s, m);
+        if (qos < 0) {
+            continue;
+        }
+        if (qos > m->qos) {
+            qos = m->qos;
+        }
+        if (qos == 0 && s->conn && s->out_num == 0) {
+            if (!send_publish(kb, s->conn, m, 0, 0, false, false, false)) {
+                kb->stats.dropped++;
+            }
+        } else if (qos > 0 || s->conn || kb->cfg.queue_qos0) {
+            session_queue(kb, s, m, (uint8_t)qos, false);
+            session_send(kb, s);
+        }
+    }
+}
+
+static void retain_store(kbroker_t *kb, kb_msg_t *m)
+{
+    uint16_t i = 0;
+    while (i < kb->stats.retained && strcmp(kb->retained[i]->data, m->data) != 0) {
+        i++;
+    }
+    if (i < kb->stats.retained) {
+        msg_unref(kb->retained[i]);
+        if (m->len == 0) {
+            kb->retained[i] = kb->retained[--kb->stats.retained];   /* empty payload clears */
+            return;
+        }
+    } else if (m->len == 0) {
+        return;
+    } else if (kb->stats.retained < kb->cfg.retained_max) {
+        kb->stats.retained++;
+    } else {
+        kb->stats.dropped++;
+        return;
+    }
+    m->refs++;
+    kb->retained[i] = m;
+}
+
+/* A message from a client (or its will): retain, deliver, hand to on_publish. */
+static void publish_from_client(kbroker_t *kb, kb_msg_t *m, bool retain)
+{
+    kb->stats.msgs_in++;
+    if (retain) {
+        retain_store(kb, m);
+    }
+    deliver(kb, m);
+    if (kb->cfg.on_publish) {
+        if (kb->cb_num == kb->cb_cap) {
+            uint16_t cap = kb->cb_cap ? kb->cb_cap * 2 : 16;
+            kb_msg_t **list = realloc(kb->cb_msgs, cap * sizeof(*list));
+            if (!list) {
+                return;
+            }
+            kb->cb_msgs = list;
+            kb->cb_cap = cap;
+        }
+        m->refs++;
+        m->retain = retain;
+        kb->cb_msgs[kb->cb_num++] = m;
+    }
+}
+
+/* ---- input ---- */
+
+/* Read a length-prefixed field; NULL if it does not fit. */
+static const uint8_t *get_str(const uint8_t **p, const uint8_t *end, size_t *len)
+{
+    if (end - *p < 2) {
+        return NULL;
+    }
+    size_t n = ((size_t)(*p)[0] << 8) | (*p)[1];
+    if ((size_t)(end - *p - 2) < n) {
+        return NULL;
+    }
+    const uint8_t *s = *p + 2;
+    *p += 2 + n;
+    *len = n;
+    return s;
+}
+
+static void connack(kbroker_t *kb, kb_conn_t *c, bool present, uint8_t rc)
+{
+    uint8_t *p = tx_room(kb, c, 4, true);
+    if (p) {
+        p[0] = PKT_CONNACK << 4;
+        p[1] = 2;
+        p[2] = present ? 1 : 0;
+        p[3] = rc;
+        c->tx_len += 4;
+    }
+}
+
+static kb_session_t *session_find(kbroker_t *kb, const char *id, size_t len)
+{
+    for (uint16_t i = 0; i < kb->cfg.max_sessions; i++) {
+        kb_session_t *s = &kb->sessions[i];
+        if (s->used && strlen(s->id) == len && memcmp(s->id, id, len) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/* A free session slot, evicting the session offline the longest if all are taken. */
+static kb_session_t *session_alloc(kbroker_t *kb)
+{
+    kb_session_t *oldest = NULL;
+    for (uint16_t i = 0; i < kb->cfg.max_sessions; i++) {
+        kb_session_t *s = &kb->sessions[i];
+        if (!s->used) {
+            return s;
+        }
+        if (!s->conn && (!oldest || s->offline_ms < oldest->offline_ms)) {
+            oldest = s;
+        }
+    }
+    if (oldest) {
+        session_free(kb, oldest);
+    }
+    return oldest;
+}
+
+static bool handle_connect(kbroker_t *kb, kb_conn_t *c, const uint8_t *p, const uint8_t *end)
+{
+    size_t len;
+    const uint8_t *name = get_str(&p, end, &len);
+    if (!name || end - p < 4) {
+        return false;
+    }
+    uint8_t level = p[0];
+    uint8_t flags = p[1];
+    uint16_t keepalive = (uint16_t)(p[2] << 8 | p[3]);
+    p += 4;
+    bool name_ok = (len == 4 && memcmp(name, "MQTT", 4) == 0 && level == 4) ||
+                   (len == 6 && memcmp(name, "MQIsdp", 6) == 0 && level == 3);
+    if (!name_ok) {
+        connack(kb, c, false, CONNACK_BAD_PROTOCOL);
+        return false;
+    }
+    if (flags & 0x01) {
+        return false;   /* reserved bit */
+    }
+    bool clean = flags & 0x02;
+    size_t id_len;
+    const uint8_t *id = get_str(&p, end, &id_len);
+    if (!id) {
+        return false;
+    }
+    const uint8_t *will_topic = NULL, *will_msg = NULL;
+    size_t will_topic_len = 0, will_len = 0;
+    if (flags & 0x04) {
+        will_topic = get_str(&p, end, &will_topic_len);
+        will_msg = get_str(&p, end, &will_len);
+        if (!will_topic || !will_msg || !topic_valid((const char *)will_topic, will_topic_len) || ((flags >> 3) & 3) == 3) {
+            return false;
+        }
+    }
+    /* username / password are not checked (allow_anonymous) */
+
+    char gen_id[24];
+    if (id_len == 0) {
+        if (!clean) {
+            connack(kb, c, false, CONNACK_BAD_ID);
+            return false;
+        }
+        id_len = (size_t)snprintf(gen_id, sizeof(gen_id), "kb-anon-%u", (unsigned)++kb->anon_seq);
+        id = (const uint8_t *)gen_id;
+    } else if (id_len > CLIENT_ID_MAX) {
+        connack(kb, c, false, CONNACK_BAD_ID);
+        return false;
+    }
+
+    kb_session_t *s = session_find(kb, (const char *)id, id_len);
+    bool present = false;
+    if (s) {
+        if (s->conn) {
+            kb_conn_t *old = s->conn;   /* takeover: the same client id connected again */
+            old->sess = NULL;
+            old->closing = true;
+            old->publish_will = false;
+            s->conn = NULL;
+        }
+        if (clean || s->clean) {
+            session_clear(s);
+        } else {
+            present = true;
+        }
+    } else {
+        s = session_alloc(kb);
+        if (!s) {
+            connack(kb, c, false, CONNACK_UNAVAILABLE);
+            return false;
+        }
+        s->id = malloc(id_len + 1);
+        if (!s->id) {
+            connack(kb, c, false, CONNACK_UNAVAILABLE);
+            return false;
+        }
+        memcpy(s->id, id, id_len);
+        s->id[id_len] = '\0';
+        s->used = true;
+        kb->stats.sessions++;
+    }
+    s->clean = clean;
+    s->conn = c;
+    c->sess = s;
+    c->keepalive = keepalive;
+    if (will_topic) {
+        c->will = msg_new((const char *)will_topic, will_topic_len, will_msg, will_len, (flags >> 3) & 3);
+        if (c->will && c->will->qos > 1) {
+            c->will->qos = 1;
+        }
+        c->will_retain = flags & 0x20;
+    }
+    connack(kb, c, present, CONNACK_OK);
+
+    /* Resend what was in flight with DUP, then the rest of the queue */
+    for (uint16_t i = s->out_head; i < s->out_end; i++) {
+        s->out[i].sent = false;
+    }
+    s->inflight = 0;
+    session_send(kb, s);
+    return true;
+}
+
+static bool handle_publish(kbroker_t *kb, kb_conn_t *c, uint8_t flags, const uint8_t *p, const uint8_t *end)
+{
+    uint8_t qos = (flags >> 1) & 3;
+    bool retain = flags & 1;
+    size_t topic_len;
+    const uint8_t *topic = get_str(&p, end, &topic_len);
+    if (qos == 3 || !topic || !topic_valid((const char *)topic, topic_len)) {
+        return false;
+    }
+    uint16_t pid = 0;
+    if (qos) {
+        if (end - p < 2) {
+            return false;
+        }
+        pid = (uint16_t)(p[0] << 8 | p[1]);
+        p += 2;
+    }
+    kb_msg_t *m = msg_new((const char *)topic, topic_len, p, (size_t)(end - p), qos > 1 ? 1 : qos);
+    if (!m) {
+        return false;
+    }
+    publish_from_client(kb, m, retain);
+    msg_unref(m);
+    if (qos == 1) {
+        send_ack(kb, c, PKT_PUBACK << 4, pid);
+    } else if (qos == 2) {
+        send_ack(kb, c, PKT_PUBREC << 4, pid);     /* delivered now; a resend would be delivered again */
+    }
+    return true;
+}
+
+static bool handle_subscribe(kbroker_t *kb, kb_conn_t *c, const uint8_t *p, const uint8_t *end)
+{
+    kb_session_t *s = c->sess;
+    if (end - p < 2) {
+        return false;
+    }
+    uint16_t pid = (uint16_t)(p[0] << 8 | p[1]);
+    p += 2;
+    uint8_t codes[64];
+    uint16_t idx[64];
+    size_t n = 0;
+    while (p < end) {
+        size_t len;
+        const uint8_t *f = get_str(&p, end, &len);
+        if (!f || p >= end || (*p & 0xfc) || n >= sizeof(codes)) {
+            return false;
+        }
+        uint8_t qos = *p++ & 3;
+        if (qos > 1) {
+            qos = 1;
+        }
+        if (!filter_valid((const char *)f, len)) {
+            codes[n++] = 0x80;
+            continue;
+        }
+        uint16_t i = 0;
+        while (i < s->sub_num && !(strlen(s->subs[i].filter) == len && memcmp(s->subs[i].filter, f, len) == 0)) {
+            i++;
+        }
+        if (i == s->sub_num) {
+            if (s->sub_num == s->sub_cap) {
+                uint16_t cap = s->sub_cap ? s->sub_cap * 2 : 4;
+                kb_sub_t *subs = realloc(s->subs, cap * sizeof(*subs));
+                if (!subs) {
+                    codes[n++] = 0x80;
+                    continue;
+                }
+                s->subs = subs;
+                s->sub_cap = cap;
+            }
+            char *filter = malloc(len + 1);
+            if (!filter) {
+                codes[n++] = 0x80;
+                continue;
+            }
+            memcpy(filter, f, len);
+            filter[len] = '\0';
+            s->subs[s->sub_num++].filter = filter;
+        }
+        s->subs[i].qos = qos;
+        idx[n] = i;
+        codes[n++] = qos;
+    }
+    if (n == 0) {
+        return false;
+    }
+    uint8_t *out = tx_room(kb, c, 1 + 4 + 2 + n, true);
+    if (out) {
+        size_t i = 0;
+        out[i++] = PKT_SUBACK << 4;
+        i += put_varint(out + i, 2 + n);
+        out[i++] = pid >> 8;
+        out[i++] = pid & 0xff;
+        memcpy(out + i, codes, n);
+        c->tx_len += i + n;
+    }
+
+    /* Retained messages for the new filters, flagged as retained */
+    for (size_t k = 0; k < n; k++) {
+        if (codes[k] == 0x80) {
+            continue;
+        }
+        for (uint32_t r = 0; r < kb->stats.retained; r++) {
+            kb_msg_t *m = kb->retained[r];
+            if (kbroker_topic_match(s->subs[idx[k]].filter, m->data, m->topic_len)) {
+                session_queue(kb, s, m, codes[k] < m->qos ? codes[k] : m->qos, true);
+            }
+        }
+    }
+    session_send(kb, s);
+    return true;
+}
+
+static bool handle_unsubscribe(kbroker_t *kb, kb_conn_t *c, const uint8_t *p, const uint8_t *end)
+{
+    kb_session_t *s = c->sess;
+    if (end - p < 2) {
+        return false;
+    }
+    uint16_t pid = (uint16_t)(p[0] << 8 | p[1]);
+    p += 2;
+    while (p < end) {
+        size_t len;
+        const uint8_t *f = get_str(&p, end, &len);
+        if (!f) {
+            return false;
+        }
+        for (uint16_t i = 0; i < s->sub_num; i++) {
+            if (strlen(s->subs[i].filter) == len && memcmp(s->subs[i].filter, f, len) == 0) {
+                free(s->subs[i].filter);
+                s->subs[i] = s->subs[--s->sub_num];
+                break;
+            }
+        }
+    }
+    send_ack(kb, c, PKT_UNSUBACK << 4, pid);
+    return true;
+}
+
+static bool handle_puback(kbroker_t *kb, kb_conn_t *c, const uint8_t *p, const uint8_t *end)
+{
+    kb_session_t *s = c->sess;
+    if (end - p != 2) {
+        return false;
+    }
+    uint16_t pid = (uint16_t)(p[0] << 8 | p[1]);
+    for (uint16_t i = s->out_head; i < s->out_end; i++) {
+        if (s->out[i].msg && s->out[i].sent && s->out[i].pid == pid) {
+            out_remove(s, i);
+            s->inflight--;
+            session_send(kb, s);
+            break;
+        }
+    }
+    return true;
+}
+
+/* One complete packet. false: protocol error, close the connection. */
+static bool handle_packet(kbroker_t *kb, kb_conn_t *c, uint8_t hdr, const uint8_t *p, size_t len)
+{
+    uint8_t type = hdr >> 4;
+    const uint8_t *end = p + len;
+    if (!c->sess) {
+        return type == PKT_CONNECT && hdr == (PKT_CONNECT << 4) && handle_connect(kb, c, p, end);
+    }
+    switch (type) {
+    case PKT_PUBLISH:
+        return handle_publish(kb, c, hdr & 0x0f, p, end);
+    case PKT_PUBACK:
+        return handle_puback(kb, c, p, end);
+    case PKT_PUBREL:
+        if (len != 2) {
+            return false;
+        }
+        send_ack(kb, c, PKT_PUBCOMP << 4, (uint16_t)(p[0] << 8 | p[1]));
+        return true;
+    case PKT_SUBSCRIBE:
+        return hdr == ((PKT_SUBSCRIBE << 4) | 2) && handle_subscribe(kb, c, p, end);
+    case PKT_UNSUBSCRIBE:
+        return hdr == ((PKT_UNSUBSCRIBE << 4) | 2) && handle_unsubscribe(kb, c, p, end);
+    case PKT_PINGREQ: {
+        uint8_t *out = tx_room(kb, c, 2, true);
+        if (out) {
+            out[0] = PKT_PINGRESP << 4;
+            out[1] = 0;
+            c->tx_len += 2;
+        }
+        return true;
+    }
+    case PKT_DISCONNECT:
+        msg_unref(c->will);     /* clean disconnect: no will */
+        c->will = NULL;
+        c->closing = true;
+        c->publish_will = false;
+        return true;
+    default:
+        return false;           /* second CONNECT, or a server-to-client packet */
+    }
+}
+
+/* Parse the complete packets in the input buffer. */
+static void conn_parse(kbroker_t *kb, kb_conn_t *c)
+{
+    size_t off = 0;
+    while (!c->closing && c->rx_len - off >= 2) {
+        size_t rem = 0, mul = 1, i = 1;
+        bool complete = false;
+        while (i < 5 && off + i < c->rx_len) {
+            uint8_t b = c->rx[off + i++];
+            rem += (b & 127) * mul;
+            mul *= 128;
+            if (!(b & 128)) {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete) {
+            if (i >= 5 || off + i < c->rx_len) {
+                c->closing = c->publish_will = true;    /* malformed length */
+            }
+            break;
+        }
+        if (rem > kb->cfg.max_packet) {
+            c->closing = c->publish_will = true;
+            break;
+        }
+        if (c->rx_len - off < i + rem) {
+            if (c->rx_cap < i + rem) {
+                uint8_t *rx = realloc(c->rx, i + rem);  /* whole packet must fit */
+                if (!rx) {
+                    c->closing = c->publish_will = true;
+                    break;
+                }
+                c->rx = rx;
+                c->rx_cap = i + rem;
+            }
+            break;
+        }
+        if (!handle_packet(kb, c, c->rx[off], c->rx + off + i, rem)) {
+            c->closing = c->publish_will = true;
+        }
+        off += i + rem;
+    }
+    if (off > 0) {
+        memmove(c->rx, c->rx + off, c->rx_len - off);
+        c->rx_len -= off;
+    }
+}
+
+/* Read and handle what the client sent, up to READ_MAX bytes so one busy client cannot starve the rest. */
+static void conn_read(kbroker_t *kb, kb_conn_t *c)
+{
+    size_t total = 0;
+    while (total < READ_MAX) {
+        if (c->rx_len == c->rx_cap) {
+            size_t cap = c->rx_cap ? c->rx_cap * 2 : RX_INIT;
+            uint8_t *rx = realloc(c->rx, cap);
+            if (!rx) {
+                c->closing = c->publish_will = true;
+                return;
+            }
+            c->rx = rx;
+            c->rx_cap = cap;
+        }
+        ssize_t n = recv(c->fd, c->rx + c->rx_len, c->rx_cap - c->rx_len, MSG_DONTWAIT);
+        if (n > 0) {
+            c->rx_len += (size_t)n;
+            total += (size_t)n;
+            kb->stats.bytes_in += (uint64_t)n;
+            c->last_rx_ms = now_ms();
+            conn_parse(kb, c);
+            if (c->closing) {
+                return;
+            }
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        c->closing = true;      /* closed by the client, or reset */
+        c->publish_will = true;
+        return;
+    }
+}
+
+static void conn_close(kbroker_t *kb, kb_conn_t *c)
+{
+    kb_msg_t *will = c->publish_will ? c->will : NULL;
+    bool will_retain = c->will_retain;
+    if (c->will && !will) {
+        msg_unref(c->will);
+    }
+    kb_session_t *s = c->sess;
+    if (s) {
+        s->conn = NULL;
+        if (s->clean) {
+            session_free(kb, s);
+        } else {
+            s->offline_ms = now_ms();
+        }
+    }
+    close(c->fd);
+    free(c->rx);
+    free(c->tx);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    kb->stats.conns--;
+    if (will) {
+        publish_from_client(kb, will, will_retain);
+        msg_unref(will);
+    }
+}
+
+static void accept_all(kbroker_t *kb)
+{
+    for (;;) {
+        int fd = accept(kb->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        kb_conn_t *c = NULL;
+        for (uint16_t i = 0; i < kb->cfg.max_conns && !c; i++) {
+            if (kb->conns[i].fd < 0) {
+                c = &kb->conns[i];
+            }
+        }
+        if (!c) {
+            close(fd);
+            kb->stats.refused++;
+            continue;
+        }
+        int one = 1;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        memset(c, 0, sizeof(*c));
+        c->fd = fd;
+        c->last_rx_ms = now_ms();
+        kb->stats.conns++;
+        kb->stats.accepted++;
+    }
+}
+
+/* ---- API ---- */
+
+void kbroker_config_default(kbroker_config_t *cfg)
+{
+    *cfg = (kbroker_config_t) {
+        .port = 1883,
+        .max_conns = 16,
+        .max_packet = 4096,
+        .queue_max = 128,
+        .inflight_max = 16,
+        .retained_max = 64,
+        .tx_max = 16 * 1024,
+        .queue_qos0 = true,
+    };
+}
+
+int kbroker_create(const kbroker_config_t *cfg, kbroker_t **out)
+{
+    kbroker_t *kb = calloc(1, sizeof(*kb));
+    if (!kb) {
+        return -ENOMEM;
+    }
+    kb->cfg = *cfg;
+    if (kb->cfg.max_sessions < kb->cfg.max_conns) {
+        kb->cfg.max_sessions = kb->cfg.max_sessions ? kb->cfg.max_conns : 2 * kb->cfg.max_conns;
+    }
+    kb->cfg.queue_max = kb->cfg.queue_max ? (kb->cfg.queue_max > QUEUE_MAX ? QUEUE_MAX : kb->cfg.queue_max) : 1;
+    kb->cfg.inflight_max = kb->cfg.inflight_max ? kb->cfg.inflight_max : 1;
+    kb->conns = calloc(kb->cfg.max_conns, sizeof(kb_conn_t));
+    kb->sessions = calloc(kb->cfg.max_sessions, sizeof(kb_session_t));
+    kb->retained = calloc(kb->cfg.retained_max ? kb->cfg.retained_max : 1, sizeof(kb_msg_t *));
+    if (!kb->conns || !kb->sessions || !kb->retained) {
+        free(kb->conns);
+        free(kb->sessions);
+        free(kb->retained);
+        free(kb);
+        return -ENOMEM;
+    }
+    for (uint16_t i = 0; i < kb->cfg.max_conns; i++) {
+        kb->conns[i].fd = -1;
+    }
+
+    int err = 0;
+    kb->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (kb->listen_fd < 0) {
+        err = -errno;
+    } else {
+        int one = 1;
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(cfg->port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+        socklen_t addr_len = sizeof(addr);
+        setsockopt(kb->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(kb->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(kb->listen_fd, 8) < 0 ||
+                getsockname(kb->listen_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+            err = -errno;
+            close(kb->listen_fd);
+        } else {
+            fcntl(kb->listen_fd, F_SETFL, fcntl(kb->listen_fd, F_GETFL, 0) | O_NONBLOCK);
+            kb->port = ntohs(addr.sin_port);
+        }
+    }
+    if (err == 0 && pthread_mutex_init(&kb->lock, NULL) != 0) {
+        close(kb->listen_fd);
+        err = -ENOMEM;
+    }
+    if (err) {
+        free(kb->conns);
+        free(kb->sessions);
+        free(kb->retained);
+        free(kb);
+        return err;
+    }
+    *out = kb;
+    return 0;
+}
+
+uint16_t kbroker_port(const kbroker_t *kb)
+{
+    return kb->port;
+}
+
+int kbroker_poll(kbroker_t *kb, int timeout_ms)
+{
+    fd_set rd, wr;
+    FD_ZERO(&rd);
+    FD_ZERO(&wr);
+    int max_fd = kb->listen_fd;
+    FD_SET(kb->listen_fd, &rd);
+    pthread_mutex_lock(&kb->lock);
+
+    /*
+     * Backpressure: while a subscriber is behind (half its queue or output buffer used), stop reading
+     * from the clients that are not, so publishers wait in TCP instead of their messages being dropped.
+     * The ones behind are still read, for their PUBACKs. A client behind for longer than HOLD_MAX_MS is
+     * taken as stuck and no longer holds the others up; its queue limit applies.
+     */
+    int64_t now = now_ms();
+    bool hold = false;
+    for (uint16_t i = 0; i < kb->cfg.max_conns; i++) {
+        kb_conn_t *c = &kb->conns[i];
+        if (c->fd < 0 || c->closing || !c->sess) {
+            continue;
+        }
+        if (c->sess->out_num < kb->cfg.queue_max / 2 && c->tx_len < kb->cfg.tx_max / 2) {
+            c->behind_ms = 0;
+        } else if (!c->behind_ms) {
+            c->behind_ms = now ? now : 1;
+            hold = true;
+        } else if (now - c->behind_ms < HOLD_MAX_MS) {
+            hold = true;
+        }
+    }
+    for (uint16_t i = 0; i < kb->cfg.max_conns; i++) {
+        kb_conn_t *c = &kb->conns[i];
+        if (c->fd >= 0 && !c->closing) {
+            if (!hold || !c->sess || c->behind_ms) {
+                FD_SET(c->fd, &rd);
+            }
+            if (c->tx_len) {
+                FD_SET(c->fd, &wr);
+            }
+            if (c->fd > max_fd) {
+                max_fd = c->fd;
+            }
+        }
+    }
+    bool sweep = false;
+    for (uint16_t i = 0; i < kb->cfg.max_conns && !sweep; i++) {
+        sweep = kb->conns[i].fd >= 0 && kb->conns[i].closing;   /* marked by kbroker_publish() */
+    }
+    pthread_mutex_unlock(&kb->lock);
+
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    int n = select(max_fd + 1, &rd, &wr, NULL, sweep ? &(struct timeval) { 0 } : &tv);
+    if (n < 0) {
+        return errno == EINTR ? 0 : -errno;
+    }
+
+    pthread_mutex_lock(&kb->lock);
+    if (FD_ISSET(kb->listen_fd, &rd)) {
+        accept_all(kb);
+    }
+    now = now_ms();
+    for (uint16_t i = 0; i < kb->cfg.max_conns; i++) {
+        kb_conn_t *c = &kb->conns[i];
+        if (c->fd < 0 || c->closing) {
+            continue;
+        }
+        if (FD_ISSET(c->fd, &rd)) {
+            conn_read(kb, c);
+        }
+        int64_t limit = c->sess ? (int64_t)c->keepalive * 1500 : CONNECT_TIMEOUT_MS;
+        if (limit > 0 && now - c->last_rx_ms > limit) {
+            c->closing = c->publish_will = true;
+        }
+    }
+    /* Output of this round (replies and deliveries), then close what failed; a will may fail more */
+    bool closed;
+    do {
+        closed = false;
+        for (uint16_t i = 0; i < kb->cfg.max_conns; i++) {
+            kb_conn_t *c = &kb->conns[i];
+            if (c->fd >= 0 && c->tx_len && !c->closing) {
+                flush(kb, c);
+            }
+        }
+        for (uint16_t i = 0; i < kb->cfg.max_conns; i++) {
+            if (kb->conns[i].fd >= 0 && kb->conns[i].closing) {
+                conn_close(kb, &kb->conns[i]);
+                closed = true;
+            }
+        }
+    } while (closed);
+
+    uint16_t cb_num = kb->cb_num;
+    pthread_mutex_unlock(&kb->lock);
+    if (cb_num == 0) {
+        return 0;
+    }
+
+    /* cb_msgs is only touched by this task, so it can be read without the lock */
+    for (uint16_t i = 0; i < cb_num; i++) {
+        const kb_msg_t *m = kb->cb_msgs[i];
+        kbroker_msg_t msg = {
+            .topic = m->data, .topic_len = m->topic_len, .payload = MSG_PAYLOAD(m), .len = m->len,
+            .qos = m->qos, .retain = m->retain,
+        };
+        kb->cfg.on_publish(&msg, kb->cfg.arg);
+    }
+    pthread_mutex_lock(&kb->lock);
+    for (uint16_t i = 0; i < cb_num; i++) {
+        msg_unref(kb->cb_msgs[i]);
+    }
+    kb->cb_num = 0;
+    pthread_mutex_unlock(&kb->lock);
+    return 0;
+}
+
+int kbroker_publish(kbroker_t *kb, const char *topic, const void *payload, size_t len, int qos, bool retain)
+{
+    size_t topic_len = topic ? strlen(topic) : 0;
+    if (!topic_valid(topic, topic_len) || qos < 0 || qos > 2) {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&kb->lock);
+    kb_msg_t *m = msg_new(topic, topic_len, payload, len, qos > 1 ? 1 : (uint8_t)qos);
+    if (!m) {
+        pthread_mutex_unlock(&kb->lock);
+        return -ENOMEM;
+    }
+    kb->stats.msgs_in++;
+    if (retain) {
+        retain_store(kb, m);
+    }
+    deliver(kb, m);
+    msg_unref(m);
+    for (uint16_t i = 0; i < kb->cfg.max_conns; i++) {
+        kb_conn_t *c = &kb->conns[i];
+        if (c->fd >= 0 && c->tx_len && !c->closing) {
+            flush(kb, c);   /* failures are closed by kbroker_poll() */
+        }
+    }
+    pthread_mutex_unlock(&kb->lock);
+    return 0;
+}
+
+void kbroker_get_stats(kbroker_t *kb, kbroker_stats_t *stats)
+{
+    pthread_mutex_lock(&kb->lock);
+    *stats = kb->stats;
+    pthread_mutex_unlock(&kb->lock);
+}
+
+void kbroker_destroy(kbroker_t *kb)
+{
+    if (!kb) {
+        return;
+    }
+    for (uint16_t i = 0; i < kb->cfg.max_conns; i++) {
+        kb_conn_t *c = &kb->conns[i];
+        if (c->fd >= 0) {
+            c->publish_will = false;
+            conn_close(kb, c);
+        }
+    }
+    for (uint16_t i = 0; i < kb->cfg.max_sessions; i++) {
+        if (kb->sessions[i].used) {
+            session_free(kb, &kb->sessions[i]);
+        }
+    }
+    for (uint32_t i = 0; i < kb->stats.retained; i++) {
+        msg_unref(kb->retained[i]);
+    }
+    for (uint16_t i = 0; i < kb->cb_num; i++) {
+        msg_unref(kb->cb_msgs[i]);
+    }
+    close(kb->listen_fd);
+    pthread_mutex_destroy(&kb->lock);
+    free(kb->cb_msgs);
+    free(kb->conns);
+    free(kb->sessions);
+    free(kb->retained);
+    free(kb);
+}
@@ -0,0 +1,111 @@
+/*
+ * kjson checks and throughput: field extraction from the gas sensor payload (against the old
+ * memcpy + strstr check it replaced, which could not tell fields apart) and tokenizing a 1.2 KB
+ * nested document. The checks cover escaped keys, \uXXXX and surrogate pairs, nested members not
+ * shadowing top-level ones, and the int32 range.
+ *
+ *   kjson_bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "kjson.h"
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+static volatile int s_sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void checks(void)
+{
+    const char *j = "{\"d\\u0065vice\":\"caf\\u00e9 \\ud83d\\ude00\",\"state\":\"leak\",\"gas\":-2147483648,"
+                    "\"n\":{\"state\":\"LEAK\"},\"x\":2.5,\"big\":2147483648}";
+    kjson_field_t f[5] = {
+        { .key = "device" }, { .key = "state" }, { .key = "gas" }, { .key = "x" }, { .key = "big" },
+    };
+    char out[32];
+    int32_t v;
+    int found = kjson_scan_object(j, strlen(j), f, 5);
+    CHECK(found == 5, "scan_object found %d of 5 fields", found);
+    CHECK(kjson_str_copy(&f[0].val, out, sizeof(out)) == 10 && strcmp(out, "caf\xc3\xa9 \xf0\x9f\x98\x80") == 0,
+          "decoded \"%s\"", out);
+    CHECK(kjson_str_caseeq(&f[1].val, "LEAK") && !kjson_str_eq(&f[1].val, "LEAK"),
+          "top-level state is \"leak\", not the nested \"LEAK\"");
+    CHECK(kjson_get_int(&f[2].val, &v) && v == INT32_MIN, "gas -2147483648");
+    CHECK(!kjson_get_int(&f[3].val, &v), "2.5 is not an integer");
+    CHECK(!kjson_get_int(&f[4].val, &v), "2147483648 is out of int32 range");
+    CHECK(kjson_str_copy(&f[0].val, out, 4) == -1, "copy into a short buffer must fail");
+
+    static const char *const bad[] = {
+        "{\"a\":1,}", "{\"a\" 1}", "[1,2", "{\"a\":01}", "{\"a\":\"\x01\"}", "{\"a\":\"\\x\"}",
+        "{\"a\":1} x", "{\"a\":NaN}", "", "{\"state\":\"LEAK\"",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        kjson_field_t g[1] = { { .key = "state" } };
+        CHECK(kjson_scan_object(bad[i], strlen(bad[i]), g, 1) == -1, "accepted invalid %s", bad[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 2000000;
+    if (n < 1) {
+        n = 1;
+    }
+    checks();
+
+    const char *gas = "{\"device\":\"gas_sensor\",\"gas\":512,\"state\":\"LEAK\"}";
+    size_t gas_len = strlen(gas);
+    double t0 = now_ns();
+    for (int i = 0; i < n; i++) {
+        char buf[96];
+        size_t len = gas_len < sizeof(buf) - 1 ? gas_len : sizeof(buf) - 1;
+        memcpy(buf, gas, len);
+        buf[len] = '\0';
+        s_sink += strstr(buf, "LEAK") != NULL;
+    }
+    double old_ns = (now_ns() - t0) / n;
+    t0 = now_ns();
+    for (int i = 0; i < n; i++) {
+        kjson_field_t f[3] = { { .key = "state" }, { .key = "gas" }, { .key = "device" } };
+        s_sink += kjson_scan_object(gas, gas_len, f, 3);
+        s_sink += kjson_str_caseeq(&f[0].val, "LEAK");
+    }
+    double scan_ns = (now_ns() - t0) / n;
+    printf("gas payload (%zu B): old memcpy+strstr %.1f ns, kjson_scan_object(state, gas, device) %.1f ns "
+           "(%.0f MB/s)\n", gas_len, old_ns, scan_ns, gas_len / scan_ns * 1e3);
+
+    static char doc[2048];
+    int len = snprintf(doc, sizeof(doc), "{\"nodes\":[");
+    for (int i = 0; i < 20; i++) {
+        len += snprintf(doc + len, sizeof(doc) - len, "%s{\"device\":\"node%d\",\"temp\":%d.%d,\"on\":true,"
+                        "\"tags\":[\"a\",\"b\\n\"]}", i ? "," : "", i, 20 + i, i % 10);
+    }
+    len += snprintf(doc + len, sizeof(doc) - len, "]}");
+    int docs = n / 10 > 0 ? n / 10 : 1;
+    int tokens = 0;
+    t0 = now_ns();
+    for (int i = 0; i < docs; i++) {
+        kjson_t p;
+        kjson_token_t t;
+        kjson_init(&p, doc, len);
+        tokens = 0;
+        while (kjson_next(&p, &t) > KJSON_END) {
+            tokens++;
+        }
+    }
+    double doc_ns = (now_ns() - t0) / docs;
+    CHECK(tokens == 3 + 20 * 13 + 2, "document tokenized into %d tokens", tokens);
+    printf("%d B document, %d tokens: %.0f ns (%.0f MB/s)\n", len, tokens, doc_ns, len / doc_ns * 1e3);
+    return s_fail;
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Check kjson's accept/reject verdicts in a kjson_fuzz corpus against Python's json module.
+
+Python is made strict about NaN/Infinity (not JSON). Documents nested deeper than KJSON_DEPTH_MAX
+are expected to be rejected by kjson even though they are valid JSON.
+"""
+import argparse
+import json
+import struct
+import sys
+
+KJSON_DEPTH_MAX = 32
+
+
+def reject_constant(name):
+    raise ValueError(name)
+
+
+def depth(v):
+    if isinstance(v, dict):
+        return 1 + max((depth(x) for x in v.values()), default=0)
+    if isinstance(v, list):
+        return 1 + max((depth(x) for x in v), default=0)
+    return 0
+
+
+def python_accepts(data):
+    try:
+        v = json.loads(data.decode('latin-1'), parse_constant=reject_constant)
+    except (ValueError, RecursionError):
+        return False
+    return depth(v) <= KJSON_DEPTH_MAX
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument('corpus', help='file written by kjson_fuzz <inputs> <corpus>')
+    args = ap.parse_args()
+    with open(args.corpus, 'rb') as f:
+        d = f.read()
+    i = n = mismatches = 0
+    while i < len(d):
+        (length,) = struct.unpack_from('<I', d, i)
+        data = d[i + 4:i + 4 + length]
+        kjson_ok = d[i + 4 + length]
+        i += 5 + length
+        n += 1
+        if bool(kjson_ok) != python_accepts(data):
+            mismatches += 1
+            if mismatches <= 10:
+                print('mismatch: kjson %s, python %s: %r' % ('accepts' if kjson_ok else 'rejects',
+                      'rejects' if kjson_ok else 'accepts', data[:100]))
+    print('%d inputs, %d verdicts differ from python json' % (n, mismatches))
+    if mismatches:
+        sys.exit('error: kjson and python json disagree')
+
+
+if __name__ == '__main__':
+    main()
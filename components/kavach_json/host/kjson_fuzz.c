@@ -0,0 +1,234 @@
+/*
+ * kjson fuzz test. Inputs are node payloads and grammar-generated documents (nested objects and
+ * arrays, every escape, numbers with exponents, literals, raw bytes >= 0x80), half of them mutated
+ * byte-wise: replaced, inserted, deleted, truncated. Each input sits in a heap buffer of exactly its
+ * size, so with -fsanitize=address any read past buf + len is reported. For every input:
+ *
+ *   - every token lies inside the input, and every kjson_str_* / kjson_get_* helper runs on it;
+ *   - the tokenizer ends in KJSON_END or KJSON_ERROR within a bounded number of tokens;
+ *   - kjson_scan_object() accepts only inputs the tokenizer accepts, and its values lie in the input.
+ *
+ * The optional corpus file records each input and kjson's verdict for kjson_diff.py, which checks them
+ * against Python's json module.
+ *
+ *   kjson_fuzz [inputs] [corpus file]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kjson.h"
+
+#define WORK_SIZE   8192
+#define TOKENS_MAX  100000
+
+static const char *const s_seeds[] = {
+    "{\"device\":\"gas_sensor\",\"gas\":512,\"state\":\"LEAK\"}",
+    "{\"device\":\"pir_sensor\",\"motion\":\"detected\"}",
+    "{\"device\":\"light1\",\"state\":\"ON\"}",
+    "{\"a\":[1,2.5e3,-0.1,true,false,null,{\"b\":\"\\u00e9\\ud83d\\ude00\\n\"}],\"c\":{}}",
+    "[[],{},\"x\",0]",
+    "\"str\"",
+    "-12",
+    " {\"k\" : [ ] } ",
+};
+
+static uint64_t s_rng = 88172645463325252ull;
+
+static uint32_t rnd(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (uint32_t)s_rng;
+}
+
+/* Random, mostly valid JSON value at o; stops nesting near end */
+static char *gen(int depth, char *o, char *end)
+{
+    static const char *const lits[] = { "true", "false", "null" };
+    if (o >= end - 64) {
+        *o++ = '0';
+        return o;
+    }
+    int n = depth < KJSON_DEPTH_MAX - 4 ? (int)(rnd() % 4) : 0;
+    switch (rnd() % 9) {
+    case 0:
+    case 1:
+        *o++ = '{';
+        for (int i = 0; i < n; i++) {
+            if (i) {
+                *o++ = ',';
+            }
+            o += sprintf(o, "\"k%u\":", rnd() % 5);
+            o = gen(depth + 1, o, end);
+        }
+        *o++ = '}';
+        return o;
+    case 2:
+        *o++ = '[';
+        for (int i = 0; i < n; i++) {
+            if (i) {
+                *o++ = ',';
+            }
+            o = gen(depth + 1, o, end);
+        }
+        *o++ = ']';
+        return o;
+    case 3:
+        return o + sprintf(o, "\"s\\\"\\\\\\/\\b\\f\\n\\r\\t\\u%04x%c\"", rnd() & 0xffff, 'a' + rnd() % 26);
+    case 4:
+        return o + sprintf(o, "%d", (int)rnd());
+    case 5:
+        return o + sprintf(o, "-%u.%ue%c%u", rnd() % 100, rnd() % 100, "+-"[rnd() % 2], rnd() % 50);
+    case 6:
+        return o + sprintf(o, "%s", lits[rnd() % 3]);
+    case 7:
+        return o + sprintf(o, "\"%c\"", 0x80 + rnd() % 128);
+    default:
+        return o + sprintf(o, "0.%u", rnd() % 1000);
+    }
+}
+
+static size_t mutate(char *b, size_t n, size_t cap)
+{
+    static const char alpha[] = "{}[]\":,\\u0123456789abcdefeE+-.tnrl \t\n\r\x01\x80x";
+    for (int m = rnd() % 4 + 1; m > 0; m--) {
+        switch (rnd() % 5) {
+        case 0:
+            if (n) {
+                b[rnd() % n] = alpha[rnd() % (sizeof(alpha) - 1)];
+            }
+            break;
+        case 1:
+            if (n < cap) {
+                size_t p = rnd() % (n + 1);
+                memmove(b + p + 1, b + p, n - p);
+                b[p] = alpha[rnd() % (sizeof(alpha) - 1)];
+                n++;
+            }
+            break;
+        case 2:
+            if (n) {
+                size_t p = rnd() % n;
+                memmove(b + p, b + p + 1, n - p - 1);
+                n--;
+            }
+            break;
+        case 3:
+            if (n) {
+                n = rnd() % n;
+            }
+            break;
+        default:
+            if (n) {
+                b[rnd() % n] = (char)rnd();
+            }
+            break;
+        }
+    }
+    return n;
+}
+
+static void fail(const char *what, const char *buf, size_t len)
+{
+    fprintf(stderr, "FAIL: %s on input (%zu B): %.*s\n", what, len, (int)(len < 200 ? len : 200), buf);
+    exit(1);
+}
+
+static bool in_input(const kjson_token_t *t, const char *buf, size_t len)
+{
+    return t->ptr >= buf && t->len <= len && t->ptr + t->len <= buf + len;
+}
+
+/* Run every API on the input; true if kjson accepts it */
+static bool exercise(const char *buf, size_t len)
+{
+    kjson_t p;
+    kjson_token_t t;
+    kjson_init(&p, buf, len);
+    bool ok = false;
+    char out[64];
+    int32_t iv;
+    bool bv;
+    int i;
+    for (i = 0; i < TOKENS_MAX; i++) {
+        kjson_type_t type = kjson_next(&p, &t);
+        if (type == KJSON_END) {
+            ok = true;
+            break;
+        }
+        if (type == KJSON_ERROR) {
+            break;
+        }
+        if (!in_input(&t, buf, len)) {
+            fail("token outside the input", buf, len);
+        }
+        kjson_str_copy(&t, out, sizeof(out));
+        kjson_str_eq(&t, "state");
+        kjson_str_caseeq(&t, "LEAK");
+        kjson_get_int(&t, &iv);
+        kjson_get_bool(&t, &bv);
+    }
+    if (i == TOKENS_MAX) {
+        fail("no end after too many tokens", buf, len);
+    }
+
+    kjson_field_t f[3] = { { .key = "state" }, { .key = "gas" }, { .key = "device" } };
+    int found = kjson_scan_object(buf, len, f, 3);
+    for (int k = 0; k < 3; k++) {
+        if (f[k].val.type != KJSON_END) {
+            if (!in_input(&f[k].val, buf, len)) {
+                fail("scan_object value outside the input", buf, len);
+            }
+            kjson_str_copy(&f[k].val, out, sizeof(out));
+        }
+    }
+    if (found >= 0 && !ok) {
+        fail("scan_object accepted what the tokenizer rejects", buf, len);
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    long inputs = argc > 1 ? atol(argv[1]) : 1000000;
+    FILE *corpus = NULL;
+    if (argc > 2 && !(corpus = fopen(argv[2], "wb"))) {
+        perror(argv[2]);
+        return 1;
+    }
+    static char work[WORK_SIZE];
+    long valid = 0;
+    for (long it = 0; it < inputs; it++) {
+        size_t n;
+        if (rnd() % 2) {
+            const char *s = s_seeds[rnd() % (sizeof(s_seeds) / sizeof(s_seeds[0]))];
+            n = strlen(s);
+            memcpy(work, s, n);
+        } else {
+            n = (size_t)(gen(0, work, work + WORK_SIZE / 2) - work);
+        }
+        if (rnd() % 4) {
+            n = mutate(work, n, sizeof(work));
+        }
+        char *buf = malloc(n ? n : 1);
+        if (!buf) {
+            return 1;
+        }
+        memcpy(buf, work, n);
+        bool ok = exercise(buf, n);
+        valid += ok;
+        if (corpus) {
+            uint32_t len = (uint32_t)n;
+            fwrite(&len, sizeof(len), 1, corpus);
+            fwrite(buf, 1, n, corpus);
+            fputc(ok, corpus);
+        }
+        free(buf);
+    }
+    if (corpus) {
+        fclose(corpus);
+    }
+    printf("%ld inputs, %ld valid JSON\n", inputs, valid);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * kjson: small in-place JSON tokenizer for MQTT payloads (Kavach device and the mqtt_nodes firmware).
+ *
+ * Works directly on the received bytes (no NUL terminator, no copy, no heap): tokens are views into
+ * the buffer, strings are returned with their escapes still in place and compared or copied with
+ * the kjson_str_* helpers. The whole input is validated, so a payload is either accepted completely
+ * or rejected, and reads never go past buf + len.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KJSON_DEPTH_MAX     32
+
+typedef enum {
+    KJSON_ERROR = -1,
+    KJSON_END = 0,          /* the single top-level value is complete and only whitespace follows */
+    KJSON_OBJECT,           /* '{'; after kjson_skip() len spans the whole object */
+    KJSON_OBJECT_END,
+    KJSON_ARRAY,            /* '['; after kjson_skip() len spans the whole array */
+    KJSON_ARRAY_END,
+    KJSON_KEY,              /* object member name (string body, escapes in place) */
+    KJSON_STRING,           /* string body without the quotes, escapes in place */
+    KJSON_NUMBER,
+    KJSON_TRUE,
+    KJSON_FALSE,
+    KJSON_NULL,
+} kjson_type_t;
+
+typedef struct {
+    kjson_type_t type;
+    const char *ptr;
+    size_t len;
+    uint8_t depth;          /* nesting depth of the token: 1 for members of the top-level object */
+} kjson_token_t;
+
+typedef struct {
+    const char *buf;
+    size_t len;
+    size_t pos;
+    uint32_t stack;         /* bit n set: level n+1 is an array, clear: an object */
+    uint8_t depth;
+    uint8_t expect;         /* internal parser state */
+} kjson_t;
+
+/** Start tokenizing len bytes at buf. */
+void kjson_init(kjson_t *p, const char *buf, size_t len);
+
+/** Next token. Returns its type (also in tok->type); KJSON_END and KJSON_ERROR are sticky. */
+kjson_type_t kjson_next(kjson_t *p, kjson_token_t *tok);
+
+/**
+ * Skip the value that tok starts: for KJSON_OBJECT / KJSON_ARRAY consume up to the matching end
+ * and extend tok->len over the whole container. Scalars need no skipping.
+ */
+kjson_type_t kjson_skip(kjson_t *p, kjson_token_t *tok);
+
+typedef struct {
+    const char *key;        /* member name to look for */
+    kjson_token_t val;      /* filled in when found; type KJSON_END if not present */
+} kjson_field_t;
+
+/**
+ * One pass over a payload that must be a single JSON object: fill in the top-level members named in
+ * fields (the first occurrence wins). The whole payload is validated.
+ *
+ * @return number of fields found, or -1 if the payload is not a valid JSON object
+ */
+int kjson_scan_object(const char *buf, size_t len, kjson_field_t *fields, size_t num);
+
+/** Decoded string token equals s (escapes and \uXXXX decoded, UTF-8 compared byte for byte). */
+bool kjson_str_eq(const kjson_token_t *tok, const char *s);
+
+/** As kjson_str_eq(), ASCII letters compared case-insensitively. */
+bool kjson_str_caseeq(const kjson_token_t *tok, const char *s);
+
+/**
+ * Decode a string token into out as NUL-terminated UTF-8.
+ * @return decoded length, or -1 if it does not fit (out then holds a truncated string)
+ */
+int kjson_str_copy(const kjson_token_t *tok, char *out, size_t out_len);
+
+/** Number token as an integer. False if not a number, not integral or out of int32 range. */
+bool kjson_get_int(const kjson_token_t *tok, int32_t *out);
+
+/** true/false token, or number token (non-zero is true). */
+bool kjson_get_bool(const kjson_token_t *tok, bool *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,526 @@
+/*
+ * Pull tokenizer: the only state between calls is the position, the container stack (one bit per
+ * level) and what may come next, so it runs in a few dozen bytes of stack on any task.
+ */
+#include <string.h>
+#include "kjson.h"
+
+enum {
+    EXPECT_VALUE,           /* a value (top level, after ':' or after ',' in an array) */
+    EXPECT_FIRST_VALUE,     /* a value or ']' (just after '[') */
+    EXPECT_KEY,             /* a member name (after ',' in an object) */
+    EXPECT_FIRST_KEY,       /* a member name or '}' (just after '{') */
+    EXPECT_COLON,
+    EXPECT_COMMA,           /* ',' or the end of the current container */
+    EXPECT_DONE,            /* the top-level value is complete */
+    EXPECT_FAILED,
+};
+
+void kjson_init(kjson_t *p, const char *buf, size_t len)
+{
+    p->buf = buf;
+    p->len = buf ? len : 0;
+    p->pos = 0;
+    p->stack = 0;
+    p->depth = 0;
+    p->expect = EXPECT_VALUE;
+}
+
+static bool in_array(const kjson_t *p)
+{
+    return p->depth > 0 && (p->stack >> (p->depth - 1)) & 1;
+}
+
+static void skip_ws(kjson_t *p)
+{
+    while (p->pos < p->len) {
+        char c = p->buf[p->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+        p->pos++;
+    }
+}
+
+static int hex_val(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+/* String starting after the opening quote at p->pos; on success pos is past the closing quote. */
+static bool scan_string(kjson_t *p, kjson_token_t *tok)
+{
+    size_t start = p->pos;
+    while (p->pos < p->len) {
+        unsigned char c = (unsigned char)p->buf[p->pos];
+        if (c == '"') {
+            tok->ptr = p->buf + start;
+            tok->len = p->pos - start;
+            p->pos++;
+            return true;
+        }
+        if (c < 0x20) {
+            return false;
+        }
+        if (c != '\\') {
+            p->pos++;
+            continue;
+        }
+        if (p->pos + 1 >= p->len) {
+            return false;
+        }
+        c = (unsigned char)p->buf[p->pos + 1];
+        if (c == 'u') {
+            if (p->pos + 6 > p->len) {
+                return false;
+            }
+            for (int i = 2; i < 6; i++) {
+                if (hex_val(p->buf[p->pos + i]) < 0) {
+                    return false;
+                }
+            }
+            p->pos += 6;
+        } else if (c && strchr("\"\\/bfnrt", c)) {
+            p->pos += 2;
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+static bool is_digit(const kjson_t *p)
+{
+    return p->pos < p->len && p->buf[p->pos] >= '0' && p->buf[p->pos] <= '9';
+}
+
+/* RFC 8259 number: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+static bool scan_number(kjson_t *p, kjson_token_t *tok)
+{
+    size_t start = p->pos;
+    if (p->buf[p->pos] == '-') {
+        p->pos++;
+    }
+    if (!is_digit(p)) {
+        return false;
+    }
+    if (p->buf[p->pos++] != '0') {
+        while (is_digit(p)) {
+            p->pos++;
+        }
+    }
+    if (p->pos < p->len && p->buf[p->pos] == '.') {
+        p->pos++;
+        if (!is_digit(p)) {
+            return false;
+        }
+        while (is_digit(p)) {
+            p->pos++;
+        }
+    }
+    if (p->pos < p->len && (p->buf[p->pos] == 'e' || p->buf[p->pos] == 'E')) {
+        p->pos++;
+        if (p->pos < p->len && (p->buf[p->pos] == '+' || p->buf[p->pos] == '-')) {
+            p->pos++;
+        }
+        if (!is_digit(p)) {
+            return false;
+        }
+        while (is_digit(p)) {
+            p->pos++;
+        }
+    }
+    tok->ptr = p->buf + start;
+    tok->len = p->pos - start;
+    return true;
+}
+
+static bool scan_literal(kjson_t *p, const char *word, size_t len)
+{
+    if (p->len - p->pos < len || memcmp(p->buf + p->pos, word, len) != 0) {
+        return false;
+    }
+    p->pos += len;
+    return true;
+}
+
+static kjson_type_t fail(kjson_t *p, kjson_token_t *tok)
+{
+    p->expect = EXPECT_FAILED;
+    tok->type = KJSON_ERROR;
+    tok->ptr = p->buf + p->pos;
+    tok->len = 0;
+    return KJSON_ERROR;
+}
+
+/* A value token is complete: what may follow depends on the enclosing container. */
+static void value_done(kjson_t *p)
+{
+    p->expect = (p->depth == 0) ? EXPECT_DONE : EXPECT_COMMA;
+}
+
+kjson_type_t kjson_next(kjson_t *p, kjson_token_t *tok)
+{
+    for (;;) {
+        skip_ws(p);
+        tok->depth = p->depth;
+        if (p->expect == EXPECT_FAILED) {
+            return fail(p, tok);
+        }
+        if (p->pos >= p->len) {
+            if (p->expect != EXPECT_DONE) {
+                return fail(p, tok);
+            }
+            tok->type = KJSON_END;
+            tok->ptr = p->buf + p->pos;
+            tok->len = 0;
+            return KJSON_END;
+        }
+        char c = p->buf[p->pos];
+        tok->ptr = p->buf + p->pos;
+        tok->len = 1;
+
+        switch (p->expect) {
+        case EXPECT_DONE:
+            return fail(p, tok);    /* trailing garbage */
+
+        case EXPECT_COLON:
+            if (c != ':') {
+                return fail(p, tok);
+            }
+            p->pos++;
+            p->expect = EXPECT_VALUE;
+            continue;
+
+        case EXPECT_COMMA:
+            if (c == ',') {
+                p->pos++;
+                p->expect = in_array(p) ? EXPECT_VALUE : EXPECT_KEY;
+                continue;
+            }
+            /* otherwise the container must end here (below) */
+            break;
+
+        case EXPECT_KEY:
+        case EXPECT_FIRST_KEY:
+            if (c == '"') {
+                p->pos++;
+                if (!scan_string(p, tok)) {
+                    return fail(p, tok);
+                }
+                tok->type = KJSON_KEY;
+                p->expect = EXPECT_COLON;
+                return KJSON_KEY;
+            }
+            if (p->expect == EXPECT_KEY) {
+                return fail(p, tok);    /* trailing comma */
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        /* Container end: after a member/element, or right after the opening bracket */
+        if (c == '}' || c == ']') {
+            bool array = (c == ']');
+            bool ok = (p->expect == EXPECT_COMMA) || (array ? p->expect == EXPECT_FIRST_VALUE
+                                                           : p->expect == EXPECT_FIRST_KEY);
+            if (!ok || p->depth == 0 || in_array(p) != array) {
+                return fail(p, tok);
+            }
+            p->pos++;
+            p->depth--;
+            p->stack &= ~(1u << p->depth);
+            tok->depth = p->depth;
+            value_done(p);
+            tok->type = array ? KJSON_ARRAY_END : KJSON_OBJECT_END;
+            return tok->type;
+        }
+        if (p->expect != EXPECT_VALUE && p->expect != EXPECT_FIRST_VALUE) {
+            return fail(p, tok);
+        }
+
+        switch (c) {
+        case '{':
+        case '[':
+            if (p->depth >= KJSON_DEPTH_MAX) {
+                return fail(p, tok);
+            }
+            p->pos++;
+            if (c == '[') {
+                p->stack |= 1u << p->depth;
+            }
+            p->depth++;
+            p->expect = (c == '[') ? EXPECT_FIRST_VALUE : EXPECT_FIRST_KEY;
+            tok->type = (c == '[') ? KJSON_ARRAY : KJSON_OBJECT;
+            return tok->type;
+        case '"':
+            p->pos++;
+            if (!scan_string(p, tok)) {
+                return fail(p, tok);
+            }
+            tok->type = KJSON_STRING;
+            break;
+        case 't':
+            if (!scan_literal(p, "true", 4)) {
+                return fail(p, tok);
+            }
+            tok->type = KJSON_TRUE;
+            tok->len = 4;
+            break;
+        case 'f':
+            if (!scan_literal(p, "false", 5)) {
+                return fail(p, tok);
+            }
+            tok->type = KJSON_FALSE;
+            tok->len = 5;
+            break;
+        case 'n':
+            if (!scan_literal(p, "null", 4)) {
+                return fail(p, tok);
+            }
+            tok->type = KJSON_NULL;
+            tok->len = 4;
+            break;
+        default:
+            if (c != '-' && (c < '0' || c > '9')) {
+                return fail(p, tok);
+            }
+            if (!scan_number(p, tok)) {
+                return fail(p, tok);
+            }
+            tok->type = KJSON_NUMBER;
+            break;
+        }
+        value_done(p);
+        return tok->type;
+    }
+}
+
+kjson_type_t kjson_skip(kjson_t *p, kjson_token_t *tok)
+{
+    if (tok->type != KJSON_OBJECT && tok->type != KJSON_ARRAY) {
+        return tok->type;
+    }
+    uint8_t depth = tok->depth;
+    kjson_token_t t;
+    do {
+        if (kjson_next(p, &t) == KJSON_ERROR) {
+            *tok = t;
+            return KJSON_ERROR;
+        }
+    } while (!((t.type == KJSON_OBJECT_END || t.type == KJSON_ARRAY_END) && t.depth == depth));
+    tok->len = (size_t)(t.ptr + t.len - tok->ptr);
+    return tok->type;
+}
+
+int kjson_scan_object(const char *buf, size_t len, kjson_field_t *fields, size_t num)
+{
+    kjson_t p;
+    kjson_token_t tok;
+    int found = 0;
+    for (size_t i = 0; i < num; i++) {
+        fields[i].val.type = KJSON_END;
+    }
+    kjson_init(&p, buf, len);
+    if (kjson_next(&p, &tok) != KJSON_OBJECT) {
+        return -1;
+    }
+    for (;;) {
+        kjson_type_t type = kjson_next(&p, &tok);
+        if (type == KJSON_OBJECT_END) {
+            break;
+        }
+        if (type != KJSON_KEY) {
+            return -1;
+        }
+        kjson_field_t *field = NULL;
+        for (size_t i = 0; i < num; i++) {
+            if (fields[i].val.type == KJSON_END && kjson_str_eq(&tok, fields[i].key)) {
+                field = &fields[i];
+                break;
+            }
+        }
+        if (kjson_next(&p, &tok) == KJSON_ERROR || kjson_skip(&p, &tok) == KJSON_ERROR) {
+            return -1;
+        }
+        if (field) {
+            field->val = tok;
+            found++;
+        }
+    }
+    return (kjson_next(&p, &tok) == KJSON_END) ? found : -1;
+}
+
+/*
+ * Decode the next character of a string body (escapes resolved) as up to 4 UTF-8 bytes in out.
+ * Returns the number of bytes, 0 at the end of the string.
+ */
+static size_t str_decode(const char **pos, const char *end, uint8_t out[4])
+{
+    const char *s = *pos;
+    if (s >= end) {
+        return 0;
+    }
+    if (*s != '\\') {
+        out[0] = (uint8_t)*s;
+        *pos = s + 1;
+        return 1;
+    }
+    char e = s[1];
+    if (e != 'u') {
+        static const char from[] = "\"\\/bfnrt";
+        static const char to[] = "\"\\/\b\f\n\r\t";
+        const char *f = strchr(from, e);
+        out[0] = (uint8_t)to[f - from];     /* escape letters were validated by the tokenizer */
+        *pos = s + 2;
+        return 1;
+    }
+    uint32_t cp = 0;
+    for (int i = 2; i < 6; i++) {
+        cp = (cp << 4) | (uint32_t)hex_val(s[i]);
+    }
+    s += 6;
+    /* Surrogate pair; a lone surrogate decodes as U+FFFD */
+    if (cp >= 0xd800 && cp <= 0xdbff && end - s >= 6 && s[0] == '\\' && s[1] == 'u') {
+        uint32_t lo = 0;
+        for (int i = 2; i < 6; i++) {
+            lo = (lo << 4) | (uint32_t)hex_val(s[i]);
+        }
+        if (lo >= 0xdc00 && lo <= 0xdfff) {
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            s += 6;
+        }
+    }
+    if (cp >= 0xd800 && cp <= 0xdfff) {
+        cp = 0xfffd;
+    }
+    *pos = s;
+    if (cp < 0x80) {
+        out[0] = (uint8_t)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (uint8_t)(0xc0 | (cp >> 6));
+        out[1] = (uint8_t)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (uint8_t)(0xe0 | (cp >> 12));
+        out[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (uint8_t)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (uint8_t)(0xf0 | (cp >> 18));
+    out[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (uint8_t)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+static bool str_cmp(const kjson_token_t *tok, const char *s, bool fold)
+{
+    if (tok->type != KJSON_STRING && tok->type != KJSON_KEY) {
+        return false;
+    }
+    const char *pos = tok->ptr;
+    const char *end = tok->ptr + tok->len;
+    uint8_t ch[4];
+    size_t n;
+    while ((n = str_decode(&pos, end, ch)) > 0) {
+        for (size_t i = 0; i < n; i++, s++) {
+            uint8_t a = ch[i], b = (uint8_t)*s;
+            if (fold) {
+                a = (a >= 'A' && a <= 'Z') ? a | 0x20 : a;
+                b = (b >= 'A' && b <= 'Z') ? b | 0x20 : b;
+            }
+            if (b == 0 || a != b) {
+                return false;
+            }
+        }
+    }
+    return *s == '\0';
+}
+
+bool kjson_str_eq(const kjson_token_t *tok, const char *s)
+{
+    /* Fast path: no escapes, compare bytes */
+    if ((tok->type == KJSON_STRING || tok->type == KJSON_KEY) && !memchr(tok->ptr, '\\', tok->len)) {
+        return strncmp(tok->ptr, s, tok->len) == 0 && s[tok->len] == '\0';
+    }
+    return str_cmp(tok, s, false);
+}
+
+bool kjson_str_caseeq(const kjson_token_t *tok, const char *s)
+{
+    return str_cmp(tok, s, true);
+}
+
+int kjson_str_copy(const kjson_token_t *tok, char *out, size_t out_len)
+{
+    if (out_len == 0 || (tok->type != KJSON_STRING && tok->type != KJSON_KEY)) {
+        return -1;
+    }
+    const char *pos = tok->ptr;
+    const char *end = tok->ptr + tok->len;
+    size_t len = 0;
+    uint8_t ch[4];
+    size_t n;
+    while ((n = str_decode(&pos, end, ch)) > 0) {
+        if (len + n >= out_len) {
+            out[len] = '\0';
+            return -1;
+        }
+        memcpy(out + len, ch, n);
+        len += n;
+    }
+    out[len] = '\0';
+    return (int)len;
+}
+
+bool kjson_get_int(const kjson_token_t *tok, int32_t *out)
+{
+    if (tok->type != KJSON_NUMBER) {
+        return false;
+    }
+    const char *s = tok->ptr;
+    const char *end = tok->ptr + tok->len;
+    bool neg = (*s == '-');
+    s += neg;
+    int64_t v = 0;
+    while (s < end && *s >= '0' && *s <= '9') {
+        v = v * 10 + (*s++ - '0');
+        if (v > (int64_t)INT32_MAX + 1) {
+            return false;
+        }
+    }
+    if (s != end || (!neg && v > INT32_MAX)) {
+        return false;   /* fraction or exponent, or out of range */
+    }
+    *out = (int32_t)(neg ? -v : v);
+    return true;
+}
+
+bool kjson_get_bool(const kjson_token_t *tok, bool *out)
+{
+    if (tok->type == KJSON_TRUE || tok->type == KJSON_FALSE) {
+        *out = (tok->type == KJSON_TRUE);
+        return true;
+    }
+    if (tok->type == KJSON_NUMBER) {
+        *out = false;
+        for (size_t i = 0; i < tok->len && tok->ptr[i] != 'e' && tok->ptr[i] != 'E'; i++) {
+            if (tok->ptr[i] >= '1' && tok->ptr[i] <= '9') {
+                *out = true;
+                break;
+            }
+        }
+        return true;
+    }
+    return false;
+}
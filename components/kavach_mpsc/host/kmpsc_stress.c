@@ -0,0 +1,222 @@
+/*
+ * kmpsc stress test: producer threads push numbered items into one queue while the main thread pops.
+ * Each item carries its producer, a per-producer sequence number and a payload filled from both, so
+ * the consumer can check for every run that
+ *
+ *   - each producer's items arrive in the order it pushed them, none twice;
+ *   - every accepted push is popped exactly once and no rejected one shows up;
+ *   - kmpsc_overflows() equals the number of rejected pushes;
+ *   - no payload is torn (a slot read while a producer was still writing it).
+ *
+ * Runs cover a small queue (as in ui_kavach.c, mostly full: overflow path) and a larger one (mostly
+ * not full), with producers that drop on overflow and producers that retry until accepted.
+ *
+ *   kmpsc_stress [producers] [items per producer]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "kmpsc.h"
+
+#define PAYLOAD_WORDS 14    /* item is 64 bytes, about a UI command */
+#define MAX_PRODUCERS 64
+
+typedef struct {
+    uint32_t producer;
+    uint32_t seq;
+    uint32_t payload[PAYLOAD_WORDS];
+} item_t;
+
+typedef struct {
+    kmpsc_t *q;
+    uint32_t id;
+    uint32_t items;
+    bool retry;                 /* retry a rejected push until accepted, instead of dropping the item */
+    uint32_t accepted;
+    uint32_t rejected;
+} producer_t;
+
+static atomic_uint s_start;
+static atomic_uint s_running;
+
+static uint32_t payload_word(uint32_t producer, uint32_t seq, int i)
+{
+    return (producer * 2654435761u) ^ (seq * 40503u) ^ (uint32_t)i;
+}
+
+static void *producer_main(void *arg)
+{
+    producer_t *p = arg;
+    while (!atomic_load(&s_start)) {
+        sched_yield();
+    }
+    item_t it;
+    it.producer = p->id;
+    for (uint32_t seq = 0; seq < p->items; seq++) {
+        it.seq = seq;
+        for (int i = 0; i < PAYLOAD_WORDS; i++) {
+            it.payload[i] = payload_word(p->id, seq, i);
+        }
+        for (;;) {
+            if (kmpsc_push(p->q, &it)) {
+                p->accepted++;
+                break;
+            }
+            p->rejected++;
+            if (!p->retry) {
+                break;
+            }
+            sched_yield();
+        }
+    }
+    atomic_fetch_sub(&s_running, 1);
+    return NULL;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* One run; q is already set up (and empty). Returns the number of failed checks. */
+static int run(const char *name, kmpsc_t *q, uint32_t nprod, uint32_t items)
+{
+    producer_t prod[MAX_PRODUCERS];
+    pthread_t th[MAX_PRODUCERS];
+    int64_t next[MAX_PRODUCERS];
+    uint32_t popped_by[MAX_PRODUCERS] = {0};
+    int errors = 0;
+    uint32_t overflows0 = kmpsc_overflows(q);
+
+    atomic_store(&s_start, 0);
+    atomic_store(&s_running, nprod);
+    for (uint32_t i = 0; i < nprod; i++) {
+        prod[i] = (producer_t){ .q = q, .id = i, .items = items, .retry = (i % 2) == 1 };
+        next[i] = 0;
+        pthread_create(&th[i], NULL, producer_main, &prod[i]);
+    }
+
+    double t0 = now_s();
+    atomic_store(&s_start, 1);
+    uint64_t popped = 0;
+    item_t it;
+    for (;;) {
+        if (kmpsc_pop(q, &it)) {
+            popped++;
+            if (it.producer >= nprod) {
+                if (errors++ < 10) {
+                    fprintf(stderr, "%s: bad producer %u\n", name, (unsigned)it.producer);
+                }
+                continue;
+            }
+            if ((int64_t)it.seq < next[it.producer]) {
+                if (errors++ < 10) {
+                    fprintf(stderr, "%s: producer %u seq %u after %lld (reordered or duplicate)\n", name,
+                            (unsigned)it.producer, (unsigned)it.seq, (long long)next[it.producer] - 1);
+                }
+            }
+            next[it.producer] = (int64_t)it.seq + 1;
+            popped_by[it.producer]++;
+            for (int i = 0; i < PAYLOAD_WORDS; i++) {
+                if (it.payload[i] != payload_word(it.producer, it.seq, i)) {
+                    if (errors++ < 10) {
+                        fprintf(stderr, "%s: producer %u seq %u torn payload\n", name,
+                                (unsigned)it.producer, (unsigned)it.seq);
+                    }
+                    break;
+                }
+            }
+            continue;
+        }
+        if (atomic_load(&s_running) == 0) {
+            /* All pushes returned, so every accepted item is fully written: drain and stop */
+            while (kmpsc_pop(q, &it)) {
+                popped++;
+                if (it.producer < nprod) {
+                    popped_by[it.producer]++;
+                    if ((int64_t)it.seq < next[it.producer] && errors++ < 10) {
+                        fprintf(stderr, "%s: producer %u out of order at the end\n", name, (unsigned)it.producer);
+                    }
+                    next[it.producer] = (int64_t)it.seq + 1;
+                }
+            }
+            break;
+        }
+        sched_yield();
+    }
+    double dt = now_s() - t0;
+
+    uint64_t accepted = 0, rejected = 0;
+    for (uint32_t i = 0; i < nprod; i++) {
+        pthread_join(th[i], NULL);
+        accepted += prod[i].accepted;
+        rejected += prod[i].rejected;
+        if (popped_by[i] != prod[i].accepted) {
+            if (errors++ < 10) {
+                fprintf(stderr, "%s: producer %u: %u accepted, %u popped\n", name, (unsigned)i,
+                        (unsigned)prod[i].accepted, (unsigned)popped_by[i]);
+            }
+        }
+        if (prod[i].retry && prod[i].accepted != items && errors++ < 10) {
+            fprintf(stderr, "%s: retrying producer %u got %u of %u in\n", name, (unsigned)i,
+                    (unsigned)prod[i].accepted, (unsigned)items);
+        }
+    }
+    uint32_t overflows = kmpsc_overflows(q) - overflows0;
+    if (overflows != (uint32_t)rejected) {
+        errors++;
+        fprintf(stderr, "%s: overflows %u, rejected pushes %llu\n", name, (unsigned)overflows,
+                (unsigned long long)rejected);
+    }
+    if (kmpsc_pop(q, &it)) {
+        errors++;
+        fprintf(stderr, "%s: queue not empty at the end\n", name);
+    }
+
+    printf("%-28s %2u producers  %8llu pushed  %8llu popped  %8u overflows  %6.2f M/s  %s\n", name,
+           (unsigned)nprod, (unsigned long long)accepted, (unsigned long long)popped, (unsigned)overflows,
+           dt > 0 ? popped / dt / 1e6 : 0.0, errors ? "FAIL" : "ok");
+    return errors;
+}
+
+#define SMALL_CAP 16
+#define LARGE_CAP 1024
+
+static KMPSC_STORAGE(s_small_storage, SMALL_CAP, sizeof(item_t));
+static kmpsc_t s_small = KMPSC_INITIALIZER(s_small_storage, SMALL_CAP, sizeof(item_t));
+
+int main(int argc, char **argv)
+{
+    uint32_t nprod = argc > 1 ? (uint32_t)atoi(argv[1]) : 8;
+    uint32_t items = argc > 2 ? (uint32_t)atoi(argv[2]) : 200000;
+    if (nprod < 1 || nprod > MAX_PRODUCERS || items < 1) {
+        fprintf(stderr, "usage: %s [producers 1..%d] [items per producer]\n", argv[0], MAX_PRODUCERS);
+        return 2;
+    }
+
+    int errors = 0;
+    /* Static queue, never initialised: zeroed storage must be an empty queue */
+    errors += run("static, 16 slots", &s_small, nprod, items);
+    errors += run("static, 16 slots, again", &s_small, nprod, items);
+
+    size_t size = (size_t)LARGE_CAP * KMPSC_CELL_SIZE(sizeof(item_t));
+    void *storage = aligned_alloc(8, size);
+    kmpsc_t large;
+    if (!storage || kmpsc_init(&large, storage, 3, sizeof(item_t)) ||
+        !kmpsc_init(&large, storage, LARGE_CAP, sizeof(item_t))) {
+        fprintf(stderr, "kmpsc_init checks failed\n");
+        return 1;
+    }
+    errors += run("1024 slots", &large, nprod, items);
+    errors += run("1024 slots, 1 producer", &large, 1, items);
+    free(storage);
+
+    printf("%s\n", errors ? "FAILED" : "all checks passed");
+    return errors ? 1 : 0;
+}
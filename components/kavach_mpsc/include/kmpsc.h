@@ -0,0 +1,69 @@
+/*
+ * kmpsc: bounded lock-free multi-producer / single-consumer queue of fixed-size items, so tasks can
+ * hand work to one owner task (the LVGL task in ui_kavach.c) without a mutex or a shared buffer.
+ *
+ * Any number of tasks may call kmpsc_push() at the same time; only one task calls kmpsc_pop().
+ * Items are copied in and out. Items pushed by one task are popped in the order that task pushed
+ * them. A full queue rejects the item and counts it (kmpsc_overflows()); nothing blocks.
+ *
+ * Storage is the caller's: declare it with KMPSC_STORAGE() and either call kmpsc_init() or use
+ * KMPSC_INITIALIZER() for a static queue, which is usable before any init code runs (zeroed storage
+ * is an empty queue).
+ */
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Bytes per slot for items of elem_size bytes: a sequence word, then the item, 8-byte aligned. */
+#define KMPSC_CELL_SIZE(elem_size) (((size_t)(elem_size) + 8 + 7) & ~(size_t)7)
+
+/** Declare zeroed storage for capacity items of elem_size bytes (capacity: a power of 2). */
+#define KMPSC_STORAGE(name, capacity, elem_size) \
+    uint64_t name[(capacity) * KMPSC_CELL_SIZE(elem_size) / sizeof(uint64_t)]
+
+/** Static initializer for a queue over storage declared with KMPSC_STORAGE() (storage must be zero). */
+#define KMPSC_INITIALIZER(storage, capacity, size) \
+    { .cells = (uint8_t *)(storage), .mask = (capacity) - 1, .cell_size = KMPSC_CELL_SIZE(size), \
+      .elem_size = (size) }
+
+typedef struct {
+    uint8_t *cells;
+    uint32_t mask;                  /* capacity - 1 */
+    uint32_t cell_size;
+    uint32_t elem_size;
+    _Atomic uint32_t head;          /* next position a producer claims */
+    uint32_t tail;                  /* next position the consumer reads */
+    _Atomic uint32_t overflows;     /* pushes rejected because the queue was full */
+} kmpsc_t;
+
+/**
+ * Set up q over storage (capacity * KMPSC_CELL_SIZE(elem_size) bytes, 8-byte aligned) and empty it.
+ * @return false if capacity is not a power of 2
+ */
+bool kmpsc_init(kmpsc_t *q, void *storage, uint32_t capacity, size_t elem_size);
+
+/** Copy item into the queue. Any task. @return false if full (counted in kmpsc_overflows()) */
+bool kmpsc_push(kmpsc_t *q, const void *item);
+
+/**
+ * Copy the oldest item out. Consumer task only.
+ * @return false if empty, or if the oldest slot is claimed by a producer that has not finished
+ *         writing it (that producer's push then returns true afterwards, so check again after it)
+ */
+bool kmpsc_pop(kmpsc_t *q, void *item);
+
+static inline uint32_t kmpsc_overflows(const kmpsc_t *q)
+{
+    return atomic_load_explicit(&((kmpsc_t *)q)->overflows, memory_order_relaxed);
+}
+
+#ifdef __cplusplus
+}
+#endif
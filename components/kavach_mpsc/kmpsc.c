@@ -0,0 +1,80 @@
+/*
+ * Bounded MPSC queue after D. Vyukov's array queue: every slot has a sequence word telling which
+ * position may use it next. A producer claims a position with one CAS on head, writes the item, then
+ * publishes it by bumping the slot's sequence (release); the consumer reads a slot once its sequence
+ * says it is filled (acquire) and hands it back to the producers one lap later.
+ *
+ * The sequence is stored minus the slot index, so all-zero storage is an empty queue and a static
+ * queue needs no init call. Positions are free-running 32-bit counters; differences are compared as
+ * signed, which is fine for any capacity below 2^31.
+ */
+#include <string.h>
+#include "kmpsc.h"
+
+static inline _Atomic uint32_t *cell_seq(const kmpsc_t *q, uint32_t idx)
+{
+    return (_Atomic uint32_t *)(q->cells + (size_t)idx * q->cell_size);
+}
+
+static inline uint8_t *cell_data(const kmpsc_t *q, uint32_t idx)
+{
+    return q->cells + (size_t)idx * q->cell_size + 8;
+}
+
+bool kmpsc_init(kmpsc_t *q, void *storage, uint32_t capacity, size_t elem_size)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+    memset(storage, 0, (size_t)capacity * KMPSC_CELL_SIZE(elem_size));
+    q->cells = storage;
+    q->mask = capacity - 1;
+    q->cell_size = KMPSC_CELL_SIZE(elem_size);
+    q->elem_size = elem_size;
+    atomic_init(&q->head, 0);
+    q->tail = 0;
+    atomic_init(&q->overflows, 0);
+    return true;
+}
+
+bool kmpsc_push(kmpsc_t *q, const void *item)
+{
+    uint32_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t idx;
+    for (;;) {
+        idx = pos & q->mask;
+        uint32_t seq = atomic_load_explicit(cell_seq(q, idx), memory_order_acquire) + idx;
+        int32_t dif = (int32_t)(seq - pos);
+        if (dif == 0) {
+            /* Slot is free for pos: claim it (on failure pos is reloaded with the current head) */
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            /* Slot still holds the item from one lap ago: full */
+            atomic_fetch_add_explicit(&q->overflows, 1, memory_order_relaxed);
+            return false;
+        } else {
+            /* Another producer took pos */
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+    memcpy(cell_data(q, idx), item, q->elem_size);
+    atomic_store_explicit(cell_seq(q, idx), pos + 1 - idx, memory_order_release);
+    return true;
+}
+
+bool kmpsc_pop(kmpsc_t *q, void *item)
+{
+    uint32_t pos = q->tail;
+    uint32_t idx = pos & q->mask;
+    uint32_t seq = atomic_load_explicit(cell_seq(q, idx), memory_order_acquire) + idx;
+    if ((int32_t)(seq - (pos + 1)) < 0) {
+        return false;
+    }
+    memcpy(item, cell_data(q, idx), q->elem_size);
+    atomic_store_explicit(cell_seq(q, idx), pos + q->mask + 1 - idx, memory_order_release);
+    q->tail = pos + 1;
+    return true;
+}
@@ -0,0 +1,235 @@
+/*
+ * AEC playback reference: the third channel app_sr feeds to the AFE must be the playback PCM,
+ * decimated to 16 kHz and aligned with the echo the microphones capture.
+ *
+ * Unit cases: the 48 -> 16 kHz box decimation across uneven writes; app_aec_ref_begin() dropping the
+ * previous prompt's samples and a partial decimation group; the CONFIG_KAVACH_AEC_REF_DELAY_MS
+ * padding; zero-fill when the ring runs empty (nothing playing) and when it overflowed (feed task
+ * paused), with the oldest reference kept.
+ *
+ * Alignment: a 1 s (32 blocks) prompt on a 16 kHz sample clock. The playback task writes stream blocks as the
+ * I2S DMA (I2S_DMA_MS deep, ESP-IDF's default 6 x 240 frames) drains, the speaker plays one sample per
+ * tick from the start of playback, and the feed task reads one FEED_CHUNK of reference per captured
+ * chunk, as app_sr's feed task does. Every playback sample carries its own index, so each reference
+ * sample tells which playback sample it is; its lag against the echo of that sample must be the same
+ * for the whole prompt and equal the part of the first chunk captured before playback started, minus
+ * the configured delay. The same run with the reference published after bsp_i2s_write() returns (the
+ * order before this test) is printed for comparison: a feed read between the start of playback and the
+ * return misses the reference, which then trails the echo.
+ *
+ * Built twice: with the default delay (0) and as aec_ref_test_delay with 20 ms.
+ *
+ *   aec_ref_test
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "app_aec_ref.h"
+
+#define DECIMATION      3
+#define REF_RATE        16000
+#define RING_SAMPLES    (REF_RATE / 4)          /* REF_RING_MS = 250 */
+#define PAD             (REF_RATE * CONFIG_KAVACH_AEC_REF_DELAY_MS / 1000)
+#define FEED_CHUNK      512                     /* AFE feed chunk at 16 kHz (32 ms) */
+#define STREAM_BLOCK    512                     /* WAV_STREAM_BLOCK_SAMPLES of a 16 kHz prompt */
+#define I2S_DMA_MS      30
+#define DMA_SAMPLES     (REF_RATE * I2S_DMA_MS / 1000)
+#define PROMPT          (32 * STREAM_BLOCK)     /* about 1 s */
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+static int16_t s_ref[REF_RATE * 2];
+
+/* Read n reference samples into s_ref (pre-filled with garbage so zero-fill is visible) */
+static size_t read_ref(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        s_ref[i] = 0x7777;
+    }
+    return app_aec_ref_read(s_ref, n);
+}
+
+static bool all_zero(const int16_t *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (p[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Box filter: each output is the truncated mean of three input samples, groups span write calls */
+static void decimation(void)
+{
+    static const int16_t in[] = { 3, 6, 9, -1, -2, -4, 32767, 32767, 32767, -32768, -32768, -32768, 1, 1, 0 };
+    static const int16_t want[] = { 6, -2, 32767, -32768, 0 };
+    app_aec_ref_begin();
+    size_t splits[] = { 1, 4, 2, 7, 1 };
+    size_t off = 0;
+    for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); i++) {
+        app_aec_ref_write(in + off, splits[i]);
+        off += splits[i];
+    }
+    size_t got = read_ref(PAD + 8);
+    CHECK(got == PAD + 5, "decimation: %zu reference samples, want %d", got, PAD + 5);
+    CHECK(all_zero(s_ref, PAD), "decimation: padding not silent");
+    CHECK(memcmp(s_ref + PAD, want, sizeof(want)) == 0, "decimation: got %d %d %d %d %d", s_ref[PAD],
+          s_ref[PAD + 1], s_ref[PAD + 2], s_ref[PAD + 3], s_ref[PAD + 4]);
+    CHECK(all_zero(s_ref + PAD + 5, 3), "decimation: not zero-filled after the data");
+}
+
+/* A new prompt drops what the last one left in the ring and its partial group */
+static void begin_resets(void)
+{
+    int16_t pcm[300];
+    for (int i = 0; i < 300; i++) {
+        pcm[i] = 1000;
+    }
+    app_aec_ref_begin();
+    app_aec_ref_write(pcm, 300);
+    app_aec_ref_write(pcm, 2);           /* partial group */
+    app_aec_ref_begin();
+    int16_t next[] = { 30, 30, 30 };
+    app_aec_ref_write(next, 3);
+    size_t got = read_ref(PAD + 4);
+    CHECK(got == PAD + 1 && all_zero(s_ref, PAD) && s_ref[PAD] == 30 && s_ref[PAD + 1] == 0,
+          "begin: %zu samples, first after padding %d, want %d samples starting with 30", got, s_ref[PAD],
+          PAD + 1);
+}
+
+/* Nothing playing: silence and a count of 0 */
+static void empty(void)
+{
+    app_aec_ref_begin();
+    read_ref(PAD);
+    size_t got = read_ref(FEED_CHUNK);
+    CHECK(got == 0 && all_zero(s_ref, FEED_CHUNK), "empty ring: %zu samples, not zero-filled", got);
+}
+
+/* Feed task paused for 1 s of playback: the ring keeps the first 250 ms, drops the rest */
+static void overflow(void)
+{
+    static int16_t pcm[PROMPT * DECIMATION];
+    for (int i = 0; i < PROMPT * DECIMATION; i++) {
+        pcm[i] = (int16_t)(i / DECIMATION % 30000 + 1);
+    }
+    app_aec_ref_begin();
+    app_aec_ref_write(pcm, PROMPT * DECIMATION);
+    size_t got = read_ref(PROMPT);
+    bool oldest = all_zero(s_ref, PAD);
+    for (int i = PAD; i < RING_SAMPLES && oldest; i++) {
+        oldest = s_ref[i] == i - PAD + 1;
+    }
+    CHECK(got == RING_SAMPLES, "overflow: %zu samples kept, want %d", got, RING_SAMPLES);
+    CHECK(oldest, "overflow: the kept samples are not the oldest");
+    CHECK(all_zero(s_ref + RING_SAMPLES, PROMPT - RING_SAMPLES), "overflow: not zero-filled after the ring");
+    app_aec_ref_begin();
+    read_ref(PAD);
+    CHECK(read_ref(FEED_CHUNK) == 0, "overflow: begin did not clear the ring");
+}
+
+/*
+ * One prompt starting `start` ticks into the run. The playback task hands each stream block to
+ * bsp_i2s_write(), which returns once the rest of the block fits in the DMA buffer; the speaker plays
+ * from the first sample handed over. The reference is published before the write (publish_first, as
+ * app_sr_handler does) or after it returns. Returns the constant lag (echo time minus reference time,
+ * in 16 kHz samples), or INT32_MIN if it varies or playback samples are missing from the reference.
+ */
+static int32_t alignment(int start, bool publish_first)
+{
+    static int16_t block[STREAM_BLOCK * DECIMATION];
+    const int end = start + PROMPT + 4 * FEED_CHUNK;
+    int written = 0;            /* 16 kHz samples handed to I2S */
+    bool in_write = false;      /* a block is being written, its reference not yet published */
+    int32_t lag = INT32_MIN;
+    int mismatches = 0, seen = 0;
+    app_aec_ref_begin();        /* start from an empty ring */
+    read_ref(RING_SAMPLES);
+    for (int t = 0; t <= end; t++) {
+        if (t == start) {
+            app_aec_ref_begin();
+        }
+        int played = t < start ? 0 : (t - start < written ? t - start : written);
+        while (t >= start && (in_write || written < PROMPT)) {
+            if (!in_write) {
+                for (int i = 0; i < STREAM_BLOCK * DECIMATION; i++) {
+                    block[i] = (int16_t)(written + i / DECIMATION + 1);    /* playback index + 1 */
+                }
+                if (publish_first) {
+                    app_aec_ref_write(block, STREAM_BLOCK * DECIMATION);
+                }
+                written += STREAM_BLOCK;
+                in_write = true;
+                played = t - start < written ? t - start : written;
+            }
+            if (written - played > DMA_SAMPLES) {
+                break;          /* bsp_i2s_write() still blocked */
+            }
+            if (!publish_first) {
+                app_aec_ref_write(block, STREAM_BLOCK * DECIMATION);
+            }
+            in_write = false;
+        }
+        /* Feed task: a captured chunk [t - FEED_CHUNK, t) and its reference */
+        if (t > 0 && t % FEED_CHUNK == 0) {
+            read_ref(FEED_CHUNK);
+            for (int i = 0; i < FEED_CHUNK; i++) {
+                if (s_ref[i] <= 0) {
+                    continue;
+                }
+                int capture = t - FEED_CHUNK + i;
+                int echo = start + s_ref[i] - 1;        /* the speaker played that sample here */
+                int32_t l = echo - capture;
+                if (lag == INT32_MIN) {
+                    lag = l;
+                }
+                mismatches += l != lag;
+                seen++;
+            }
+        }
+    }
+    return (mismatches || seen != PROMPT) ? INT32_MIN : lag;
+}
+
+int main(void)
+{
+    if (app_aec_ref_init() != ESP_OK) {
+        fprintf(stderr, "FAIL: app_aec_ref_init\n");
+        return 1;
+    }
+    decimation();
+    begin_resets();
+    empty();
+    overflow();
+
+    printf("delay %d ms, feed chunk %d, I2S DMA %d ms, stream block %d\n", CONFIG_KAVACH_AEC_REF_DELAY_MS,
+           FEED_CHUNK, I2S_DMA_MS, STREAM_BLOCK);
+    static const int starts[] = { 0, 1, 100, 500, 511, 777, 1536 };
+    for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); i++) {
+        int start = starts[i];
+        int first_read = (start / FEED_CHUNK + (start % FEED_CHUNK || start == 0)) * FEED_CHUNK;
+        int32_t want = start - (first_read - FEED_CHUNK) - PAD;    /* captured before playback, minus the delay */
+        int32_t lag = alignment(start, true);
+        int32_t lag_after = alignment(start, false);
+        char after[48] = "drifts";
+        if (lag_after != INT32_MIN) {
+            snprintf(after, sizeof(after), "%.2f ms", lag_after * 1000.0 / REF_RATE);
+        }
+        if (lag == INT32_MIN) {
+            CHECK(false, "start %d: reference drifts against the echo", start);
+            continue;
+        }
+        printf("playback from %4d: reference leads the echo by %5.2f ms (published after the write: %s)\n", start,
+               lag * 1000.0 / REF_RATE, after);
+        CHECK(lag == want, "start %d: lag %d samples, want %d", start, (int)lag, (int)want);
+    }
+    printf("%s\n", s_fail ? "FAIL" : "OK");
+    return s_fail;
+}
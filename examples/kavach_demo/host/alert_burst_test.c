@@ -0,0 +1,271 @@
+/*
+ * app_alert under repeated node reports: bursts of 100 gas LEAK messages, parsed as app_mqtt's on_gas
+ * does, raise one overlay and one alarm per incident and allocate nothing.
+ *
+ * Scenarios on a manual clock: 100 reports 7 s apart (the gas node's repeat rate) that then go quiet;
+ * 100 back to back (queued by the broker during an outage) ended by "OK"; a dismiss after the third
+ * report of a long leak; two nodes leaking at once. The UI and playback calls are counted here, and
+ * every malloc/calloc/realloc (glibc) and heap_caps allocation made while a scenario runs is counted.
+ *
+ * Fails if a scenario allocates, if the overlay or alarm is raised more than once per incident (or not
+ * lowered at its end), or on wrong incident events or stats.
+ *
+ *   alert_burst_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "kjson.h"
+#include "app_alert.h"
+
+#define BURST       100
+#define QUIET_SEC   CONFIG_KAVACH_ALERT_QUIET_SEC
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+/* Count the C library's allocations while a scenario runs */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static bool s_counting;
+static long s_mallocs;
+
+void *malloc(size_t size)
+{
+    s_mallocs += s_counting;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    s_mallocs += s_counting;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+    s_mallocs += s_counting;
+    return __libc_realloc(p, size);
+}
+
+/* What the alert manager drives: overlay, alarm sound, incident events */
+typedef struct {
+    int overlay, overlay_clear, intruder, alarm_play, alarm_stop;
+    int starts, ends, ends_quiet;
+    uint32_t last_reports;
+    int32_t last_peak;
+    long mallocs, heap_allocs;
+} counts_t;
+
+static counts_t s_n;
+static uint32_t s_heap_allocs0;
+
+void kavach_ui_trigger_gas_leak_alert(void)
+{
+    s_n.overlay++;
+}
+
+void kavach_ui_clear_gas_leak_alert(void)
+{
+    s_n.overlay_clear++;
+}
+
+void kavach_ui_trigger_intruder_alert(void)
+{
+    s_n.intruder++;
+}
+
+void sr_handler_play_gas_alarm(void)
+{
+    s_n.alarm_play++;
+}
+
+void sr_handler_stop_gas_alarm(void)
+{
+    s_n.alarm_stop++;
+}
+
+static void on_event(const app_alert_incident_t *inc, const app_alert_end_t *end, void *arg)
+{
+    (void)arg;
+    if (!end) {
+        s_n.starts++;
+        return;
+    }
+    s_n.ends++;
+    s_n.ends_quiet += *end == APP_ALERT_END_QUIET;
+    s_n.last_reports = inc->reports;
+    s_n.last_peak = inc->peak;
+}
+
+/* app_mqtt.c's on_gas */
+static void on_gas(const char *data)
+{
+    kjson_field_t fields[] = { { .key = "state" }, { .key = "gas" }, { .key = "device" } };
+    if (kjson_scan_object(data, strlen(data), fields, 3) < 0) {
+        return;
+    }
+    char device[APP_ALERT_DEVICE_MAX] = "?";
+    kjson_str_copy(&fields[2].val, device, sizeof(device));
+    if (!kjson_str_caseeq(&fields[0].val, "LEAK")) {
+        if (fields[0].val.type == KJSON_STRING) {
+            app_alert_clear(APP_ALERT_GAS, device);
+        }
+        return;
+    }
+    int32_t level = -1;
+    kjson_get_int(&fields[1].val, &level);
+    app_alert_report(APP_ALERT_GAS, device, level);
+}
+
+static void leak(const char *device, int gas)
+{
+    char msg[96];
+    snprintf(msg, sizeof(msg), "{\"device\":\"%s\",\"gas\":%d,\"state\":\"LEAK\"}", device, gas);
+    on_gas(msg);
+}
+
+/* Step the clock in 1 s ticks; the quiet timer checks due incidents itself, so firing it every tick is safe */
+static void advance_sec(int sec)
+{
+    for (int i = 0; i < sec; i++) {
+        host_time_advance(1000000);
+        host_timer_fire("alert_quiet");
+    }
+}
+
+static void begin(void)
+{
+    memset(&s_n, 0, sizeof(s_n));
+    host_heap_stats_t h;
+    host_heap_get(&h);
+    s_heap_allocs0 = h.allocs;
+    s_mallocs = 0;
+    s_counting = true;
+}
+
+static void end(const char *name, double ns_per_msg)
+{
+    s_counting = false;
+    host_heap_stats_t h;
+    host_heap_get(&h);
+    s_n.mallocs = s_mallocs;
+    s_n.heap_allocs = (long)(h.allocs - s_heap_allocs0);
+    printf("%-34s | overlay %d/%d cleared, alarm %d started/%d stopped, incidents %d/%d ended, "
+           "allocations %ld", name, s_n.overlay, s_n.overlay_clear, s_n.alarm_play, s_n.alarm_stop, s_n.starts,
+           s_n.ends, s_n.mallocs + s_n.heap_allocs);
+    if (ns_per_msg > 0) {
+        printf(", %.0f ns per message", ns_per_msg);
+    }
+    printf("\n");
+    CHECK(s_n.mallocs == 0 && s_n.heap_allocs == 0, "%s: %ld malloc and %ld heap_caps allocations", name,
+          s_n.mallocs, s_n.heap_allocs);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    host_time_set(1000000);
+    if (app_alert_init(on_event, NULL) != ESP_OK) {
+        fprintf(stderr, "FAIL: app_alert_init\n");
+        return 1;
+    }
+    /* Warm-up incident, so lazy allocations of the C library (stdio, locale) are not counted */
+    leak("warmup", 500);
+    on_gas("{\"device\":\"warmup\",\"state\":\"OK\"}");
+
+    /* 100 reports at the gas node's repeat rate, then nothing */
+    begin();
+    double ns = 0;
+    int peak = 0;
+    for (int i = 0; i < BURST; i++) {
+        int gas = 600 + (i * 37) % 300;
+        peak = gas > peak ? gas : peak;
+        double t0 = now_ns();
+        leak("gas_sensor", gas);
+        ns += now_ns() - t0;
+        advance_sec(7);
+    }
+    advance_sec(QUIET_SEC + 1);
+    end("100 LEAK 7 s apart, then quiet", ns / BURST);
+    CHECK(s_n.overlay == 1 && s_n.alarm_play == 1, "raised %d overlays and %d alarms, want 1", s_n.overlay,
+          s_n.alarm_play);
+    CHECK(s_n.overlay_clear == 1 && s_n.alarm_stop == 1, "quiet end: overlay cleared %d, alarm stopped %d",
+          s_n.overlay_clear, s_n.alarm_stop);
+    CHECK(s_n.starts == 1 && s_n.ends_quiet == 1 && s_n.last_reports == BURST && s_n.last_peak == peak,
+          "events: %d starts, %d quiet ends, %u reports, peak %d (want %d)", s_n.starts, s_n.ends_quiet,
+          (unsigned)s_n.last_reports, (int)s_n.last_peak, peak);
+
+    /* 100 back to back, ended by the node */
+    begin();
+    ns = 0;
+    for (int i = 0; i < BURST; i++) {
+        double t0 = now_ns();
+        leak("gas_sensor", 700);
+        ns += now_ns() - t0;
+    }
+    on_gas("{\"device\":\"gas_sensor\",\"state\":\"OK\"}");
+    end("100 LEAK back to back, then OK", ns / BURST);
+    CHECK(s_n.overlay == 1 && s_n.alarm_play == 1 && s_n.overlay_clear == 1 && s_n.alarm_stop == 1,
+          "overlay %d/%d, alarm %d/%d, want 1/1 each", s_n.overlay, s_n.overlay_clear, s_n.alarm_play,
+          s_n.alarm_stop);
+    CHECK(s_n.starts == 1 && s_n.ends == 1 && s_n.ends_quiet == 0 && s_n.last_reports == BURST,
+          "events: %d starts, %d ends (%d quiet), %u reports", s_n.starts, s_n.ends, s_n.ends_quiet,
+          (unsigned)s_n.last_reports);
+
+    /* Dismissed after the third report: the repeats that follow stay silent */
+    begin();
+    for (int i = 0; i < 23; i++) {
+        leak("gas_sensor", 650);
+        if (i == 2) {
+            app_alert_dismiss(APP_ALERT_GAS);
+        }
+        advance_sec(7);
+    }
+    on_gas("{\"device\":\"gas_sensor\",\"state\":\"OK\"}");
+    end("dismissed, 20 more LEAK, then OK", 0);
+    CHECK(s_n.overlay == 1 && s_n.alarm_play == 1 && s_n.alarm_stop == 1 && s_n.overlay_clear == 1,
+          "dismiss: overlay %d/%d, alarm %d/%d, want 1/1 each", s_n.overlay, s_n.overlay_clear,
+          s_n.alarm_play, s_n.alarm_stop);
+    CHECK(s_n.starts == 1 && s_n.ends == 1 && s_n.last_reports == 23, "dismiss: %d starts, %d ends, %u reports",
+          s_n.starts, s_n.ends, (unsigned)s_n.last_reports);
+
+    /* Two nodes: one alert while either leaks */
+    begin();
+    for (int i = 0; i < 10; i++) {
+        leak("kitchen", 650);
+        advance_sec(3);
+        if (i >= 4) {
+            leak("garage", 800);
+        }
+        advance_sec(4);
+    }
+    advance_sec(QUIET_SEC + 1);
+    end("two nodes overlapping", 0);
+    CHECK(s_n.overlay == 1 && s_n.alarm_play == 1 && s_n.alarm_stop == 1, "two nodes: overlay %d, alarm %d/%d",
+          s_n.overlay, s_n.alarm_play, s_n.alarm_stop);
+    CHECK(s_n.starts == 2 && s_n.ends_quiet == 2, "two nodes: %d starts, %d quiet ends", s_n.starts,
+          s_n.ends_quiet);
+
+    app_alert_stats_t st;
+    app_alert_get_stats(&st);
+    CHECK(st.dropped == 0 && st.incidents == 6 && st.reports == st.incidents + st.coalesced,
+          "stats: %u reports, %u incidents, %u coalesced, %u dropped", (unsigned)st.reports,
+          (unsigned)st.incidents, (unsigned)st.coalesced, (unsigned)st.dropped);
+    CHECK(app_alert_active(APP_ALERT_GAS) == 0, "%d incidents still open", app_alert_active(APP_ALERT_GAS));
+    return s_fail;
+}
@@ -0,0 +1,271 @@
+/*
+ * app_mqtt_router: wildcard semantics, the handler limit per message, reassembly of fragmented
+ * messages, and dispatch time against the strlen + strncmp chain it replaced, at 10 and 200 registered
+ * filters.
+ *
+ * Filters look like the node topics the app subscribes to, fabacademy/kavach/nodeN/<kind>. The chain
+ * uses byte-wise strlen/strncmp, like newlib's on the target; the trie's time includes the router
+ * mutex and the handler call. The 200-filter trie also holds the 10-filter set and the semantics
+ * filters (there is no way to clear the router), so its numbers are if anything pessimistic.
+ *
+ * Fragmented messages are sent in 1 KB events from a reused buffer, like the MQTT client's. A message
+ * that cannot be buffered whole (over the arena size, or the arena allocation failed) must still reach
+ * the streaming handlers on its topic.
+ *
+ * Fails on a wrong match, if more than ROUTE_MATCH_MAX handlers are called, on a wrongly reassembled
+ * or streamed message, or if the trie is slower than the chain at 200 filters.
+ *
+ *   mqtt_router_bench [dispatches]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_heap_caps.h"
+#include "app_mqtt_router.h"
+
+#define MATCH_MAX   8       /* ROUTE_MATCH_MAX in app_mqtt_router.c */
+#define EVENT_MAX   1024    /* MQTT client buffer: larger messages arrive in several events */
+#define PAYLOAD_MAX 20000
+
+static int s_fail;
+static int s_hits;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Adds its arg, so the sum tells which handlers ran */
+static void on_msg(const app_mqtt_msg_t *msg, void *arg)
+{
+    (void)msg;
+    s_hits += (int)(intptr_t)arg;
+}
+
+static int dispatch(const char *topic)
+{
+    s_hits = 0;
+    return app_mqtt_router_dispatch(topic, strlen(topic), "x", 1, 0, 1);
+}
+
+static void expect(const char *topic, int want)
+{
+    dispatch(topic);
+    CHECK(s_hits == want, "%s: handlers summed to %d, want %d", topic, s_hits, want);
+}
+
+static void semantics(void)
+{
+    app_mqtt_router_register("a/b", 0, on_msg, (void *)1);
+    app_mqtt_router_register("a/+", 0, on_msg, (void *)10);
+    app_mqtt_router_register("a/#", 0, on_msg, (void *)100);
+    app_mqtt_router_register("#", 0, on_msg, (void *)1000);
+    app_mqtt_router_register("+/+/c", 0, on_msg, (void *)10000);
+    expect("a/b", 1111);
+    expect("a", 1100);          /* "a/#" also matches "a" */
+    expect("a/x", 1110);
+    expect("a/b/c", 11100);
+    expect("a/", 1110);         /* empty last level */
+    expect("z/", 1000);
+    expect("$SYS/x", 0);        /* wildcards skip $ topics */
+    expect("$SYS/x/c", 0);
+    CHECK(app_mqtt_router_register("a/#/b", 0, on_msg, NULL) == ESP_ERR_INVALID_ARG, "'#' not last accepted");
+    CHECK(app_mqtt_router_register("a+/b", 0, on_msg, NULL) == ESP_ERR_INVALID_ARG, "'+' inside a level accepted");
+    app_mqtt_router_unregister("#", on_msg, (void *)1000);
+    expect("a", 100);
+    app_mqtt_router_unregister("a/b", on_msg, (void *)1);
+    app_mqtt_router_unregister("a/+", on_msg, (void *)10);
+    app_mqtt_router_unregister("a/#", on_msg, (void *)100);
+    app_mqtt_router_unregister("+/+/c", on_msg, (void *)10000);
+
+    /* More matching handlers than the limit: the first MATCH_MAX run (and a warning is logged) */
+    for (int i = 0; i < MATCH_MAX + 3; i++) {
+        app_mqtt_router_register(i % 2 ? "many/+" : "many/x", 0, on_msg, (void *)1);
+    }
+    int called = dispatch("many/x");
+    CHECK(called == MATCH_MAX && s_hits == MATCH_MAX, "%d handlers matched: %d called, want %d",
+          MATCH_MAX + 3, called, MATCH_MAX);
+}
+
+static char s_payload[PAYLOAD_MAX];
+static char s_whole[PAYLOAD_MAX];
+static size_t s_whole_len;
+static int s_whole_calls;
+static char s_stream[PAYLOAD_MAX];
+static size_t s_stream_len;
+static int s_stream_done;
+
+static void on_whole(const app_mqtt_msg_t *msg, void *arg)
+{
+    (void)arg;
+    CHECK(msg->topic_len == 8 && memcmp(msg->topic, "cfg/big1", 8) == 0, "whole handler got topic %.*s",
+          (int)msg->topic_len, msg->topic);
+    s_whole_calls++;
+    s_whole_len = msg->data_len < sizeof(s_whole) ? msg->data_len : sizeof(s_whole);
+    memcpy(s_whole, msg->data, s_whole_len);
+}
+
+static void on_stream(const app_mqtt_msg_t *msg, void *arg)
+{
+    (void)arg;
+    CHECK(msg->topic_len == 8 && memcmp(msg->topic, "cfg/big", 7) == 0, "stream handler got topic %.*s",
+          (int)msg->topic_len, msg->topic);
+    if (msg->offset == 0) {
+        s_stream_len = 0;
+    }
+    CHECK(msg->offset == s_stream_len && msg->offset + msg->data_len <= sizeof(s_stream),
+          "chunk at %zu, expected %zu", msg->offset, s_stream_len);
+    if (msg->offset == s_stream_len && msg->offset + msg->data_len <= sizeof(s_stream)) {
+        memcpy(s_stream + msg->offset, msg->data, msg->data_len);
+        s_stream_len += msg->data_len;
+        s_stream_done += s_stream_len == msg->total_len;
+    }
+}
+
+/* Send len bytes of s_payload in EVENT_MAX events; returns how many handlers ran over all of them */
+static int send_fragmented(const char *topic, size_t len)
+{
+    static char event[EVENT_MAX];
+    int called = 0;
+    s_whole_calls = 0;
+    s_stream_len = 0;
+    s_stream_done = 0;
+    for (size_t off = 0; off < len; off += EVENT_MAX) {
+        size_t n = len - off < EVENT_MAX ? len - off : EVENT_MAX;
+        memcpy(event, s_payload + off, n);
+        called += app_mqtt_router_dispatch(off ? NULL : topic, off ? 0 : strlen(topic), event, n, off, len);
+    }
+    return called;
+}
+
+static void expect_fragmented(const char *what, const char *topic, size_t len, int whole, int stream)
+{
+    send_fragmented(topic, len);
+    CHECK(s_whole_calls == whole && (!whole || (s_whole_len == len && memcmp(s_whole, s_payload, len) == 0)),
+          "%s: whole handler called %d times with %zu B, want %d with %zu B", what, s_whole_calls,
+          s_whole_len, whole, len);
+    CHECK(s_stream_done == stream && (!stream || memcmp(s_stream, s_payload, len) == 0),
+          "%s: streamed %d complete messages, want %d", what, s_stream_done, stream);
+}
+
+static void reassembly(void)
+{
+    for (size_t i = 0; i < sizeof(s_payload); i++) {
+        s_payload[i] = (char)('a' + i % 26);
+    }
+    app_mqtt_route_opts_t whole = { .max_len = PAYLOAD_MAX }, stream = { .stream = true };
+    app_mqtt_router_register_ex("cfg/big1", 0, &whole, on_whole, NULL);
+    app_mqtt_router_register_ex("cfg/+", 0, &stream, on_stream, NULL);
+
+    /* The arena is allocated on the first fragmented message (two tries: PSRAM, then internal) */
+    host_heap_fail_next(2);
+    expect_fragmented("arena allocation failed", "cfg/big1", 5000, 0, 1);
+    expect_fragmented("5000 B", "cfg/big1", 5000, 1, 1);
+    expect_fragmented("arena allocated on retry", "cfg/big1", 3000, 1, 1);
+    expect_fragmented("20000 B, over the arena", "cfg/big1", PAYLOAD_MAX, 0, 1);
+    expect_fragmented("20000 B, streaming only", "cfg/big2", PAYLOAD_MAX, 0, 1);
+
+    /* A message cut off by a new one, then a chunk that does not follow on */
+    app_mqtt_router_dispatch("cfg/big1", 8, s_payload, EVENT_MAX, 0, 3 * EVENT_MAX);
+    expect_fragmented("after a cut-off message", "cfg/big1", 2500, 1, 1);
+    s_whole_calls = 0;
+    app_mqtt_router_dispatch("cfg/big1", 8, s_payload, EVENT_MAX, 0, 3 * EVENT_MAX);
+    app_mqtt_router_dispatch(NULL, 0, s_payload, EVENT_MAX, 2 * EVENT_MAX, 3 * EVENT_MAX);
+    CHECK(s_whole_calls == 0, "message with a gap delivered whole");
+
+    app_mqtt_router_unregister("cfg/big1", on_whole, NULL);
+    app_mqtt_router_unregister("cfg/+", on_stream, NULL);
+}
+
+/* The old mqtt_event_handler chain: one length check and strncmp per known topic */
+static char s_chain[256][64];
+static int s_chain_num;
+
+static size_t byte_strlen(const char *s)
+{
+    const char *p = s;
+    while (*p) {
+        p++;
+    }
+    return (size_t)(p - s);
+}
+
+static int byte_strncmp(const char *a, const char *b, size_t n)
+{
+    for (; n; n--, a++, b++) {
+        if (*a != *b) {
+            return (unsigned char)*a - (unsigned char)*b;
+        }
+        if (!*a) {
+            break;
+        }
+    }
+    return 0;
+}
+
+static void chain_dispatch(const char *topic, size_t len)
+{
+    for (int i = 0; i < s_chain_num; i++) {
+        if (len == byte_strlen(s_chain[i]) && byte_strncmp(topic, s_chain[i], len) == 0) {
+            on_msg(NULL, (void *)1);
+            return;
+        }
+    }
+}
+
+static void bench(int filters, const char *tag, int n)
+{
+    static const char *const kinds[] = { "temp", "hum", "gas", "motion", "state" };
+    s_chain_num = 0;
+    for (int i = 0; i < filters; i++) {
+        snprintf(s_chain[s_chain_num], sizeof(s_chain[0]), "fabacademy/%s/node%d/%s", tag, i / 5, kinds[i % 5]);
+        app_mqtt_router_register(s_chain[s_chain_num], 0, on_msg, (void *)1);
+        s_chain_num++;
+    }
+    char miss[64];
+    snprintf(miss, sizeof(miss), "fabacademy/%s/other/x", tag);
+    const char *const topics[] = { s_chain[0], s_chain[filters / 2], s_chain[filters - 1], miss };
+    const char *const what[] = { "first", "middle", "last", "no match" };
+    for (int k = 0; k < 4; k++) {
+        const char *t = topics[k];
+        size_t len = strlen(t);
+        expect(t, k < 3);
+        double t0 = now_ns();
+        for (int r = 0; r < n; r++) {
+            chain_dispatch(t, len);
+        }
+        double t1 = now_ns();
+        for (int r = 0; r < n; r++) {
+            app_mqtt_router_dispatch(t, len, "x", 1, 0, 1);
+        }
+        double chain = (t1 - t0) / n, trie = (now_ns() - t1) / n;
+        printf("%3d filters, %-8s | chain %7.1f ns  trie %6.1f ns\n", filters, what[k], chain, trie);
+        if (filters >= 200 && k >= 1) {
+            CHECK(trie < chain, "%d filters, %s topic: trie %.1f ns not faster than chain %.1f ns", filters,
+                  what[k], trie, chain);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (n < 1) {
+        n = 1;
+    }
+    semantics();
+    reassembly();
+    bench(10, "kavach", n);
+    bench(200, "kavach200", n);
+    if (!s_fail) {
+        printf("semantics and reassembly ok\n");
+    }
+    return s_fail;
+}
@@ -0,0 +1,439 @@
+/*
+ * MQTT connection supervisor: reconnect timing, persistent sessions and broker failover, with the real
+ * app_mqtt_supervisor.c and app_mqtt_router.c driving the TCP esp-mqtt stand-in (stubs/mqtt_client_tcp.c,
+ * which has esp-mqtt's own client task) against kbroker instances in this process. The event handler
+ * does what app_mqtt.c's does for these events. Backoff is scaled down (100 ms .. 2 s) so the run is
+ * short; the failover count is the default.
+ *
+ *   broker restart: the primary is stopped for 250 ms (less than FAILOVER_ATTEMPTS failures) and
+ *       started again without its sessions. The box must come back to it with a new session and
+ *       subscribe every filter again.
+ *   link drop: the client loses its socket while the broker stays up; a QoS 1 alert is published while
+ *       it is away. The box must resume the session without a single SUBSCRIBE and get the alert.
+ *   failover: the primary is stopped for good. After FAILOVER_ATTEMPTS failed attempts the next one
+ *       must go to the secondary, which then gets all filters; a later drop must stay on it.
+ *
+ * Every outage must show esp-mqtt's event order, each wait must lie in its backoff window (the first
+ * after a drop BACKOFF_MIN/2 .. BACKOFF_MIN, doubling per failure), the supervisor's outage and attempt
+ * counts must match the events, and the client task must still be running at the end (esp-mqtt ends it
+ * if auto reconnect is ever left off).
+ *
+ *   mqtt_supervisor_test
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "kbroker.h"
+#include "mqtt_client.h"
+#include "app_mqtt_router.h"
+#include "app_mqtt_supervisor.h"
+
+#define BACKOFF_MIN_MS      CONFIG_KAVACH_MQTT_BACKOFF_MIN_MS
+#define BACKOFF_MAX_MS      (CONFIG_KAVACH_MQTT_BACKOFF_MAX_SEC * 1000)
+#define FILTERS             4           /* registered as app_mqtt_start() does */
+#define RESTART_DOWN_MS     250
+#define WAIT_SLACK_MS       30          /* thread scheduling around each wait */
+#define CONNECT_TIMEOUT_MS  10000
+#define EVENTS_MAX          256
+#define GAS_TOPIC           "fabacademy/kavach/gas"
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+static int64_t now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+/* Brokers: each kbroker is polled by a thread of its own; a restart is a new one on the same port */
+typedef struct {
+    kbroker_t *kb;
+    pthread_t thread;
+    volatile bool stop;
+    uint16_t port;
+    char uri[48];
+} broker_t;
+
+static void *broker_loop(void *arg)
+{
+    broker_t *b = arg;
+    while (!b->stop) {
+        kbroker_poll(b->kb, 5);
+    }
+    return NULL;
+}
+
+static bool broker_start(broker_t *b)
+{
+    kbroker_config_t cfg;
+    kbroker_config_default(&cfg);
+    cfg.port = b->port;
+    if (kbroker_create(&cfg, &b->kb) != 0) {
+        return false;
+    }
+    b->port = kbroker_port(b->kb);
+    snprintf(b->uri, sizeof(b->uri), "mqtt://127.0.0.1:%u", (unsigned)b->port);
+    b->stop = false;
+    return pthread_create(&b->thread, NULL, broker_loop, b) == 0;
+}
+
+static void broker_stop(broker_t *b)
+{
+    if (!b->kb) {
+        return;
+    }
+    b->stop = true;
+    pthread_join(b->thread, NULL);
+    kbroker_destroy(b->kb);
+    b->kb = NULL;
+}
+
+static kbroker_stats_t broker_stats(broker_t *b)
+{
+    kbroker_stats_t st = { 0 };
+    if (b->kb) {
+        kbroker_get_stats(b->kb, &st);
+    }
+    return st;
+}
+
+/* Connection events as the client task delivered them, with their time */
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    int32_t id;
+    int64_t ms;
+} s_ev[EVENTS_MAX];
+static int s_ev_n;
+static esp_mqtt_client_handle_t s_client;
+static bool s_resumed;
+static int s_alerts;
+
+static int events_now(void)
+{
+    pthread_mutex_lock(&s_lock);
+    int n = s_ev_n;
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    (void)handler_args;
+    (void)base;
+    esp_mqtt_event_handle_t evt = event_data;
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_BEFORE_CONNECT:
+        app_mqtt_supervisor_before_connect();
+        break;
+    case MQTT_EVENT_CONNECTED: {
+        bool resumed = app_mqtt_supervisor_connected(evt && evt->session_present);
+        app_mqtt_router_connected(s_client, resumed);
+        pthread_mutex_lock(&s_lock);
+        s_resumed = resumed;
+        pthread_mutex_unlock(&s_lock);
+        break;
+    }
+    case MQTT_EVENT_DISCONNECTED:
+        app_mqtt_supervisor_disconnected();
+        app_mqtt_router_disconnected();
+        break;
+    case MQTT_EVENT_DATA:
+        app_mqtt_router_dispatch(evt->topic, evt->topic_len, evt->data, evt->data_len, evt->current_data_offset,
+                                 evt->total_data_len);
+        break;
+    default:
+        break;
+    }
+    if (event_id == MQTT_EVENT_BEFORE_CONNECT || event_id == MQTT_EVENT_CONNECTED ||
+        event_id == MQTT_EVENT_DISCONNECTED || event_id == MQTT_EVENT_ERROR) {
+        pthread_mutex_lock(&s_lock);
+        if (s_ev_n < EVENTS_MAX) {
+            s_ev[s_ev_n].id = event_id;
+            s_ev[s_ev_n].ms = now_ms();
+            s_ev_n++;
+        }
+        pthread_mutex_unlock(&s_lock);
+    }
+}
+
+static void on_gas(const app_mqtt_msg_t *msg, void *arg)
+{
+    (void)msg;
+    (void)arg;
+    pthread_mutex_lock(&s_lock);
+    s_alerts++;
+    pthread_mutex_unlock(&s_lock);
+}
+
+static void on_other(const app_mqtt_msg_t *msg, void *arg)
+{
+    (void)msg;
+    (void)arg;
+}
+
+static int alerts(void)
+{
+    pthread_mutex_lock(&s_lock);
+    int n = s_alerts;
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+static bool wait_for(bool (*cond)(void), int timeout_ms)
+{
+    int64_t end = now_ms() + timeout_ms;
+    while (!cond()) {
+        if (now_ms() > end) {
+            return false;
+        }
+        usleep(1000);
+    }
+    return true;
+}
+
+/* Connected and the handler done with MQTT_EVENT_CONNECTED (the router has subscribed) */
+static bool connected(void)
+{
+    pthread_mutex_lock(&s_lock);
+    bool handled = s_ev_n > 0 && s_ev[s_ev_n - 1].id == MQTT_EVENT_CONNECTED;
+    pthread_mutex_unlock(&s_lock);
+    return handled && host_mqtt_client_connected(s_client);
+}
+
+static bool resumed(void)
+{
+    pthread_mutex_lock(&s_lock);
+    bool r = s_resumed;
+    pthread_mutex_unlock(&s_lock);
+    return r;
+}
+
+static bool disconnected(void)
+{
+    return !host_mqtt_client_connected(s_client);
+}
+
+static int s_alerts_want;
+
+static bool alert_arrived(void)
+{
+    return alerts() >= s_alerts_want;
+}
+
+/* Upper end of the k-th wait of an outage (k = 0: after the drop, k: after the k-th failed attempt) */
+static int64_t window_ms(int k)
+{
+    int64_t cap = BACKOFF_MIN_MS;
+    while (k-- > 0 && cap < BACKOFF_MAX_MS) {
+        cap <<= 1;
+    }
+    return cap < BACKOFF_MAX_MS ? cap : BACKOFF_MAX_MS;
+}
+
+/*
+ * One outage from event `from`: DISCONNECTED, then (BEFORE_CONNECT ERROR DISCONNECTED) per failed
+ * attempt, BEFORE_CONNECT CONNECTED. Checks each wait against its window; returns the failed attempts
+ * (-1 if the order is wrong) and the outage as the events saw it.
+ */
+static int check_outage(const char *name, int from, int64_t *outage_ms)
+{
+    int n = events_now();
+    pthread_mutex_lock(&s_lock);
+    int i = from, failed = 0;
+    bool ok = i < n && s_ev[i].id == MQTT_EVENT_DISCONNECTED;
+    int64_t start = ok ? s_ev[i].ms : 0;
+    while (ok) {
+        int64_t wait = i + 1 < n ? s_ev[i + 1].ms - s_ev[i].ms : -1;
+        int64_t hi = window_ms(failed);
+        if (wait >= 0) {
+            printf("  %s: wait %d %3lld ms (window %lld .. %lld)\n", name, failed, (long long)wait,
+                   (long long)hi / 2, (long long)hi);
+        }
+        CHECK(wait >= hi / 2 - 2 && wait <= hi + WAIT_SLACK_MS, "%s: wait %d took %lld ms, window %lld .. %lld",
+              name, failed, (long long)wait, (long long)hi / 2, (long long)hi);
+        if (i + 2 < n && s_ev[i + 1].id == MQTT_EVENT_BEFORE_CONNECT && s_ev[i + 2].id == MQTT_EVENT_CONNECTED) {
+            *outage_ms = s_ev[i + 2].ms - start;
+            break;
+        }
+        ok = i + 3 < n && s_ev[i + 1].id == MQTT_EVENT_BEFORE_CONNECT && s_ev[i + 2].id == MQTT_EVENT_ERROR &&
+             s_ev[i + 3].id == MQTT_EVENT_DISCONNECTED;
+        i += 3;
+        failed++;
+    }
+    pthread_mutex_unlock(&s_lock);
+    CHECK(ok, "%s: events out of esp-mqtt's order", name);
+    return ok ? failed : -1;
+}
+
+/* The supervisor's view of the last outage against the events' */
+static void check_stats(const char *name, const app_mqtt_link_stats_t *before, int failed, int64_t outage_ms)
+{
+    app_mqtt_link_stats_t st;
+    app_mqtt_supervisor_get_stats(&st);
+    CHECK(st.outages == before->outages + 1 && st.connects == before->connects + 1 && st.connected,
+          "%s: %u outages, %u connects since the last scenario", name, (unsigned)(st.outages - before->outages),
+          (unsigned)(st.connects - before->connects));
+    CHECK(st.attempts - before->attempts == (uint32_t)failed + 1, "%s: supervisor counted %u attempts, events %d",
+          name, (unsigned)(st.attempts - before->attempts), failed + 1);
+    CHECK(st.last_outage_ms + 5 >= outage_ms && st.last_outage_ms <= outage_ms + 5,
+          "%s: supervisor outage %u ms, events %lld ms", name, (unsigned)st.last_outage_ms, (long long)outage_ms);
+    CHECK(host_mqtt_client_running(s_client), "%s: the client task ended", name);
+}
+
+static void publish_alert(broker_t *b)
+{
+    static const char alert[] = "{\"device\":\"gas_sensor\",\"gas\":620,\"state\":\"LEAK\"}";
+    CHECK(kbroker_publish(b->kb, GAS_TOPIC, alert, sizeof(alert) - 1, 1, false) == 0, "kbroker_publish failed");
+}
+
+int main(void)
+{
+    broker_t primary = { 0 }, secondary = { 0 };
+    if (!broker_start(&primary) || !broker_start(&secondary)) {
+        fprintf(stderr, "FAIL: could not start the brokers\n");
+        return 1;
+    }
+    printf("primary %s, secondary %s, backoff %d ms .. %d s, failover after %d attempts\n", primary.uri,
+           secondary.uri, BACKOFF_MIN_MS, CONFIG_KAVACH_MQTT_BACKOFF_MAX_SEC, CONFIG_KAVACH_MQTT_FAILOVER_ATTEMPTS);
+
+    esp_mqtt_client_config_t cfg = { .broker.address.uri = primary.uri };
+    app_mqtt_supervisor_config(&cfg);
+    s_client = esp_mqtt_client_init(&cfg);
+    if (!s_client) {
+        fprintf(stderr, "FAIL: esp_mqtt_client_init\n");
+        return 1;
+    }
+    app_mqtt_router_register("fabacademy/kavach/ping", 0, on_other, NULL);
+    app_mqtt_router_register(GAS_TOPIC, 1, on_gas, NULL);
+    app_mqtt_router_register("fabacademy/kavach/intruder", 1, on_other, NULL);
+    app_mqtt_router_register("fabacademy/kavach/trace/get", 0, on_other, NULL);
+    esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    if (app_mqtt_supervisor_start(s_client, &cfg, primary.uri, secondary.uri) != ESP_OK ||
+        esp_mqtt_client_start(s_client) != ESP_OK) {
+        fprintf(stderr, "FAIL: start\n");
+        return 1;
+    }
+    if (!wait_for(connected, CONNECT_TIMEOUT_MS)) {
+        fprintf(stderr, "FAIL: no initial connect\n");
+        return 1;
+    }
+    CHECK(host_mqtt_client_subscribes(s_client) == FILTERS, "initial connect: %u subscribes, want %d",
+          (unsigned)host_mqtt_client_subscribes(s_client), FILTERS);
+
+    /* Broker restart: back to the primary, new session, every filter again */
+    app_mqtt_link_stats_t before;
+    app_mqtt_supervisor_get_stats(&before);
+    uint32_t subs = host_mqtt_client_subscribes(s_client);
+    int from = events_now();
+    broker_stop(&primary);
+    usleep(RESTART_DOWN_MS * 1000);
+    if (!broker_start(&primary)) {
+        fprintf(stderr, "FAIL: could not restart the primary on port %u\n", (unsigned)primary.port);
+        return 1;
+    }
+    CHECK(wait_for(connected, CONNECT_TIMEOUT_MS), "restart: no reconnect");
+    int64_t outage = 0;
+    int failed = check_outage("restart", from, &outage);
+    check_stats("restart", &before, failed, outage);
+    app_mqtt_link_stats_t st;
+    app_mqtt_supervisor_get_stats(&st);
+    CHECK(st.broker == 0 && st.failovers == 0, "restart: moved to broker %u", (unsigned)st.broker);
+    CHECK(!resumed() && host_mqtt_client_subscribes(s_client) - subs == FILTERS,
+          "restart: %s session, %u subscribes, want a new one and %d", resumed() ? "resumed" : "new",
+          (unsigned)(host_mqtt_client_subscribes(s_client) - subs), FILTERS);
+    CHECK(outage <= RESTART_DOWN_MS + window_ms(failed) + WAIT_SLACK_MS, "restart: %lld ms offline for %d ms down",
+          (long long)outage, RESTART_DOWN_MS);
+    printf("broker restart: %d ms down, %lld ms offline, %d failed attempts, session new, %u subscribes\n",
+           RESTART_DOWN_MS, (long long)outage, failed, (unsigned)(host_mqtt_client_subscribes(s_client) - subs));
+
+    /* Link drop: the session and the subscriptions are still on the broker, the alert is queued there */
+    usleep(50 * 1000);
+    app_mqtt_supervisor_get_stats(&before);
+    subs = host_mqtt_client_subscribes(s_client);
+    from = events_now();
+    s_alerts_want = alerts() + 1;
+    host_mqtt_client_drop(s_client);
+    CHECK(wait_for(disconnected, 1000), "drop: still connected");
+    while (broker_stats(&primary).conns > 0) {
+        usleep(500);
+    }
+    bool away = disconnected();
+    publish_alert(&primary);
+    CHECK(away, "drop: reconnected before the broker saw the drop, the alert was not queued");
+    CHECK(wait_for(connected, CONNECT_TIMEOUT_MS), "drop: no reconnect");
+    failed = check_outage("drop", from, &outage);
+    check_stats("drop", &before, failed, outage);
+    CHECK(failed == 0, "drop: %d failed attempts with the broker up", failed);
+    CHECK(resumed(), "drop: session not resumed");
+    CHECK(wait_for(alert_arrived, 2000), "drop: the alert queued while away did not arrive");
+    CHECK(host_mqtt_client_subscribes(s_client) == subs, "drop: %u subscribes on a resumed session",
+          (unsigned)(host_mqtt_client_subscribes(s_client) - subs));
+    printf("link drop: %lld ms offline, session resumed, %u subscribes, queued alert delivered\n",
+           (long long)outage, (unsigned)(host_mqtt_client_subscribes(s_client) - subs));
+
+    /* Failover: FAILOVER_ATTEMPTS failures on the primary, then the secondary */
+    usleep(50 * 1000);
+    app_mqtt_supervisor_get_stats(&before);
+    subs = host_mqtt_client_subscribes(s_client);
+    uint32_t accepted = broker_stats(&secondary).accepted;
+    from = events_now();
+    broker_stop(&primary);
+    CHECK(wait_for(disconnected, 1000), "failover: the drop went unnoticed");
+    CHECK(wait_for(connected, CONNECT_TIMEOUT_MS), "failover: no connect");
+    failed = check_outage("failover", from, &outage);
+    check_stats("failover", &before, failed, outage);
+    app_mqtt_supervisor_get_stats(&st);
+    CHECK(failed == CONFIG_KAVACH_MQTT_FAILOVER_ATTEMPTS, "failover: %d failed attempts, want %d", failed,
+          CONFIG_KAVACH_MQTT_FAILOVER_ATTEMPTS);
+    CHECK(st.broker == 1 && st.failovers == 1 && strcmp(app_mqtt_supervisor_uri(), secondary.uri) == 0,
+          "failover: broker %u, %u failovers, uri %s", (unsigned)st.broker, (unsigned)st.failovers,
+          app_mqtt_supervisor_uri());
+    CHECK(broker_stats(&secondary).accepted - accepted == 1, "failover: %u connections to the secondary, want 1",
+          (unsigned)(broker_stats(&secondary).accepted - accepted));
+    CHECK(!resumed() && host_mqtt_client_subscribes(s_client) - subs == FILTERS,
+          "failover: %s session, %u subscribes, want a new one and %d", resumed() ? "resumed" : "new",
+          (unsigned)(host_mqtt_client_subscribes(s_client) - subs), FILTERS);
+    usleep(50 * 1000);
+    s_alerts_want = alerts() + 1;
+    publish_alert(&secondary);
+    CHECK(wait_for(alert_arrived, 2000), "failover: no alert from the secondary");
+    printf("failover: %lld ms offline, %d failed attempts on the primary, then the secondary, %u subscribes\n",
+           (long long)outage, failed, (unsigned)(host_mqtt_client_subscribes(s_client) - subs));
+
+    /* The box stays on the secondary while it answers, even with the primary back */
+    if (!broker_start(&primary)) {
+        fprintf(stderr, "FAIL: could not restart the primary on port %u\n", (unsigned)primary.port);
+        return 1;
+    }
+    app_mqtt_supervisor_get_stats(&before);
+    subs = host_mqtt_client_subscribes(s_client);
+    accepted = broker_stats(&primary).accepted;
+    from = events_now();
+    host_mqtt_client_drop(s_client);
+    CHECK(wait_for(disconnected, 1000), "stay: still connected");
+    CHECK(wait_for(connected, CONNECT_TIMEOUT_MS), "stay: no reconnect");
+    failed = check_outage("stay", from, &outage);
+    check_stats("stay", &before, failed, outage);
+    app_mqtt_supervisor_get_stats(&st);
+    CHECK(st.broker == 1 && broker_stats(&primary).accepted == accepted && resumed() &&
+          host_mqtt_client_subscribes(s_client) == subs,
+          "stay: broker %u, %u connections to the primary, session %s, %u subscribes", (unsigned)st.broker,
+          (unsigned)(broker_stats(&primary).accepted - accepted), resumed() ? "resumed" : "new",
+          (unsigned)(host_mqtt_client_subscribes(s_client) - subs));
+
+    app_mqtt_supervisor_get_stats(&st);
+    printf("stats: %u connects, %u attempts, %u resumed, %u failovers, %u outages, max %u ms, total %lu ms\n",
+           (unsigned)st.connects, (unsigned)st.attempts, (unsigned)st.resumed, (unsigned)st.failovers,
+           (unsigned)st.outages, (unsigned)st.max_outage_ms, (unsigned long)st.total_outage_ms);
+    esp_mqtt_client_destroy(s_client);
+    broker_stop(&primary);
+    broker_stop(&secondary);
+    printf("%s\n", s_fail ? "FAIL" : "OK");
+    return s_fail;
+}
@@ -0,0 +1,260 @@
+/*
+ * app_outbox across power cuts: no acknowledged-priority message is lost, whatever flash operation
+ * the power fails in.
+ *
+ * The workload queues messages through broker outages (nothing sent), reconnects (drain and PUBACK
+ * each message) and one dropped connection (in-flight messages reset), long enough to wrap the ring
+ * of sectors several times. A clean run counts its flash writes and erases; then, for every one of
+ * them, a child process runs the workload with the power cut in that operation (half applied), and a
+ * second child boots from the resulting flash and drains the outbox to the broker. The flash and the
+ * broker's receive counts live in shared memory, so they survive the "reboot".
+ *
+ * Fails if a normal- or high-priority message that app_outbox_put() accepted never reaches the broker,
+ * if a delivered payload differs from the one queued, or if the outbox takes no new messages after
+ * recovery. Sensor readings may be dropped by design and are only checked for integrity.
+ *
+ *   outbox_replay_test [stride]    test every stride-th cut point (default 1: all)
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "esp_partition.h"
+#include "app_outbox.h"
+
+#define SECTORS     4
+#define MSGS        600
+#define OUTAGE      100         /* messages queued per outage */
+#define ONLINE      20          /* messages sent per connected stretch */
+#define FRESH       (MSGS + 10) /* first index of the post-recovery messages */
+#define SENT_MAX    16
+
+typedef struct {
+    uint8_t flash[SECTORS * 4096];
+    uint8_t accepted[FRESH + 10];   /* put returned ESP_OK */
+    uint16_t received[FRESH + 10];  /* times the broker got the message */
+    uint32_t corrupt;               /* deliveries whose payload did not match */
+    long flash_ops;
+    app_outbox_stats_t stats;
+} shared_t;
+
+static shared_t *s_sh;
+static bool s_online;
+static int s_next_msg_id = 1;
+static int s_sent[SENT_MAX];
+static size_t s_sent_num;
+
+static app_outbox_prio_t msg_prio(int i)
+{
+    return i % 7 == 0 ? APP_OUTBOX_PRIO_HIGH : i % 3 == 0 ? APP_OUTBOX_PRIO_LOW : APP_OUTBOX_PRIO_NORMAL;
+}
+
+/* Payload of message i: its number, then filler so record sizes vary */
+static size_t msg_payload(int i, char *buf, size_t len)
+{
+    int n = snprintf(buf, len, "m%05d:", i);
+    size_t fill = 20 + (size_t)(i * 37) % 180;
+    for (size_t k = 0; k < fill && n + 1 < (int)len; k++) {
+        buf[n++] = (char)('a' + (i + k) % 26);
+    }
+    buf[n] = '\0';
+    return (size_t)n;
+}
+
+static int broker_send(const char *topic, const char *payload, size_t len, void *arg)
+{
+    (void)arg;
+    if (!s_online || s_sent_num == SENT_MAX) {
+        return -1;
+    }
+    int i = atoi(payload + 1);
+    char want[256];
+    size_t want_len = msg_payload(i, want, sizeof(want));
+    char want_topic[32];
+    snprintf(want_topic, sizeof(want_topic), "kavach/t%d", i % 5);
+    if (payload[0] != 'm' || i < 0 || i >= FRESH + 10 || len != want_len || memcmp(payload, want, len) ||
+            strcmp(topic, want_topic)) {
+        s_sh->corrupt++;
+        return -1;
+    }
+    s_sh->received[i]++;
+    s_sent[s_sent_num++] = s_next_msg_id;
+    return s_next_msg_id++;
+}
+
+/* Connected: publish everything pending, acknowledging each batch */
+static void drain_all(void)
+{
+    for (int rounds = 0; rounds < 1000; rounds++) {
+        s_sent_num = 0;
+        app_outbox_drain(broker_send, NULL);
+        if (s_sent_num == 0) {
+            return;
+        }
+        for (size_t k = 0; k < s_sent_num; k++) {
+            app_outbox_acked(s_sent[k]);
+        }
+    }
+}
+
+static void put(int i)
+{
+    char topic[32], payload[256];
+    snprintf(topic, sizeof(topic), "kavach/t%d", i % 5);
+    msg_payload(i, payload, sizeof(payload));
+    if (app_outbox_put(topic, payload, msg_prio(i)) == ESP_OK) {
+        s_sh->accepted[i] = 1;
+    }
+}
+
+static void workload(void)
+{
+    if (app_outbox_init() != ESP_OK) {
+        _exit(2);
+    }
+    for (int i = 0; i < MSGS; i++) {
+        int phase = i % (OUTAGE + ONLINE);
+        s_online = phase >= OUTAGE;
+        put(i);
+        if (!s_online) {
+            continue;
+        }
+        if (i % 97 == 0) {
+            /* Connection drops with messages in flight: no PUBACK, sent again after reconnecting */
+            s_sent_num = 0;
+            app_outbox_drain(broker_send, NULL);
+            app_outbox_reset_inflight();
+        }
+        drain_all();
+    }
+    s_online = true;
+    drain_all();
+    s_sh->flash_ops = host_flash_ops();
+    app_outbox_get_stats(&s_sh->stats);
+}
+
+/* Boot after the cut: replay the outbox, then check it still takes messages */
+static void recover(void)
+{
+    if (app_outbox_init() != ESP_OK) {
+        _exit(2);
+    }
+    s_online = true;
+    drain_all();
+    for (int i = FRESH; i < FRESH + 10; i++) {
+        put(i);
+    }
+    drain_all();
+}
+
+static int run_child(void (*fn)(void), long cut)
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        if (!getenv("KAVACH_HOST_VERBOSE")) {
+            freopen("/dev/null", "w", stderr);
+        }
+        host_partition_set("outbox", APP_OUTBOX_SUBTYPE, s_sh->flash, sizeof(s_sh->flash));
+        host_flash_cut_after(cut);
+        fn();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void reset_shared(void)
+{
+    memset(s_sh, 0, sizeof(*s_sh));     /* unformatted flash: the first init erases it */
+}
+
+/* Messages that must have reached the broker, and ones that did not */
+static int check(long cut, bool recovered, int *redelivered)
+{
+    int lost = 0;
+    for (int i = 0; i < FRESH + 10; i++) {
+        if (s_sh->received[i] > 1) {
+            (*redelivered)++;
+        }
+        if (s_sh->accepted[i] && !s_sh->received[i] && msg_prio(i) != APP_OUTBOX_PRIO_LOW) {
+            if (lost++ < 5) {
+                fprintf(stderr, "FAIL cut %ld: message %d (prio %d) accepted but never delivered\n",
+                        cut, i, msg_prio(i));
+            }
+        }
+    }
+    for (int i = FRESH; recovered && i < FRESH + 10; i++) {
+        if (!s_sh->accepted[i]) {
+            fprintf(stderr, "FAIL cut %ld: message %d not accepted after recovery\n", cut, i);
+            lost++;
+            break;
+        }
+    }
+    if (s_sh->corrupt) {
+        fprintf(stderr, "FAIL cut %ld: %u corrupt deliveries\n", cut, (unsigned)s_sh->corrupt);
+        lost++;
+    }
+    return lost;
+}
+
+int main(int argc, char **argv)
+{
+    long stride = argc > 1 ? atol(argv[1]) : 1;
+    if (stride < 1) {
+        stride = 1;
+    }
+    s_sh = mmap(NULL, sizeof(*s_sh), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (s_sh == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    reset_shared();
+    if (run_child(workload, 0) != 0) {
+        fprintf(stderr, "FAIL: clean run did not complete\n");
+        return 1;
+    }
+    int redelivered = 0;
+    int fail = check(0, false, &redelivered) > 0;
+    long ops = s_sh->flash_ops;
+    app_outbox_stats_t st = s_sh->stats;
+    printf("clean run: %d messages, %lu acked, %lu dropped (sensor), %lu erases of %d sectors, "
+           "%lu B queued -> %lu B written, %ld flash ops\n", MSGS, (unsigned long)st.acked,
+           (unsigned long)st.dropped, (unsigned long)st.erases, SECTORS, (unsigned long)st.bytes_queued,
+           (unsigned long)st.bytes_written, ops);
+    if (st.erases < 2 * SECTORS) {
+        fprintf(stderr, "FAIL: workload wrapped the ring only %lu erases\n", (unsigned long)st.erases);
+        fail = 1;
+    }
+
+    long tested = 0, failed = 0;
+    redelivered = 0;
+    for (long cut = 1; cut <= ops; cut += stride) {
+        reset_shared();
+        int status = run_child(workload, cut);
+        if (status != HOST_FLASH_CUT_EXIT) {
+            fprintf(stderr, "FAIL cut %ld: workload exited with %d\n", cut, status);
+            failed++;
+            continue;
+        }
+        if (run_child(recover, 0) != 0) {
+            fprintf(stderr, "FAIL cut %ld: recovery did not complete\n", cut);
+            failed++;
+            continue;
+        }
+        failed += check(cut, true, &redelivered) > 0;
+        tested++;
+    }
+    printf("power cuts: %ld tested, %ld with lost or corrupt messages, %d duplicate deliveries in total\n",
+           tested, failed, redelivered);
+    return fail || failed;
+}
@@ -0,0 +1,196 @@
+/*
+ * Prompt sources, pack vs. file: time to the first 48 kHz chunk and peak allocation per prompt.
+ *
+ * "pack" is the playback task's prompt pack path: app_prompt_pack_get() on a pack built from spiffs/
+ * by tools/prompt_pack.py (as main/CMakeLists.txt does), mapped through the esp_partition stand-in.
+ * "file" is the SPIFFS fallback: app_wav_stream_open() + the first app_wav_stream_read() of the same
+ * WAV. The mapping is plain memory here and the page cache is warm, so the times are lookup and decode
+ * cost, not flash access. The one-time app_prompt_pack_init() (index and CRC check) is reported apart.
+ *
+ * Fails if a prompt is missing from the pack, its first chunk differs from the file path's, the pack
+ * path allocates or is not faster than the file path, or init does not accept the pack.
+ *
+ *   prompt_pack_bench <prompts.bin> <spiffs dir> [runs]
+ */
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "app_prompt_pack.h"
+#include "app_wav_stream.h"
+
+#define PACK_PART_SIZE  (768 * 1024)    /* "prompts" in partitions.csv */
+#define NAME_MAX_LEN    64
+#define PROMPTS_MAX     16
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static const char *s_dir;
+static int16_t s_first[WAV_STREAM_BLOCK_SAMPLES * 6];
+static size_t s_first_n;
+static size_t s_chunk;      /* the pack has no blocks: a chunk is as long as the stream's first block */
+
+static int pack_first_chunk(const char *name)
+{
+    size_t samples = 0;
+    const int16_t *pcm = app_prompt_pack_get(name, &samples);
+    if (!pcm) {
+        return -1;
+    }
+    s_first_n = samples < s_chunk ? samples : s_chunk;
+    memcpy(s_first, pcm, s_first_n * sizeof(int16_t));
+    return 0;
+}
+
+static int file_first_chunk(const char *name)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", s_dir, name);
+    app_wav_stream_t *s;
+    if (app_wav_stream_open(path, &s) != ESP_OK) {
+        return -1;
+    }
+    const int16_t *pcm;
+    size_t n = app_wav_stream_read(s, &pcm);
+    memcpy(s_first, pcm, n * sizeof(int16_t));
+    s_first_n = n;
+    app_wav_stream_close(s);
+    return n ? 0 : -1;
+}
+
+typedef int (*first_fn_t)(const char *name);
+
+static bool measure(first_fn_t fn, const char *name, int runs, double *us, size_t *peak)
+{
+    host_heap_stats_t st;
+    host_heap_get(&st);
+    size_t base = st.in_use;
+    host_heap_reset_peak();
+    double best = 1e30;
+    for (int r = 0; r < runs; r++) {
+        double t0 = now_us();
+        if (fn(name) != 0) {
+            return false;
+        }
+        double dt = now_us() - t0;
+        best = dt < best ? dt : best;
+    }
+    host_heap_get(&st);
+    *us = best;
+    *peak = st.peak - base;
+    return true;
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <prompts.bin> <spiffs dir> [runs]\n", argv[0]);
+        return 2;
+    }
+    s_dir = argv[2];
+    int runs = argc > 3 ? atoi(argv[3]) : 20;
+    if (runs < 1) {
+        runs = 1;
+    }
+
+    /* The pack, flashed to the "prompts" partition (erased flash after it) */
+    static uint8_t flash[PACK_PART_SIZE];
+    memset(flash, 0xff, sizeof(flash));
+    FILE *f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    size_t pack_len = fread(flash, 1, sizeof(flash), f);
+    fclose(f);
+    host_partition_set("prompts", APP_PROMPT_PACK_SUBTYPE, flash, sizeof(flash));
+
+    char names[PROMPTS_MAX][NAME_MAX_LEN];
+    int count = 0;
+    DIR *d = opendir(s_dir);
+    if (!d) {
+        perror(s_dir);
+        return 1;
+    }
+    for (struct dirent *e; (e = readdir(d)) != NULL && count < PROMPTS_MAX;) {
+        size_t len = strlen(e->d_name);
+        if (len > 4 && len < NAME_MAX_LEN && strcmp(e->d_name + len - 4, ".wav") == 0) {
+            strcpy(names[count++], e->d_name);
+        }
+    }
+    closedir(d);
+    qsort(names, count, sizeof(names[0]), cmp_name);
+
+    host_heap_stats_t st;
+    host_heap_get(&st);
+    uint32_t allocs0 = st.allocs;
+    double t0 = now_us();
+    esp_err_t ret = app_prompt_pack_init();
+    double init_us = now_us() - t0;
+    host_heap_get(&st);
+    CHECK(ret == ESP_OK, "app_prompt_pack_init: %s", esp_err_to_name(ret));
+    CHECK(st.allocs == allocs0, "app_prompt_pack_init allocated %u times", (unsigned)(st.allocs - allocs0));
+    printf("pack: %zu bytes, %u prompts, init (index + CRC) %.0f us, 0 B heap\n", pack_len,
+           (unsigned)app_prompt_pack_count(), init_us);
+
+    /* Block buffers are allocated on the first open and kept: count them from a cold open */
+    host_heap_reset_peak();
+    if (count == 0 || file_first_chunk(names[0]) != 0) {
+        fprintf(stderr, "FAIL: no playable WAV in %s\n", s_dir);
+        return 1;
+    }
+    host_heap_get(&st);
+    size_t file_resident = st.peak;
+
+    printf("%-22s %-9s | %-11s %-10s | %-11s %-10s\n", "prompt", "length", "file TTFC", "file peak",
+           "pack TTFC", "pack peak");
+    for (int i = 0; i < count; i++) {
+        double t_file = 0, t_pack = 0;
+        size_t p_file = 0, p_pack = 0;
+        if (!measure(file_first_chunk, names[i], runs, &t_file, &p_file)) {
+            CHECK(false, "%s: file path failed", names[i]);
+            continue;
+        }
+        p_file += file_resident;
+        int16_t first[sizeof(s_first) / sizeof(s_first[0])];
+        size_t first_n = s_first_n;
+        s_chunk = first_n;
+        memcpy(first, s_first, first_n * sizeof(int16_t));
+        size_t samples = 0;
+        if (!app_prompt_pack_get(names[i], &samples)) {
+            CHECK(false, "%s: not in the pack", names[i]);
+            continue;
+        }
+        if (!measure(pack_first_chunk, names[i], runs, &t_pack, &p_pack)) {
+            CHECK(false, "%s: pack path failed", names[i]);
+            continue;
+        }
+        printf("%-22s %-6.2f s | %-8.2f us %-8zu B | %-8.2f us %-8zu B\n", names[i], samples / 48000.0, t_file,
+               p_file, t_pack, p_pack);
+        CHECK(s_first_n == first_n && memcmp(s_first, first, first_n * sizeof(int16_t)) == 0,
+              "%s: first chunk of the pack differs from the file path", names[i]);
+        CHECK(p_pack == 0, "%s: pack path allocated %zu B", names[i], p_pack);
+        CHECK(t_pack < t_file, "%s: pack %.2f us not faster than file %.2f us", names[i], t_pack, t_file);
+    }
+    printf("%s\n", s_fail ? "FAIL" : "OK");
+    return s_fail;
+}
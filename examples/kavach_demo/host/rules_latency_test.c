@@ -0,0 +1,387 @@
+/*
+ * Local rule engine: trigger-to-action latency, the rule semantics that latency depends on, that rule
+ * actions stay out of the voice trace, and that a rule action and a voice command publishing at the
+ * same time do not mix up their messages.
+ *
+ * A rule set is published to the update topic through the real router, as app_mqtt's MQTT_EVENT_DATA
+ * does, and its status reply is checked. Gas messages are then dispatched: below the threshold, above
+ * it, inside the cooldown of a second rule. Actions go through the real app_mqtt.c publish calls into
+ * the outbox stand-in here; each timed message runs from app_mqtt_router_dispatch() to the first
+ * action reaching it. p50/p99/max are printed next to the engine's own last_react_us/max_react_us.
+ *
+ * Two callers: an "MQTT task" thread dispatching gas messages (gas_valve OFF from the rule) and a
+ * "voice handler" thread publishing light1 ON, as app_sr_handler does, both through
+ * app_mqtt_publish_appliance_json_ex(). They take turns between formatting a payload and the outbox
+ * copying it, so the interleaving happens on every message, also on a single core. Every message each
+ * of them queues must be its own.
+ *
+ * Fails if the rule set is rejected, a rule fires when it should not (or not when it should), an action
+ * stamps the voice trace, dispatch allocates, the stats disagree with the messages sent, or one caller
+ * queues a payload that is not its own.
+ *
+ *   rules_latency_test [messages]
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#include "app_alert.h"
+#include "app_assets.h"
+#include "app_mqtt.h"
+#include "app_mqtt_router.h"
+#include "app_outbox.h"
+#include "app_rules.h"
+#include "app_telemetry.h"
+#include "app_trace.h"
+
+#define RULES_TOPIC "fabacademy/kavach/rules/set"
+#define GAS_TOPIC   "fabacademy/kavach/gas"
+#define VALVE_JSON  "{\"device\":\"gas_valve\",\"state\":\"OFF\"}"
+#define LIGHT_JSON  "{\"device\":\"light1\",\"state\":\"ON\"}"
+
+static const char s_rules[] =
+    "{\"rules\":["
+    "{\"name\":\"gas_valve\",\"on\":\"fabacademy/kavach/gas\","
+    "\"if\":[[\"state\",\"==\",\"LEAK\"],[\"gas\",\">=\",400]],"
+    "\"do\":[{\"appliance\":\"gas_valve\",\"state\":\"OFF\"},{\"help\":\"Gas leak, valve closed\"}],"
+    "\"cooldown\":0},"
+    "{\"name\":\"gas_ac\",\"on\":\"fabacademy/kavach/+\","
+    "\"if\":[[\"state\",\"==\",\"LEAK\"]],"
+    "\"do\":[{\"ir\":\"ac_off\"},{\"prompt\":\"echo_en_alerted\"}],"
+    "\"cooldown\":30}"
+    "]}";
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* What the actions drive, per thread (the two-caller case runs in threads of its own); the first one
+ * after a dispatch records the reaction time */
+static _Thread_local struct {
+    int appliance, help, ir_off, ir_on, prompts;
+    int traced;                 /* actions that asked for (or went through) a trace stamp */
+    int foreign;                /* appliance payloads that are not this thread's */
+    const char *appliance_json; /* what this thread's appliance messages must be */
+    int caller;                 /* two-caller case: 1 rule actions, 2 voice commands; 0 main thread */
+    bool ok_status;
+} s_n;
+
+static _Thread_local double s_t0, s_react_ns;
+
+static void acted(void)
+{
+    if (s_react_ns == 0) {
+        s_react_ns = now_ns() - s_t0;
+    }
+}
+
+/*
+ * The two callers take turns: each hands over inside the outbox call, after its payload was formatted
+ * and before it is copied, and runs on when the other has got that far too. A shared buffer would then
+ * be overwritten by the other caller every time, on one core as on two.
+ */
+static pthread_mutex_t s_turn_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_turn_cond = PTHREAD_COND_INITIALIZER;
+static int s_turn = 1;
+static int s_finished;
+
+static void take_turn(int me)
+{
+    pthread_mutex_lock(&s_turn_lock);
+    while (s_turn != me && !s_finished) {
+        pthread_cond_wait(&s_turn_cond, &s_turn_lock);
+    }
+    pthread_mutex_unlock(&s_turn_lock);
+}
+
+static void hand_over(int me)
+{
+    pthread_mutex_lock(&s_turn_lock);
+    s_turn = 3 - me;
+    pthread_cond_broadcast(&s_turn_cond);
+    pthread_mutex_unlock(&s_turn_lock);
+    take_turn(me);
+}
+
+static void finish_turns(int me)
+{
+    pthread_mutex_lock(&s_turn_lock);
+    s_finished++;
+    s_turn = 3 - me;
+    pthread_cond_broadcast(&s_turn_cond);
+    pthread_mutex_unlock(&s_turn_lock);
+}
+
+/* app_mqtt.c's publish calls queue here */
+esp_err_t app_outbox_put_bin(const char *topic, const void *payload, size_t len, app_outbox_prio_t prio)
+{
+    acted();
+    if (s_n.caller) {
+        hand_over(s_n.caller);
+    }
+    if (strcmp(topic, CONFIG_KAVACH_MQTT_TOPIC_APPLIANCES) == 0) {
+        const char *want = s_n.appliance_json ? s_n.appliance_json : VALVE_JSON;
+        s_n.foreign += len != strlen(want) || memcmp(payload, want, len) != 0;
+        s_n.appliance++;
+        CHECK(prio == APP_OUTBOX_PRIO_NORMAL, "appliance message at priority %d", (int)prio);
+    } else {
+        CHECK(strcmp(topic, CONFIG_KAVACH_MQTT_TOPIC_HELP) == 0 && len == strlen("Gas leak, valve closed") &&
+              memcmp(payload, "Gas leak, valve closed", len) == 0, "%s \"%.*s\"", topic, (int)len,
+              (const char *)payload);
+        s_n.help++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t app_outbox_put(const char *topic, const char *payload, app_outbox_prio_t prio)
+{
+    return app_outbox_put_bin(topic, payload, strlen(payload), prio);
+}
+
+void app_outbox_drain(app_outbox_send_fn send, void *arg)
+{
+    (void)send;
+    (void)arg;
+}
+
+void app_outbox_acked(int msg_id)
+{
+    (void)msg_id;
+}
+
+void app_outbox_reset_inflight(void)
+{
+}
+
+void app_trace_stamp(app_trace_stage_t stage)
+{
+    s_n.traced += stage == APP_TRACE_ACTION;
+}
+
+int app_trace_format_json(char *buf, size_t len)
+{
+    (void)buf;
+    (void)len;
+    return 0;
+}
+
+void app_trace_dump(void)
+{
+}
+
+/* Not started here: app_mqtt.c only refers to them */
+esp_err_t app_alert_init(app_alert_event_cb_t event_cb, void *arg)
+{
+    (void)event_cb;
+    (void)arg;
+    return ESP_OK;
+}
+
+void app_alert_report(app_alert_kind_t kind, const char *device, int32_t level)
+{
+    (void)kind;
+    (void)device;
+    (void)level;
+}
+
+void app_alert_clear(app_alert_kind_t kind, const char *device)
+{
+    (void)kind;
+    (void)device;
+}
+
+const char *app_alert_kind_name(app_alert_kind_t kind)
+{
+    (void)kind;
+    return "gas";
+}
+
+esp_err_t app_telemetry_start(app_telemetry_sink_t sink)
+{
+    (void)sink;
+    return ESP_OK;
+}
+
+void app_ir_send_ac_ex(bool on, bool trace)
+{
+    acted();
+    s_n.ir_on += on;
+    s_n.ir_off += !on;
+    s_n.traced += trace;
+}
+
+/* The voice command path: it stamps the trace, so rules must not use it */
+void app_ir_send_ac_on(void)
+{
+    s_n.traced++;
+    app_ir_send_ac_ex(true, true);
+}
+
+void app_ir_send_ac_off(void)
+{
+    s_n.traced++;
+    app_ir_send_ac_ex(false, true);
+}
+
+void sr_handler_play_asset(app_asset_id_t id)
+{
+    acted();
+    CHECK(id == APP_ASSET_ECHO_EN_OK + 1, "prompt %d", (int)id);
+    s_n.prompts++;
+}
+
+const char *app_assets_file_name(app_asset_id_t id)
+{
+    static const char *const names[APP_ASSET_MAX] = {
+        "beep.wav", "wake.wav", "gas_alarm.wav",
+        "echo_en_ok.wav", "echo_en_alerted.wav", "echo_en_calling.wav", "echo_en_help.wav",
+        "echo_cn_ok.wav", "echo_cn_alerted.wav", "echo_cn_calling.wav", "echo_cn_help.wav",
+    };
+    return (unsigned)id < APP_ASSET_MAX ? names[id] : NULL;
+}
+
+static esp_err_t status_sink(const char *json)
+{
+    printf("status: %s\n", json);
+    s_n.ok_status = strstr(json, "\"ok\":true") != NULL;
+    return ESP_OK;
+}
+
+/* One gas message; returns the number of handlers the router called */
+static int gas(const char *state, int level)
+{
+    char msg[96];
+    int len = snprintf(msg, sizeof(msg), "{\"device\":\"gas_sensor\",\"gas\":%d,\"state\":\"%s\"}", level, state);
+    s_react_ns = 0;
+    s_t0 = now_ns();
+    return app_mqtt_router_dispatch(GAS_TOPIC, strlen(GAS_TOPIC), msg, len, 0, len);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    bool rules;                 /* MQTT task (rule actions) or voice handler */
+    int calls;
+    int appliance, foreign, traced;
+} caller_t;
+
+static void *caller(void *arg)
+{
+    caller_t *c = arg;
+    s_n.appliance_json = c->rules ? VALVE_JSON : LIGHT_JSON;
+    s_n.caller = c->rules ? 1 : 2;
+    take_turn(s_n.caller);
+    for (int i = 0; i < c->calls; i++) {
+        if (c->rules) {
+            gas("LEAK", 500);
+        } else {
+            app_mqtt_publish_appliance_json("light1", "ON");
+        }
+    }
+    c->appliance = s_n.appliance;
+    c->foreign = s_n.foreign;
+    c->traced = s_n.traced;
+    finish_turns(s_n.caller);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 10000;
+    if (n < 100) {
+        n = 100;
+    }
+    if (app_rules_start(status_sink) != ESP_OK) {
+        fprintf(stderr, "FAIL: app_rules_start\n");
+        return 1;
+    }
+    size_t len = strlen(s_rules);
+    app_mqtt_router_dispatch(RULES_TOPIC, strlen(RULES_TOPIC), s_rules, len, 0, len);
+    CHECK(s_n.ok_status, "rule set rejected");
+
+    /* Semantics: the threshold, then both rules, then the cooldown of the second */
+    gas("OK", 100);
+    gas("LEAK", 300);
+    CHECK(s_n.appliance == 0 && s_n.help == 0, "gas_valve fired below 400");
+    CHECK(s_n.ir_off == 1 && s_n.prompts == 1, "gas_ac: %d ir, %d prompts after the first LEAK", s_n.ir_off,
+          s_n.prompts);
+    gas("LEAK", 500);
+    CHECK(s_n.appliance == 1 && s_n.help == 1, "gas_valve: %d appliance, %d help at 500", s_n.appliance, s_n.help);
+    CHECK(s_n.ir_off == 1 && s_n.prompts == 1, "gas_ac fired inside its cooldown");
+
+    /* Latency: dispatch to the first action. Every message fires gas_valve and is held back by gas_ac's
+     * cooldown; each of the two topics counts it as evaluated */
+    app_rules_stats_t before;
+    app_rules_get_stats(&before);
+    double *ns = malloc(n * sizeof(*ns));
+    if (!ns) {
+        return 1;
+    }
+    host_heap_stats_t h0, h1;
+    host_heap_get(&h0);
+    for (int i = 0; i < n; i++) {
+        gas("LEAK", 400 + i % 600);
+        ns[i] = s_react_ns;
+    }
+    host_heap_get(&h1);
+    app_rules_stats_t st;
+    app_rules_get_stats(&st);
+    qsort(ns, n, sizeof(*ns), cmp_double);
+    printf("trigger to action, %d messages | p50 %.2f us, p99 %.2f us, max %.2f us | engine: last %u us, "
+           "max %u us\n", n, ns[n / 2] / 1e3, ns[n * 99 / 100] / 1e3, ns[n - 1] / 1e3,
+           (unsigned)st.last_react_us, (unsigned)st.max_react_us);
+    free(ns);
+
+    CHECK(s_n.appliance == n + 1 && s_n.help == n + 1, "gas_valve fired %d of %d times", s_n.appliance - 1, n);
+    CHECK(st.fired - before.fired == (uint32_t)n && st.messages - before.messages == 2u * n &&
+          st.suppressed - before.suppressed == (uint32_t)n,
+          "stats: %u evaluated, %u fired, %u suppressed of %d messages", (unsigned)(st.messages - before.messages), (unsigned)(st.fired - before.fired),
+          (unsigned)(st.suppressed - before.suppressed), n);
+    CHECK(st.malformed == 0 && st.updates == 1 && st.rules == 2, "stats: %u malformed, %u updates, %u rules",
+          (unsigned)st.malformed, (unsigned)st.updates, (unsigned)st.rules);
+    CHECK(h1.allocs == h0.allocs, "%u heap_caps allocations during dispatch", (unsigned)(h1.allocs - h0.allocs));
+    CHECK(s_n.traced == 0, "%d actions stamped the voice trace", s_n.traced);
+    CHECK(s_n.foreign == 0, "%d appliance messages from the rules were not gas_valve OFF", s_n.foreign);
+    if (!s_fail) {
+        printf("semantics ok, no trace stamps from rule actions\n");
+    }
+
+    /* Two callers at once: rule actions on the MQTT task, voice commands on the voice handler */
+    caller_t callers[2] = { { .rules = true, .calls = n }, { .rules = false, .calls = n } };
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++) {
+        if (pthread_create(&threads[i], NULL, caller, &callers[i]) != 0) {
+            fprintf(stderr, "FAIL: pthread_create\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < 2; i++) {
+        const caller_t *c = &callers[i];
+        const char *name = c->rules ? "rule actions" : "voice commands";
+        CHECK(c->appliance == n && c->foreign == 0, "%s: %d of %d appliance messages were the other caller's",
+              name, c->foreign, c->appliance);
+        CHECK(c->traced == (c->rules ? 0 : n), "%s: %d trace stamps for %d messages", name, c->traced, n);
+    }
+    if (!s_fail) {
+        printf("two callers, %d appliance messages each: none mixed up\n", n);
+    }
+    return s_fail;
+}
@@ -0,0 +1,204 @@
+/*
+ * Voice command lookup, generated flash table vs. the per-command heap list it replaced.
+ *
+ * "list" is the old lang_ctx bookkeeping: one heap_caps_calloc'd node (sr_cmd_t plus its SLIST link)
+ * per command, searched by walking the list. "table" is sr_cmd_table.c as app_sr.c now uses it: the
+ * id -> command index it allocates per loaded language, and the perfect-hash phoneme lookup.
+ *
+ * Checks that every built-in phoneme hashes to its own id and unknown phonemes miss; fails if the table
+ * lookups are not faster than the list walks or the table allocates more than the list did.
+ *
+ *   sr_cmd_table_bench [lookups]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/queue.h>
+#include "sdkconfig.h"
+#include "esp_heap_caps.h"
+#include "sr_cmd_table.h"
+
+#define OVERLAY_MAX CONFIG_KAVACH_SR_CMD_OVERLAY_MAX
+
+typedef struct node {
+    sr_cmd_t cmd;
+    SLIST_ENTRY(node) next;
+} node_t;
+
+typedef SLIST_HEAD(node_list, node) node_list_t;
+
+static volatile int s_sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* The removed lang_ctx load: append every command as its own node */
+static void list_load(node_list_t *list, const sr_cmd_table_t *t)
+{
+    node_t *last = NULL;
+    SLIST_INIT(list);
+    for (uint16_t i = 0; i < t->num; i++) {
+        node_t *n = heap_caps_calloc(1, sizeof(*n), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!n) {
+            exit(1);
+        }
+        n->cmd = t->cmds[i];
+        if (last) {
+            SLIST_INSERT_AFTER(last, n, next);
+        } else {
+            SLIST_INSERT_HEAD(list, n, next);
+        }
+        last = n;
+    }
+}
+
+static void list_free(node_list_t *list)
+{
+    while (!SLIST_EMPTY(list)) {
+        node_t *n = SLIST_FIRST(list);
+        SLIST_REMOVE_HEAD(list, next);
+        heap_caps_free(n);
+    }
+}
+
+/* lang_ctx_load() now: only the id index, sized for the runtime overlay too */
+static const sr_cmd_t **index_load(const sr_cmd_table_t *t)
+{
+    const sr_cmd_t **by_id = heap_caps_calloc(t->num + OVERLAY_MAX, sizeof(by_id[0]), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!by_id) {
+        exit(1);
+    }
+    for (uint16_t i = 0; i < t->num; i++) {
+        by_id[i] = &t->cmds[i];
+    }
+    return by_id;
+}
+
+static int check_table(const char *name, const sr_cmd_table_t *t)
+{
+    int fail = 0;
+    for (uint16_t i = 0; i < t->num; i++) {
+        if (t->cmds[i].id != i) {
+            fprintf(stderr, "FAIL %s: cmds[%u].id = %u\n", name, i, (unsigned)t->cmds[i].id);
+            fail = 1;
+        }
+        int id = sr_cmd_table_find(t, t->cmds[i].phoneme);
+        if (id != i) {
+            fprintf(stderr, "FAIL %s: \"%s\" -> %d, want %u\n", name, t->cmds[i].phoneme, id, i);
+            fail = 1;
+        }
+    }
+    static const char *const miss[] = { "", "zzz", "da kai kong", "turn on the lights please" };
+    for (size_t i = 0; i < sizeof(miss) / sizeof(miss[0]); i++) {
+        if (sr_cmd_table_find(t, miss[i]) != -1) {
+            fprintf(stderr, "FAIL %s: unknown phoneme \"%s\" found\n", name, miss[i]);
+            fail = 1;
+        }
+    }
+    return fail;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 2000000;
+    if (n < 1) {
+        n = 1;
+    }
+    static const char *const lang_name[SR_LANG_MAX] = { "EN", "CN" };
+    int fail = 0;
+    for (int l = 0; l < SR_LANG_MAX; l++) {
+        fail |= check_table(lang_name[l], &g_sr_cmd_table[l]);
+    }
+
+    /* Memory with both languages loaded */
+    host_heap_stats_t st;
+    node_list_t list[SR_LANG_MAX];
+    host_heap_reset_peak();
+    for (int l = 0; l < SR_LANG_MAX; l++) {
+        list_load(&list[l], &g_sr_cmd_table[l]);
+    }
+    host_heap_get(&st);
+    size_t list_bytes = st.peak, list_allocs = st.allocs;
+    const sr_cmd_t **by_id[SR_LANG_MAX];
+    host_heap_reset_peak();
+    size_t base = st.in_use;
+    for (int l = 0; l < SR_LANG_MAX; l++) {
+        by_id[l] = index_load(&g_sr_cmd_table[l]);
+    }
+    host_heap_get(&st);
+    size_t table_bytes = st.peak - base, table_allocs = st.allocs;
+    size_t flash = 0;
+    for (int l = 0; l < SR_LANG_MAX; l++) {
+        const sr_cmd_table_t *t = &g_sr_cmd_table[l];
+        flash += t->num * sizeof(sr_cmd_t) + t->buckets * sizeof(t->seed[0]) + t->num * sizeof(t->slot_id[0]);
+    }
+    printf("commands: EN %u, CN %u\n", g_sr_cmd_table[SR_LANG_EN].num, g_sr_cmd_table[SR_LANG_CN].num);
+    printf("heap, both languages: list %zu B in %zu allocations, table %zu B in %zu (flash table %zu B)\n",
+           list_bytes, list_allocs, table_bytes, table_allocs, flash);
+    if (table_bytes >= list_bytes) {
+        fprintf(stderr, "FAIL: table index (%zu B) not smaller than the list (%zu B)\n", table_bytes, list_bytes);
+        fail = 1;
+    }
+
+    /* Lookup time, in the larger language */
+    int l = g_sr_cmd_table[SR_LANG_CN].num > g_sr_cmd_table[SR_LANG_EN].num ? SR_LANG_CN : SR_LANG_EN;
+    const sr_cmd_table_t *t = &g_sr_cmd_table[l];
+    double t0, id_list, id_table, ph_list, ph_table;
+
+    t0 = now_ns();
+    for (int k = 0; k < n; k++) {
+        uint32_t id = (uint32_t)k % t->num;
+        node_t *it;
+        SLIST_FOREACH(it, &list[l], next) {
+            if (it->cmd.id == id) {
+                break;
+            }
+        }
+        s_sink += it->cmd.cmd;
+    }
+    id_list = (now_ns() - t0) / n;
+
+    t0 = now_ns();
+    for (int k = 0; k < n; k++) {
+        s_sink += by_id[l][k % t->num]->cmd;
+    }
+    id_table = (now_ns() - t0) / n;
+
+    /* app_sr_search_cmd_from_phoneme(): the list version compared every node */
+    t0 = now_ns();
+    for (int k = 0; k < n; k++) {
+        const char *p = t->cmds[k % t->num].phoneme;
+        node_t *it;
+        int hits = 0;
+        SLIST_FOREACH(it, &list[l], next) {
+            hits += 0 == strcmp(p, it->cmd.phoneme);
+        }
+        s_sink += hits;
+    }
+    ph_list = (now_ns() - t0) / n;
+
+    t0 = now_ns();
+    for (int k = 0; k < n; k++) {
+        s_sink += sr_cmd_table_find(t, t->cmds[k % t->num].phoneme);
+    }
+    ph_table = (now_ns() - t0) / n;
+
+    printf("%s lookup (%d each) | %-10s %-10s\n", lang_name[l], n, "list", "table");
+    printf("  by id             | %7.1f ns %7.1f ns\n", id_list, id_table);
+    printf("  by phoneme        | %7.1f ns %7.1f ns\n", ph_list, ph_table);
+    if (id_table >= id_list || ph_table >= ph_list) {
+        fprintf(stderr, "FAIL: table lookup not faster than the list walk\n");
+        fail = 1;
+    }
+
+    for (int i = 0; i < SR_LANG_MAX; i++) {
+        list_free(&list[i]);
+        heap_caps_free(by_id[i]);
+    }
+    return fail;
+}
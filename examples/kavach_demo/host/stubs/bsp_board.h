@@ -0,0 +1,12 @@
+/* Host stand-in for bsp_board.h: the sensor property the telemetry module reads; the test provides it. */
+#pragma once
+
+#include "esp_err.h"
+
+typedef esp_err_t (*bsp_bottom_get_humiture)(float *temperature, float *humidity);
+
+typedef struct {
+    bsp_bottom_get_humiture get_humiture;
+} bsp_bottom_property_t;
+
+bsp_bottom_property_t *bsp_board_get_sensor_handle(void);
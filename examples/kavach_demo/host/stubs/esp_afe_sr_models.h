@@ -0,0 +1,8 @@
+/* Host stand-in for esp-sr's esp_afe_sr_models.h: only the wake word state app_sr.h uses. */
+#pragma once
+
+typedef enum {
+    WAKENET_NO_DETECT = 0,
+    WAKENET_CHANNEL_VERIFIED = -2,
+    WAKENET_DETECTED = 1,
+} wakenet_state_t;
@@ -0,0 +1,34 @@
+/*
+ * Host stand-in for esp_heap_caps.h. Every allocation is counted (host_heap_*), so tests can report
+ * peak use and allocation counts of the code under test; capabilities are ignored.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+typedef struct {
+    size_t in_use;          /* bytes currently allocated */
+    size_t peak;            /* largest in_use since the last host_heap_reset_peak() */
+    size_t allocs;          /* heap_caps_malloc/calloc/realloc calls that returned memory */
+    size_t frees;
+} host_heap_stats_t;
+
+void host_heap_get(host_heap_stats_t *out);
+/** Restart peak tracking at the current use and zero the call counters. */
+void host_heap_reset_peak(void);
+/** Make the next n allocations fail (0: none), to exercise out-of-memory paths. */
+void host_heap_fail_next(int n);
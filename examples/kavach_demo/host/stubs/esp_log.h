@@ -0,0 +1,16 @@
+/* Host stand-in for esp_log.h: W/E always, I/D/V only with KAVACH_HOST_VERBOSE set in the environment. */
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+bool host_log_verbose(void);
+
+#define HOST_LOG(l, tag, fmt, ...)  fprintf(stderr, l " (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...)     HOST_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)     HOST_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)     do { if (host_log_verbose()) HOST_LOG("I", tag, fmt, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, fmt, ...)     do { if (host_log_verbose()) HOST_LOG("D", tag, fmt, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, fmt, ...)     do { if (host_log_verbose()) HOST_LOG("V", tag, fmt, ##__VA_ARGS__); } while (0)
+#define ESP_ERROR_CHECK(x)          do { esp_err_t err_ = (x); if (err_) { HOST_LOG("E", "check", "%s", #x); abort(); } } while (0)
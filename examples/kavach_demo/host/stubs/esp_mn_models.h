@@ -0,0 +1,8 @@
+/* Host stand-in for esp-sr's esp_mn_models.h: only the command state app_sr.h uses. */
+#pragma once
+
+typedef enum {
+    ESP_MN_STATE_DETECTING = 0,
+    ESP_MN_STATE_DETECTED = 1,
+    ESP_MN_STATE_TIMEOUT = 2,
+} esp_mn_state_t;
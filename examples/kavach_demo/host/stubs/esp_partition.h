@@ -0,0 +1,52 @@
+/*
+ * Host stand-in for esp_partition.h: one data partition backed by memory the test provides, with NOR
+ * semantics (writes only clear bits, erase sets 4 KB sectors to 0xff). host_flash_cut_after() simulates
+ * a power cut: the n-th write or erase from then on is applied only half way and the process exits.
+ * esp_partition_mmap() returns that memory directly, as the flash cache mapping does on the target.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0,
+    ESP_PARTITION_TYPE_DATA = 1,
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    uint32_t erase_size;
+    char label[17];
+} esp_partition_t;
+
+typedef enum {
+    ESP_PARTITION_MMAP_DATA,
+    ESP_PARTITION_MMAP_INST,
+} esp_partition_mmap_memory_t;
+
+typedef uint32_t esp_partition_mmap_handle_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size);
+esp_err_t esp_partition_mmap(const esp_partition_t *part, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle);
+void esp_partition_munmap(esp_partition_mmap_handle_t handle);
+
+#define HOST_FLASH_CUT_EXIT     42      /* exit status of a process stopped by host_flash_cut_after() */
+
+/** Back the data partition label/subtype with mem (size bytes, a multiple of 4 KB). */
+void host_partition_set(const char *label, esp_partition_subtype_t subtype, void *mem, size_t size);
+/** Cut power at the n-th flash write or erase from now (0: never). */
+void host_flash_cut_after(long n);
+/** Writes and erases since the partition was set. */
+long host_flash_ops(void);
@@ -0,0 +1,6 @@
+/* Host stand-in for esp_rom_crc.h: the ROM's little-endian CRC-32 (same results as zlib's crc32()). */
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,43 @@
+/*
+ * Host stand-in for esp_timer.h. esp_timer_get_time() is the monotonic clock, or a manual clock
+ * after host_time_set() so tests can step time. Timers are recorded but never fire on their own:
+ * tests run them with host_timer_fire().
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+int64_t esp_timer_get_time(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+bool esp_timer_is_active(esp_timer_handle_t timer);
+
+/** Switch esp_timer_get_time() to a manual clock at us. */
+void host_time_set(int64_t us);
+/** Advance the manual clock. */
+void host_time_advance(int64_t us);
+/** Run the callback of the named timer if it is active (a one-shot timer stops first). Returns true if run. */
+bool host_timer_fire(const char *name);
+/** Period or timeout (us) the named timer was last started with; 0 if not active. */
+uint64_t host_timer_period(const char *name);
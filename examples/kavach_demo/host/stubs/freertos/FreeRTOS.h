@@ -0,0 +1,25 @@
+/* Host stand-in for the FreeRTOS pieces the app modules use: critical sections are pthread mutexes. */
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"     /* as FreeRTOSConfig.h does on the target */
+
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(mux)
+#define portENTER_CRITICAL_ISR(mux)     pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL_ISR(mux)      pthread_mutex_unlock(mux)
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define pdFAIL              0
+#define portMAX_DELAY       0xffffffffu
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
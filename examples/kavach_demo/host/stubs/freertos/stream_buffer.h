@@ -0,0 +1,17 @@
+/*
+ * Host stand-in for freertos/stream_buffer.h: a byte ring behind a mutex. Calls never block (the app
+ * modules only use a zero timeout); a send stores as many bytes as fit, a receive returns what is there.
+ */
+#pragma once
+
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_stream_buffer *StreamBufferHandle_t;
+
+StreamBufferHandle_t xStreamBufferCreate(size_t size, size_t trigger_level);
+size_t xStreamBufferSend(StreamBufferHandle_t sb, const void *data, size_t len, TickType_t ticks);
+size_t xStreamBufferReceive(StreamBufferHandle_t sb, void *data, size_t len, TickType_t ticks);
+BaseType_t xStreamBufferReset(StreamBufferHandle_t sb);
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t sb);
+void vStreamBufferDelete(StreamBufferHandle_t sb);
@@ -0,0 +1,4 @@
+/* Host stand-in for freertos/task.h: the types come from FreeRTOS.h. */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
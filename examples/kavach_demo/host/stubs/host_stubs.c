@@ -0,0 +1,615 @@
+/* Host implementations behind the stand-in ESP-IDF headers in this folder. */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "nvs.h"
+
+const char *esp_err_to_name(esp_err_t err)
+{
+    static char buf[16];
+    snprintf(buf, sizeof(buf), "0x%x", (unsigned)err);
+    return err == ESP_OK ? "ESP_OK" : buf;
+}
+
+#if HOST_NEED_STRLCPY
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+bool host_log_verbose(void)
+{
+    static int verbose = -1;
+    if (verbose < 0) {
+        verbose = getenv("KAVACH_HOST_VERBOSE") != NULL;
+    }
+    return verbose;
+}
+
+/* Each block is prefixed with its size so frees can be accounted */
+typedef struct {
+    size_t size;
+    size_t pad;                 /* keep the payload 16-byte aligned */
+} heap_hdr_t;
+
+static host_heap_stats_t s_heap;
+static int s_fail_next;
+
+static void *heap_account(heap_hdr_t *h, size_t size)
+{
+    if (!h) {
+        return NULL;
+    }
+    h->size = size;
+    s_heap.in_use += size;
+    s_heap.allocs++;
+    if (s_heap.in_use > s_heap.peak) {
+        s_heap.peak = s_heap.in_use;
+    }
+    return h + 1;
+}
+
+static bool heap_should_fail(void)
+{
+    if (s_fail_next > 0) {
+        s_fail_next--;
+        return true;
+    }
+    return false;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    if (heap_should_fail()) {
+        return NULL;
+    }
+    return heap_account(malloc(sizeof(heap_hdr_t) + size), size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    (void)caps;
+    if (heap_should_fail()) {
+        return NULL;
+    }
+    return heap_account(calloc(1, sizeof(heap_hdr_t) + n * size), n * size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    heap_hdr_t *h = (heap_hdr_t *)ptr - 1;
+    s_heap.in_use -= h->size;
+    s_heap.frees++;
+    free(h);
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    if (!ptr) {
+        return heap_caps_malloc(size, caps);
+    }
+    if (heap_should_fail()) {
+        return NULL;
+    }
+    heap_hdr_t *h = (heap_hdr_t *)ptr - 1;
+    size_t old = h->size;
+    heap_hdr_t *n = realloc(h, sizeof(heap_hdr_t) + size);
+    if (!n) {
+        return NULL;
+    }
+    s_heap.in_use -= old;
+    s_heap.frees++;
+    return heap_account(n, size);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return 8u << 20;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void)caps;
+    return 4u << 20;
+}
+
+void host_heap_get(host_heap_stats_t *out)
+{
+    *out = s_heap;
+}
+
+void host_heap_reset_peak(void)
+{
+    s_heap.peak = s_heap.in_use;
+    s_heap.allocs = 0;
+    s_heap.frees = 0;
+}
+
+void host_heap_fail_next(int n)
+{
+    s_fail_next = n;
+}
+
+static bool s_manual_time;
+static int64_t s_now_us;
+
+int64_t esp_timer_get_time(void)
+{
+    if (s_manual_time) {
+        return s_now_us;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void host_time_set(int64_t us)
+{
+    s_manual_time = true;
+    s_now_us = us;
+}
+
+void host_time_advance(int64_t us)
+{
+    s_manual_time = true;
+    s_now_us += us;
+}
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    uint64_t period_us;
+    bool active;
+    bool periodic;
+    struct esp_timer *next;
+};
+
+static struct esp_timer *s_timers;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    struct esp_timer *t = calloc(1, sizeof(*t));
+    if (!t) {
+        return ESP_ERR_NO_MEM;
+    }
+    t->args = *args;
+    t->next = s_timers;
+    s_timers = t;
+    *out_handle = t;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t t, uint64_t us, bool periodic)
+{
+    if (t->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->period_us = us;
+    t->periodic = periodic;
+    t->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return timer_start(timer, period_us, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    for (struct esp_timer **p = &s_timers; *p; p = &(*p)->next) {
+        if (*p == timer) {
+            *p = timer->next;
+            free(timer);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->active;
+}
+
+static struct esp_timer *timer_by_name(const char *name)
+{
+    for (struct esp_timer *t = s_timers; t; t = t->next) {
+        if (t->args.name && strcmp(t->args.name, name) == 0) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+bool host_timer_fire(const char *name)
+{
+    struct esp_timer *t = timer_by_name(name);
+    if (!t || !t->active) {
+        return false;
+    }
+    if (!t->periodic) {
+        t->active = false;
+    }
+    t->args.callback(t->args.arg);
+    return true;
+}
+
+uint64_t host_timer_period(const char *name)
+{
+    struct esp_timer *t = timer_by_name(name);
+    return t && t->active ? t->period_us : 0;
+}
+
+#define FLASH_SECTOR    4096
+
+static esp_partition_t s_part;
+static uint8_t *s_flash;
+static long s_flash_ops;
+static long s_flash_cut;
+
+void host_partition_set(const char *label, esp_partition_subtype_t subtype, void *mem, size_t size)
+{
+    s_part = (esp_partition_t) {
+        .type = ESP_PARTITION_TYPE_DATA, .subtype = subtype, .size = (uint32_t)size, .erase_size = FLASH_SECTOR,
+    };
+    snprintf(s_part.label, sizeof(s_part.label), "%s", label);
+    s_flash = mem;
+    s_flash_ops = 0;
+    s_flash_cut = 0;
+}
+
+void host_flash_cut_after(long n)
+{
+    s_flash_cut = n > 0 ? s_flash_ops + n : 0;
+}
+
+long host_flash_ops(void)
+{
+    return s_flash_ops;
+}
+
+/* Count a write or erase; true if power fails during it */
+static bool flash_op_cut(void)
+{
+    return ++s_flash_ops == s_flash_cut;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    if (!s_flash || type != s_part.type || subtype != s_part.subtype || (label && strcmp(label, s_part.label))) {
+        return NULL;
+    }
+    return &s_part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, s_flash + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    bool cut = flash_op_cut();
+    size_t n = cut ? size / 2 : size;
+    for (size_t i = 0; i < n; i++) {
+        s_flash[offset + i] &= ((const uint8_t *)src)[i];
+    }
+    if (cut) {
+        _exit(HOST_FLASH_CUT_EXIT);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (offset % FLASH_SECTOR || size % FLASH_SECTOR || offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool cut = flash_op_cut();
+    memset(s_flash + offset, 0xff, cut ? size / 2 : size);
+    if (cut) {
+        _exit(HOST_FLASH_CUT_EXIT);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *part, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle)
+{
+    (void)memory;
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *out_ptr = s_flash + offset;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle)
+{
+    (void)handle;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+struct host_stream_buffer {
+    pthread_mutex_t lock;
+    size_t size, head, used;    /* head: next byte to receive */
+    uint8_t data[];
+};
+
+StreamBufferHandle_t xStreamBufferCreate(size_t size, size_t trigger_level)
+{
+    (void)trigger_level;
+    StreamBufferHandle_t sb = calloc(1, sizeof(*sb) + size);
+    if (sb) {
+        pthread_mutex_init(&sb->lock, NULL);
+        sb->size = size;
+    }
+    return sb;
+}
+
+size_t xStreamBufferSend(StreamBufferHandle_t sb, const void *data, size_t len, TickType_t ticks)
+{
+    (void)ticks;
+    pthread_mutex_lock(&sb->lock);
+    size_t n = len < sb->size - sb->used ? len : sb->size - sb->used;
+    for (size_t i = 0; i < n; i++) {
+        sb->data[(sb->head + sb->used + i) % sb->size] = ((const uint8_t *)data)[i];
+    }
+    sb->used += n;
+    pthread_mutex_unlock(&sb->lock);
+    return n;
+}
+
+size_t xStreamBufferReceive(StreamBufferHandle_t sb, void *data, size_t len, TickType_t ticks)
+{
+    (void)ticks;
+    pthread_mutex_lock(&sb->lock);
+    size_t n = len < sb->used ? len : sb->used;
+    for (size_t i = 0; i < n; i++) {
+        ((uint8_t *)data)[i] = sb->data[(sb->head + i) % sb->size];
+    }
+    sb->head = (sb->head + n) % sb->size;
+    sb->used -= n;
+    pthread_mutex_unlock(&sb->lock);
+    return n;
+}
+
+BaseType_t xStreamBufferReset(StreamBufferHandle_t sb)
+{
+    pthread_mutex_lock(&sb->lock);
+    sb->head = 0;
+    sb->used = 0;
+    pthread_mutex_unlock(&sb->lock);
+    return pdPASS;
+}
+
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t sb)
+{
+    pthread_mutex_lock(&sb->lock);
+    size_t n = sb->used;
+    pthread_mutex_unlock(&sb->lock);
+    return n;
+}
+
+void vStreamBufferDelete(StreamBufferHandle_t sb)
+{
+    pthread_mutex_destroy(&sb->lock);
+    free(sb);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    pthread_mutex_t *m = malloc(sizeof(*m));
+    if (m) {
+        pthread_mutex_init(m, NULL);
+    }
+    return m;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    (void)ticks;
+    return pthread_mutex_lock(sem) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return pthread_mutex_unlock(sem) == 0 ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(sem);
+    free(sem);
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    static const uint8_t base[6] = { 0x24, 0x6f, 0x28, 0x4b, 0x1a, 0x30 };
+    memcpy(mac, base, sizeof(base));
+    mac[5] += (uint8_t)type;
+    return ESP_OK;
+}
+
+/* xorshift32 from a fixed seed, so runs repeat */
+uint32_t esp_random(void)
+{
+    static uint32_t x = 0x4b415641;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+#define NVS_NS_MAX      8
+#define NVS_ENTRY_MAX   16
+#define NVS_NAME_MAX    16      /* NVS_KEY_NAME_MAX_SIZE */
+
+typedef struct {
+    uint32_t ns;                /* handle of the namespace, 0 = free */
+    char key[NVS_NAME_MAX];
+    void *data;
+    size_t len;
+} nvs_entry_t;
+
+static char s_nvs_ns[NVS_NS_MAX][NVS_NAME_MAX];
+static nvs_entry_t s_nvs[NVS_ENTRY_MAX];
+
+static nvs_entry_t *nvs_find(nvs_handle_t handle, const char *key)
+{
+    for (int i = 0; i < NVS_ENTRY_MAX; i++) {
+        if (s_nvs[i].ns == handle && strcmp(s_nvs[i].key, key) == 0) {
+            return &s_nvs[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out_handle)
+{
+    if (!name || strlen(name) >= NVS_NAME_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < NVS_NS_MAX; i++) {
+        if (s_nvs_ns[i][0] && strcmp(s_nvs_ns[i], name) == 0) {
+            *out_handle = (nvs_handle_t)i + 1;
+            return ESP_OK;
+        }
+    }
+    if (mode == NVS_READONLY) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    for (int i = 0; i < NVS_NS_MAX; i++) {
+        if (!s_nvs_ns[i][0]) {
+            strcpy(s_nvs_ns[i], name);
+            *out_handle = (nvs_handle_t)i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if (!key || strlen(key) >= NVS_NAME_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    nvs_entry_t *e = nvs_find(handle, key);
+    for (int i = 0; i < NVS_ENTRY_MAX && !e; i++) {
+        if (!s_nvs[i].ns) {
+            e = &s_nvs[i];
+            e->ns = handle;
+            strcpy(e->key, key);
+            e->data = NULL;
+        }
+    }
+    if (!e) {
+        return ESP_ERR_NO_MEM;
+    }
+    void *data = malloc(length ? length : 1);
+    if (!data) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(data, value, length);
+    free(e->data);
+    e->data = data;
+    e->len = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    nvs_entry_t *e = nvs_find(handle, key);
+    if (!e) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value) {
+        if (*length < e->len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(out_value, e->data, e->len);
+    }
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    nvs_entry_t *e = nvs_find(handle, key);
+    if (!e) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    free(e->data);
+    memset(e, 0, sizeof(*e));
+    return ESP_OK;
+}
@@ -0,0 +1,99 @@
+/*
+ * Host stand-in for esp-mqtt's mqtt_client.h: the config fields, events and calls the app modules use.
+ * Two implementations: mqtt_client_stub.c (in host_stubs; subscribes succeed, nothing is sent) and
+ * mqtt_client_tcp.c (an MQTT 3.1.1 client over a socket, linked by tests that talk to a broker).
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
+
+#define ESP_EVENT_ANY_ID    -1
+
+typedef enum {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+} esp_mqtt_event_id_t;
+
+typedef struct {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    char *data;
+    int data_len;
+    int total_data_len;
+    int current_data_offset;
+    char *topic;
+    int topic_len;
+    int msg_id;
+    int session_present;
+    int qos;
+    bool retain;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct {
+    struct {
+        struct {
+            const char *uri;
+        } address;
+        struct {
+            const char *certificate;
+            esp_err_t (*crt_bundle_attach)(void *conf);
+        } verification;
+    } broker;
+    struct {
+        const char *username;
+        const char *client_id;
+        struct {
+            const char *password;
+        } authentication;
+    } credentials;
+    struct {
+        bool disable_clean_session;
+        int keepalive;
+    } session;
+    struct {
+        bool disable_auto_reconnect;
+        int reconnect_timeout_ms;
+        void *transport;
+    } network;
+    struct {
+        int size;
+        int out_size;
+    } buffer;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain);
+
+/* mqtt_client_tcp.c only */
+
+/** The link drops: the client closes its socket, as when Wi-Fi is lost and keepalive notices. */
+void host_mqtt_client_drop(esp_mqtt_client_handle_t client);
+/** False once the client task has ended (auto reconnect found off while waiting). */
+bool host_mqtt_client_running(esp_mqtt_client_handle_t client);
+bool host_mqtt_client_connected(esp_mqtt_client_handle_t client);
+/** SUBSCRIBE packets sent since init. */
+uint32_t host_mqtt_client_subscribes(esp_mqtt_client_handle_t client);
@@ -0,0 +1,67 @@
+/*
+ * esp-mqtt stand-in without a network: the client never connects, subscribes and publishes succeed
+ * and nothing is sent. Its own object in host_stubs, so a test that links mqtt_client_tcp.c gets that
+ * client instead.
+ */
+#include <stddef.h>
+#include "mqtt_client.h"
+
+struct esp_mqtt_client {
+    int msg_id;
+};
+
+static struct esp_mqtt_client s_client;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    return config ? &s_client : NULL;
+}
+
+esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *config)
+{
+    return client && config ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args)
+{
+    (void)event;
+    (void)handler;
+    (void)handler_args;
+    return client ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    return client ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    (void)client;
+    return ESP_FAIL;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    return client ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    (void)client;
+    (void)topic;
+    (void)qos;
+    return ++s_client.msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain)
+{
+    (void)client;
+    (void)topic;
+    (void)data;
+    (void)len;
+    (void)retain;
+    return qos > 0 ? ++s_client.msg_id : 0;
+}
@@ -0,0 +1,545 @@
+/*
+ * esp-mqtt stand-in over a TCP socket (MQTT 3.1.1, QoS 0 and 1), for tests that run the app's MQTT
+ * modules against a real broker.
+ *
+ * It keeps the parts of esp-mqtt's behaviour the app depends on: a client task of its own that
+ * dispatches the events, holding the client lock (so API calls from a handler nest, as on the target);
+ * BEFORE_CONNECT before each attempt; ERROR then DISCONNECTED for a failed attempt; reconnect_timeout_ms
+ * read when the connection drops, before DISCONNECTED, so a later esp_mqtt_set_config() only changes
+ * the wait after the next drop; and the task stopping for good when it finds auto reconnect off while
+ * waiting (esp_mqtt_client_reconnect() then fails). esp_mqtt_set_config() resets fields left zero to
+ * esp-mqtt's defaults. Large messages arrive as one MQTT_EVENT_DATA, not in fragments.
+ */
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "mqtt_client.h"
+
+#define RECON_DEFAULT_MS    10000   /* MQTT_RECON_DEFAULT_MS */
+#define KEEPALIVE_DEFAULT   120     /* MQTT_KEEPALIVE_TICK */
+#define NETWORK_TIMEOUT_MS  10000   /* MQTT_NETWORK_TIMEOUT_MS */
+#define URI_MAX             128
+#define CLIENT_ID_MAX       32
+#define RX_MAX              8192
+#define TX_MAX              4096
+#define POLL_MS             2
+
+typedef enum {
+    ST_INIT,
+    ST_CONNECTED,
+    ST_WAIT_RECONNECT,
+    ST_DISCONNECTED,
+} client_state_t;
+
+struct esp_mqtt_client {
+    pthread_mutex_t lock;           /* recursive: API calls from an event handler */
+    pthread_t task;
+    bool task_started;
+    volatile bool run;
+    volatile bool stop;
+    client_state_t state;
+    char uri[URI_MAX];
+    char client_id[CLIENT_ID_MAX];
+    bool clean_session;
+    int keepalive_sec;
+    bool auto_reconnect;
+    int reconnect_timeout_ms;
+    int wait_timeout_ms;            /* read from reconnect_timeout_ms at the drop */
+    int64_t reconnect_tick_ms;
+    int64_t last_tx_ms;
+    int fd;
+    bool drop;                      /* host_mqtt_client_drop() */
+    uint16_t msg_id;
+    uint32_t subscribes;
+    uint8_t rx[RX_MAX];
+    size_t rx_len;
+    esp_event_handler_t handler;
+    void *handler_args;
+};
+
+static int64_t tick_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void dispatch(esp_mqtt_client_handle_t c, esp_mqtt_event_t *evt)
+{
+    evt->client = c;
+    if (c->handler) {
+        c->handler(c->handler_args, "MQTT_EVENTS", evt->event_id, evt);
+    }
+}
+
+static void dispatch_id(esp_mqtt_client_handle_t c, esp_mqtt_event_id_t id)
+{
+    esp_mqtt_event_t evt = { .event_id = id };
+    dispatch(c, &evt);
+}
+
+/* As esp_mqtt_set_config(): fields left zero get esp-mqtt's defaults */
+static esp_err_t apply_config(esp_mqtt_client_handle_t c, const esp_mqtt_client_config_t *cfg)
+{
+    if (cfg->broker.address.uri) {
+        if (strlen(cfg->broker.address.uri) >= sizeof(c->uri)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        strcpy(c->uri, cfg->broker.address.uri);
+    }
+    if (cfg->credentials.client_id) {
+        snprintf(c->client_id, sizeof(c->client_id), "%s", cfg->credentials.client_id);
+    } else if (!c->client_id[0]) {
+        snprintf(c->client_id, sizeof(c->client_id), "ESP32_%06x", (unsigned)(getpid() & 0xffffff));
+    }
+    c->clean_session = !cfg->session.disable_clean_session;
+    c->keepalive_sec = cfg->session.keepalive ? cfg->session.keepalive : KEEPALIVE_DEFAULT;
+    c->auto_reconnect = !cfg->network.disable_auto_reconnect;
+    c->reconnect_timeout_ms = cfg->network.reconnect_timeout_ms ? cfg->network.reconnect_timeout_ms
+                                                                 : RECON_DEFAULT_MS;
+    return ESP_OK;
+}
+
+/* "mqtt://host:port" */
+static int tcp_connect(const char *uri)
+{
+    const char *host = strstr(uri, "://");
+    host = host ? host + 3 : uri;
+    const char *colon = strrchr(host, ':');
+    char name[URI_MAX], port[8] = "1883";
+    size_t len = colon ? (size_t)(colon - host) : strcspn(host, "/");
+    if (len >= sizeof(name)) {
+        return -1;
+    }
+    memcpy(name, host, len);
+    name[len] = '\0';
+    if (colon) {
+        snprintf(port, sizeof(port), "%.*s", (int)strcspn(colon + 1, "/"), colon + 1);
+    }
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *ai;
+    if (getaddrinfo(name, port, &hints, &ai) != 0) {
+        return -1;
+    }
+    int fd = socket(ai->ai_family, ai->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static int send_packet(esp_mqtt_client_handle_t c, uint8_t type, const uint8_t *body, size_t len)
+{
+    uint8_t buf[TX_MAX];
+    size_t n = 0;
+    buf[n++] = type;
+    size_t rem = len;
+    do {
+        uint8_t b = rem % 128;
+        rem /= 128;
+        buf[n++] = b | (rem ? 0x80 : 0);
+    } while (rem);
+    if (c->fd < 0 || n + len > sizeof(buf)) {
+        return -1;
+    }
+    memcpy(buf + n, body, len);
+    n += len;
+    for (size_t off = 0; off < n;) {
+        ssize_t w = send(c->fd, buf + off, n - off, MSG_NOSIGNAL);
+        if (w <= 0) {
+            return -1;
+        }
+        off += (size_t)w;
+    }
+    c->last_tx_ms = tick_ms();
+    return 0;
+}
+
+/* Next whole packet from the receive buffer: its header byte, body and length; false if incomplete */
+static bool next_packet(esp_mqtt_client_handle_t c, uint8_t *type, uint8_t **body, size_t *len, size_t *used)
+{
+    size_t n = 1, rem = 0, mul = 1;
+    for (;;) {
+        if (n >= c->rx_len || n > 4) {
+            return false;
+        }
+        uint8_t b = c->rx[n++];
+        rem += (b & 127) * mul;
+        mul *= 128;
+        if (!(b & 128)) {
+            break;
+        }
+    }
+    if (c->rx_len < n + rem) {
+        return false;
+    }
+    *type = c->rx[0];
+    *body = c->rx + n;
+    *len = rem;
+    *used = n + rem;
+    return true;
+}
+
+/* Read what the socket has (waiting up to timeout_ms); false if it closed or failed */
+static bool receive(esp_mqtt_client_handle_t c, int timeout_ms)
+{
+    struct pollfd p = { .fd = c->fd, .events = POLLIN };
+    int r = poll(&p, 1, timeout_ms);
+    if (r <= 0) {
+        return r == 0 || errno == EINTR;
+    }
+    if (c->rx_len == sizeof(c->rx)) {
+        return false;       /* a packet larger than the buffer */
+    }
+    ssize_t n = recv(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len, 0);
+    if (n <= 0) {
+        return false;
+    }
+    c->rx_len += (size_t)n;
+    return true;
+}
+
+/* esp_mqtt_abort_connection(): the wait is read here, before DISCONNECTED */
+static void abort_connection(esp_mqtt_client_handle_t c)
+{
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    c->rx_len = 0;
+    c->drop = false;
+    c->wait_timeout_ms = c->reconnect_timeout_ms;
+    c->reconnect_tick_ms = tick_ms();
+    c->state = ST_WAIT_RECONNECT;
+    dispatch_id(c, MQTT_EVENT_DISCONNECTED);
+}
+
+static bool mqtt_connect(esp_mqtt_client_handle_t c, bool *session_present)
+{
+    c->fd = tcp_connect(c->uri);
+    if (c->fd < 0) {
+        return false;
+    }
+    uint8_t body[64];
+    size_t id_len = strlen(c->client_id), n = 0;
+    memcpy(body, "\0\4MQTT\4", 7);
+    n = 7;
+    body[n++] = c->clean_session ? 0x02 : 0x00;
+    body[n++] = (uint8_t)(c->keepalive_sec >> 8);
+    body[n++] = (uint8_t)c->keepalive_sec;
+    body[n++] = (uint8_t)(id_len >> 8);
+    body[n++] = (uint8_t)id_len;
+    memcpy(body + n, c->client_id, id_len);
+    n += id_len;
+    if (send_packet(c, 0x10, body, n) != 0) {
+        return false;
+    }
+    int64_t deadline = tick_ms() + NETWORK_TIMEOUT_MS;
+    uint8_t type, *ack;
+    size_t len, used;
+    while (!next_packet(c, &type, &ack, &len, &used)) {
+        if (tick_ms() > deadline || !receive(c, POLL_MS * 5)) {
+            return false;
+        }
+    }
+    bool ok = type == 0x20 && len == 2 && ack[1] == 0;
+    *session_present = ok && (ack[0] & 1);
+    memmove(c->rx, c->rx + used, c->rx_len - used);
+    c->rx_len -= used;
+    return ok;
+}
+
+static void handle_packet(esp_mqtt_client_handle_t c, uint8_t type, uint8_t *body, size_t len)
+{
+    esp_mqtt_event_t evt = { 0 };
+    switch (type >> 4) {
+    case 3: {   /* PUBLISH */
+        int qos = (type >> 1) & 3;
+        size_t topic_len = len >= 2 ? (size_t)(body[0] << 8 | body[1]) : 0;
+        size_t off = 2 + topic_len + (qos ? 2 : 0);
+        if (off > len) {
+            return;
+        }
+        if (qos) {
+            send_packet(c, 0x40, body + 2 + topic_len, 2);      /* PUBACK (QoS 2 is not used) */
+            evt.msg_id = body[2 + topic_len] << 8 | body[3 + topic_len];
+        }
+        evt.event_id = MQTT_EVENT_DATA;
+        evt.topic = (char *)body + 2;
+        evt.topic_len = (int)topic_len;
+        evt.data = (char *)body + off;
+        evt.data_len = (int)(len - off);
+        evt.total_data_len = evt.data_len;
+        evt.qos = qos;
+        evt.retain = type & 1;
+        dispatch(c, &evt);
+        break;
+    }
+    case 4:     /* PUBACK */
+    case 9:     /* SUBACK */
+        if (len >= 2) {
+            evt.event_id = (type >> 4) == 4 ? MQTT_EVENT_PUBLISHED : MQTT_EVENT_SUBSCRIBED;
+            evt.msg_id = body[0] << 8 | body[1];
+            dispatch(c, &evt);
+        }
+        break;
+    default:    /* PINGRESP */
+        break;
+    }
+}
+
+static void *client_task(void *arg)
+{
+    esp_mqtt_client_handle_t c = arg;
+    while (c->run && !c->stop) {
+        pthread_mutex_lock(&c->lock);
+        switch (c->state) {
+        case ST_INIT: {
+            dispatch_id(c, MQTT_EVENT_BEFORE_CONNECT);
+            bool session_present = false;
+            if (!mqtt_connect(c, &session_present)) {
+                dispatch_id(c, MQTT_EVENT_ERROR);
+                abort_connection(c);
+                break;
+            }
+            c->state = ST_CONNECTED;
+            esp_mqtt_event_t evt = { .event_id = MQTT_EVENT_CONNECTED, .session_present = session_present };
+            dispatch(c, &evt);
+            break;
+        }
+        case ST_CONNECTED: {
+            uint8_t type, *body;
+            size_t len, used;
+            while (c->state == ST_CONNECTED && next_packet(c, &type, &body, &len, &used)) {
+                handle_packet(c, type, body, len);
+                memmove(c->rx, c->rx + used, c->rx_len - used);
+                c->rx_len -= used;
+            }
+            if (c->state == ST_CONNECTED && tick_ms() - c->last_tx_ms >= c->keepalive_sec * 1000) {
+                send_packet(c, 0xc0, NULL, 0);      /* PINGREQ */
+            }
+            if (c->state == ST_CONNECTED && (c->drop || !receive(c, 0))) {
+                abort_connection(c);
+            }
+            break;
+        }
+        case ST_WAIT_RECONNECT:
+            if (!c->auto_reconnect) {
+                c->run = false;     /* the task ends; nothing restarts it */
+                c->state = ST_DISCONNECTED;
+            } else if (tick_ms() - c->reconnect_tick_ms > c->wait_timeout_ms) {
+                c->state = ST_INIT;
+            }
+            break;
+        default:
+            break;
+        }
+        bool idle = c->state != ST_INIT;
+        int fd = c->state == ST_CONNECTED ? c->fd : -1;
+        pthread_mutex_unlock(&c->lock);
+        if (idle) {
+            /* Wait for input (or a tick) without the lock, as esp-mqtt's task does between reads */
+            struct pollfd p = { .fd = fd, .events = POLLIN };
+            poll(&p, fd >= 0 ? 1 : 0, POLL_MS);
+        }
+    }
+    return NULL;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    esp_mqtt_client_handle_t c = calloc(1, sizeof(*c));
+    if (!c) {
+        return NULL;
+    }
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&c->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    c->fd = -1;
+    if (apply_config(c, config) != ESP_OK || !c->uri[0]) {
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *config)
+{
+    if (!client || !config) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&client->lock);
+    esp_err_t err = apply_config(client, config);
+    pthread_mutex_unlock(&client->lock);
+    return err;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args)
+{
+    (void)event;        /* every event goes to the one handler */
+    if (!client) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&client->lock);
+    client->handler = handler;
+    client->handler_args = handler_args;
+    pthread_mutex_unlock(&client->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (!client || client->task_started) {
+        return ESP_FAIL;
+    }
+    client->state = ST_INIT;
+    client->run = true;
+    if (pthread_create(&client->task, NULL, client_task, client) != 0) {
+        client->run = false;
+        return ESP_FAIL;
+    }
+    client->task_started = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    if (!client) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&client->lock);
+    esp_err_t err = ESP_FAIL;
+    if (client->run && client->state == ST_WAIT_RECONNECT) {
+        client->wait_timeout_ms = 0;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&client->lock);
+    return err;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    if (!client) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    client->stop = true;
+    if (client->task_started) {
+        pthread_join(client->task, NULL);
+    }
+    if (client->fd >= 0) {
+        close(client->fd);
+    }
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    size_t len = topic ? strlen(topic) : 0;
+    if (!client || !len || len > TX_MAX / 2) {
+        return -1;
+    }
+    pthread_mutex_lock(&client->lock);
+    int msg_id = -1;
+    if (client->state == ST_CONNECTED) {
+        uint8_t body[TX_MAX / 2 + 5];
+        uint16_t id = ++client->msg_id ? client->msg_id : ++client->msg_id;
+        body[0] = (uint8_t)(id >> 8);
+        body[1] = (uint8_t)id;
+        body[2] = (uint8_t)(len >> 8);
+        body[3] = (uint8_t)len;
+        memcpy(body + 4, topic, len);
+        body[4 + len] = (uint8_t)qos;
+        if (send_packet(client, 0x82, body, len + 5) == 0) {
+            client->subscribes++;
+            msg_id = id;
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+    return msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain)
+{
+    size_t topic_len = topic ? strlen(topic) : 0;
+    if (!client || !topic_len || qos < 0 || qos > 1) {
+        return -1;
+    }
+    if (data && len == 0) {
+        len = (int)strlen(data);
+    }
+    if (len < 0 || topic_len + (size_t)len + 4 > TX_MAX - 8) {
+        return -1;
+    }
+    pthread_mutex_lock(&client->lock);
+    int msg_id = -1;
+    if (client->state == ST_CONNECTED) {
+        uint8_t body[TX_MAX];
+        size_t n = 0;
+        body[n++] = (uint8_t)(topic_len >> 8);
+        body[n++] = (uint8_t)topic_len;
+        memcpy(body + n, topic, topic_len);
+        n += topic_len;
+        uint16_t id = 0;
+        if (qos) {
+            id = ++client->msg_id ? client->msg_id : ++client->msg_id;
+            body[n++] = (uint8_t)(id >> 8);
+            body[n++] = (uint8_t)id;
+        }
+        memcpy(body + n, data, (size_t)len);
+        n += (size_t)len;
+        if (send_packet(client, (uint8_t)(0x30 | qos << 1 | (retain ? 1 : 0)), body, n) == 0) {
+            msg_id = id;
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+    return msg_id;
+}
+
+void host_mqtt_client_drop(esp_mqtt_client_handle_t client)
+{
+    pthread_mutex_lock(&client->lock);
+    client->drop = true;
+    pthread_mutex_unlock(&client->lock);
+}
+
+bool host_mqtt_client_running(esp_mqtt_client_handle_t client)
+{
+    return client->run;
+}
+
+bool host_mqtt_client_connected(esp_mqtt_client_handle_t client)
+{
+    pthread_mutex_lock(&client->lock);
+    bool connected = client->state == ST_CONNECTED;
+    pthread_mutex_unlock(&client->lock);
+    return connected;
+}
+
+uint32_t host_mqtt_client_subscribes(esp_mqtt_client_handle_t client)
+{
+    pthread_mutex_lock(&client->lock);
+    uint32_t n = client->subscribes;
+    pthread_mutex_unlock(&client->lock);
+    return n;
+}
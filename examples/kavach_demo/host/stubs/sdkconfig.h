@@ -0,0 +1,39 @@
+/* Host build configuration: the Kconfig defaults of the modules the host tests compile. */
+#pragma once
+
+#define CONFIG_KAVACH_RESAMPLE_ESP_DSP  0
+#define CONFIG_KAVACH_PROMPT_CACHE_KB   1024
+#define CONFIG_KAVACH_SR_CMD_OVERLAY_MAX 16
+#define CONFIG_KAVACH_MQTT_MSG_MAX_DEFAULT 1024
+#define CONFIG_KAVACH_MQTT_REASM_BUF_KB 8
+#define CONFIG_KAVACH_MQTT_SENSOR_INTERVAL_SEC 30
+#define CONFIG_KAVACH_TELEMETRY_SAMPLE_SEC 5
+#define CONFIG_KAVACH_TELEMETRY_TEMP_DEADBAND 2
+#define CONFIG_KAVACH_TELEMETRY_HUM_DEADBAND 10
+#define CONFIG_KAVACH_TELEMETRY_HEARTBEAT_SEC 300
+#define CONFIG_KAVACH_TELEMETRY_BATCH_MAX 24
+#define CONFIG_KAVACH_TELEMETRY_CBOR 1
+#define CONFIG_KAVACH_ALERT_QUIET_SEC 20
+#define CONFIG_KAVACH_MQTT_TOPIC_RULES "fabacademy/kavach/rules"
+#define CONFIG_KAVACH_RULES_MAX_BYTES 4096
+#ifndef CONFIG_KAVACH_AEC_REF_DELAY_MS
+#define CONFIG_KAVACH_AEC_REF_DELAY_MS 0
+#endif
+#define CONFIG_KAVACH_MQTT_KEEPALIVE_SEC 30
+#ifndef CONFIG_KAVACH_MQTT_BACKOFF_MIN_MS
+#define CONFIG_KAVACH_MQTT_BACKOFF_MIN_MS 500
+#endif
+#ifndef CONFIG_KAVACH_MQTT_BACKOFF_MAX_SEC
+#define CONFIG_KAVACH_MQTT_BACKOFF_MAX_SEC 60
+#endif
+#define CONFIG_KAVACH_MQTT_FAILOVER_ATTEMPTS 3
+#define CONFIG_KAVACH_MQTT_BROKER_URI "mqtt://192.168.1.100:1883"
+#define CONFIG_KAVACH_MQTT_BROKER_URI_SECONDARY ""
+#define CONFIG_KAVACH_MQTT_USERNAME ""
+#define CONFIG_KAVACH_MQTT_PASSWORD ""
+#define CONFIG_KAVACH_MQTT_TOPIC_HELP "fabacademy/kavach/help"
+#define CONFIG_KAVACH_MQTT_TOPIC_APPLIANCES "fabacademy/kavach/appliances"
+#define CONFIG_KAVACH_MQTT_TOPIC_SENSOR "fabacademy/kavach/sensor"
+#define CONFIG_KAVACH_MQTT_TOPIC_INCIDENT "fabacademy/kavach/incident"
+#define CONFIG_KAVACH_MQTT_TOPIC_TRACE "fabacademy/kavach/trace"
+#define CONFIG_KAVACH_TRACE_PUBLISH_SEC 300
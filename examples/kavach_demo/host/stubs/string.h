@@ -0,0 +1,9 @@
+/* Host stand-in for newlib's string.h: the C library's, plus strlcpy() where glibc lacks it (< 2.38). */
+#pragma once
+
+#include_next <string.h>
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+#define HOST_NEED_STRLCPY 1
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
@@ -0,0 +1,329 @@
+/*
+ * app_telemetry: payload size over a simulated day against the per-reading JSON it replaced, and the
+ * cost of encoding and handing over a full batch. Built twice, for the CBOR (default) and the JSON
+ * batch format.
+ *
+ * The day is 24 h of indoor readings sampled every CONFIG_KAVACH_TELEMETRY_SAMPLE_SEC: a slow daily
+ * swing, half an hour of cooking (fast rise and fall) and sensor noise. The old firmware published
+ * {"temp": %.1f, "hum": %.0f} every CONFIG_KAVACH_MQTT_SENSOR_INTERVAL_SEC. Every batch the sink gets
+ * is decoded and each sample checked against the reading fed at its time.
+ *
+ * Fails on a batch that does not decode or does not match the readings, or if the day costs more
+ * payload bytes or publishes than the old per-reading JSON.
+ *
+ *   telemetry_bench [batches]    batches for the encode timing
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "bsp_board.h"
+#include "sdkconfig.h"
+#include "app_telemetry.h"
+
+#define SAMPLE_SEC  CONFIG_KAVACH_TELEMETRY_SAMPLE_SEC
+#define BATCH_MAX   CONFIG_KAVACH_TELEMETRY_BATCH_MAX
+#define DAY_SEC     86400
+#define BOOT_SEC    1
+
+#if CONFIG_KAVACH_TELEMETRY_JSON
+#define FORMAT      "JSON"
+#else
+#define FORMAT      "CBOR"
+#endif
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Sensor: the day simulation reads day_temp/day_hum at the current uptime, the encode timing s_temp/s_hum */
+static bool s_day;
+static float s_temp, s_hum;
+static uint64_t s_rng = 88172645463325252ull;
+
+static double noise(uint32_t up_s)
+{
+    uint64_t x = s_rng ^ (up_s * 0x9e3779b97f4a7c15ull);
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return (double)(x % 2001) / 1000.0 - 1.0;
+}
+
+static double cooking(uint32_t s)
+{
+    return s > 64800 && s < 66600 ? 3.0 * sin((s - 64800) / 1800.0 * M_PI) : 0;
+}
+
+static float day_temp(uint32_t s)
+{
+    return (float)(24 + 2 * sin(s / 86400.0 * 2 * M_PI) + cooking(s) + 0.03 * noise(s));
+}
+
+static float day_hum(uint32_t s)
+{
+    return (float)(55 + 5 * sin(s / 43200.0 * 2 * M_PI) + 2 * cooking(s) + 0.2 * noise(s + 1));
+}
+
+static esp_err_t get_humiture(float *temp, float *hum)
+{
+    uint32_t up_s = (uint32_t)(esp_timer_get_time() / 1000000);
+    *temp = s_day ? day_temp(up_s) : s_temp;
+    *hum = s_day ? day_hum(up_s) : s_hum;
+    return ESP_OK;
+}
+
+static bsp_bottom_property_t s_sensor = { .get_humiture = get_humiture };
+
+bsp_bottom_property_t *bsp_board_get_sensor_handle(void)
+{
+    return &s_sensor;
+}
+
+/* A decoded batch */
+typedef struct {
+    bool epoch;
+    uint32_t t0;
+    size_t n[3];
+    int32_t v[3][BATCH_MAX];    /* dt, temp, hum as sent (delta coded) */
+} batch_t;
+
+static const char *const s_keys[3] = { "dt", "temp", "hum" };
+
+static bool cbor_head(const uint8_t **p, const uint8_t *end, uint8_t *major, uint32_t *val)
+{
+    if (*p >= end) {
+        return false;
+    }
+    uint8_t ib = *(*p)++;
+    *major = ib >> 5;
+    uint8_t ai = ib & 0x1f;
+    if (ai < 24) {
+        *val = ai;
+        return true;
+    }
+    int bytes = ai == 24 ? 1 : ai == 25 ? 2 : ai == 26 ? 4 : 0;
+    if (!bytes || end - *p < bytes) {
+        return false;
+    }
+    *val = 0;
+    for (int i = 0; i < bytes; i++) {
+        *val = *val << 8 | *(*p)++;
+    }
+    return true;
+}
+
+static bool cbor_int(const uint8_t **p, const uint8_t *end, int32_t *v)
+{
+    uint8_t major;
+    uint32_t val;
+    if (!cbor_head(p, end, &major, &val) || major > 1) {
+        return false;
+    }
+    *v = major ? -1 - (int32_t)val : (int32_t)val;
+    return true;
+}
+
+static bool decode_cbor(const uint8_t *p, size_t len, batch_t *b)
+{
+    const uint8_t *end = p + len;
+    uint8_t major;
+    uint32_t val;
+    if (!cbor_head(&p, end, &major, &val) || major != 5 || val != 5) {
+        return false;
+    }
+    for (uint32_t pair = 0; pair < 5; pair++) {
+        char key[8];
+        if (!cbor_head(&p, end, &major, &val) || major != 3 || val >= sizeof(key) || (uint32_t)(end - p) < val) {
+            return false;
+        }
+        memcpy(key, p, val);
+        key[val] = '\0';
+        p += val;
+        int f = -1;
+        for (int k = 0; k < 3; k++) {
+            f = strcmp(key, s_keys[k]) == 0 ? k : f;
+        }
+        if (f >= 0) {
+            if (!cbor_head(&p, end, &major, &val) || major != 4 || val > BATCH_MAX) {
+                return false;
+            }
+            b->n[f] = val;
+            for (uint32_t i = 0; i < val; i++) {
+                if (!cbor_int(&p, end, &b->v[f][i])) {
+                    return false;
+                }
+            }
+            continue;
+        }
+        int32_t v;
+        if (!cbor_int(&p, end, &v)) {
+            return false;
+        }
+        if (strcmp(key, "t0") == 0 || strcmp(key, "up") == 0) {
+            b->epoch = key[0] == 't';
+            b->t0 = (uint32_t)v;
+        } else if (strcmp(key, "v") != 0 || v != 1) {
+            return false;
+        }
+    }
+    return p == end;
+}
+
+static bool decode_json(const uint8_t *data, size_t len, batch_t *b)
+{
+    char doc[1024];
+    if (len >= sizeof(doc)) {
+        return false;
+    }
+    memcpy(doc, data, len);
+    doc[len] = '\0';
+    if (strncmp(doc, "{\"v\":1,", 7) != 0 || doc[len - 1] != '}') {
+        return false;
+    }
+    const char *t = strstr(doc, "\"t0\":");
+    b->epoch = t != NULL;
+    if (!t && !(t = strstr(doc, "\"up\":"))) {
+        return false;
+    }
+    b->t0 = (uint32_t)strtoul(t + 5, NULL, 10);
+    for (int f = 0; f < 3; f++) {
+        char key[16];
+        snprintf(key, sizeof(key), "\"%s\":[", s_keys[f]);
+        const char *p = strstr(doc, key);
+        if (!p) {
+            return false;
+        }
+        p += strlen(key);
+        b->n[f] = 0;
+        while (*p != ']') {
+            char *e;
+            long v = strtol(p, &e, 10);
+            if (e == p || b->n[f] == BATCH_MAX) {
+                return false;
+            }
+            b->v[f][b->n[f]++] = (int32_t)v;
+            p = *e == ',' ? e + 1 : e;
+        }
+    }
+    return true;
+}
+
+static uint32_t s_batches, s_bytes, s_samples;
+static size_t s_last_len;
+
+/* Decode the batch and check each sample against the reading at its uptime */
+static esp_err_t sink(const uint8_t *data, size_t len, bool cbor)
+{
+    s_batches++;
+    s_bytes += len;
+    s_last_len = len;
+    if (!s_day) {
+        return ESP_OK;
+    }
+    batch_t b = { 0 };
+    bool ok = cbor ? decode_cbor(data, len, &b) : decode_json(data, len, &b);
+    CHECK(ok && b.n[0] == b.n[1] && b.n[1] == b.n[2] && b.n[0] > 0, "batch %u (%zu B) does not decode",
+          (unsigned)s_batches, len);
+    if (!ok) {
+        return ESP_OK;
+    }
+    /* t0 is wall clock when set: map it back to uptime, on the sample grid */
+    uint32_t now_up = (uint32_t)(esp_timer_get_time() / 1000000);
+    uint32_t up = b.epoch ? now_up - (uint32_t)(time(NULL) - b.t0) : b.t0;
+    up = (up - BOOT_SEC + SAMPLE_SEC / 2) / SAMPLE_SEC * SAMPLE_SEC + BOOT_SEC;
+    int32_t temp = 0, hum = 0;
+    for (size_t i = 0; i < b.n[0]; i++) {
+        up += (uint32_t)b.v[0][i];
+        temp += b.v[1][i];
+        hum += b.v[2][i];
+        CHECK(temp == lroundf(day_temp(up) * 10) && hum == lroundf(day_hum(up) * 10),
+              "batch %u sample %zu at %us: %d/%d, reading was %ld/%ld", (unsigned)s_batches, i, (unsigned)up,
+              (int)temp, (int)hum, lroundf(day_temp(up) * 10), lroundf(day_hum(up) * 10));
+    }
+    s_samples += (uint32_t)b.n[0];
+    return ESP_OK;
+}
+
+static void simulate_day(void)
+{
+    s_day = true;
+    long old_pubs = 0, old_bytes = 0;
+    for (uint32_t s = BOOT_SEC; s < BOOT_SEC + DAY_SEC; s += SAMPLE_SEC) {
+        host_time_set((int64_t)s * 1000000);
+        host_timer_fire("telemetry");
+        if ((s - BOOT_SEC) % CONFIG_KAVACH_MQTT_SENSOR_INTERVAL_SEC == 0) {
+            char buf[64];
+            old_bytes += snprintf(buf, sizeof(buf), "{\"temp\": %.1f, \"hum\": %.0f}", day_temp(s), day_hum(s));
+            old_pubs++;
+        }
+    }
+    app_telemetry_flush();
+    s_day = false;
+
+    app_telemetry_stats_t st;
+    app_telemetry_get_stats(&st);
+    printf("24 h, old per-reading JSON: %ld publishes, %ld payload bytes\n", old_pubs, old_bytes);
+    printf("24 h, " FORMAT " batches: %u samples, %u kept, %u publishes, %u payload bytes (%.1f B per kept sample)\n",
+           (unsigned)st.samples, (unsigned)st.kept,
+           (unsigned)s_batches, (unsigned)s_bytes, st.kept ? (double)s_bytes / st.kept : 0.0);
+    CHECK(s_samples == st.kept, "%u samples decoded, %u kept", (unsigned)s_samples, (unsigned)st.kept);
+    CHECK(st.batches == s_batches && st.bytes == s_bytes, "stats disagree with the sink");
+    CHECK((long)s_bytes < old_bytes && (long)s_batches < old_pubs, "batches cost more than per-reading JSON");
+}
+
+/* Time the sample that completes a full batch (encode + sink) and the ones that only add a sample */
+static void encode_cost(int batches)
+{
+    int64_t us = (int64_t)(BOOT_SEC + 2 * DAY_SEC) * 1000000;
+    double add_ns = 0, flush_ns = 0;
+    uint32_t before = s_batches;
+    for (int r = 0; r < batches; r++) {
+        for (int i = 0; i < BATCH_MAX; i++) {
+            us += 1000000;      /* every sample kept, the batch fills before it ages out */
+            host_time_set(us);
+            s_temp = 24.0f + (float)((r + i) % 5) * 0.3f;
+            s_hum = 55.0f + (float)((r + i) % 3) * 1.5f;
+            double t0 = now_ns();
+            host_timer_fire("telemetry");
+            double dt = now_ns() - t0;
+            if (i == BATCH_MAX - 1) {
+                flush_ns += dt;
+            } else {
+                add_ns += dt;
+            }
+        }
+    }
+    CHECK(s_batches - before == (uint32_t)batches, "%u full batches published, want %d",
+          (unsigned)(s_batches - before), batches);
+    printf("%d-sample " FORMAT " batch: %zu B, encode + sink %.0f ns; sample without a flush %.0f ns\n",
+           BATCH_MAX, s_last_len, flush_ns / batches,
+           add_ns / ((double)batches * (BATCH_MAX - 1)));
+}
+
+int main(int argc, char **argv)
+{
+    int batches = argc > 1 ? atoi(argv[1]) : 100000;
+    if (batches < 1) {
+        batches = 1;
+    }
+    host_time_set((int64_t)BOOT_SEC * 1000000);
+    if (app_telemetry_start(sink) != ESP_OK || host_timer_period("telemetry") != SAMPLE_SEC * 1000000ull) {
+        fprintf(stderr, "FAIL: telemetry did not start its sample timer\n");
+        return 1;
+    }
+    simulate_day();
+    encode_cost(batches);
+    return s_fail;
+}
@@ -0,0 +1,200 @@
+/*
+ * MQTT over TLS, full vs. resumed handshake: the cost CONFIG_KAVACH_MQTT_TLS_SESSION_RESUME saves on
+ * each reconnect.
+ *
+ * Each connect is TCP + TLS handshake + MQTT CONNECT/CONNACK against tools/tls_broker_stub.py.
+ * Connects alternate: a full handshake, whose session is kept, then one that offers it (by ticket, or
+ * by session ID if the server issues none), as the device's transport does. TLS 1.2 is the most the
+ * client offers, as esp-tls negotiates with the defaults. OpenSSL stands in for mbedTLS (no mbedTLS on
+ * the host): the times are a PC's, and the heap peak is OpenSSL's allocations during the connect.
+ *
+ * Fails if a connect fails, no offered session is resumed, or a resumed handshake does not use less
+ * CPU than a full one.
+ *
+ *   tls_resume_bench <ca.pem> <port> [connects] [cipher list]
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#define HDR     16      /* keeps allocations 16-byte aligned */
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double cpu_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* OpenSSL's allocations, accounted like host_heap_get(): each block carries its size */
+static size_t s_in_use, s_peak;
+
+static void *acct_malloc(size_t n, const char *file, int line)
+{
+    (void)file;
+    (void)line;
+    size_t *p = malloc(n + HDR);
+    if (!p) {
+        return NULL;
+    }
+    *p = n;
+    s_in_use += n;
+    s_peak = s_in_use > s_peak ? s_in_use : s_peak;
+    return (char *)p + HDR;
+}
+
+static void acct_free(void *ptr, const char *file, int line)
+{
+    (void)file;
+    (void)line;
+    if (ptr) {
+        size_t *p = (size_t *)((char *)ptr - HDR);
+        s_in_use -= *p;
+        free(p);
+    }
+}
+
+static void *acct_realloc(void *ptr, size_t n, const char *file, int line)
+{
+    if (!ptr) {
+        return acct_malloc(n, file, line);
+    }
+    size_t *p = (size_t *)((char *)ptr - HDR);
+    size_t old = *p;
+    p = realloc(p, n + HDR);
+    if (!p) {
+        return NULL;
+    }
+    *p = n;
+    s_in_use = s_in_use - old + n;
+    s_peak = s_in_use > s_peak ? s_in_use : s_peak;
+    return (char *)p + HDR;
+}
+
+typedef struct {
+    int n;
+    double ms, cpu;
+    size_t peak;
+} row_t;
+
+/* One connect; *reused tells whether the server resumed the offered session */
+static bool mqtt_tls_connect(SSL_CTX *ctx, int port, SSL_SESSION **session, bool offer, bool *reused)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        close(fd);
+        return false;
+    }
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    SSL_set1_host(ssl, "localhost");
+    if (offer && *session) {
+        SSL_set_session(ssl, *session);
+    }
+    bool ok = SSL_connect(ssl) == 1;
+    if (ok) {
+        /* CONNECT, clean session, keepalive 30 s, client id "kavach"; CONNACK is 4 bytes */
+        static const unsigned char connect_pkt[] = { 0x10, 18, 0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, 30,
+                                                     0, 6, 'k', 'a', 'v', 'a', 'c', 'h' };
+        unsigned char ack[4];
+        ok = SSL_write(ssl, connect_pkt, sizeof(connect_pkt)) == (int)sizeof(connect_pkt) &&
+             SSL_read(ssl, ack, sizeof(ack)) == (int)sizeof(ack) && ack[0] == 0x20 && ack[3] == 0;
+    } else {
+        ERR_print_errors_fp(stderr);
+    }
+    *reused = ok && SSL_session_reused(ssl);
+    if (ok && !offer) {
+        SSL_SESSION_free(*session);
+        *session = SSL_get1_session(ssl);
+    }
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+    return ok;
+}
+
+static void print_row(const char *name, const row_t *r)
+{
+    int n = r->n ? r->n : 1;
+    printf("%-8s %4d x %6.2f ms, %5.2f ms CPU, heap peak %6.1f KB\n", name, r->n, r->ms / n, r->cpu / n,
+           r->peak / (double)n / 1024);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <ca.pem> <port> [connects] [cipher list]\n", argv[0]);
+        return 2;
+    }
+    int port = atoi(argv[2]);
+    int connects = argc > 3 ? atoi(argv[3]) : 400;
+    if (connects < 2) {
+        connects = 2;
+    }
+    CRYPTO_set_mem_functions(acct_malloc, acct_realloc, acct_free);
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    if (SSL_CTX_load_verify_locations(ctx, argv[1], NULL) != 1 ||
+        (argc > 4 && SSL_CTX_set_cipher_list(ctx, argv[4]) != 1)) {
+        ERR_print_errors_fp(stderr);
+        return 1;
+    }
+
+    SSL_SESSION *session = NULL;
+    row_t full = { 0 }, resumed = { 0 };
+    int offered = 0;
+    for (int i = 0; i < connects; i++) {
+        bool offer = i % 2 == 1;
+        size_t base = s_in_use;
+        s_peak = s_in_use;
+        double t0 = now_ms(), c0 = cpu_ms();
+        bool reused = false;
+        if (!mqtt_tls_connect(ctx, port, &session, offer, &reused)) {
+            fprintf(stderr, "FAIL: connect %d\n", i);
+            return 1;
+        }
+        row_t *r = reused ? &resumed : &full;
+        r->ms += now_ms() - t0;
+        r->cpu += cpu_ms() - c0;
+        r->peak += s_peak - base;
+        r->n++;
+        offered += offer;
+    }
+    SSL_SESSION_free(session);
+    SSL_CTX_free(ctx);
+
+    print_row("full", &full);
+    print_row("resumed", &resumed);
+    CHECK(resumed.n == offered, "%d of %d offered sessions resumed", resumed.n, offered);
+    CHECK(resumed.n && resumed.cpu / resumed.n < full.cpu / full.n, "resumed handshake not cheaper in CPU");
+    printf("%s\n", s_fail ? "FAIL" : "OK");
+    return s_fail;
+}
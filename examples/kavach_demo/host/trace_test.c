@@ -0,0 +1,133 @@
+/*
+ * app_trace: span bookkeeping and percentiles on a manual clock.
+ *
+ *   - a completed span lands in every stage's histogram with the right latency;
+ *   - an ACTION stamp with no open span, or after the span timed out, records nothing;
+ *   - a span superseded by the next command, or timed out, is counted as expired;
+ *   - p50/p95/p99 of a known latency distribution are within the histogram's bucket resolution.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "app_trace.h"
+
+#define CHUNK   512     /* samples per feed/fetch, like the AFE at 16 kHz (32 ms) */
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); s_fail = 1; } } while (0)
+
+/* Value of "key":<number> inside the object of stage (or top level if stage is NULL) */
+static double json_num(const char *json, const char *stage, const char *key)
+{
+    const char *p = json;
+    char pat[48];
+    if (stage) {
+        snprintf(pat, sizeof(pat), "\"%s\":{", stage);
+        p = strstr(json, pat);
+        if (!p) {
+            return -1;
+        }
+    }
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    p = strstr(p, pat);
+    return p ? atof(p + strlen(pat)) : -1;
+}
+
+static void stats(char *buf, size_t len)
+{
+    int n = app_trace_format_json(buf, len);
+    CHECK(n > 0, "format_json failed");
+}
+
+/* Feed one chunk, then fetch it back after afe_ms; the detector fires detect_ms after the fetch. */
+static void utterance(int afe_ms, int detect_ms)
+{
+    app_trace_feed(CHUNK);
+    host_time_advance(afe_ms * 1000);
+    app_trace_fetch(CHUNK);
+    host_time_advance(detect_ms * 1000);
+    app_trace_begin();
+}
+
+int main(void)
+{
+    char json[1024];
+    host_time_set(1000000);
+
+    /* No span open: an action (e.g. a sensor rule publishing) records nothing */
+    app_trace_stamp(APP_TRACE_ACTION);
+    stats(json, sizeof(json));
+    CHECK(json_num(json, NULL, "spans") == 0, "action without a span counted: %s", json);
+
+    /* One full span: feed -> fetch 30 ms -> detect 5 ms -> ... -> action at 100 ms */
+    utterance(30, 5);
+    host_time_advance(1000);
+    app_trace_stamp(APP_TRACE_RESULT_SEND);
+    host_time_advance(2000);
+    app_trace_stamp(APP_TRACE_RESULT_RECV);
+    app_trace_stamp(APP_TRACE_DISPATCH);
+    host_time_advance(62000);
+    app_trace_stamp(APP_TRACE_ACTION);
+    app_trace_stamp(APP_TRACE_ACTION);      /* second publish of the same command: span already closed */
+    stats(json, sizeof(json));
+    CHECK(json_num(json, NULL, "spans") == 1, "spans: %s", json);
+    CHECK(json_num(json, NULL, "expired") == 0, "expired: %s", json);
+    CHECK(json_num(json, "fetch", "max") == 30.0, "fetch latency: %s", json);
+    CHECK(json_num(json, "detect", "max") == 35.0, "detect latency: %s", json);
+    CHECK(json_num(json, "action", "n") == 1 && json_num(json, "action", "max") == 100.0, "action: %s", json);
+    CHECK(json_num(json, "play_post", "n") == 0, "play_post not reached but counted: %s", json);
+
+    /* Span without an action ("say again"), then an unrelated action 10 s later */
+    utterance(30, 5);
+    app_trace_stamp(APP_TRACE_DISPATCH);
+    host_time_advance(10 * 1000 * 1000);
+    app_trace_stamp(APP_TRACE_ACTION);
+    stats(json, sizeof(json));
+    CHECK(json_num(json, NULL, "spans") == 2, "spans: %s", json);
+    CHECK(json_num(json, NULL, "expired") == 1, "timed-out span not expired: %s", json);
+    CHECK(json_num(json, "action", "n") == 1 && json_num(json, "action", "max") == 100.0,
+          "unrelated action after timeout recorded: %s", json);
+    CHECK(json_num(json, "dispatch", "n") == 2, "stages reached by the expired span lost: %s", json);
+
+    /* Span superseded by the next command before any action */
+    utterance(30, 5);
+    host_time_advance(500000);
+    utterance(30, 5);
+    host_time_advance(200000);
+    app_trace_stamp(APP_TRACE_ACTION);
+    stats(json, sizeof(json));
+    CHECK(json_num(json, NULL, "spans") == 4, "spans: %s", json);
+    CHECK(json_num(json, NULL, "expired") == 2, "superseded span not expired: %s", json);
+    CHECK(json_num(json, "action", "n") == 2 && json_num(json, "action", "max") == 235.0, "action: %s", json);
+
+    /* Action just inside the window still counts */
+    utterance(30, 5);
+    host_time_advance(2900000);
+    app_trace_stamp(APP_TRACE_ACTION);
+    stats(json, sizeof(json));
+    CHECK(json_num(json, "action", "n") == 3, "action inside the window dropped: %s", json);
+
+    /* Percentiles: actions at 100, 101, ... 299 ms after detection (uniform) */
+    for (int i = 0; i < 200; i++) {
+        utterance(30, 5);
+        host_time_advance((100 + i) * 1000);
+        app_trace_stamp(APP_TRACE_ACTION);
+    }
+    stats(json, sizeof(json));
+    double p50 = json_num(json, "action", "p50"), p95 = json_num(json, "action", "p95");
+    double p99 = json_num(json, "action", "p99");
+    /* 200 of 203 values in 135..334 ms; buckets are ~19% wide */
+    CHECK(p50 > 234 * 0.85 && p50 < 234 * 1.15, "p50 %.1f: %s", p50, json);
+    CHECK(p95 > 324 * 0.85 && p95 < 324 * 1.15, "p95 %.1f: %s", p95, json);
+    CHECK(p99 >= p95 && p99 <= json_num(json, "action", "max"), "p99 %.1f: %s", p99, json);
+
+    /* Output that does not fit is an error, not a truncated object */
+    CHECK(app_trace_format_json(json, 40) < 0, "short buffer accepted");
+
+    app_trace_dump();
+    printf("%s\n", s_fail ? "FAIL" : "OK");
+    return s_fail;
+}
@@ -0,0 +1,231 @@
+/*
+ * Prompt playback, streaming vs. whole-file: time to the first 48 kHz sample and peak allocation.
+ *
+ * "legacy" is the path app_wav_stream replaced (play_wav_by_path() before the streaming engine):
+ * load the whole WAV, build a 3x linearly interpolated 48 kHz copy, then hand it to I2S. "stream" is
+ * app_wav_stream_open() + the first app_wav_stream_read(). Both read the same 16 kHz mono WAVs from a
+ * temporary file; the page cache is warm for both, so the time is decode cost, not flash access.
+ *
+ * Fails if the streaming peak grows with file length or is not below the legacy peak.
+ *
+ *   wav_stream_bench [runs]
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include "esp_heap_caps.h"
+#include "app_wav_stream.h"
+
+#define IN_RATE     16000
+#define LEGACY_MAX  (128 * 1024)    /* legacy path refused larger files */
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+}
+
+/* 16 kHz mono 16-bit WAV with a LIST chunk before "data", like the exported prompts */
+static void write_wav(const char *path, size_t samples)
+{
+    uint8_t hdr[12 + 24 + 8 + 26 + 8];
+    uint8_t *p = hdr;
+    memcpy(p, "RIFF", 4); put_le32(p + 4, (uint32_t)(sizeof(hdr) - 8 + samples * 2)); memcpy(p + 8, "WAVE", 4);
+    p += 12;
+    memcpy(p, "fmt ", 4); put_le32(p + 4, 16); put_le16(p + 8, 1); put_le16(p + 10, 1);
+    put_le32(p + 12, IN_RATE); put_le32(p + 16, IN_RATE * 2); put_le16(p + 20, 2); put_le16(p + 22, 16);
+    p += 24;
+    memcpy(p, "LIST", 4); put_le32(p + 4, 26); memset(p + 8, 'x', 26);
+    p += 8 + 26;
+    memcpy(p, "data", 4); put_le32(p + 4, (uint32_t)(samples * 2));
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fwrite(hdr, 1, sizeof(hdr), f);
+    for (size_t i = 0; i < samples; i++) {
+        int16_t s = (int16_t)(12000 * sin(2 * M_PI * 440.0 * (double)i / IN_RATE));
+        fwrite(&s, 2, 1, f);
+    }
+    fclose(f);
+}
+
+/* The removed play_wav_by_path() up to its bsp_i2s_write(): returns the first output sample */
+static int legacy_first_sample(const char *path, int16_t *first)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (fsize <= 44 || fsize > LEGACY_MAX) {
+        fclose(f);
+        return -1;
+    }
+    uint8_t *buf = heap_caps_malloc((size_t)fsize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf || fread(buf, 1, (size_t)fsize, f) != (size_t)fsize) {
+        heap_caps_free(buf);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    /* wav_find_data(): walk the chunks in memory */
+    size_t off = 12;
+    const uint8_t *pcm = NULL;
+    size_t pcm_len = 0;
+    while (off + 8 <= (size_t)fsize) {
+        uint32_t len = buf[off + 4] | buf[off + 5] << 8 | buf[off + 6] << 16 | (uint32_t)buf[off + 7] << 24;
+        if (memcmp(buf + off, "data", 4) == 0) {
+            pcm = buf + off + 8;
+            pcm_len = len;
+            break;
+        }
+        off += 8 + len + (len & 1);
+    }
+    if (!pcm) {
+        heap_caps_free(buf);
+        return -1;
+    }
+    const unsigned up = 3;
+    size_t num_in = pcm_len / 2;
+    size_t num_out = num_in * up;
+    int16_t *out = heap_caps_malloc(num_out * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!out) {
+        heap_caps_free(buf);
+        return -1;
+    }
+    for (size_t o = 0; o < num_out; o++) {
+        size_t idx = o / up;
+        unsigned frac = o % up;
+        int16_t v0 = (int16_t)(pcm[idx * 2] | pcm[idx * 2 + 1] << 8);
+        int16_t v1 = idx + 1 < num_in ? (int16_t)(pcm[idx * 2 + 2] | pcm[idx * 2 + 3] << 8) : v0;
+        out[o] = (int16_t)((v0 * (int32_t)(up - frac) + v1 * (int32_t)frac) / (int32_t)up);
+    }
+    *first = out[0];        /* first sample handed to bsp_i2s_write() */
+    heap_caps_free(out);
+    heap_caps_free(buf);
+    return 0;
+}
+
+static int stream_first_sample(const char *path, int16_t *first)
+{
+    app_wav_stream_t *s;
+    if (app_wav_stream_open(path, &s) != ESP_OK) {
+        return -1;
+    }
+    const int16_t *pcm;
+    size_t n = app_wav_stream_read(s, &pcm);
+    if (n) {
+        *first = pcm[0];
+    }
+    app_wav_stream_close(s);
+    return n ? 0 : -1;
+}
+
+typedef int (*first_fn_t)(const char *path, int16_t *first);
+
+static bool measure(first_fn_t fn, const char *path, int runs, double *ttfs_us, size_t *peak)
+{
+    host_heap_stats_t st;
+    host_heap_get(&st);
+    size_t base = st.in_use;
+    host_heap_reset_peak();
+    double best = 1e30;
+    for (int r = 0; r < runs; r++) {
+        int16_t first;
+        double t0 = now_us();
+        if (fn(path, &first) != 0) {
+            return false;
+        }
+        double dt = now_us() - t0;
+        best = dt < best ? dt : best;
+    }
+    host_heap_get(&st);
+    *ttfs_us = best;
+    *peak = st.peak - base;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? atoi(argv[1]) : 20;
+    if (runs < 1) {
+        runs = 1;
+    }
+    static const double seconds[] = { 0.5, 1.0, 2.0, 4.0, 30.0 };
+    char path[] = "/tmp/wav_stream_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+
+    /* Block buffers are allocated on first use and kept: count them on the first (cold) open only */
+    write_wav(path, IN_RATE / 10);
+    host_heap_reset_peak();
+    int16_t first;
+    if (stream_first_sample(path, &first) != 0) {
+        fprintf(stderr, "stream: cannot open %s\n", path);
+        return 1;
+    }
+    host_heap_stats_t st;
+    host_heap_get(&st);
+    size_t stream_resident = st.peak;
+
+    printf("%-8s %-10s | %-12s %-12s | %-12s %-12s\n", "length", "file", "legacy TTFS", "legacy peak",
+           "stream TTFS", "stream peak");
+    int fail = 0;
+    size_t stream_peak_first = (size_t)-1;
+    for (size_t i = 0; i < sizeof(seconds) / sizeof(seconds[0]); i++) {
+        size_t samples = (size_t)(seconds[i] * IN_RATE);
+        write_wav(path, samples);
+        double t_legacy = 0, t_stream = 0;
+        size_t p_legacy = 0, p_stream = 0;
+        bool legacy_ok = measure(legacy_first_sample, path, runs, &t_legacy, &p_legacy);
+        if (!measure(stream_first_sample, path, runs, &t_stream, &p_stream)) {
+            fprintf(stderr, "stream failed at %.1f s\n", seconds[i]);
+            fail = 1;
+            continue;
+        }
+        p_stream += stream_resident;        /* buffers kept from the cold open */
+        char lt[24] = "refused", lp[24] = "-";
+        if (legacy_ok) {
+            snprintf(lt, sizeof(lt), "%.0f us", t_legacy);
+            snprintf(lp, sizeof(lp), "%zu B", p_legacy);
+        }
+        printf("%-6.1f s %-8zu B | %-12s %-12s | %-9.0f us %-10zu B\n", seconds[i], samples * 2 + 78, lt, lp,
+               t_stream, p_stream);
+        if (stream_peak_first == (size_t)-1) {
+            stream_peak_first = p_stream;
+        } else if (p_stream != stream_peak_first) {
+            fprintf(stderr, "FAIL: stream peak changed with length (%zu vs %zu B)\n", p_stream, stream_peak_first);
+            fail = 1;
+        }
+        if (legacy_ok && p_stream >= p_legacy) {
+            fprintf(stderr, "FAIL: stream peak %zu B not below legacy %zu B\n", p_stream, p_legacy);
+            fail = 1;
+        }
+    }
+    close(fd);
+    unlink(path);
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
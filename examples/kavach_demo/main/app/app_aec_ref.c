@@ -0,0 +1,107 @@
+/*
+ * AEC reference ring: 48 kHz playback PCM is box-filtered and decimated by 3 to the 16 kHz
+ * capture rate, then queued in a stream buffer. The playback task publishes each block before
+ * handing it to bsp_i2s_write(): the speaker starts while that call blocks, and a feed read in between
+ * must already find the reference, or it would trail the echo. The reference then leads the echo by
+ * at most one feed chunk (host/aec_ref_test.c), which the AEC filter length absorbs.
+ */
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/stream_buffer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "app_aec_ref.h"
+
+static const char *TAG = "aec_ref";
+
+#define REF_DECIMATION      3       /* 48 kHz playback -> 16 kHz capture */
+#define REF_RATE_HZ         16000
+#define REF_RING_MS         250
+#define REF_RING_BYTES      (REF_RATE_HZ * REF_RING_MS / 1000 * sizeof(int16_t))
+#define REF_WRITE_CHUNK     128     /* decimated samples staged per stream buffer send */
+
+static StreamBufferHandle_t s_ring = NULL;
+static int32_t s_acc = 0;           /* partial sum of the current decimation group */
+static int s_acc_n = 0;
+static uint32_t s_dropped = 0;
+
+esp_err_t app_aec_ref_init(void)
+{
+    if (s_ring) {
+        return ESP_OK;
+    }
+    s_ring = xStreamBufferCreate(REF_RING_BYTES, sizeof(int16_t));
+    if (!s_ring) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Playback reference ring: %d ms", REF_RING_MS);
+    return ESP_OK;
+}
+
+void app_aec_ref_begin(void)
+{
+    if (!s_ring) {
+        return;
+    }
+    if (s_dropped) {
+        ESP_LOGD(TAG, "%lu reference samples dropped (ring full)", (unsigned long)s_dropped);
+        s_dropped = 0;
+    }
+    /* Reader never blocks on the ring, so a reset from the writer side always succeeds */
+    xStreamBufferReset(s_ring);
+    s_acc = 0;
+    s_acc_n = 0;
+#if CONFIG_KAVACH_AEC_REF_DELAY_MS > 0
+    static const int16_t silence[REF_WRITE_CHUNK];
+    size_t pad = (size_t)REF_RATE_HZ * CONFIG_KAVACH_AEC_REF_DELAY_MS / 1000;
+    while (pad > 0) {
+        size_t n = pad < REF_WRITE_CHUNK ? pad : REF_WRITE_CHUNK;
+        xStreamBufferSend(s_ring, silence, n * sizeof(int16_t), 0);
+        pad -= n;
+    }
+#endif
+}
+
+static void send_staged(const int16_t *staged, size_t n)
+{
+    /* Never block playback: if the feed task is paused the ring fills and new reference is dropped */
+    size_t sent = xStreamBufferSend(s_ring, staged, n * sizeof(int16_t), 0) / sizeof(int16_t);
+    s_dropped += (uint32_t)(n - sent);
+}
+
+void app_aec_ref_write(const int16_t *pcm, size_t samples)
+{
+    if (!s_ring || !pcm) {
+        return;
+    }
+    int16_t staged[REF_WRITE_CHUNK];
+    size_t n = 0;
+    for (size_t i = 0; i < samples; i++) {
+        s_acc += pcm[i];
+        if (++s_acc_n < REF_DECIMATION) {
+            continue;
+        }
+        staged[n++] = (int16_t)(s_acc / REF_DECIMATION);
+        s_acc = 0;
+        s_acc_n = 0;
+        if (n == REF_WRITE_CHUNK) {
+            send_staged(staged, n);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        send_staged(staged, n);
+    }
+}
+
+size_t app_aec_ref_read(int16_t *ref, size_t samples)
+{
+    size_t got = 0;
+    if (s_ring) {
+        got = xStreamBufferReceive(s_ring, ref, samples * sizeof(int16_t), 0) / sizeof(int16_t);
+    }
+    if (got < samples) {
+        memset(ref + got, 0, (samples - got) * sizeof(int16_t));
+    }
+    return got;
+}
@@ -0,0 +1,33 @@
+/*
+ * AEC playback reference: the playback task publishes the exact PCM it writes to I2S, the AFE feed
+ * task reads it back time-aligned with the microphone frames as the third (reference) channel.
+ * Single writer (playback task), single reader (feed task), lock-free FreeRTOS stream buffer.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Create the reference ring. Call before the feed task starts. */
+esp_err_t app_aec_ref_init(void);
+
+/** Start of a prompt: drop stale reference and insert CONFIG_KAVACH_AEC_REF_DELAY_MS of silence. */
+void app_aec_ref_begin(void);
+
+/** Publish PCM about to be written to I2S (48 kHz mono); decimated to the 16 kHz capture rate. */
+void app_aec_ref_write(const int16_t *pcm, size_t samples);
+
+/**
+ * Read samples 16 kHz reference samples for one feed chunk; missing samples (nothing playing,
+ * underrun) are filled with silence. Returns the number of real reference samples.
+ */
+size_t app_aec_ref_read(int16_t *ref, size_t samples);
+
+#ifdef __cplusplus
+}
+#endif
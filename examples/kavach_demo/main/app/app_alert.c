@@ -0,0 +1,286 @@
+/*
+ * Incident table: a few fixed slots (no allocation per report), searched linearly by kind and device.
+ * A one-shot timer is armed for the earliest quiet timeout. Reports, clears and timeouts work out
+ * under s_lock what changed (incident events, alert raised or lowered) and act on it after releasing
+ * it, so the event callback may publish and the UI / playback calls never run under the lock.
+ */
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "app_alert.h"
+#include "app_sr_handler.h"
+#include "gui/ui_kavach.h"
+
+static const char *TAG = "alert";
+
+#define INCIDENT_MAX        8
+#define QUIET_US            ((int64_t)CONFIG_KAVACH_ALERT_QUIET_SEC * 1000000)
+
+typedef struct {
+    app_alert_incident_t inc;
+    bool used;
+} slot_t;
+
+typedef struct {
+    app_alert_incident_t inc;
+    app_alert_end_t end;
+    bool is_end;
+} alert_event_t;
+
+/* What a call changed; filled under s_lock, acted on after */
+typedef struct {
+    alert_event_t events[INCIDENT_MAX];
+    int event_num;
+    bool raise[APP_ALERT_KIND_MAX];
+    bool lower[APP_ALERT_KIND_MAX];
+} alert_out_t;
+
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_timer = NULL;
+static app_alert_event_cb_t s_event_cb = NULL;
+static void *s_event_arg = NULL;
+static slot_t s_slots[INCIDENT_MAX];
+static bool s_raised[APP_ALERT_KIND_MAX];   /* alert shown / sounding */
+static app_alert_stats_t s_stats;
+
+static const char *const s_kind_names[APP_ALERT_KIND_MAX] = { "gas", "intruder" };
+
+const char *app_alert_kind_name(app_alert_kind_t kind)
+{
+    return kind < APP_ALERT_KIND_MAX ? s_kind_names[kind] : "?";
+}
+
+static slot_t *find_slot(app_alert_kind_t kind, const char *device)
+{
+    for (int i = 0; i < INCIDENT_MAX; i++) {
+        if (s_slots[i].used && s_slots[i].inc.kind == kind && strcmp(s_slots[i].inc.device, device) == 0) {
+            return &s_slots[i];
+        }
+    }
+    return NULL;
+}
+
+/* Arm the timer for the earliest quiet timeout. Caller holds s_lock. */
+static void arm_timer_locked(int64_t now)
+{
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < INCIDENT_MAX; i++) {
+        if (s_slots[i].used && s_slots[i].inc.last_us + QUIET_US < next) {
+            next = s_slots[i].inc.last_us + QUIET_US;
+        }
+    }
+    esp_timer_stop(s_timer);
+    if (next != INT64_MAX) {
+        esp_timer_start_once(s_timer, next > now ? (uint64_t)(next - now) : 1);
+    }
+}
+
+/* End the incident in slot; lower the alert if it was the last one still shown. Caller holds s_lock. */
+static void end_locked(slot_t *slot, app_alert_end_t why, alert_out_t *out)
+{
+    alert_event_t *ev = &out->events[out->event_num++];
+    ev->inc = slot->inc;
+    ev->end = why;
+    ev->is_end = true;
+    slot->used = false;
+
+    app_alert_kind_t kind = slot->inc.kind;
+    for (int i = 0; i < INCIDENT_MAX; i++) {
+        if (s_slots[i].used && s_slots[i].inc.kind == kind && !s_slots[i].inc.dismissed) {
+            return;
+        }
+    }
+    if (s_raised[kind]) {
+        s_raised[kind] = false;
+        out->lower[kind] = true;
+    }
+}
+
+static void apply(const alert_out_t *out)
+{
+    for (int i = 0; i < out->event_num; i++) {
+        const alert_event_t *ev = &out->events[i];
+        if (ev->is_end) {
+            ESP_LOGI(TAG, "%s incident from %s ended (%s) after %lu s, %lu reports",
+                     app_alert_kind_name(ev->inc.kind), ev->inc.device,
+                     ev->end == APP_ALERT_END_CLEAR ? "clear" : "quiet",
+                     (unsigned long)((ev->inc.last_us - ev->inc.start_us) / 1000000),
+                     (unsigned long)ev->inc.reports);
+        } else {
+            ESP_LOGW(TAG, "%s incident from %s started", app_alert_kind_name(ev->inc.kind), ev->inc.device);
+        }
+        if (s_event_cb) {
+            s_event_cb(&ev->inc, ev->is_end ? &ev->end : NULL, s_event_arg);
+        }
+    }
+    if (out->raise[APP_ALERT_GAS]) {
+        kavach_ui_trigger_gas_leak_alert();     /* full-screen until the incident ends or is dismissed */
+        sr_handler_play_gas_alarm();            /* loops until sr_handler_stop_gas_alarm() */
+    }
+    if (out->lower[APP_ALERT_GAS]) {
+        sr_handler_stop_gas_alarm();
+        kavach_ui_clear_gas_leak_alert();
+    }
+    if (out->raise[APP_ALERT_INTRUDER]) {
+        kavach_ui_trigger_intruder_alert();
+    }
+}
+
+static void quiet_timer_cb(void *arg)
+{
+    (void)arg;
+    alert_out_t out = { 0 };
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < INCIDENT_MAX; i++) {
+        if (s_slots[i].used && now - s_slots[i].inc.last_us >= QUIET_US) {
+            end_locked(&s_slots[i], APP_ALERT_END_QUIET, &out);
+        }
+    }
+    arm_timer_locked(now);
+    xSemaphoreGive(s_lock);
+    apply(&out);
+}
+
+esp_err_t app_alert_init(app_alert_event_cb_t event_cb, void *arg)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    const esp_timer_create_args_t timer_args = {
+        .callback = &quiet_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "alert_quiet",
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &s_timer);
+    if (ret != ESP_OK) {
+        vSemaphoreDelete(s_lock);
+        s_lock = NULL;
+        return ret;
+    }
+    s_event_cb = event_cb;
+    s_event_arg = arg;
+    return ESP_OK;
+}
+
+void app_alert_report(app_alert_kind_t kind, const char *device, int32_t level)
+{
+    if (!s_lock || kind >= APP_ALERT_KIND_MAX) {
+        return;
+    }
+    if (!device || !device[0]) {
+        device = "?";
+    }
+    alert_out_t out = { 0 };
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.reports++;
+    slot_t *slot = find_slot(kind, device);
+    if (slot) {
+        slot->inc.last_us = now;
+        slot->inc.reports++;
+        if (level > slot->inc.peak) {
+            slot->inc.peak = level;
+        }
+        s_stats.coalesced++;
+    } else {
+        for (int i = 0; i < INCIDENT_MAX && !slot; i++) {
+            if (!s_slots[i].used) {
+                slot = &s_slots[i];
+            }
+        }
+        if (slot) {
+            slot->used = true;
+            slot->inc = (app_alert_incident_t) {
+                .kind = kind, .start_us = now, .last_us = now, .reports = 1, .peak = level,
+            };
+            strlcpy(slot->inc.device, device, sizeof(slot->inc.device));
+            s_stats.incidents++;
+            alert_event_t *ev = &out.events[out.event_num++];
+            ev->inc = slot->inc;
+            ev->is_end = false;
+            if (!s_raised[kind]) {
+                s_raised[kind] = true;
+                out.raise[kind] = true;
+            }
+        } else {
+            s_stats.dropped++;
+        }
+    }
+    if (slot) {
+        arm_timer_locked(now);
+    }
+    xSemaphoreGive(s_lock);
+    if (!slot) {
+        ESP_LOGW(TAG, "Incident table full, %s report from %s dropped", app_alert_kind_name(kind), device);
+    }
+    apply(&out);
+}
+
+void app_alert_clear(app_alert_kind_t kind, const char *device)
+{
+    if (!s_lock || kind >= APP_ALERT_KIND_MAX) {
+        return;
+    }
+    alert_out_t out = { 0 };
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    slot_t *slot = find_slot(kind, (device && device[0]) ? device : "?");
+    if (slot) {
+        end_locked(slot, APP_ALERT_END_CLEAR, &out);
+        arm_timer_locked(esp_timer_get_time());
+    }
+    xSemaphoreGive(s_lock);
+    apply(&out);
+}
+
+void app_alert_dismiss(app_alert_kind_t kind)
+{
+    if (!s_lock || kind >= APP_ALERT_KIND_MAX) {
+        return;
+    }
+    alert_out_t out = { 0 };
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < INCIDENT_MAX; i++) {
+        if (s_slots[i].used && s_slots[i].inc.kind == kind) {
+            s_slots[i].inc.dismissed = true;
+        }
+    }
+    if (s_raised[kind]) {
+        s_raised[kind] = false;
+        out.lower[kind] = true;
+    }
+    xSemaphoreGive(s_lock);
+    apply(&out);
+}
+
+int app_alert_active(app_alert_kind_t kind)
+{
+    int n = 0;
+    if (!s_lock) {
+        return 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < INCIDENT_MAX; i++) {
+        n += s_slots[i].used && s_slots[i].inc.kind == kind;
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+void app_alert_get_stats(app_alert_stats_t *stats)
+{
+    if (!s_lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
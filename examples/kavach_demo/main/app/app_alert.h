@@ -0,0 +1,75 @@
+/*
+ * Alert manager: gas and intruder reports from the sensor nodes are grouped into incidents, one per
+ * kind and source device. The first report of an incident raises the alert (overlay, gas alarm sound);
+ * repeats only extend it. An incident ends when the node reports clear or nothing was heard for
+ * CONFIG_KAVACH_ALERT_QUIET_SEC. Dismissing the overlay silences the alert, but the incident stays
+ * open, so the repeats that follow do not raise it again.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define APP_ALERT_DEVICE_MAX    32
+
+typedef enum {
+    APP_ALERT_GAS = 0,
+    APP_ALERT_INTRUDER,
+    APP_ALERT_KIND_MAX,
+} app_alert_kind_t;
+
+typedef enum {
+    APP_ALERT_END_CLEAR = 0,    /* the node reported the condition gone */
+    APP_ALERT_END_QUIET,        /* no report for CONFIG_KAVACH_ALERT_QUIET_SEC */
+} app_alert_end_t;
+
+typedef struct {
+    app_alert_kind_t kind;
+    char device[APP_ALERT_DEVICE_MAX];
+    int64_t start_us;           /* esp_timer time of the first report */
+    int64_t last_us;            /* latest report */
+    uint32_t reports;           /* reports in this incident, the first one included */
+    int32_t peak;               /* highest level reported (gas), -1 if none */
+    bool dismissed;             /* silenced by the user */
+} app_alert_incident_t;
+
+/**
+ * Incident start (end == NULL) or end. Called without the alert lock held, from the task that
+ * reported (MQTT task) or from the esp_timer task for quiet timeouts.
+ */
+typedef void (*app_alert_event_cb_t)(const app_alert_incident_t *inc, const app_alert_end_t *end, void *arg);
+
+typedef struct {
+    uint32_t reports;           /* app_alert_report() calls */
+    uint32_t incidents;         /* incidents started */
+    uint32_t coalesced;         /* reports that only extended an open incident */
+    uint32_t dropped;           /* reports lost because the incident table was full */
+} app_alert_stats_t;
+
+/** Create the alert manager. event_cb (may be NULL) is told about incident start and end. */
+esp_err_t app_alert_init(app_alert_event_cb_t event_cb, void *arg);
+
+/** A node reported the condition (level: gas reading, or -1). device may be NULL. */
+void app_alert_report(app_alert_kind_t kind, const char *device, int32_t level);
+
+/** A node reported the condition gone: end its incident. */
+void app_alert_clear(app_alert_kind_t kind, const char *device);
+
+/** The user dismissed the alert (UI): silence it; open incidents stay open. */
+void app_alert_dismiss(app_alert_kind_t kind);
+
+/** Number of open incidents of kind. */
+int app_alert_active(app_alert_kind_t kind);
+
+void app_alert_get_stats(app_alert_stats_t *stats);
+
+const char *app_alert_kind_name(app_alert_kind_t kind);
+
+#ifdef __cplusplus
+}
+#endif
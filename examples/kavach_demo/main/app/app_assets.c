@@ -0,0 +1,211 @@
+/*
+ * Asset index: one directory scan per mount point, then O(1) id -> path lookups.
+ * Mount points are searched in priority order (SD card first, user-provided files win).
+ * While an SD card is mounted, a slow esp_timer watches it and rebuilds the index when it goes away;
+ * boards without a card (or that never mount one) run no timer at all.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "app_assets.h"
+
+static const char *TAG = "app_assets";
+
+#define ASSET_PATH_MAX          48
+#define ASSET_NOT_FOUND         0xFF
+#define SD_WATCH_PERIOD_US      (3 * 1000 * 1000)
+
+/* Mount points in lookup priority order: SD card first (user-provided), then SPIFFS/storage. */
+static const char *s_mount_points[] = { "/sdcard", "/spiffs", "/storage" };
+#define MOUNT_POINT_NUM (sizeof(s_mount_points) / sizeof(s_mount_points[0]))
+#define SD_MOUNT_INDEX  0
+
+static const char *s_file_names[APP_ASSET_MAX] = {
+    [APP_ASSET_BEEP]                 = "beep.wav",
+    [APP_ASSET_WAKE]                 = "wake.wav",
+    [APP_ASSET_GAS_ALARM]            = "gas_alarm.wav",
+    [APP_ASSET_ECHO_EN_OK + 0]       = "echo_en_ok.wav",
+    [APP_ASSET_ECHO_EN_OK + 1]       = "echo_en_alerted.wav",
+    [APP_ASSET_ECHO_EN_OK + 2]       = "echo_en_calling.wav",
+    [APP_ASSET_ECHO_EN_OK + 3]       = "echo_en_help.wav",
+    [APP_ASSET_ECHO_CN_OK + 0]       = "echo_cn_ok.wav",
+    [APP_ASSET_ECHO_CN_OK + 1]       = "echo_cn_alerted.wav",
+    [APP_ASSET_ECHO_CN_OK + 2]       = "echo_cn_calling.wav",
+    [APP_ASSET_ECHO_CN_OK + 3]       = "echo_cn_help.wav",
+};
+
+typedef struct {
+    char path[APP_ASSET_MAX][ASSET_PATH_MAX];
+    uint8_t mount_idx[APP_ASSET_MAX];   /* index into s_mount_points, ASSET_NOT_FOUND if missing */
+} asset_table_t;
+
+static asset_table_t s_table;
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_sd_watch_timer = NULL;
+static bool s_sd_present = false;
+static uint32_t s_generation = 0;
+static app_assets_stats_t s_stats;
+
+static bool dir_present(const char *mount_point)
+{
+    DIR *d = opendir(mount_point);
+    s_stats.fs_calls_spent++;
+    if (!d) {
+        return false;
+    }
+    closedir(d);
+    return true;
+}
+
+static void scan_mount(size_t m, asset_table_t *t)
+{
+    DIR *d = opendir(s_mount_points[m]);
+    s_stats.fs_calls_spent++;
+    if (!d) {
+        return;
+    }
+    if (m == SD_MOUNT_INDEX) {
+        s_sd_present = true;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        s_stats.fs_calls_spent++;
+        for (size_t id = 0; id < APP_ASSET_MAX; id++) {
+            /* FAT may report upper-case short names; SPIFFS lists nested files as "dir/name" (no match) */
+            if (t->mount_idx[id] == ASSET_NOT_FOUND && strcasecmp(de->d_name, s_file_names[id]) == 0) {
+                snprintf(t->path[id], ASSET_PATH_MAX, "%s/%s", s_mount_points[m], de->d_name);
+                t->mount_idx[id] = (uint8_t)m;
+                break;
+            }
+        }
+    }
+    closedir(d);
+}
+
+static void sd_watch_timer_cb(void *arg)
+{
+    (void)arg;
+    if (!dir_present(s_mount_points[SD_MOUNT_INDEX])) {
+        ESP_LOGI(TAG, "SD card removed, rebuilding asset index");
+        app_assets_rebuild();
+    }
+}
+
+/* Watch the card only while one is mounted. A card mounted later (bsp_sdcard_init) needs an
+ * app_assets_rebuild() call, which also starts the watch. */
+static void sd_watch_update(void)
+{
+    if (!s_sd_watch_timer) {
+        if (!s_sd_present) {
+            return;
+        }
+        const esp_timer_create_args_t timer_args = {
+            .callback = &sd_watch_timer_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "assets_sd",
+        };
+        if (esp_timer_create(&timer_args, &s_sd_watch_timer) != ESP_OK) {
+            s_sd_watch_timer = NULL;
+            ESP_LOGW(TAG, "SD watch timer not started; call app_assets_rebuild() after removing the card");
+            return;
+        }
+    }
+    bool active = esp_timer_is_active(s_sd_watch_timer);
+    if (s_sd_present && !active) {
+        esp_timer_start_periodic(s_sd_watch_timer, SD_WATCH_PERIOD_US);
+    } else if (!s_sd_present && active) {
+        esp_timer_stop(s_sd_watch_timer);
+    }
+}
+
+esp_err_t app_assets_rebuild(void)
+{
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    static asset_table_t t;  /* static: keeps ~600 bytes off the caller's (timer task) stack */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    memset(&t, 0, sizeof(t));
+    memset(t.mount_idx, ASSET_NOT_FOUND, sizeof(t.mount_idx));
+    s_sd_present = false;
+    for (size_t m = 0; m < MOUNT_POINT_NUM; m++) {
+        scan_mount(m, &t);
+    }
+    bool changed = memcmp(&t, &s_table, sizeof(t)) != 0;
+    if (changed) {
+        memcpy(&s_table, &t, sizeof(t));
+        s_generation++;
+    }
+    s_stats.rebuilds++;
+    sd_watch_update();
+    xSemaphoreGive(s_lock);
+
+    int found = 0;
+    for (size_t id = 0; id < APP_ASSET_MAX; id++) {
+        found += (t.mount_idx[id] != ASSET_NOT_FOUND);
+    }
+    ESP_LOGI(TAG, "Asset index: %d/%d prompts found (SD card %s)%s", found, APP_ASSET_MAX,
+             s_sd_present ? "mounted" : "absent", changed ? "" : ", unchanged");
+    return ESP_OK;
+}
+
+esp_err_t app_assets_init(void)
+{
+    if (s_lock) {
+        return app_assets_rebuild();
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    return app_assets_rebuild();
+}
+
+const char *app_assets_file_name(app_asset_id_t id)
+{
+    return (id < APP_ASSET_MAX) ? s_file_names[id] : NULL;
+}
+
+bool app_assets_get_path(app_asset_id_t id, char *buf, size_t buf_len)
+{
+    if (id >= APP_ASSET_MAX || !buf || buf_len == 0 || !s_lock) {
+        return false;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint8_t m = s_table.mount_idx[id];
+    bool found = (m != ASSET_NOT_FOUND);
+    if (found) {
+        strlcpy(buf, s_table.path[id], buf_len);
+    }
+    s_stats.lookups++;
+    /* The old search tried each mount point in order until fopen() succeeded */
+    s_stats.fs_calls_avoided += found ? (uint32_t)m + 1 : (uint32_t)MOUNT_POINT_NUM;
+    xSemaphoreGive(s_lock);
+    return found;
+}
+
+bool app_assets_is_override(app_asset_id_t id)
+{
+    return id < APP_ASSET_MAX && s_lock && s_table.mount_idx[id] == SD_MOUNT_INDEX;
+}
+
+uint32_t app_assets_generation(void)
+{
+    return s_generation;
+}
+
+void app_assets_get_stats(app_assets_stats_t *out)
+{
+    if (!out || !s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,58 @@
+/*
+ * Asset index for voice prompts: enumerates /sdcard, /spiffs and /storage once after mount and
+ * resolves logical prompts (wake beep, gas alarm, echo_<lang>_<suffix>) to a path in O(1),
+ * instead of probing each mount point with fopen() on every playback.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Confirmation prompts per language, in confirm-type order: ok, alerted, calling, help. */
+#define APP_ASSET_CONFIRM_NUM 4
+
+typedef enum {
+    APP_ASSET_BEEP = 0,     /* beep.wav */
+    APP_ASSET_WAKE,         /* wake.wav (alternative wake beep) */
+    APP_ASSET_GAS_ALARM,    /* gas_alarm.wav */
+    APP_ASSET_ECHO_EN_OK,   /* echo_en_<suffix>.wav, APP_ASSET_CONFIRM_NUM entries */
+    APP_ASSET_ECHO_CN_OK = APP_ASSET_ECHO_EN_OK + APP_ASSET_CONFIRM_NUM,
+    APP_ASSET_MAX = APP_ASSET_ECHO_CN_OK + APP_ASSET_CONFIRM_NUM,
+} app_asset_id_t;
+
+typedef struct {
+    uint32_t lookups;           /* app_assets_get_path() calls */
+    uint32_t fs_calls_avoided;  /* fopen() probes the old per-playback search would have made */
+    uint32_t fs_calls_spent;    /* opendir/readdir calls made by index builds and the SD watcher */
+    uint32_t rebuilds;
+} app_assets_stats_t;
+
+/** Build the index; while an SD card is mounted, watch for its removal. Call after bsp_spiffs_mount() (and bsp_sdcard_init() if used). */
+esp_err_t app_assets_init(void);
+
+/** Rebuild the index now (e.g. right after mounting or unmounting a filesystem; a newly mounted SD card is watched from then on). */
+esp_err_t app_assets_rebuild(void);
+
+/** File name of a logical asset (e.g. "echo_en_ok.wav"), also usable as a cache key. */
+const char *app_assets_file_name(app_asset_id_t id);
+
+/** Copy the resolved path of an asset into buf. Returns false if the asset is on no mounted filesystem. */
+bool app_assets_get_path(app_asset_id_t id, char *buf, size_t buf_len);
+
+/** True if the asset resolves to the SD card, i.e. a user-provided file that overrides built-in prompts. */
+bool app_assets_is_override(app_asset_id_t id);
+
+/** Incremented on every rebuild that changed a resolved path; lets users drop derived caches. */
+uint32_t app_assets_generation(void);
+
+void app_assets_get_stats(app_assets_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,320 @@
+/*
+ * The broker (components/kavach_broker) runs in its own task, looping kbroker_poll(). The bridge is a
+ * second esp-mqtt client with esp-mqtt's own reconnect (every 5 s; the box's client talks to the local
+ * broker and keeps the supervisor).
+ *
+ * Upward: kbroker calls on_local_publish() from the broker task. It only copies the message into a
+ * queue; the bridge task hands it to esp_mqtt_client_enqueue(), which can wait for the bridge client's
+ * lock while a connect to an unreachable broker times out, and the broker task must not wait for that.
+ * QoS 1 messages are stored in the bridge client's outbox until the external broker acknowledges them;
+ * QoS 0 messages are dropped while it is unreachable.
+ * Downward: messages from the external broker are published locally with kbroker_publish(), which does
+ * not pass them back to on_local_publish(). A topic in both lists (the appliance commands) would still
+ * come back from the external broker after we forwarded it; a short list of checksums of what was
+ * forwarded recently catches those echoes.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "kbroker.h"
+#include "app_broker.h"
+
+static const char *TAG = "broker";
+
+#define FILTER_MAX          8
+#define FILTER_TEXT_MAX     256
+#define TOPIC_MAX           128
+#define BRIDGE_QUEUE_LEN    32
+#define ECHO_MAX            16
+#define ECHO_US             (5 * 1000 * 1000)
+#define RECONNECT_MS        5000
+#define SOCKETS_RESERVED    6       /* listen socket, box client (both ends), bridge, SNTP, spare */
+
+typedef struct {
+    uint8_t qos;
+    bool retain;
+    uint16_t topic_len;
+    size_t len;
+    char data[];                    /* topic, NUL, payload */
+} bridge_msg_t;
+
+typedef struct {
+    uint32_t crc;
+    int64_t us;
+} echo_t;
+
+static kbroker_t *s_broker = NULL;
+static esp_mqtt_client_handle_t s_upstream = NULL;
+static QueueHandle_t s_bridge_queue = NULL;
+static SemaphoreHandle_t s_lock = NULL;     /* s_echo, s_stats */
+static volatile bool s_up_connected;
+static char s_local_uri[32];
+static char s_out_text[FILTER_TEXT_MAX];
+static char s_in_text[FILTER_TEXT_MAX];
+static const char *s_out[FILTER_MAX];
+static const char *s_in[FILTER_MAX];
+static int s_out_num, s_in_num;
+static echo_t s_echo[ECHO_MAX];
+static int s_echo_next;
+static app_broker_stats_t s_stats;
+
+/* Split a space-separated Kconfig list into filters (pointers into text) */
+static int parse_filters(const char *list, char *text, size_t text_len, const char **filters)
+{
+    int n = 0;
+    strlcpy(text, list, text_len);
+    for (char *save = NULL, *f = strtok_r(text, " ,", &save); f && n < FILTER_MAX; f = strtok_r(NULL, " ,", &save)) {
+        filters[n++] = f;
+    }
+    return n;
+}
+
+static bool matches(const char *const *filters, int n, const char *topic, size_t topic_len)
+{
+    for (int i = 0; i < n; i++) {
+        if (kbroker_topic_match(filters[i], topic, topic_len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t msg_crc(const char *topic, size_t topic_len, const void *payload, size_t len)
+{
+    return esp_rom_crc32_le(esp_rom_crc32_le(0, (const uint8_t *)topic, topic_len), payload, len);
+}
+
+static void count(uint32_t *counter)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    (*counter)++;
+    xSemaphoreGive(s_lock);
+}
+
+/* Broker task, no broker lock held: queue a local client's message for the external broker */
+static void on_local_publish(const kbroker_msg_t *msg, void *arg)
+{
+    (void)arg;
+    if (!matches(s_out, s_out_num, msg->topic, msg->topic_len)) {
+        return;
+    }
+    if (msg->qos == 0 && !s_up_connected) {
+        count(&s_stats.lost);
+        return;
+    }
+    bridge_msg_t *m = malloc(sizeof(*m) + msg->topic_len + 1 + msg->len);
+    if (!m) {
+        count(&s_stats.lost);
+        return;
+    }
+    m->qos = msg->qos;
+    m->retain = msg->retain;
+    m->topic_len = (uint16_t)msg->topic_len;
+    m->len = msg->len;
+    memcpy(m->data, msg->topic, msg->topic_len + 1);
+    memcpy(m->data + msg->topic_len + 1, msg->payload, msg->len);
+    if (xQueueSend(s_bridge_queue, &m, 0) != pdTRUE) {
+        free(m);
+        count(&s_stats.lost);
+    }
+}
+
+static void bridge_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        bridge_msg_t *m;
+        if (xQueueReceive(s_bridge_queue, &m, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        const char *payload = m->data + m->topic_len + 1;
+        uint32_t crc = msg_crc(m->data, m->topic_len, payload, m->len);
+        int id = -1;
+        if (m->qos > 0 || s_up_connected) {
+            id = esp_mqtt_client_enqueue(s_upstream, m->data, payload, (int)m->len, m->qos, m->retain, true);
+        }
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (id >= 0) {
+            s_echo[s_echo_next] = (echo_t) { .crc = crc, .us = esp_timer_get_time() };
+            s_echo_next = (s_echo_next + 1) % ECHO_MAX;
+            s_stats.bridged_up++;
+        } else {
+            s_stats.lost++;
+        }
+        xSemaphoreGive(s_lock);
+        free(m);
+    }
+}
+
+/* true if topic/payload is a message we forwarded in the last ECHO_US (the entry is used up) */
+static bool is_echo(const char *topic, size_t topic_len, const char *payload, size_t len)
+{
+    uint32_t crc = msg_crc(topic, topic_len, payload, len);
+    int64_t now = esp_timer_get_time();
+    bool echo = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < ECHO_MAX && !echo; i++) {
+        if (s_echo[i].us && s_echo[i].crc == crc && now - s_echo[i].us < ECHO_US) {
+            s_echo[i].us = 0;
+            echo = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return echo;
+}
+
+static void upstream_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    (void)handler_args;
+    (void)base;
+    esp_mqtt_event_handle_t evt = (esp_mqtt_event_handle_t)event_data;
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+        s_up_connected = true;
+        for (int i = 0; i < s_in_num; i++) {
+            esp_mqtt_client_subscribe(s_upstream, s_in[i], 1);
+        }
+        ESP_LOGI(TAG, "Bridge connected%s", evt && evt->session_present ? " (session resumed)" : "");
+        break;
+
+    case MQTT_EVENT_DISCONNECTED:
+        if (s_up_connected) {
+            ESP_LOGW(TAG, "Bridge disconnected; local clients are not affected");
+        }
+        s_up_connected = false;
+        break;
+
+    case MQTT_EVENT_DATA: {
+        if (!evt || evt->current_data_offset != 0) {
+            break;      /* later pieces of a message that was too large */
+        }
+        if (evt->total_data_len > evt->data_len || evt->topic_len <= 0 || evt->topic_len >= TOPIC_MAX) {
+            count(&s_stats.lost);
+            ESP_LOGW(TAG, "Bridge: message too large (%d bytes), not published locally", evt->total_data_len);
+            break;
+        }
+        char topic[TOPIC_MAX];
+        memcpy(topic, evt->topic, evt->topic_len);
+        topic[evt->topic_len] = '\0';
+        if (is_echo(topic, evt->topic_len, evt->data, evt->data_len)) {
+            count(&s_stats.echoes);
+            break;
+        }
+        if (kbroker_publish(s_broker, topic, evt->data, evt->data_len, evt->qos, evt->retain) == 0) {
+            count(&s_stats.bridged_down);
+        } else {
+            count(&s_stats.lost);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+static void broker_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        int err = kbroker_poll(s_broker, 1000);
+        if (err) {
+            ESP_LOGE(TAG, "select failed (%d)", err);
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+    }
+}
+
+esp_err_t app_broker_start(const esp_mqtt_client_config_t *upstream, const char **local_uri)
+{
+    if (s_broker) {
+        *local_uri = s_local_uri;
+        return ESP_OK;
+    }
+    bool bridge = upstream->broker.address.uri && upstream->broker.address.uri[0];
+    if (bridge) {
+        s_out_num = parse_filters(CONFIG_KAVACH_BROKER_BRIDGE_OUT, s_out_text, sizeof(s_out_text), s_out);
+        s_in_num = parse_filters(CONFIG_KAVACH_BROKER_BRIDGE_IN, s_in_text, sizeof(s_in_text), s_in);
+        bridge = s_out_num > 0 || s_in_num > 0;
+    }
+
+    kbroker_config_t cfg;
+    kbroker_config_default(&cfg);
+    cfg.port = CONFIG_KAVACH_BROKER_PORT;
+    cfg.max_conns = CONFIG_KAVACH_BROKER_MAX_CLIENTS;
+    cfg.max_packet = CONFIG_KAVACH_BROKER_MAX_PACKET;
+    cfg.tx_max = 8 * 1024;
+    cfg.on_publish = s_out_num > 0 ? on_local_publish : NULL;
+    if (cfg.max_conns > CONFIG_LWIP_MAX_SOCKETS - SOCKETS_RESERVED) {
+        cfg.max_conns = CONFIG_LWIP_MAX_SOCKETS - SOCKETS_RESERVED;
+        ESP_LOGW(TAG, "Only %d clients: raise CONFIG_LWIP_MAX_SOCKETS (%d) for more", (int)cfg.max_conns,
+                 CONFIG_LWIP_MAX_SOCKETS);
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    s_bridge_queue = xQueueCreate(BRIDGE_QUEUE_LEN, sizeof(bridge_msg_t *));
+    if (!s_lock || !s_bridge_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    int err = kbroker_create(&cfg, &s_broker);
+    if (err) {
+        ESP_LOGE(TAG, "Cannot listen on port %d (%d)", CONFIG_KAVACH_BROKER_PORT, err);
+        s_broker = NULL;
+        return err == -ENOMEM ? ESP_ERR_NO_MEM : ESP_FAIL;
+    }
+    if (xTaskCreate(broker_task, "kbroker", 4096, NULL, 5, NULL) != pdPASS) {
+        kbroker_destroy(s_broker);
+        s_broker = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(s_local_uri, sizeof(s_local_uri), "mqtt://127.0.0.1:%u", (unsigned)kbroker_port(s_broker));
+    *local_uri = s_local_uri;
+
+    /* Bridge: the box's upstream settings, with esp-mqtt's own reconnect instead of the supervisor */
+    if (bridge) {
+        esp_mqtt_client_config_t up_cfg = *upstream;
+        up_cfg.network.disable_auto_reconnect = false;
+        up_cfg.network.reconnect_timeout_ms = RECONNECT_MS;
+        up_cfg.buffer.size = CONFIG_KAVACH_BROKER_MAX_PACKET;   /* bridged messages arrive in one piece */
+        s_upstream = esp_mqtt_client_init(&up_cfg);
+        if (s_upstream && xTaskCreate(bridge_task, "kbridge", 3072, NULL, 4, NULL) == pdPASS) {
+            esp_mqtt_client_register_event(s_upstream, ESP_EVENT_ANY_ID, upstream_event_handler, NULL);
+            esp_mqtt_client_start(s_upstream);
+        } else {
+            ESP_LOGE(TAG, "Bridge not started (no memory); local clients only");
+            s_out_num = s_in_num = 0;   /* on_local_publish() then forwards nothing */
+        }
+    }
+    ESP_LOGI(TAG, "Broker on port %u (%d clients); bridge %s: %d topics out, %d in",
+             (unsigned)kbroker_port(s_broker), (int)cfg.max_conns,
+             s_upstream ? upstream->broker.address.uri : "off", s_out_num, s_in_num);
+    return ESP_OK;
+}
+
+void app_broker_get_stats(app_broker_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!s_broker) {
+        return;
+    }
+    kbroker_stats_t kb;
+    kbroker_get_stats(s_broker, &kb);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+    stats->clients = kb.conns;
+    stats->sessions = kb.sessions;
+    stats->msgs_in = kb.msgs_in;
+    stats->msgs_out = kb.msgs_out;
+    stats->dropped = kb.dropped;
+    stats->upstream = s_up_connected;
+}
@@ -0,0 +1,44 @@
+/*
+ * Embedded MQTT broker (CONFIG_KAVACH_BROKER_ENABLE): the nodes and the box's own client connect to the
+ * box, so local actions ("Turn on the light", gas valve rules) do not depend on the PC broker or the
+ * internet. A bridge client keeps a connection to the external broker (CONFIG_KAVACH_MQTT_BROKER_URI)
+ * while the WAN is up: local messages matching CONFIG_KAVACH_BROKER_BRIDGE_OUT are forwarded to it, and
+ * its messages matching CONFIG_KAVACH_BROKER_BRIDGE_IN (the phone app's commands) are published locally.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t clients;           /* local connections */
+    uint32_t sessions;
+    uint32_t msgs_in;           /* PUBLISH received by the local broker */
+    uint32_t msgs_out;          /* PUBLISH sent by the local broker */
+    uint32_t dropped;           /* local deliveries dropped (slow client) */
+    bool upstream;              /* bridge connected to the external broker */
+    uint32_t bridged_up;        /* local messages handed to the bridge client */
+    uint32_t bridged_down;      /* external messages published locally */
+    uint32_t echoes;            /* external messages that were our own forwarded ones */
+    uint32_t lost;              /* not bridged: bridge queue full, QoS 0 while offline, too large */
+} app_broker_stats_t;
+
+/**
+ * Start the broker and the bridge. upstream is the config the box's client would have used for the
+ * external broker (URI, TLS, credentials, client id); it is copied, and the bridge keeps its client id
+ * so the external broker sees the same persistent session. Call from app_mqtt_start().
+ * @param local_uri set to the URI the box's own client should connect to
+ */
+esp_err_t app_broker_start(const esp_mqtt_client_config_t *upstream, const char **local_uri);
+
+void app_broker_get_stats(app_broker_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
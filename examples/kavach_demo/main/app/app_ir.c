@@ -17,6 +17,7 @@
 #include "ir_learn.h"
 #include "ir_encoder.h"
 #include "app_ir.h"
+#include "app_trace.h"
 #include "gui/ui_kavach.h"  /* kavach_ui_set_status_async_ir, kavach_ui_set_light_async (from any task) */
 
 static const char *TAG = "app_ir";
@@ -35,6 +36,12 @@ static struct ir_learn_list_head s_learn_off_head;
 static struct ir_learn_sub_list_head s_data_on;
 static struct ir_learn_sub_list_head s_data_off;
 
+/* One burst to send; trace: the first frame ends the voice command's trace span (not for rule actions) */
+typedef struct {
+    struct ir_learn_sub_list_head *list;
+    bool trace;
+} ir_tx_item_t;
+
 static QueueHandle_t s_tx_queue = NULL;
 static TaskHandle_t s_tx_task_handle = NULL;
 
@@ -100,7 +107,7 @@ static esp_err_t ir_read_cfg(const char *filepath, struct ir_learn_sub_list_head
     return ESP_OK;
 }
 
-static void ir_tx_raw(struct ir_learn_sub_list_head *list)
+static void ir_tx_raw(struct ir_learn_sub_list_head *list, bool trace)
 {
     rmt_tx_channel_config_t tx_cfg = {
         .clk_src = RMT_CLK_SRC_DEFAULT,
@@ -132,6 +139,9 @@ static void ir_tx_raw(struct ir_learn_sub_list_head *list)
     SLIST_FOREACH(sub_it, list, next) {
         vTaskDelay(pdMS_TO_TICKS(sub_it->timediff / 1000));
         rmt_transmit(tx_channel, nec_encoder, sub_it->symbols.received_symbols, sub_it->symbols.num_symbols, &transmit_config);
+        if (trace) {
+            app_trace_stamp(APP_TRACE_ACTION);  /* first frame on air ends a voice command's span */
+        }
         rmt_tx_wait_all_done(tx_channel, -1);
     }
 
@@ -152,17 +162,17 @@ static void ir_tx_task(void *arg)
     gpio_config(&io);
     gpio_set_level(BSP_IR_CTRL_GPIO, 0);
 
-    struct ir_learn_sub_list_head *list = NULL;
-    while (xQueueReceive(s_tx_queue, &list, portMAX_DELAY) == pdTRUE && list != NULL) {
-        ir_tx_raw(list);
-        ir_learn_clean_sub_data(list);
-        free(list);
+    ir_tx_item_t item;
+    while (xQueueReceive(s_tx_queue, &item, portMAX_DELAY) == pdTRUE && item.list != NULL) {
+        ir_tx_raw(item.list, item.trace);
+        ir_learn_clean_sub_data(item.list);
+        free(item.list);
     }
     s_tx_task_handle = NULL;
     vTaskDelete(NULL);
 }
 
-static void send_ir_from_file(const char *path)
+static void send_ir_from_file(const char *path, bool trace)
 {
     struct ir_learn_sub_list_head *list = heap_caps_calloc(1, sizeof(struct ir_learn_sub_list_head), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     if (!list) {
@@ -173,9 +183,8 @@ static void send_ir_from_file(const char *path)
         free(list);
         return;
     }
-    if (s_tx_queue) {
-        xQueueSend(s_tx_queue, &list, 0);
-    } else {
+    const ir_tx_item_t item = { .list = list, .trace = trace };
+    if (!s_tx_queue || xQueueSend(s_tx_queue, &item, 0) != pdTRUE) {
         ir_learn_clean_sub_data(list);
         free(list);
     }
@@ -338,18 +347,23 @@ bool app_ir_has_ac_codes(void)
 
 void app_ir_send_ac_on(void)
 {
-    send_ir_from_file(IR_AC_ON_PATH);
+    send_ir_from_file(IR_AC_ON_PATH, true);
 }
 
 void app_ir_send_ac_off(void)
 {
-    send_ir_from_file(IR_AC_OFF_PATH);
+    send_ir_from_file(IR_AC_OFF_PATH, true);
+}
+
+void app_ir_send_ac_ex(bool on, bool trace)
+{
+    send_ir_from_file(on ? IR_AC_ON_PATH : IR_AC_OFF_PATH, trace);
 }
 
 void app_ir_init(void)
 {
     if (s_tx_queue == NULL) {
-        s_tx_queue = xQueueCreate(4, sizeof(struct ir_learn_sub_list_head *));
+        s_tx_queue = xQueueCreate(4, sizeof(ir_tx_item_t));
         if (s_tx_queue) {
             xTaskCreate(ir_tx_task, "ir_tx", 3072, NULL, 5, &s_tx_task_handle);
         }
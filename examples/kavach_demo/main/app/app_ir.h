@@ -34,6 +34,12 @@ void app_ir_send_ac_on(void);
 /** Send learned AC-off IR burst. No-op if not learned. */
 void app_ir_send_ac_off(void);
 
+/**
+ * Send the learned AC-on or AC-off burst. trace: its first frame ends the current voice command's
+ * latency span, as app_ir_send_ac_on() / _off() do; false for sends no voice command asked for.
+ */
+void app_ir_send_ac_ex(bool on, bool trace);
+
 #ifdef __cplusplus
 }
 #endif
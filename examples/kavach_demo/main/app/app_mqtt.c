@@ -1,6 +1,21 @@
 /*
- * MQTT client for Kavach: publish help commands, appliance commands, and sensor data.
+ * MQTT client for Kavach: publish help commands, appliance commands, and sensor data
+ * (batched by app_telemetry).
  * Subscribes to fabacademy/kavach/ping (reply pong) and fabacademy/kavach/gas (gas leak alert).
+ * Publishes voice latency statistics (app_trace) periodically and on request to <trace topic>/get.
+ * Incoming messages are dispatched by app_mqtt_router; handlers are registered in app_mqtt_start().
+ * Gas and intruder reports go to the alert manager (app_alert), which coalesces repeats into incidents;
+ * incident start/end events are published to CONFIG_KAVACH_MQTT_TOPIC_INCIDENT.
+ * Local rules (app_rules) react to node messages on the box; their results go to <rules topic>/status.
+ * Help, appliance and sensor messages go through the flash outbox (app_outbox) and are sent at QoS 1,
+ * so they survive WiFi/broker outages; ping replies and statistics are sent directly at QoS 0.
+ * Reconnects, failover to the secondary broker and the persistent session are handled by
+ * app_mqtt_supervisor; gas and intruder alerts are subscribed at QoS 1 so the broker can hold them
+ * while the device is offline.
+ * mqtts:// brokers are verified against the certificate bundle or an embedded CA; the TLS session is
+ * kept across reconnects (session ticket or session ID) so a reconnect skips the full handshake.
+ * With CONFIG_KAVACH_BROKER_ENABLE the client connects to the broker on the box (app_broker), which
+ * bridges to the configured broker; the settings above then apply to the bridge.
  */
 #include <stdio.h>
 #include <string.h>
@@ -8,42 +23,168 @@
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "mqtt_client.h"
-#include "bsp_board.h"
+#if CONFIG_MQTT_TRANSPORT_SSL
+#include "esp_crt_bundle.h"
+#include "esp_transport_ssl.h"
+#endif
 #include "app_mqtt.h"
-#include "app_sr_handler.h"
-#include "gui/ui_kavach.h"
+#include "app_mqtt_router.h"
+#include "app_mqtt_supervisor.h"
+#include "app_trace.h"
+#include "app_outbox.h"
+#include "app_alert.h"
+#include "app_rules.h"
+#include "app_telemetry.h"
+#if CONFIG_KAVACH_BROKER_ENABLE
+#include "app_broker.h"
+#endif
+#include "kjson.h"
 
 static const char *TAG = "mqtt";
 
 #define MQTT_URI_MAX 128
-#define SENSOR_PAYLOAD_MAX 64
 #define APPLIANCE_JSON_MAX 80
-#define GAS_PAYLOAD_MAX 96
+#define INCIDENT_JSON_MAX 160
 
 #define MQTT_TOPIC_PING "fabacademy/kavach/ping"
 #define MQTT_TOPIC_PONG "fabacademy/kavach/pong"
 #define MQTT_PAYLOAD_PONG "pong"
 #define MQTT_TOPIC_GAS      "fabacademy/kavach/gas"
 #define MQTT_TOPIC_INTRUDER "fabacademy/kavach/intruder"
-#define INTRUDER_PAYLOAD_MAX 96
+#define MQTT_TOPIC_TRACE_GET CONFIG_KAVACH_MQTT_TOPIC_TRACE "/get"
+#define TRACE_PAYLOAD_MAX 640
 static char s_mqtt_uri[MQTT_URI_MAX];
-static char s_sensor_payload[SENSOR_PAYLOAD_MAX];
+static char s_mqtt_uri_secondary[MQTT_URI_MAX];
 static esp_mqtt_client_handle_t s_client;
 static bool s_connected;
-static esp_timer_handle_t s_sensor_timer = NULL;
+static esp_timer_handle_t s_trace_timer = NULL;
+static char s_trace_payload[TRACE_PAYLOAD_MAX];
 
 /* Build full URI if config is just hostname (e.g. mqtt.fabcloud.org → mqtt://mqtt.fabcloud.org:1883) */
-static const char *get_broker_uri(void)
+static const char *get_broker_uri(const char *cfg, char *buf, size_t len)
 {
-    const char *cfg = CONFIG_KAVACH_MQTT_BROKER_URI;
-    if (strncmp(cfg, "mqtt://", 7) == 0 || strncmp(cfg, "mqtts://", 8) == 0) {
+    if (cfg[0] == '\0' || strncmp(cfg, "mqtt://", 7) == 0 || strncmp(cfg, "mqtts://", 8) == 0) {
         return cfg;
     }
-    snprintf(s_mqtt_uri, sizeof(s_mqtt_uri), "mqtt://%s:1883", cfg);
-    return s_mqtt_uri;
+    snprintf(buf, len, "mqtt://%s:1883", cfg);
+    return buf;
 }
 
-static void sensor_timer_cb(void *arg);
+#if CONFIG_MQTT_TRANSPORT_SSL
+#if KAVACH_MQTT_CA_EMBEDDED
+extern const char mqtt_ca_pem_start[] asm("_binary_mqtt_ca_pem_start");
+extern const char mqtt_ca_pem_end[] asm("_binary_mqtt_ca_pem_end");
+#endif
+
+static bool is_tls_uri(const char *uri)
+{
+    return strncmp(uri, "mqtts://", 8) == 0;
+}
+
+/*
+ * TLS for mqtts:// brokers. esp-mqtt creates a new TLS context per connect and forgets the session, so
+ * with session resumption the client gets its own SSL transport that keeps the session of the last
+ * connection and offers it on the next one (the broker then skips certificate verification and key
+ * exchange). One transport serves both brokers, so it is used only if both are mqtts://.
+ */
+static void tls_configure(esp_mqtt_client_config_t *cfg, const char *uri, const char *uri_secondary)
+{
+    if (!is_tls_uri(uri) && !is_tls_uri(uri_secondary)) {
+        return;
+    }
+#if CONFIG_KAVACH_MQTT_TLS_SESSION_RESUME
+    if (is_tls_uri(uri) && (uri_secondary[0] == '\0' || is_tls_uri(uri_secondary))) {
+        esp_transport_handle_t ssl = esp_transport_ssl_init();
+        if (ssl) {
+#if KAVACH_MQTT_CA_EMBEDDED
+            esp_transport_ssl_set_cert_data(ssl, mqtt_ca_pem_start, mqtt_ca_pem_end - mqtt_ca_pem_start);
+#else
+            esp_transport_ssl_crt_bundle_attach(ssl, esp_crt_bundle_attach);
+#endif
+            esp_transport_ssl_session_tickets_enable(ssl);
+            esp_transport_set_default_port(ssl, 8883);
+            cfg->network.transport = ssl;   /* owned and destroyed by the client */
+            ESP_LOGI(TAG, "TLS session resumption enabled");
+            return;
+        }
+        ESP_LOGW(TAG, "No memory for the TLS transport, sessions will not be resumed");
+    } else {
+        ESP_LOGW(TAG, "Mixed mqtt:// and mqtts:// brokers, TLS sessions will not be resumed");
+    }
+#endif
+#if KAVACH_MQTT_CA_EMBEDDED
+    cfg->broker.verification.certificate = mqtt_ca_pem_start;
+#else
+    cfg->broker.verification.crt_bundle_attach = esp_crt_bundle_attach;
+#endif
+}
+#endif
+
+static void trace_timer_cb(void *arg);
+static int outbox_send(const char *topic, const char *payload, size_t len, void *arg);
+
+/* Ping: reply with pong so the app can check the device is online */
+static void on_ping(const app_mqtt_msg_t *msg, void *arg)
+{
+    int msg_id = esp_mqtt_client_publish(s_client, MQTT_TOPIC_PONG, MQTT_PAYLOAD_PONG, -1, 0, 0);
+    if (msg_id >= 0) {
+        ESP_LOGI(TAG, "Ping received → pong sent");
+    }
+}
+
+/* Latency statistics request: publish now and log the table */
+static void on_trace_get(const app_mqtt_msg_t *msg, void *arg)
+{
+    trace_timer_cb(NULL);
+    app_trace_dump();
+}
+
+/* Gas leak: topic publishes only on leak; payload e.g. {"device":"gas_sensor","gas":99,"state":"LEAK"} */
+static void on_gas(const app_mqtt_msg_t *msg, void *arg)
+{
+    kjson_field_t fields[] = { { .key = "state" }, { .key = "gas" }, { .key = "device" } };
+    if (kjson_scan_object(msg->data, msg->data_len, fields, 3) < 0) {
+        ESP_LOGW(TAG, "Ignoring malformed gas message (%u bytes)", (unsigned)msg->data_len);
+        return;
+    }
+    char device[APP_ALERT_DEVICE_MAX] = "?";
+    kjson_str_copy(&fields[2].val, device, sizeof(device));
+    if (!kjson_str_caseeq(&fields[0].val, "LEAK")) {
+        if (fields[0].val.type == KJSON_STRING) {
+            app_alert_clear(APP_ALERT_GAS, device);   /* e.g. "state":"OK" */
+        }
+        return;
+    }
+    int32_t level = -1;
+    kjson_get_int(&fields[1].val, &level);
+    ESP_LOGD(TAG, "Gas leak report from %s (gas %ld)", device, (long)level);
+    app_alert_report(APP_ALERT_GAS, device, level);  /* overlay and alarm on the first report of an incident */
+}
+
+/* Intruder: payload JSON with device id and "motion" field (e.g. {"device":"pir_sensor","motion":"detected"}) */
+static void on_intruder(const app_mqtt_msg_t *msg, void *arg)
+{
+    kjson_field_t fields[] = { { .key = "motion" }, { .key = "device" } };
+    if (kjson_scan_object(msg->data, msg->data_len, fields, 2) < 0) {
+        ESP_LOGW(TAG, "Ignoring malformed intruder message (%u bytes)", (unsigned)msg->data_len);
+        return;
+    }
+    const kjson_token_t *motion = &fields[0].val;
+    bool detected = false;
+    if (motion->type == KJSON_STRING) {
+        detected = motion->len > 0 && !kjson_str_caseeq(motion, "clear") && !kjson_str_caseeq(motion, "none");
+    } else if (!kjson_get_bool(motion, &detected)) {
+        detected = false;   /* missing or null */
+    }
+    char device[APP_ALERT_DEVICE_MAX] = "?";
+    kjson_str_copy(&fields[1].val, device, sizeof(device));
+    if (detected) {
+        ESP_LOGD(TAG, "Intruder/motion report from %s", device);
+        app_alert_report(APP_ALERT_INTRUDER, device, -1);
+    } else if (motion->type != KJSON_END) {
+        app_alert_clear(APP_ALERT_INTRUDER, device);
+    }
+}
 
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
@@ -51,78 +192,51 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     (void)base;
 
     switch ((esp_mqtt_event_id_t)event_id) {
-    case MQTT_EVENT_CONNECTED:
-        ESP_LOGI(TAG, "MQTT connected");
+    case MQTT_EVENT_BEFORE_CONNECT:
+        app_mqtt_supervisor_before_connect();
+        break;
+
+    case MQTT_EVENT_CONNECTED: {
+        esp_mqtt_event_handle_t evt = (esp_mqtt_event_handle_t)event_data;
+        bool resumed = app_mqtt_supervisor_connected(evt && evt->session_present);
         s_connected = true;
-        if (s_sensor_timer) {
-            esp_timer_start_periodic(s_sensor_timer, (uint64_t)CONFIG_KAVACH_MQTT_SENSOR_INTERVAL_SEC * 1000000);
-        }
-        /* Subscribe to ping topic so app can check device is online */
-        if (esp_mqtt_client_subscribe(s_client, MQTT_TOPIC_PING, 0) < 0) {
-            ESP_LOGW(TAG, "Subscribe to %s failed", MQTT_TOPIC_PING);
-        } else {
-            ESP_LOGI(TAG, "Subscribed to %s (reply on %s)", MQTT_TOPIC_PING, MQTT_TOPIC_PONG);
-        }
-        /* Subscribe to gas leak topic: message only when leak (JSON with device, gas, state "LEAK") */
-        if (esp_mqtt_client_subscribe(s_client, MQTT_TOPIC_GAS, 0) < 0) {
-            ESP_LOGW(TAG, "Subscribe to %s failed", MQTT_TOPIC_GAS);
-        } else {
-            ESP_LOGI(TAG, "Subscribed to %s (gas leak alert)", MQTT_TOPIC_GAS);
-        }
-        if (esp_mqtt_client_subscribe(s_client, MQTT_TOPIC_INTRUDER, 0) < 0) {
-            ESP_LOGW(TAG, "Subscribe to %s failed", MQTT_TOPIC_INTRUDER);
-        } else {
-            ESP_LOGI(TAG, "Subscribed to %s (intruder/motion alert)", MQTT_TOPIC_INTRUDER);
+        if (s_trace_timer) {
+            esp_timer_start_periodic(s_trace_timer, (uint64_t)CONFIG_KAVACH_TRACE_PUBLISH_SEC * 1000000);
         }
+        /* With the session resumed the broker still has our subscriptions */
+        app_mqtt_router_connected(s_client, resumed);
+        /* Send what was queued while offline, help requests first */
+        app_outbox_drain(outbox_send, NULL);
         break;
+    }
 
     case MQTT_EVENT_DISCONNECTED:
-        ESP_LOGI(TAG, "MQTT disconnected");
+        /* Also sent for every failed connect attempt; esp-mqtt retries after the supervisor's delay */
         s_connected = false;
-        if (s_sensor_timer) {
-            esp_timer_stop(s_sensor_timer);
+        app_mqtt_supervisor_disconnected();
+        app_mqtt_router_disconnected();
+        if (s_trace_timer) {
+            esp_timer_stop(s_trace_timer);
         }
+        app_outbox_reset_inflight();  /* unacknowledged messages are sent again on reconnect */
+        break;
+
+    case MQTT_EVENT_PUBLISHED: {
+        esp_mqtt_event_handle_t evt = (esp_mqtt_event_handle_t)event_data;
+        app_outbox_acked(evt->msg_id);
+        app_outbox_drain(outbox_send, NULL);
         break;
+    }
 
     case MQTT_EVENT_DATA: {
         esp_mqtt_event_handle_t evt = (esp_mqtt_event_handle_t)event_data;
-        if (!evt || evt->topic_len <= 0) {
+        if (!evt) {
             break;
         }
-        /* Ping: reply with pong */
-        if ((size_t)evt->topic_len == strlen(MQTT_TOPIC_PING) &&
-            strncmp(evt->topic, MQTT_TOPIC_PING, evt->topic_len) == 0) {
-            int msg_id = esp_mqtt_client_publish(s_client, MQTT_TOPIC_PONG, MQTT_PAYLOAD_PONG, -1, 0, 0);
-            if (msg_id >= 0) {
-                ESP_LOGI(TAG, "Ping received → pong sent");
-            }
-            break;
-        }
-        /* Gas leak: topic publishes only on leak; payload e.g. {"device":"gas_sensor","gas":99,"state":"LEAK"} */
-        if ((size_t)evt->topic_len == strlen(MQTT_TOPIC_GAS) &&
-            strncmp(evt->topic, MQTT_TOPIC_GAS, evt->topic_len) == 0 && evt->data_len > 0) {
-            static char gas_buf[GAS_PAYLOAD_MAX];
-            size_t copy_len = (size_t)evt->data_len < (sizeof(gas_buf) - 1) ? (size_t)evt->data_len : (sizeof(gas_buf) - 1);
-            memcpy(gas_buf, evt->data, copy_len);
-            gas_buf[copy_len] = '\0';
-            if (strstr(gas_buf, "LEAK") != NULL) {
-                ESP_LOGW(TAG, "Gas leak alert received: %s", gas_buf);
-                kavach_ui_trigger_gas_leak_alert();  /* full-screen; dismiss returns to clock */
-                sr_handler_play_gas_alarm();        /* play gas_alarm.wav from spiffs */
-            }
-        }
-        /* Intruder: topic fabacademy/kavach/intruder, payload JSON with device id and "motion" field (e.g. {"device":"pir_sensor","motion":"detected"}) */
-        if ((size_t)evt->topic_len == strlen(MQTT_TOPIC_INTRUDER) &&
-            strncmp(evt->topic, MQTT_TOPIC_INTRUDER, evt->topic_len) == 0 && evt->data_len > 0) {
-            static char intruder_buf[INTRUDER_PAYLOAD_MAX];
-            size_t copy_len = (size_t)evt->data_len < (sizeof(intruder_buf) - 1) ? (size_t)evt->data_len : (sizeof(intruder_buf) - 1);
-            memcpy(intruder_buf, evt->data, copy_len);
-            intruder_buf[copy_len] = '\0';
-            if (strstr(intruder_buf, "\"motion\"") != NULL) {
-                ESP_LOGW(TAG, "Intruder/motion alert received: %s", intruder_buf);
-                kavach_ui_trigger_intruder_alert();
-            }
-        }
+        /* Large messages arrive as several events; only the first carries the topic */
+        app_mqtt_router_dispatch(evt->topic, evt->topic_len > 0 ? evt->topic_len : 0, evt->data,
+                                 evt->data_len > 0 ? evt->data_len : 0,
+                                 evt->current_data_offset, evt->total_data_len);
         break;
     }
 
@@ -135,31 +249,107 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
 }
 
-static esp_err_t publish_to(const char *topic, const char *payload)
+static esp_err_t publish_to(const char *topic, const char *payload, size_t len)
 {
     if (!s_client || !s_connected || !topic || !payload) {
         return ESP_ERR_INVALID_STATE;
     }
-    int msg_id = esp_mqtt_client_publish(s_client, topic, payload, 0, 0, 0);
+    int msg_id = esp_mqtt_client_publish(s_client, topic, payload, len, 0, 0);
     return (msg_id >= 0) ? ESP_OK : ESP_FAIL;
 }
 
-static void sensor_timer_cb(void *arg)
+static int outbox_send(const char *topic, const char *payload, size_t len, void *arg)
 {
-    float temp = 0, hum = 0;
-    if (bsp_board_get_sensor_handle()->get_humiture(&temp, &hum) != ESP_OK) {
-        return;
+    (void)arg;
+    if (!s_client || !s_connected) {
+        return -1;
+    }
+    return esp_mqtt_client_publish(s_client, topic, payload, len, 1, 0);
+}
+
+/* Queue in the outbox and send now if connected; without an outbox partition publish directly. */
+static esp_err_t enqueue_bin(const char *topic, const void *payload, size_t len, app_outbox_prio_t prio)
+{
+    esp_err_t ret = app_outbox_put_bin(topic, payload, len, prio);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        return publish_to(topic, payload, len);
+    }
+    app_outbox_drain(outbox_send, NULL);
+    return ret;
+}
+
+static esp_err_t enqueue(const char *topic, const char *payload, app_outbox_prio_t prio)
+{
+    return enqueue_bin(topic, payload, payload ? strlen(payload) : 0, prio);
+}
+
+/* Telemetry batch (CBOR or JSON, see app_telemetry.h) */
+static esp_err_t telemetry_sink(const uint8_t *data, size_t len, bool cbor)
+{
+    (void)cbor;
+    return enqueue_bin(CONFIG_KAVACH_MQTT_TOPIC_SENSOR, data, len, APP_OUTBOX_PRIO_LOW);
+}
+
+/* Incident start/end: {"event":"start","kind":"gas","device":"gas_sensor","level":99} and
+ * {"event":"end","kind":"gas","device":"gas_sensor","reason":"quiet","duration_s":42,"reports":7,"peak":120,
+ *  "dismissed":false} */
+static void on_alert_event(const app_alert_incident_t *inc, const app_alert_end_t *end, void *arg)
+{
+    (void)arg;
+    char device[APP_ALERT_DEVICE_MAX];
+    size_t j = 0;
+    for (const char *c = inc->device; *c && j < sizeof(device) - 1; c++) {
+        if (*c != '"' && *c != '\\' && (unsigned char)*c >= 0x20) {
+            device[j++] = *c;    /* node-supplied name, keep the JSON valid */
+        }
+    }
+    device[j] = '\0';
+
+    char payload[INCIDENT_JSON_MAX];   /* events come from the MQTT task or the alert timer: no static buffer */
+    int n;
+    if (!end) {
+        n = snprintf(payload, sizeof(payload),
+                     "{\"event\":\"start\",\"kind\":\"%s\",\"device\":\"%s\",\"level\":%ld}",
+                     app_alert_kind_name(inc->kind), device, (long)inc->peak);
+    } else {
+        n = snprintf(payload, sizeof(payload),
+                     "{\"event\":\"end\",\"kind\":\"%s\",\"device\":\"%s\",\"reason\":\"%s\","
+                     "\"duration_s\":%ld,\"reports\":%lu,\"peak\":%ld,\"dismissed\":%s}",
+                     app_alert_kind_name(inc->kind), device, *end == APP_ALERT_END_CLEAR ? "clear" : "quiet",
+                     (long)((inc->last_us - inc->start_us) / 1000000), (unsigned long)inc->reports, (long)inc->peak,
+                     inc->dismissed ? "true" : "false");
+    }
+    if (n > 0 && (size_t)n < sizeof(payload)) {
+        enqueue(CONFIG_KAVACH_MQTT_TOPIC_INCIDENT, payload, APP_OUTBOX_PRIO_HIGH);
+    }
+}
+
+/* Result of a rule set update */
+static esp_err_t rules_status_sink(const char *json)
+{
+    return publish_to(CONFIG_KAVACH_MQTT_TOPIC_RULES "/status", json, 0);
+}
+
+static void trace_timer_cb(void *arg)
+{
+    (void)arg;
+    if (app_trace_format_json(s_trace_payload, sizeof(s_trace_payload)) > 0) {
+        publish_to(CONFIG_KAVACH_MQTT_TOPIC_TRACE, s_trace_payload, 0);
     }
-    (void)snprintf(s_sensor_payload, sizeof(s_sensor_payload), "{\"temp\": %.1f, \"hum\": %.0f}", (double)temp, (double)hum);
-    publish_to(CONFIG_KAVACH_MQTT_TOPIC_SENSOR, s_sensor_payload);
 }
 
 esp_err_t app_mqtt_start(void)
 {
-    const char *uri = get_broker_uri();
+    const char *uri = get_broker_uri(CONFIG_KAVACH_MQTT_BROKER_URI, s_mqtt_uri, sizeof(s_mqtt_uri));
+    const char *uri_secondary = get_broker_uri(CONFIG_KAVACH_MQTT_BROKER_URI_SECONDARY, s_mqtt_uri_secondary,
+                                               sizeof(s_mqtt_uri_secondary));
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = uri,
     };
+    app_mqtt_supervisor_config(&mqtt_cfg);
+#if CONFIG_MQTT_TRANSPORT_SSL
+    tls_configure(&mqtt_cfg, uri, uri_secondary);
+#endif
 
     /* Optional username/password for public or secured brokers */
     if (strlen(CONFIG_KAVACH_MQTT_USERNAME) > 0) {
@@ -169,31 +359,60 @@ esp_err_t app_mqtt_start(void)
         }
     }
 
+#if CONFIG_KAVACH_BROKER_ENABLE
+    /* The external broker is reached through the bridge; this client only talks to the box's broker */
+    const char *local_uri;
+    if (app_broker_start(&mqtt_cfg, &local_uri) == ESP_OK) {
+        uri = local_uri;
+        uri_secondary = "";
+        memset(&mqtt_cfg.broker, 0, sizeof(mqtt_cfg.broker));    /* no TLS verification */
+        mqtt_cfg.broker.address.uri = uri;
+        mqtt_cfg.network.transport = NULL;      /* TLS transport went to the bridge */
+        mqtt_cfg.credentials.username = NULL;
+        mqtt_cfg.credentials.authentication.password = NULL;
+    } else {
+        ESP_LOGE(TAG, "Broker not started, connecting to %s directly", uri);
+    }
+#endif
+
     s_client = esp_mqtt_client_init(&mqtt_cfg);
     if (!s_client) {
         return ESP_ERR_NO_MEM;
     }
 
-    /* Create periodic timer for sensor publish (started when MQTT connects) */
-    const esp_timer_create_args_t timer_args = {
-        .callback = &sensor_timer_cb,
-        .arg = NULL,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "mqtt_sensor",
-    };
-    if (esp_timer_create(&timer_args, &s_sensor_timer) == ESP_OK) {
-        /* started in MQTT_EVENT_CONNECTED */
-    } else {
-        s_sensor_timer = NULL;
+    /* Sensor readings are sampled and batched from now on; batches wait in the outbox until connected */
+    app_telemetry_start(telemetry_sink);
+    app_alert_init(on_alert_event, NULL);
+    if (CONFIG_KAVACH_TRACE_PUBLISH_SEC > 0) {
+        const esp_timer_create_args_t trace_args = {
+            .callback = &trace_timer_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "mqtt_trace",
+        };
+        if (esp_timer_create(&trace_args, &s_trace_timer) != ESP_OK) {
+            s_trace_timer = NULL;
+        }
+    }
+
+    app_mqtt_router_register(MQTT_TOPIC_PING, 0, on_ping, NULL);
+    app_mqtt_router_register(MQTT_TOPIC_GAS, 1, on_gas, NULL);
+    app_mqtt_router_register(MQTT_TOPIC_INTRUDER, 1, on_intruder, NULL);
+    app_mqtt_router_register(MQTT_TOPIC_TRACE_GET, 0, on_trace_get, NULL);
+    if (app_rules_start(rules_status_sink) != ESP_OK) {
+        ESP_LOGW(TAG, "Local rules not available");
     }
 
     esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-    esp_err_t err = esp_mqtt_client_start(s_client);
+    esp_err_t err = app_mqtt_supervisor_start(s_client, &mqtt_cfg, uri, uri_secondary);
+    if (err == ESP_OK) {
+        err = esp_mqtt_client_start(s_client);
+    }
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "MQTT start failed: %s", esp_err_to_name(err));
-        if (s_sensor_timer) {
-            esp_timer_delete(s_sensor_timer);
-            s_sensor_timer = NULL;
+        if (s_trace_timer) {
+            esp_timer_delete(s_trace_timer);
+            s_trace_timer = NULL;
         }
         return err;
     }
@@ -208,30 +427,40 @@ esp_err_t app_mqtt_start(void)
     return ESP_OK;
 }
 
-esp_err_t app_mqtt_publish_help(const char *cmd_str)
+esp_err_t app_mqtt_publish_help_ex(const char *cmd_str, bool trace)
 {
-    return publish_to(CONFIG_KAVACH_MQTT_TOPIC_HELP, cmd_str);
+    esp_err_t ret = enqueue(CONFIG_KAVACH_MQTT_TOPIC_HELP, cmd_str, APP_OUTBOX_PRIO_HIGH);
+    if (trace) {
+        app_trace_stamp(APP_TRACE_ACTION);
+    }
+    return ret;
 }
 
-static char s_appliance_payload[APPLIANCE_JSON_MAX];
+esp_err_t app_mqtt_publish_help(const char *cmd_str)
+{
+    return app_mqtt_publish_help_ex(cmd_str, true);
+}
 
-esp_err_t app_mqtt_publish_appliance_json(const char *device, const char *state)
+esp_err_t app_mqtt_publish_appliance_json_ex(const char *device, const char *state, bool trace)
 {
     if (!device || !state) {
         return ESP_ERR_INVALID_ARG;
     }
-    int n = snprintf(s_appliance_payload, sizeof(s_appliance_payload),
-                     "{\"device\":\"%s\",\"state\":\"%s\"}", device, state);
-    if (n < 0 || (size_t)n >= sizeof(s_appliance_payload)) {
+    char payload[APPLIANCE_JSON_MAX];  /* voice handler and rule actions (MQTT task): no static buffer */
+    int n = snprintf(payload, sizeof(payload), "{\"device\":\"%s\",\"state\":\"%s\"}", device, state);
+    if (n < 0 || (size_t)n >= sizeof(payload)) {
         return ESP_ERR_INVALID_SIZE;
     }
-    return publish_to(CONFIG_KAVACH_MQTT_TOPIC_APPLIANCES, s_appliance_payload);
+    esp_err_t ret = enqueue(CONFIG_KAVACH_MQTT_TOPIC_APPLIANCES, payload, APP_OUTBOX_PRIO_NORMAL);
+    if (trace) {
+        app_trace_stamp(APP_TRACE_ACTION);
+    }
+    return ret;
 }
 
-esp_err_t app_mqtt_publish_sensor(float temp_c, float humidity_pct)
+esp_err_t app_mqtt_publish_appliance_json(const char *device, const char *state)
 {
-    (void)snprintf(s_sensor_payload, sizeof(s_sensor_payload), "{\"temp\": %.1f, \"hum\": %.0f}", (double)temp_c, (double)humidity_pct);
-    return publish_to(CONFIG_KAVACH_MQTT_TOPIC_SENSOR, s_sensor_payload);
+    return app_mqtt_publish_appliance_json_ex(device, state, true);
 }
 
 bool app_mqtt_connected(void)
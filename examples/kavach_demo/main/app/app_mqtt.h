@@ -2,10 +2,13 @@
  * MQTT client for Kavach.
  * - Help/alert/call commands → fabacademy/kavach/help (for emergency contacts).
  * - Appliance commands → fabacademy/kavach/appliances (for your app to control IoT devices).
+ * - Temperature/humidity batches → fabacademy/kavach/sensor (format in app_telemetry.h).
  * - Subscribes to fabacademy/kavach/ping and replies on fabacademy/kavach/pong to confirm device is online.
+ * - Other modules subscribe to topics through app_mqtt_router_register() (app_mqtt_router.h).
  */
 #pragma once
 
+#include <stdbool.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -15,14 +18,23 @@ extern "C" {
 /** Start MQTT client (subscribes to ping topic; replies on pong). Call after WiFi connected. */
 esp_err_t app_mqtt_start(void);
 
+/*
+ * The publish functions below queue the message in the flash outbox (app_outbox.h) and return
+ * ESP_OK once it is stored; it is sent at QoS 1 when the broker is reachable.
+ */
+
 /** Publish help-related command (I need help, Send alert, Call family, Help). */
 esp_err_t app_mqtt_publish_help(const char *cmd_str);
 
 /** Publish appliance command as JSON to fabacademy/kavach/appliances: {"device":"light1","state":"ON"}. */
 esp_err_t app_mqtt_publish_appliance_json(const char *device, const char *state);
 
-/** Publish temperature and humidity (e.g. to fabacademy/kavach/sensor). Payload "temp=25.3,hum=60". */
-esp_err_t app_mqtt_publish_sensor(float temp_c, float humidity_pct);
+/*
+ * As above. trace: the publish ends the current voice command's latency span (app_trace.h), as the
+ * plain functions do; false for messages no voice command asked for, e.g. rule actions.
+ */
+esp_err_t app_mqtt_publish_help_ex(const char *cmd_str, bool trace);
+esp_err_t app_mqtt_publish_appliance_json_ex(const char *device, const char *state, bool trace);
 
 /** Return true if MQTT is connected. */
 bool app_mqtt_connected(void);
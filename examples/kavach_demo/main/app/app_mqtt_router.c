@@ -0,0 +1,609 @@
+/*
+ * Topic trie: node 0 is the root, each node is one topic level. Literal children are kept sorted by
+ * level hash (binary search); '+' and '#' children are separate links. Registration is rare and
+ * builds the trie under a mutex; dispatch walks it under the same mutex, collects matching handlers
+ * and calls them after releasing it, so handlers may publish or (un)register.
+ *
+ * Lock order is MQTT client lock -> router lock: the MQTT task holds the client lock while it runs the
+ * event handler, so other tasks never call into the client while holding s_lock.
+ *
+ * Fragmented messages: esp-mqtt reads one message at a time, so its events arrive back to back and a
+ * single reassembly state is enough. The handlers are matched on the first event (the only one with
+ * the topic) and kept for the rest. The topic is copied into the reassembly state; the payload, for
+ * whole-message handlers, into an arena allocated on first use and reused for every later message.
+ * A payload too large for the arena still reaches the streaming handlers. Only the MQTT task touches
+ * this state.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "app_mqtt_router.h"
+
+static const char *TAG = "mqtt_router";
+
+#define NODE_NONE           0xffff
+#define ROUTE_MATCH_MAX     8       /* handlers called per message */
+#define ROUTE_DEPTH_MAX     16      /* topic levels matched */
+#define KID_SCAN_MAX        4       /* up to this many children: compare directly, no hash */
+#define REASM_BUF_SIZE      (CONFIG_KAVACH_MQTT_REASM_BUF_KB * 1024)
+#define REASM_TOPIC_MAX     128     /* fragmented messages with longer topics keep them in the arena */
+
+typedef struct route_sub {
+    app_mqtt_handler_t handler;
+    void *arg;
+    size_t max_len;
+    bool stream;
+    struct route_sub *next;
+} route_sub_t;
+
+typedef struct {
+    char *level;            /* this level's text; NULL for the root and wildcard nodes */
+    uint32_t hash;
+    uint16_t len;
+    uint16_t plus;          /* '+' child or NODE_NONE */
+    uint16_t multi;         /* '#' child or NODE_NONE */
+    uint16_t kid_num;
+    uint16_t *kids;         /* literal children, sorted by hash */
+    uint8_t qos;
+    uint8_t sub_qos;        /* QoS of the broker subscription, valid if subscribed */
+    bool subscribed;        /* filter is subscribed in the current broker session */
+    route_sub_t *subs;
+    char *filter;           /* full filter text, set once the node has been registered */
+} route_node_t;
+
+typedef struct {
+    app_mqtt_handler_t handler;
+    void *arg;
+    size_t max_len;
+    bool stream;
+} route_hit_t;
+
+typedef struct {
+    bool active;                /* between the first and last event of a fragmented message */
+    size_t total_len;
+    size_t next_offset;
+    const char *topic;          /* in topic_buf, or in s_arena if longer */
+    size_t topic_len;
+    char topic_buf[REASM_TOPIC_MAX];
+    char *buf;                  /* payload in s_arena; NULL if only streaming handlers take the message */
+    route_hit_t hits[ROUTE_MATCH_MAX];
+    int hit_num;
+} reasm_t;
+
+static portMUX_TYPE s_init_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_lock = NULL;
+static route_node_t *s_nodes = NULL;
+static uint16_t s_node_num = 0;
+static uint16_t s_node_cap = 0;
+static esp_mqtt_client_handle_t s_client = NULL;   /* set while connected */
+static reasm_t s_reasm;
+static char *s_arena = NULL;
+
+static bool router_lock(void)
+{
+    if (!s_lock) {
+        SemaphoreHandle_t m = xSemaphoreCreateMutex();
+        if (!m) {
+            return false;
+        }
+        portENTER_CRITICAL(&s_init_lock);
+        if (!s_lock) {
+            s_lock = m;
+            m = NULL;
+        }
+        portEXIT_CRITICAL(&s_init_lock);
+        if (m) {
+            vSemaphoreDelete(m);
+        }
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    return true;
+}
+
+static uint32_t level_hash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint16_t node_new(const char *level, size_t len)
+{
+    if (s_node_num == s_node_cap) {
+        uint16_t cap = s_node_cap ? s_node_cap * 2 : 16;
+        if (cap >= NODE_NONE) {
+            return NODE_NONE;
+        }
+        route_node_t *nodes = realloc(s_nodes, cap * sizeof(route_node_t));
+        if (!nodes) {
+            return NODE_NONE;
+        }
+        s_nodes = nodes;
+        s_node_cap = cap;
+    }
+    route_node_t *n = &s_nodes[s_node_num];
+    memset(n, 0, sizeof(*n));
+    n->plus = NODE_NONE;
+    n->multi = NODE_NONE;
+    if (level) {
+        n->level = strndup(level, len);
+        if (!n->level) {
+            return NODE_NONE;
+        }
+        n->len = len;
+        n->hash = level_hash(level, len);
+    }
+    return s_node_num++;
+}
+
+/* Index in kids[] of the first child with hash >= h. */
+static uint16_t kid_lower_bound(const route_node_t *n, uint32_t h)
+{
+    uint16_t lo = 0, hi = n->kid_num;
+    while (lo < hi) {
+        uint16_t mid = (lo + hi) / 2;
+        if (s_nodes[n->kids[mid]].hash < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static uint16_t kid_find(const route_node_t *n, const char *level, size_t len, uint32_t h)
+{
+    for (uint16_t i = kid_lower_bound(n, h); i < n->kid_num; i++) {
+        const route_node_t *k = &s_nodes[n->kids[i]];
+        if (k->hash != h) {
+            break;
+        }
+        if (k->len == len && memcmp(k->level, level, len) == 0) {
+            return n->kids[i];
+        }
+    }
+    return NODE_NONE;
+}
+
+/* Child of parent for one filter level, created if missing. */
+static uint16_t child_get(uint16_t parent, const char *level, size_t len)
+{
+    bool plus = (len == 1 && level[0] == '+');
+    bool multi = (len == 1 && level[0] == '#');
+    if (plus || multi) {
+        uint16_t idx = plus ? s_nodes[parent].plus : s_nodes[parent].multi;
+        if (idx == NODE_NONE) {
+            idx = node_new(NULL, 0);
+            if (idx != NODE_NONE) {
+                *(plus ? &s_nodes[parent].plus : &s_nodes[parent].multi) = idx;
+            }
+        }
+        return idx;
+    }
+
+    uint32_t h = level_hash(level, len);
+    uint16_t idx = kid_find(&s_nodes[parent], level, len, h);
+    if (idx != NODE_NONE) {
+        return idx;
+    }
+    uint16_t *kids = realloc(s_nodes[parent].kids, (s_nodes[parent].kid_num + 1) * sizeof(uint16_t));
+    if (!kids) {
+        return NODE_NONE;
+    }
+    s_nodes[parent].kids = kids;
+    idx = node_new(level, len);     /* may move s_nodes */
+    if (idx == NODE_NONE) {
+        return NODE_NONE;
+    }
+    route_node_t *p = &s_nodes[parent];
+    uint16_t pos = kid_lower_bound(p, h);
+    memmove(&p->kids[pos + 1], &p->kids[pos], (p->kid_num - pos) * sizeof(uint16_t));
+    p->kids[pos] = idx;
+    p->kid_num++;
+    return idx;
+}
+
+/* '+' and '#' must fill a whole level and '#' must be last. */
+static bool filter_valid(const char *filter)
+{
+    size_t len = strlen(filter);
+    if (len == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = filter[i];
+        if (c != '+' && c != '#') {
+            continue;
+        }
+        bool alone = (i == 0 || filter[i - 1] == '/') && (i + 1 == len || filter[i + 1] == '/');
+        if (!alone || (c == '#' && i + 1 != len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Node for filter, created if create is set. */
+static uint16_t filter_node(const char *filter, bool create)
+{
+    if (s_node_num == 0) {
+        if (!create || node_new(NULL, 0) != 0) {
+            return NODE_NONE;
+        }
+    }
+    uint16_t idx = 0;
+    const char *level = filter;
+    while (idx != NODE_NONE) {
+        const char *slash = strchr(level, '/');
+        size_t len = slash ? (size_t)(slash - level) : strlen(level);
+        if (create) {
+            idx = child_get(idx, level, len);
+        } else if (len == 1 && (level[0] == '+' || level[0] == '#')) {
+            idx = (level[0] == '+') ? s_nodes[idx].plus : s_nodes[idx].multi;
+        } else {
+            idx = kid_find(&s_nodes[idx], level, len, level_hash(level, len));
+        }
+        if (!slash) {
+            break;
+        }
+        level = slash + 1;
+    }
+    return idx;
+}
+
+esp_err_t app_mqtt_router_register(const char *filter, int qos, app_mqtt_handler_t handler, void *arg)
+{
+    const app_mqtt_route_opts_t opts = {
+        .max_len = CONFIG_KAVACH_MQTT_MSG_MAX_DEFAULT,
+    };
+    return app_mqtt_router_register_ex(filter, qos, &opts, handler, arg);
+}
+
+esp_err_t app_mqtt_router_register_ex(const char *filter, int qos, const app_mqtt_route_opts_t *opts,
+                                      app_mqtt_handler_t handler, void *arg)
+{
+    if (!filter || !handler || !opts || !filter_valid(filter) || qos < 0 || qos > 2 ||
+            (!opts->stream && opts->max_len == 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    route_sub_t *sub = malloc(sizeof(route_sub_t));
+    if (!sub || !router_lock()) {
+        free(sub);
+        return ESP_ERR_NO_MEM;
+    }
+    uint16_t idx = filter_node(filter, true);
+    route_node_t *n = (idx != NODE_NONE) ? &s_nodes[idx] : NULL;
+    if (n && !n->filter) {
+        n->filter = strdup(filter);
+    }
+    if (!n || !n->filter) {
+        xSemaphoreGive(s_lock);
+        free(sub);
+        ESP_LOGE(TAG, "No memory for %s", filter);
+        return ESP_ERR_NO_MEM;
+    }
+    sub->handler = handler;
+    sub->arg = arg;
+    sub->max_len = opts->max_len;
+    sub->stream = opts->stream;
+    sub->next = n->subs;
+    n->subs = sub;
+    if (qos > n->qos) {
+        n->qos = qos;
+    }
+    esp_mqtt_client_handle_t client = (n->subscribed && n->sub_qos >= n->qos) ? NULL : s_client;
+    if (client) {
+        n->subscribed = true;
+        n->sub_qos = n->qos;
+        qos = n->qos;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (client) {
+        if (esp_mqtt_client_subscribe(client, filter, qos) < 0) {
+            ESP_LOGW(TAG, "Subscribe to %s failed", filter);
+            if (router_lock()) {
+                s_nodes[idx].subscribed = false;
+                xSemaphoreGive(s_lock);
+            }
+        } else {
+            ESP_LOGI(TAG, "Subscribed to %s", filter);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t app_mqtt_router_unregister(const char *filter, app_mqtt_handler_t handler, void *arg)
+{
+    if (!filter || !router_lock()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    uint16_t idx = filter_node(filter, false);
+    if (idx != NODE_NONE) {
+        for (route_sub_t **pp = &s_nodes[idx].subs; *pp; pp = &(*pp)->next) {
+            if ((*pp)->handler == handler && (*pp)->arg == arg) {
+                route_sub_t *sub = *pp;
+                *pp = sub->next;
+                free(sub);
+                ret = ESP_OK;
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return ret;
+}
+
+void app_mqtt_router_connected(esp_mqtt_client_handle_t client, bool resumed)
+{
+    if (!router_lock()) {
+        return;
+    }
+    s_client = client;
+    int kept = 0;
+    for (uint16_t i = 0; i < s_node_num; i++) {
+        route_node_t *n = &s_nodes[i];
+        if (!resumed) {
+            n->subscribed = false;
+        }
+        if (!n->subs) {
+            continue;
+        }
+        if (n->subscribed && n->sub_qos >= n->qos) {
+            kept++;
+            continue;
+        }
+        if (esp_mqtt_client_subscribe(client, n->filter, n->qos) < 0) {
+            ESP_LOGW(TAG, "Subscribe to %s failed", n->filter);
+        } else {
+            n->subscribed = true;
+            n->sub_qos = n->qos;
+            ESP_LOGI(TAG, "Subscribed to %s", n->filter);
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (kept) {
+        ESP_LOGI(TAG, "%d subscriptions kept by the broker session", kept);
+    }
+}
+
+void app_mqtt_router_disconnected(void)
+{
+    if (router_lock()) {
+        s_client = NULL;
+        xSemaphoreGive(s_lock);
+    }
+}
+
+/* Append n's handlers to hits; *num counts past ROUTE_MATCH_MAX so the caller can tell some were left out. */
+static void collect(const route_node_t *n, route_hit_t *hits, int *num)
+{
+    for (const route_sub_t *sub = n->subs; sub; sub = sub->next, (*num)++) {
+        if (*num < ROUTE_MATCH_MAX) {
+            hits[*num] = (route_hit_t) {
+                .handler = sub->handler, .arg = sub->arg, .max_len = sub->max_len, .stream = sub->stream,
+            };
+        }
+    }
+}
+
+/*
+ * Match the levels from level (len bytes to end; done when every level was consumed) below node idx.
+ * Wildcards do not match a first level starting with '$' (broker topics such as $SYS).
+ */
+static void match(uint16_t idx, const char *level, const char *end, bool done, int depth,
+                  route_hit_t *hits, int *num)
+{
+    const route_node_t *n = &s_nodes[idx];
+    if (n->multi != NODE_NONE && !(depth == 0 && !done && level < end && *level == '$')) {
+        collect(&s_nodes[n->multi], hits, num);   /* "a/#" also matches "a" */
+    }
+    if (done) {
+        collect(n, hits, num);
+        return;
+    }
+    if (depth >= ROUTE_DEPTH_MAX) {
+        return;
+    }
+    const char *slash = memchr(level, '/', end - level);
+    size_t len = slash ? (size_t)(slash - level) : (size_t)(end - level);
+    const char *next = slash ? slash + 1 : end;
+    bool last = (slash == NULL);
+
+    if (n->plus != NODE_NONE && !(depth == 0 && len > 0 && *level == '$')) {
+        match(n->plus, next, end, last, depth + 1, hits, num);
+    }
+    uint16_t kid = NODE_NONE;
+    if (n->kid_num > KID_SCAN_MAX) {
+        kid = kid_find(n, level, len, level_hash(level, len));
+    } else {
+        for (uint16_t i = 0; i < n->kid_num; i++) {
+            const route_node_t *k = &s_nodes[n->kids[i]];
+            if (k->len == len && memcmp(k->level, level, len) == 0) {
+                kid = n->kids[i];
+                break;
+            }
+        }
+    }
+    if (kid != NODE_NONE) {
+        match(kid, next, end, last, depth + 1, hits, num);
+    }
+}
+
+static bool too_long(const route_hit_t *hit, size_t total_len, const char *topic, size_t topic_len)
+{
+    if (hit->max_len && total_len > hit->max_len) {
+        ESP_LOGW(TAG, "%.*s: %u byte message over the handler's %u byte limit, dropped",
+                 (int)topic_len, topic, (unsigned)total_len, (unsigned)hit->max_len);
+        return true;
+    }
+    return false;
+}
+
+/* First event of a fragmented message: keep the handlers that can take it and set up the buffers. */
+static void reasm_begin(const char *topic, size_t topic_len, const route_hit_t *hits, int num,
+                        size_t total_len)
+{
+    reasm_t *r = &s_reasm;
+    bool whole = false;
+    r->hit_num = 0;
+    for (int i = 0; i < num; i++) {
+        if (!too_long(&hits[i], total_len, topic, topic_len)) {
+            r->hits[r->hit_num++] = hits[i];
+            whole |= !hits[i].stream;
+        }
+    }
+    /* Short topics go to topic_buf, so streaming-only messages need no arena */
+    bool topic_in_arena = topic_len > sizeof(r->topic_buf);
+    size_t topic_need = topic_in_arena ? topic_len : 0;
+    if (r->hit_num && (whole || topic_in_arena) && !s_arena) {
+        s_arena = heap_caps_malloc(REASM_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_arena) {
+            s_arena = heap_caps_malloc(REASM_BUF_SIZE, MALLOC_CAP_DEFAULT);
+        }
+    }
+    /* A payload that cannot be buffered is dropped for whole-message handlers only */
+    if (whole && (!s_arena || topic_need + total_len > REASM_BUF_SIZE)) {
+        if (s_arena) {
+            ESP_LOGW(TAG, "%.*s: %u byte message does not fit the %u byte reassembly buffer, dropped",
+                     (int)topic_len, topic, (unsigned)total_len, (unsigned)REASM_BUF_SIZE);
+        } else {
+            ESP_LOGW(TAG, "%.*s: no memory for the reassembly buffer, %u byte message dropped",
+                     (int)topic_len, topic, (unsigned)total_len);
+        }
+        int kept = 0;
+        for (int i = 0; i < r->hit_num; i++) {
+            if (r->hits[i].stream) {
+                r->hits[kept++] = r->hits[i];
+            }
+        }
+        r->hit_num = kept;
+        whole = false;
+    }
+    if (r->hit_num && topic_in_arena && (!s_arena || topic_len > REASM_BUF_SIZE)) {
+        ESP_LOGW(TAG, "%.*s...: %u byte topic does not fit the reassembly buffer, message dropped",
+                 (int)sizeof(r->topic_buf), topic, (unsigned)topic_len);
+        r->hit_num = 0;
+    }
+
+    r->active = true;
+    r->total_len = total_len;
+    r->next_offset = 0;
+    r->topic = "";
+    r->topic_len = 0;
+    r->buf = NULL;
+    if (r->hit_num) {
+        char *t = topic_in_arena ? s_arena : r->topic_buf;
+        memcpy(t, topic, topic_len);
+        r->topic = t;
+        r->topic_len = topic_len;
+        r->buf = whole ? s_arena + topic_need : NULL;
+    }
+}
+
+/* One event of the message being reassembled; the last one delivers it. */
+static int reasm_feed(const char *data, size_t data_len, size_t offset)
+{
+    reasm_t *r = &s_reasm;
+    if (!r->active || offset != r->next_offset || offset + data_len > r->total_len) {
+        if (r->active) {
+            ESP_LOGW(TAG, "%.*s: fragment at %u, expected %u; message dropped", (int)r->topic_len, r->topic,
+                     (unsigned)offset, (unsigned)r->next_offset);
+        }
+        r->active = false;
+        return 0;
+    }
+    int called = 0;
+    app_mqtt_msg_t msg = {
+        .topic = r->topic, .topic_len = r->topic_len, .data = data, .data_len = data_len,
+        .offset = offset, .total_len = r->total_len,
+    };
+    for (int i = 0; i < r->hit_num; i++) {
+        if (r->hits[i].stream) {
+            r->hits[i].handler(&msg, r->hits[i].arg);
+            called++;
+        }
+    }
+    if (r->buf) {
+        memcpy(r->buf + offset, data, data_len);
+    }
+    r->next_offset = offset + data_len;
+    if (r->next_offset < r->total_len) {
+        return called;
+    }
+
+    r->active = false;
+    if (r->buf) {
+        msg.data = r->buf;
+        msg.data_len = r->total_len;
+        msg.offset = 0;
+        for (int i = 0; i < r->hit_num; i++) {
+            if (!r->hits[i].stream) {
+                r->hits[i].handler(&msg, r->hits[i].arg);
+                called++;
+            }
+        }
+    }
+    return called;
+}
+
+int app_mqtt_router_dispatch(const char *topic, size_t topic_len, const char *data, size_t data_len,
+                             size_t offset, size_t total_len)
+{
+    if (!data) {
+        data_len = 0;
+    }
+    if (total_len < offset + data_len) {
+        total_len = offset + data_len;
+    }
+    if (offset > 0) {
+        return reasm_feed(data, data_len, offset);
+    }
+    if (s_reasm.active) {
+        ESP_LOGW(TAG, "%.*s: incomplete message dropped (%u of %u bytes)", (int)s_reasm.topic_len, s_reasm.topic,
+                 (unsigned)s_reasm.next_offset, (unsigned)s_reasm.total_len);
+        s_reasm.active = false;
+    }
+
+    route_hit_t hits[ROUTE_MATCH_MAX];
+    int num = 0;
+    if (!topic || topic_len == 0 || !router_lock()) {
+        return 0;
+    }
+    if (s_node_num) {
+        match(0, topic, topic + topic_len, false, 0, hits, &num);
+    }
+    xSemaphoreGive(s_lock);
+    if (num == 0) {
+        ESP_LOGD(TAG, "No handler for %.*s", (int)topic_len, topic);
+    } else if (num > ROUTE_MATCH_MAX) {
+        ESP_LOGW(TAG, "%.*s matches %d handlers, %d of them not called (ROUTE_MATCH_MAX %d)", (int)topic_len,
+                 topic, num, num - ROUTE_MATCH_MAX, ROUTE_MATCH_MAX);
+        num = ROUTE_MATCH_MAX;
+    }
+
+    if (data_len < total_len) {
+        reasm_begin(topic, topic_len, hits, num, total_len);
+        return reasm_feed(data, data_len, 0);
+    }
+    /* Whole message in one event: no copy */
+    const app_mqtt_msg_t msg = {
+        .topic = topic, .topic_len = topic_len, .data = data, .data_len = data_len,
+        .offset = 0, .total_len = total_len,
+    };
+    int called = 0;
+    for (int i = 0; i < num; i++) {
+        if (!too_long(&hits[i], total_len, topic, topic_len)) {
+            hits[i].handler(&msg, hits[i].arg);
+            called++;
+        }
+    }
+    return called;
+}
@@ -0,0 +1,79 @@
+/*
+ * MQTT topic router: modules register a handler for an exact topic or a wildcard filter
+ * ("kavach/+/temp", "kavach/#"). Filters are kept in a trie with one node per topic level, so an
+ * incoming message costs one lookup per level instead of one comparison per registered topic.
+ * Registered filters are subscribed when the client connects, except those the broker still has from
+ * the previous connection (persistent session).
+ *
+ * Messages larger than the MQTT client's buffer arrive in several MQTT_EVENT_DATA events; the router
+ * reassembles them in a buffer allocated once (CONFIG_KAVACH_MQTT_REASM_BUF_KB), or passes each chunk
+ * on as it arrives to handlers registered for streaming.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Incoming message. topic and data point into the MQTT client's receive buffer (or the reassembly
+ * buffer): they are not NUL-terminated and are only valid during the handler call.
+ */
+typedef struct {
+    const char *topic;
+    size_t topic_len;
+    const char *data;       /* whole payload; in streaming mode the chunk at offset */
+    size_t data_len;
+    size_t offset;          /* streaming mode: position of data in the payload (0 otherwise) */
+    size_t total_len;       /* full payload length; the last chunk ends at total_len */
+} app_mqtt_msg_t;
+
+typedef void (*app_mqtt_handler_t)(const app_mqtt_msg_t *msg, void *arg);
+
+typedef struct {
+    size_t max_len;         /* larger messages are dropped for this handler; 0 = no limit (streaming only) */
+    bool stream;            /* deliver chunks as they arrive instead of the reassembled message;
+                               a chunk at offset 0 means a new message (the previous one may be cut off) */
+} app_mqtt_route_opts_t;
+
+/**
+ * Call handler for messages matching filter (MQTT syntax: '+' one level, '#' trailing levels), whole
+ * messages up to CONFIG_KAVACH_MQTT_MSG_MAX_DEFAULT bytes.
+ * If the client is connected the filter is subscribed immediately, otherwise on connect.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG (bad filter), ESP_ERR_NO_MEM
+ */
+esp_err_t app_mqtt_router_register(const char *filter, int qos, app_mqtt_handler_t handler, void *arg);
+
+/** As app_mqtt_router_register() with a per-handler size limit and/or streaming delivery. */
+esp_err_t app_mqtt_router_register_ex(const char *filter, int qos, const app_mqtt_route_opts_t *opts,
+                                      app_mqtt_handler_t handler, void *arg);
+
+/** Remove a registration (the broker subscription is kept until the next connect). */
+esp_err_t app_mqtt_router_unregister(const char *filter, app_mqtt_handler_t handler, void *arg);
+
+/**
+ * MQTT_EVENT_CONNECTED: subscribe the registered filters on client. If resumed (the broker kept the
+ * session of the previous connection), only filters registered or raised in QoS since then.
+ */
+void app_mqtt_router_connected(esp_mqtt_client_handle_t client, bool resumed);
+
+/** MQTT_EVENT_DISCONNECTED: later registrations wait for the next connect. */
+void app_mqtt_router_disconnected(void);
+
+/**
+ * MQTT_EVENT_DATA (MQTT task only): pass on one event. offset and total_len are the event's
+ * current_data_offset and total_data_len; continuation events have no topic.
+ * Returns the number of handlers called.
+ */
+int app_mqtt_router_dispatch(const char *topic, size_t topic_len, const char *data, size_t data_len,
+                             size_t offset, size_t total_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Reconnect policy. esp-mqtt reconnects on its own (its task stops for good once auto reconnect is
+ * off); the supervisor only chooses the delay and the broker. The delay doubles with each failure of
+ * the outage (BACKOFF_MIN_MS .. BACKOFF_MAX_SEC) and is drawn from the upper half of that window, so
+ * devices that lost the same broker do not all come back in the same instant. After
+ * FAILOVER_ATTEMPTS failures in a row the other broker is tried; the device stays on whichever broker
+ * answers until that one fails.
+ *
+ * esp-mqtt reads reconnect_timeout_ms when the connection drops, before MQTT_EVENT_DISCONNECTED, so
+ * each delay is set one event ahead through esp_mqtt_set_config(): on connect for the first retry,
+ * on each failure for the next one. set_config() takes a whole config (fields left zero are reset to
+ * their defaults), so the client's config is kept and re-applied with the new delay and broker URI.
+ * It runs in the MQTT task without holding s_lock: lock order is MQTT client lock -> s_lock, as in
+ * the router.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "app_mqtt_supervisor.h"
+
+static const char *TAG = "mqtt_sup";
+
+#define BACKOFF_MIN_MS      CONFIG_KAVACH_MQTT_BACKOFF_MIN_MS
+#define BACKOFF_MAX_MS      (CONFIG_KAVACH_MQTT_BACKOFF_MAX_SEC * 1000)
+#define FAILOVER_ATTEMPTS   CONFIG_KAVACH_MQTT_FAILOVER_ATTEMPTS
+#define CLIENT_ID_MAX       24
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_mqtt_client_handle_t s_client = NULL;
+static esp_mqtt_client_config_t s_cfg;  /* the client's config, re-applied with each new delay */
+static const char *s_uri[2];
+static uint8_t s_uri_num = 0;
+static uint32_t s_delay_ms = 0;         /* what esp-mqtt waits after the next disconnect */
+static int8_t s_session_broker = -1;    /* broker of the last successful connect */
+static uint32_t s_fail_streak = 0;      /* failed attempts in this outage */
+static uint32_t s_broker_fails = 0;     /* failed attempts in a row on the current broker */
+static int64_t s_outage_start_ms = 0;
+static int64_t s_attempt_start_ms = 0;
+static app_mqtt_link_stats_t s_stats;
+static char s_client_id[CLIENT_ID_MAX];
+
+static int64_t now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static uint32_t backoff_ms(uint32_t failures)
+{
+    uint32_t cap = BACKOFF_MIN_MS;
+    while (failures-- > 0 && cap < BACKOFF_MAX_MS) {
+        cap <<= 1;
+    }
+    if (cap > BACKOFF_MAX_MS) {
+        cap = BACKOFF_MAX_MS;
+    }
+    return cap / 2 + esp_random() % (cap / 2 + 1);
+}
+
+/* Broker and delay of the attempt after the next disconnect (MQTT task) */
+static void set_next_attempt(uint8_t broker, uint32_t delay_ms)
+{
+    s_cfg.broker.address.uri = s_uri[broker];
+    s_cfg.network.reconnect_timeout_ms = (int)delay_ms;
+    if (esp_mqtt_set_config(s_client, &s_cfg) != ESP_OK) {
+        ESP_LOGW(TAG, "Could not set the next attempt (%s in %lu ms)", s_uri[broker], (unsigned long)delay_ms);
+        return;
+    }
+    s_delay_ms = delay_ms;
+}
+
+void app_mqtt_supervisor_config(esp_mqtt_client_config_t *cfg)
+{
+    uint8_t mac[6] = { 0 };
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(s_client_id, sizeof(s_client_id), "kavach-%02x%02x%02x", mac[3], mac[4], mac[5]);
+    cfg->credentials.client_id = s_client_id;
+    cfg->session.disable_clean_session = true;
+    cfg->session.keepalive = CONFIG_KAVACH_MQTT_KEEPALIVE_SEC;
+    cfg->network.disable_auto_reconnect = false;
+    cfg->network.reconnect_timeout_ms = (int)backoff_ms(0);
+}
+
+esp_err_t app_mqtt_supervisor_start(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *cfg,
+                                    const char *primary, const char *secondary)
+{
+    if (!client || !cfg || !primary) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_client = client;
+    s_cfg = *cfg;
+    s_delay_ms = (uint32_t)cfg->network.reconnect_timeout_ms;
+    s_uri[0] = primary;
+    s_uri[1] = secondary;
+    s_uri_num = (secondary && secondary[0]) ? 2 : 1;
+    ESP_LOGI(TAG, "Client id %s, backoff %d ms .. %d s%s%s", s_client_id, BACKOFF_MIN_MS,
+             CONFIG_KAVACH_MQTT_BACKOFF_MAX_SEC, s_uri_num > 1 ? ", secondary " : "",
+             s_uri_num > 1 ? secondary : "");
+    return ESP_OK;
+}
+
+bool app_mqtt_supervisor_connected(bool session_present)
+{
+    int64_t now = now_ms();
+    portENTER_CRITICAL(&s_lock);
+    bool after_outage = s_outage_start_ms != 0;
+    uint32_t outage = after_outage ? (uint32_t)(now - s_outage_start_ms) : 0;
+    uint32_t attempts = s_fail_streak + 1;
+    bool resumed = session_present && s_session_broker == (int8_t)s_stats.broker;
+    s_stats.connected = true;
+    s_stats.connects++;
+    s_stats.last_connect_ms = (uint32_t)(now - s_attempt_start_ms);
+    if (session_present) {
+        s_stats.resumed++;
+    }
+    if (after_outage) {
+        s_stats.last_outage_ms = outage;
+        s_stats.total_outage_ms += outage;
+        if (outage > s_stats.max_outage_ms) {
+            s_stats.max_outage_ms = outage;
+        }
+    }
+    s_session_broker = s_stats.broker;
+    s_outage_start_ms = 0;
+    s_fail_streak = 0;
+    s_broker_fails = 0;
+    uint32_t connect_ms = s_stats.last_connect_ms;
+    uint8_t broker = s_stats.broker;
+    portEXIT_CRITICAL(&s_lock);
+
+    set_next_attempt(broker, backoff_ms(0));
+
+    if (after_outage) {
+        ESP_LOGI(TAG, "Reconnected to %s after %lu ms offline (%lu attempts, connect %lu ms, session %s)",
+                 s_uri[broker], (unsigned long)outage, (unsigned long)attempts, (unsigned long)connect_ms,
+                 session_present ? "resumed" : "new");
+    } else {
+        ESP_LOGI(TAG, "Connected to %s in %lu ms (%lu attempts, session %s)", s_uri[broker],
+                 (unsigned long)connect_ms, (unsigned long)attempts, session_present ? "resumed" : "new");
+    }
+    return resumed;
+}
+
+void app_mqtt_supervisor_before_connect(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_attempt_start_ms = now_ms();
+    s_stats.attempts++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void app_mqtt_supervisor_disconnected(void)
+{
+    if (!s_client) {
+        return;
+    }
+    int64_t now = now_ms();
+    portENTER_CRITICAL(&s_lock);
+    bool lost = s_stats.connected;
+    if (lost) {
+        s_stats.connected = false;
+        s_stats.outages++;
+        s_outage_start_ms = now;
+        s_fail_streak = 0;
+        s_broker_fails = 0;
+    } else {
+        s_fail_streak++;
+        if (++s_broker_fails >= FAILOVER_ATTEMPTS && s_uri_num > 1) {
+            s_stats.broker ^= 1;
+            s_stats.failovers++;
+            s_broker_fails = 0;
+        }
+    }
+    uint32_t next_delay = backoff_ms(s_fail_streak + 1);
+    uint8_t broker = s_stats.broker;
+    portEXIT_CRITICAL(&s_lock);
+
+    /* esp-mqtt already waits s_delay_ms for this attempt; a failover takes effect with it */
+    uint32_t delay = s_delay_ms;
+    set_next_attempt(broker, next_delay);
+    if (lost) {
+        ESP_LOGW(TAG, "Connection lost, retrying in %lu ms", (unsigned long)delay);
+    } else {
+        ESP_LOGI(TAG, "Attempt failed, next try on %s in %lu ms", s_uri[broker], (unsigned long)delay);
+    }
+}
+
+const char *app_mqtt_supervisor_uri(void)
+{
+    return s_uri[s_stats.broker];
+}
+
+void app_mqtt_supervisor_get_stats(app_mqtt_link_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,67 @@
+/*
+ * MQTT connection supervisor: replaces esp-mqtt's fixed reconnect delay with jittered exponential
+ * backoff, fails over between the primary and the optional secondary broker, and measures how long
+ * each outage and each reconnect took. The client connects with a persistent session
+ * (clean session = 0) and a stable client id, so the broker keeps the subscriptions, and queues
+ * QoS 1 messages, while the device is away.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t connects;          /* successful connects, the first one included */
+    uint32_t attempts;          /* connect attempts */
+    uint32_t resumed;           /* connects where the broker still had the session */
+    uint32_t failovers;         /* switches to the other broker */
+    uint32_t outages;           /* connection losses */
+    uint32_t last_outage_ms;    /* disconnect to connected, last outage */
+    uint32_t max_outage_ms;
+    uint64_t total_outage_ms;
+    uint32_t last_connect_ms;   /* start of the successful attempt to CONNACK */
+    uint8_t broker;             /* 0 primary, 1 secondary */
+    bool connected;
+} app_mqtt_link_stats_t;
+
+/**
+ * Fill in the client config: persistent session, stable client id, keepalive, and the delay of the
+ * first reconnect. Call before esp_mqtt_client_init().
+ */
+void app_mqtt_supervisor_config(esp_mqtt_client_config_t *cfg);
+
+/**
+ * Supervise client. cfg is the config it was initialised with; a copy is re-applied with every new
+ * reconnect delay, so the strings and transport it points to must stay valid, as must primary and
+ * secondary (may be NULL or empty), the full broker URIs. Call after esp_mqtt_client_init(), before
+ * esp_mqtt_client_start().
+ */
+esp_err_t app_mqtt_supervisor_start(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *cfg,
+                                    const char *primary, const char *secondary);
+
+/**
+ * MQTT_EVENT_CONNECTED (MQTT task). session_present is the CONNACK flag.
+ * @return true if the subscriptions of the previous connection are still in place on the broker
+ */
+bool app_mqtt_supervisor_connected(bool session_present);
+
+/** MQTT_EVENT_BEFORE_CONNECT (MQTT task): a connect attempt starts. */
+void app_mqtt_supervisor_before_connect(void);
+
+/** MQTT_EVENT_DISCONNECTED (MQTT task): connection lost or attempt failed; sets up the attempt after next. */
+void app_mqtt_supervisor_disconnected(void);
+
+/** URI of the broker in use (or being tried). */
+const char *app_mqtt_supervisor_uri(void);
+
+void app_mqtt_supervisor_get_stats(app_mqtt_link_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
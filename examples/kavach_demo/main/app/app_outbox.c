@@ -0,0 +1,540 @@
+/*
+ * Outbox log. The partition is a ring of 4 KB sectors, each starting with {magic, sector seq}.
+ * Records are appended with their state word left erased, then the state is written PENDING, and
+ * DONE (all bits cleared) once acknowledged, so a record costs one write plus two 4-byte state
+ * writes and no erase. The sector after the active one is kept erased as a spare. When the active
+ * sector fills, the spare becomes active and the oldest sector is retired: its still-pending records
+ * are copied into the new active sector (sensor readings are dropped instead) and only then is it
+ * erased as the next spare. A power cut at any point leaves every pending record on flash at least
+ * once; init drops the duplicates by sequence number and finishes the interrupted retirement.
+ */
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "app_outbox.h"
+
+static const char *TAG = "outbox";
+
+#define OUTBOX_MAGIC        0x424f564bu     /* "KVOB" */
+#define SECTOR_SIZE         4096
+#define INDEX_MAX           128             /* pending messages tracked in RAM */
+#define INFLIGHT_MAX        4
+#define EARLY_ACK_MAX       INFLIGHT_MAX
+#define REC_ERASED          0xffffffffu
+#define REC_PENDING         0x5a5a5a5au
+#define REC_DONE            0x00000000u
+#define NO_SECTOR           UINT32_MAX
+#define ALIGN4(x)           (((x) + 3u) & ~3u)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} sector_hdr_t;
+
+typedef struct {
+    uint32_t state;
+    uint32_t crc;           /* over seq .. end of payload */
+    uint32_t seq;
+    uint16_t payload_len;
+    uint8_t topic_len;
+    uint8_t prio;
+} rec_hdr_t;
+
+#define REC_MAX             ALIGN4(sizeof(rec_hdr_t) + APP_OUTBOX_TOPIC_MAX + APP_OUTBOX_PAYLOAD_MAX)
+#define REC_CRC_OFFSET      offsetof(rec_hdr_t, seq)
+
+typedef struct {
+    uint32_t addr;
+    uint32_t seq;
+    uint8_t prio;
+    int msg_id;             /* -1 idle, 0 being published, > 0 waiting for PUBACK */
+} pending_t;
+
+static const esp_partition_t *s_part = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+static uint32_t s_sectors;
+static uint32_t s_active;           /* sector being appended to */
+static uint32_t s_write_off;        /* next free offset in the active sector */
+static uint32_t s_sector_seq;
+static uint32_t s_retiring = NO_SECTOR;    /* sector whose records are not all moved yet */
+static uint32_t s_next_seq = 1;
+static pending_t s_pending[INDEX_MAX];
+static size_t s_pending_num = 0;
+static app_outbox_stats_t s_stats;
+static uint8_t s_rec[REC_MAX] __attribute__((aligned(4)));
+static uint8_t s_move[REC_MAX] __attribute__((aligned(4)));   /* record being moved; s_rec may hold the one being appended */
+static int s_early_acks[EARLY_ACK_MAX];    /* PUBACKs that beat the publisher back to the lock */
+static size_t s_early_ack_pos = 0;
+
+static size_t rec_size(const rec_hdr_t *hdr)
+{
+    return ALIGN4(sizeof(rec_hdr_t) + hdr->topic_len + hdr->payload_len);
+}
+
+static uint32_t rec_crc(const uint8_t *rec, size_t size)
+{
+    return esp_rom_crc32_le(0, rec + REC_CRC_OFFSET, size - REC_CRC_OFFSET);
+}
+
+static esp_err_t flash_write(uint32_t addr, const void *data, size_t len)
+{
+    s_stats.bytes_written += len;
+    return esp_partition_write(s_part, addr, data, len);
+}
+
+static esp_err_t set_state(uint32_t addr, uint32_t state)
+{
+    return flash_write(addr + offsetof(rec_hdr_t, state), &state, sizeof(state));
+}
+
+static void index_remove(size_t i)
+{
+    s_pending[i] = s_pending[--s_pending_num];
+}
+
+/* Make room for a message of prio: evict the oldest lower-priority message not in flight. */
+static bool index_reserve(uint8_t prio)
+{
+    if (s_pending_num < INDEX_MAX) {
+        return true;
+    }
+    int victim = -1;
+    for (size_t i = 0; i < s_pending_num; i++) {
+        const pending_t *p = &s_pending[i];
+        /* A new sensor reading also replaces the oldest one */
+        bool evictable = p->prio < prio || (prio == APP_OUTBOX_PRIO_LOW && p->prio == prio);
+        if (evictable && p->msg_id < 0 &&
+                (victim < 0 || p->prio < s_pending[victim].prio ||
+                 (p->prio == s_pending[victim].prio && p->seq < s_pending[victim].seq))) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        return false;
+    }
+    set_state(s_pending[victim].addr, REC_DONE);
+    index_remove(victim);
+    s_stats.dropped++;
+    return true;
+}
+
+/* Write a record built in rec (state erased) at the current position; torn writes stay non-PENDING. */
+static esp_err_t write_record(const uint8_t *rec, size_t size, uint32_t *addr)
+{
+    uint32_t at = s_active * SECTOR_SIZE + s_write_off;
+    if (s_write_off + size > SECTOR_SIZE) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_write_off += size;
+    esp_err_t ret = flash_write(at, rec, size);
+    if (ret == ESP_OK) {
+        ret = set_state(at, REC_PENDING);
+    }
+    if (ret == ESP_OK) {
+        *addr = at;
+    }
+    return ret;
+}
+
+/*
+ * Move the sector's pending records into the active sector, then erase it. Nothing is erased until
+ * every record is written again, so an error or power cut leaves each one on flash at least once.
+ */
+static esp_err_t retire(uint32_t sector)
+{
+    uint32_t base = sector * SECTOR_SIZE;
+    s_retiring = sector;
+    for (size_t i = 0; i < s_pending_num;) {
+        pending_t *p = &s_pending[i];
+        if (p->addr < base || p->addr >= base + SECTOR_SIZE) {
+            i++;
+            continue;
+        }
+        if (p->prio == APP_OUTBOX_PRIO_LOW && p->msg_id < 0) {
+            index_remove(i);
+            s_stats.dropped++;
+            continue;
+        }
+        rec_hdr_t *hdr = (rec_hdr_t *)s_move;
+        size_t size = 0;
+        esp_err_t ret = esp_partition_read(s_part, p->addr, hdr, sizeof(*hdr));
+        if (ret == ESP_OK) {
+            size = rec_size(hdr);
+            ret = size <= REC_MAX ? esp_partition_read(s_part, p->addr, s_move, size) : ESP_ERR_INVALID_SIZE;
+        }
+        if (ret != ESP_OK || rec_crc(s_move, size) != hdr->crc) {
+            ESP_LOGE(TAG, "Unreadable message seq %lu dropped", (unsigned long)p->seq);
+            index_remove(i);
+            s_stats.dropped++;
+            continue;
+        }
+        hdr->state = REC_ERASED;
+        ret = write_record(s_move, size, &p->addr);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Moving message seq %lu failed: %s", (unsigned long)p->seq, esp_err_to_name(ret));
+            return ret;
+        }
+        i++;
+    }
+
+    esp_err_t ret = esp_partition_erase_range(s_part, base, SECTOR_SIZE);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    s_stats.erases++;
+    s_retiring = NO_SECTOR;
+    return ESP_OK;
+}
+
+/* Start appending to the spare sector and retire the oldest one to become the next spare. */
+static esp_err_t rotate(void)
+{
+    uint32_t next = (s_active + 1) % s_sectors;
+    /* A retirement that failed last time still blocks the spare */
+    if (s_retiring != NO_SECTOR) {
+        esp_err_t ret = retire(s_retiring);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    sector_hdr_t sh = { .magic = OUTBOX_MAGIC, .seq = s_sector_seq + 1 };
+    esp_err_t ret = flash_write(next * SECTOR_SIZE, &sh, sizeof(sh));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    s_sector_seq = sh.seq;
+    s_active = next;
+    s_write_off = sizeof(sector_hdr_t);
+    return retire((next + 1) % s_sectors);
+}
+
+static esp_err_t append(const uint8_t *rec, size_t size, uint32_t *addr)
+{
+    /* Each rotation frees at least the sector's done records; give up after a full lap */
+    for (uint32_t laps = 0; s_write_off + size > SECTOR_SIZE; laps++) {
+        if (laps >= s_sectors) {
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t ret = rotate();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    return write_record(rec, size, addr);
+}
+
+static pending_t *find_seq(uint32_t seq)
+{
+    for (size_t i = 0; i < s_pending_num; i++) {
+        if (s_pending[i].seq == seq) {
+            return &s_pending[i];
+        }
+    }
+    return NULL;
+}
+
+static bool sector_blank(uint32_t sector)
+{
+    uint32_t buf[64];
+    for (uint32_t off = 0; off < SECTOR_SIZE; off += sizeof(buf)) {
+        if (esp_partition_read(s_part, sector * SECTOR_SIZE + off, buf, sizeof(buf)) != ESP_OK) {
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(buf) / sizeof(buf[0]); i++) {
+            if (buf[i] != REC_ERASED) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Index a sector's pending records; returns the offset after its last record. */
+static uint32_t scan_sector(uint32_t sector)
+{
+    uint32_t base = sector * SECTOR_SIZE;
+    uint32_t off = sizeof(sector_hdr_t);
+    while (off + sizeof(rec_hdr_t) <= SECTOR_SIZE) {
+        rec_hdr_t hdr;
+        esp_partition_read(s_part, base + off, &hdr, sizeof(hdr));
+        if (hdr.state == REC_ERASED && hdr.crc == REC_ERASED && hdr.seq == REC_ERASED) {
+            break;  /* end of data */
+        }
+        size_t size = rec_size(&hdr);
+        if (hdr.payload_len > APP_OUTBOX_PAYLOAD_MAX || hdr.topic_len > APP_OUTBOX_TOPIC_MAX ||
+                off + size > SECTOR_SIZE) {
+            ESP_LOGW(TAG, "Corrupt record in sector %lu, skipping rest", (unsigned long)sector);
+            return SECTOR_SIZE;
+        }
+        if (hdr.seq >= s_next_seq) {
+            s_next_seq = hdr.seq + 1;
+        }
+        if (hdr.state == REC_PENDING) {
+            esp_partition_read(s_part, base + off, s_rec, size);
+            bool intact = rec_crc(s_rec, size) == hdr.crc;
+            pending_t *dup = intact ? find_seq(hdr.seq) : NULL;
+            if (dup) {
+                /* Copied by a retirement that a power cut interrupted: keep the copy in the active sector */
+                if (sector == s_active) {
+                    dup->addr = base + off;
+                }
+            } else if (intact && index_reserve(hdr.prio)) {
+                s_pending[s_pending_num++] = (pending_t) {
+                    .addr = base + off, .seq = hdr.seq, .prio = hdr.prio, .msg_id = -1,
+                };
+            }
+        }
+        off += size;
+    }
+    return off;
+}
+
+esp_err_t app_outbox_init(void)
+{
+    if (s_part) {
+        return ESP_OK;
+    }
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, APP_OUTBOX_SUBTYPE, "outbox");
+    if (!part || part->size < 2 * SECTOR_SIZE) {
+        ESP_LOGW(TAG, "No \"outbox\" partition; MQTT messages are not kept while offline");
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_part = part;
+    s_sectors = part->size / SECTOR_SIZE;
+
+    /* Newest formatted sector is the one being appended to */
+    bool found = false;
+    for (uint32_t i = 0; i < s_sectors; i++) {
+        sector_hdr_t sh;
+        esp_partition_read(s_part, i * SECTOR_SIZE, &sh, sizeof(sh));
+        if (sh.magic == OUTBOX_MAGIC && (!found || (int32_t)(sh.seq - s_sector_seq) > 0)) {
+            s_sector_seq = sh.seq;
+            s_active = i;
+            found = true;
+        }
+    }
+    if (!found) {
+        /* Unformatted: erase it all once, so the spare every rotation relies on is blank */
+        esp_err_t ret = esp_partition_erase_range(s_part, 0, s_sectors * SECTOR_SIZE);
+        if (ret != ESP_OK) {
+            s_part = NULL;
+            return ret;
+        }
+        s_active = s_sectors - 1;   /* first rotate() formats sector 0 */
+        s_write_off = SECTOR_SIZE;
+        ESP_LOGI(TAG, "Empty outbox (%lu sectors)", (unsigned long)s_sectors);
+        return ESP_OK;
+    }
+    for (uint32_t i = 0; i < s_sectors; i++) {
+        sector_hdr_t sh;
+        esp_partition_read(s_part, i * SECTOR_SIZE, &sh, sizeof(sh));
+        if (sh.magic != OUTBOX_MAGIC) {
+            continue;
+        }
+        uint32_t end = scan_sector(i);
+        if (i == s_active) {
+            s_write_off = end;
+        }
+    }
+    /* A power cut during rotate() leaves the spare formatted or half erased: finish retiring it */
+    uint32_t spare = (s_active + 1) % s_sectors;
+    if (!sector_blank(spare)) {
+        ESP_LOGW(TAG, "Finishing interrupted rotation of sector %lu", (unsigned long)spare);
+        esp_err_t ret = retire(spare);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Retiring sector %lu failed: %s", (unsigned long)spare, esp_err_to_name(ret));
+        }
+    }
+    ESP_LOGI(TAG, "%u message(s) pending from before restart", (unsigned)s_pending_num);
+    return ESP_OK;
+}
+
+esp_err_t app_outbox_put(const char *topic, const char *payload, app_outbox_prio_t prio)
+{
+    return app_outbox_put_bin(topic, payload, payload ? strlen(payload) : 0, prio);
+}
+
+esp_err_t app_outbox_put_bin(const char *topic, const void *payload, size_t payload_len, app_outbox_prio_t prio)
+{
+    if (!s_part) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t topic_len = topic ? strlen(topic) : 0;
+    if (topic_len == 0 || topic_len > APP_OUTBOX_TOPIC_MAX || payload_len > APP_OUTBOX_PAYLOAD_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    if (index_reserve(prio)) {
+        rec_hdr_t *hdr = (rec_hdr_t *)s_rec;
+        *hdr = (rec_hdr_t) {
+            .state = REC_ERASED,
+            .seq = s_next_seq++,
+            .payload_len = payload_len,
+            .topic_len = topic_len,
+            .prio = prio,
+        };
+        memcpy(s_rec + sizeof(rec_hdr_t), topic, topic_len);
+        memcpy(s_rec + sizeof(rec_hdr_t) + topic_len, payload, payload_len);
+        size_t size = rec_size(hdr);
+        memset(s_rec + sizeof(rec_hdr_t) + topic_len + payload_len, 0xff, size - sizeof(rec_hdr_t) - topic_len - payload_len);
+        hdr->crc = rec_crc(s_rec, size);
+
+        uint32_t addr;
+        ret = append(s_rec, size, &addr);
+        if (ret == ESP_OK) {
+            s_pending[s_pending_num++] = (pending_t) {
+                .addr = addr, .seq = hdr->seq, .prio = prio, .msg_id = -1,
+            };
+            s_stats.bytes_queued += topic_len + payload_len;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Message to %s not queued: %s", topic, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/* Done with the message: mark it on flash and forget it. Caller holds s_lock. */
+static void complete(pending_t *p)
+{
+    set_state(p->addr, REC_DONE);
+    index_remove(p - s_pending);
+    s_stats.acked++;
+}
+
+/* Highest-priority, oldest idle message, or NULL if none or the in-flight window is full. */
+static pending_t *next_to_send(void)
+{
+    int inflight = 0;
+    pending_t *best = NULL;
+    for (size_t i = 0; i < s_pending_num; i++) {
+        pending_t *p = &s_pending[i];
+        if (p->msg_id >= 0) {
+            inflight++;
+        } else if (!best || p->prio > best->prio || (p->prio == best->prio && p->seq < best->seq)) {
+            best = p;
+        }
+    }
+    return (inflight < INFLIGHT_MAX) ? best : NULL;
+}
+
+void app_outbox_drain(app_outbox_send_fn send, void *arg)
+{
+    if (!s_part || !send) {
+        return;
+    }
+    uint8_t rec[REC_MAX] __attribute__((aligned(4)));
+    char topic[APP_OUTBOX_TOPIC_MAX + 1];
+    const rec_hdr_t *hdr = (const rec_hdr_t *)rec;
+
+    while (true) {
+        /* Claim a message under the lock but publish without it: the MQTT task takes s_lock from
+         * its event handler while holding the client lock that publishing needs */
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        pending_t *p = next_to_send();
+        uint32_t seq = p ? p->seq : 0;
+        if (p) {
+            esp_partition_read(s_part, p->addr, rec, sizeof(rec_hdr_t));
+            size_t size = rec_size(hdr);
+            if (size > REC_MAX || esp_partition_read(s_part, p->addr, rec, size) != ESP_OK ||
+                    rec_crc(rec, size) != hdr->crc) {
+                ESP_LOGE(TAG, "Unreadable message seq %lu dropped", (unsigned long)seq);
+                set_state(p->addr, REC_DONE);
+                index_remove(p - s_pending);
+                s_stats.dropped++;
+                xSemaphoreGive(s_lock);
+                continue;
+            }
+            p->msg_id = 0;
+        }
+        xSemaphoreGive(s_lock);
+        if (!p) {
+            break;
+        }
+
+        memcpy(topic, rec + sizeof(rec_hdr_t), hdr->topic_len);
+        topic[hdr->topic_len] = '\0';
+        int msg_id = send(topic, (const char *)rec + sizeof(rec_hdr_t) + hdr->topic_len, hdr->payload_len, arg);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        p = find_seq(seq);
+        if (p && p->msg_id == 0) {
+            p->msg_id = (msg_id > 0) ? msg_id : -1;
+            for (size_t i = 0; msg_id > 0 && i < EARLY_ACK_MAX; i++) {
+                if (s_early_acks[i] == msg_id) {
+                    s_early_acks[i] = 0;
+                    complete(p);
+                    break;
+                }
+            }
+        }
+        xSemaphoreGive(s_lock);
+        if (msg_id <= 0) {
+            break;
+        }
+    }
+}
+
+void app_outbox_acked(int msg_id)
+{
+    if (!s_part || msg_id <= 0) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool found = false;
+    for (size_t i = 0; i < s_pending_num; i++) {
+        if (s_pending[i].msg_id == msg_id) {
+            complete(&s_pending[i]);
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        s_early_acks[s_early_ack_pos] = msg_id;
+        s_early_ack_pos = (s_early_ack_pos + 1) % EARLY_ACK_MAX;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void app_outbox_reset_inflight(void)
+{
+    if (!s_part) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (size_t i = 0; i < s_pending_num; i++) {
+        s_pending[i].msg_id = -1;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void app_outbox_get_stats(app_outbox_stats_t *stats)
+{
+    if (!stats) {
+        return;
+    }
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+    *stats = s_stats;
+    stats->pending = s_pending_num;
+    stats->inflight = 0;
+    for (size_t i = 0; i < s_pending_num; i++) {
+        stats->inflight += (s_pending[i].msg_id >= 0);
+    }
+    if (s_lock) {
+        xSemaphoreGive(s_lock);
+    }
+}
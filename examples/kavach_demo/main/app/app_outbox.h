@@ -0,0 +1,76 @@
+/*
+ * Offline outbox: outgoing MQTT messages are appended to a log in the "outbox" data partition and
+ * only marked done when the broker acknowledges them (QoS 1), so a help request spoken during a
+ * WiFi or broker outage is delivered once the connection is back, even across a reboot.
+ * Pending messages are sent highest priority first, oldest first within a priority.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Data partition subtype of the "outbox" partition (custom range, see partitions.csv). */
+#define APP_OUTBOX_SUBTYPE      0x41
+
+#define APP_OUTBOX_TOPIC_MAX    127
+#define APP_OUTBOX_PAYLOAD_MAX  512
+
+typedef enum {
+    APP_OUTBOX_PRIO_LOW = 0,    /* sensor readings: dropped first when the outbox is full */
+    APP_OUTBOX_PRIO_NORMAL,     /* appliance commands */
+    APP_OUTBOX_PRIO_HIGH,       /* help / alert */
+} app_outbox_prio_t;
+
+typedef struct {
+    uint32_t pending;           /* queued, not yet acknowledged */
+    uint32_t inflight;          /* published, waiting for PUBACK */
+    uint32_t acked;
+    uint32_t dropped;           /* evicted for higher-priority messages */
+    uint32_t erases;            /* sector erases since boot */
+    uint32_t bytes_queued;      /* topic + payload bytes accepted since boot */
+    uint32_t bytes_written;     /* flash bytes written since boot, incl. headers, state and relocation */
+} app_outbox_stats_t;
+
+/**
+ * Publish callback used by app_outbox_drain(): send one message at QoS 1.
+ * @return MQTT message id (> 0) to wait for, or -1 if it cannot be sent now.
+ */
+typedef int (*app_outbox_send_fn)(const char *topic, const char *payload, size_t len, void *arg);
+
+/**
+ * Find the outbox partition and rebuild the pending index from flash.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND (no partition; callers should publish directly)
+ */
+esp_err_t app_outbox_init(void);
+
+/**
+ * Append a message. It stays queued until app_outbox_acked() is called for its message id.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE (not initialised), ESP_ERR_INVALID_SIZE,
+ *         ESP_ERR_NO_MEM (full of messages of higher priority, or equal unless both are sensor readings)
+ */
+esp_err_t app_outbox_put(const char *topic, const char *payload, app_outbox_prio_t prio);
+
+/** As app_outbox_put() for a binary payload of len bytes. */
+esp_err_t app_outbox_put_bin(const char *topic, const void *payload, size_t len, app_outbox_prio_t prio);
+
+/** Publish pending messages through send() until the in-flight window is full. Safe from any task. */
+void app_outbox_drain(app_outbox_send_fn send, void *arg);
+
+/** Broker acknowledged msg_id (MQTT_EVENT_PUBLISHED): mark the message done. */
+void app_outbox_acked(int msg_id);
+
+/** Connection lost: in-flight messages will be published again by the next drain. */
+void app_outbox_reset_inflight(void);
+
+void app_outbox_get_stats(app_outbox_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Decoded prompt cache: small fixed table of 48 kHz PCM buffers in PSRAM with LRU eviction.
+ * Decoding reuses the streaming WAV reader, so a cached prompt sounds exactly like a streamed one.
+ */
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#include "app_wav_stream.h"
+#include "app_prompt_cache.h"
+
+static const char *TAG = "prompt_cache";
+
+#define PROMPT_CACHE_MAX_ENTRIES  12
+#define PROMPT_NAME_MAX           32
+#define PROMPT_CACHE_BUDGET       ((size_t)CONFIG_KAVACH_PROMPT_CACHE_KB * 1024)
+
+typedef struct {
+    char name[PROMPT_NAME_MAX];
+    int16_t *pcm;           /* NULL = free slot */
+    size_t samples;
+    uint32_t last_use;      /* s_use_clock value at last hit/load; smallest = least recently used */
+} prompt_entry_t;
+
+static prompt_entry_t s_entries[PROMPT_CACHE_MAX_ENTRIES];
+static uint32_t s_use_clock = 0;
+static size_t s_bytes_used = 0;
+static uint32_t s_hits = 0;
+static uint32_t s_misses = 0;
+static uint32_t s_evictions = 0;
+
+static prompt_entry_t *find_entry(const char *name)
+{
+    for (size_t i = 0; i < PROMPT_CACHE_MAX_ENTRIES; i++) {
+        if (s_entries[i].pcm && strncmp(s_entries[i].name, name, PROMPT_NAME_MAX) == 0) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void free_entry(prompt_entry_t *e)
+{
+    s_bytes_used -= e->samples * sizeof(int16_t);
+    heap_caps_free(e->pcm);
+    memset(e, 0, sizeof(*e));
+}
+
+/* Evict least recently used entries until `bytes` fit in the budget; return a free slot. */
+static prompt_entry_t *make_room(size_t bytes)
+{
+    for (;;) {
+        prompt_entry_t *free_slot = NULL;
+        prompt_entry_t *lru = NULL;
+        for (size_t i = 0; i < PROMPT_CACHE_MAX_ENTRIES; i++) {
+            prompt_entry_t *e = &s_entries[i];
+            if (!e->pcm) {
+                free_slot = free_slot ? free_slot : e;
+            } else if (!lru || e->last_use < lru->last_use) {
+                lru = e;
+            }
+        }
+        if (free_slot && s_bytes_used + bytes <= PROMPT_CACHE_BUDGET) {
+            return free_slot;
+        }
+        if (!lru) {
+            return NULL;
+        }
+        ESP_LOGI(TAG, "Evict %s (%u bytes)", lru->name, (unsigned)(lru->samples * sizeof(int16_t)));
+        free_entry(lru);
+        s_evictions++;
+    }
+}
+
+const int16_t *app_prompt_cache_get(const char *name, size_t *out_samples)
+{
+    prompt_entry_t *e = name ? find_entry(name) : NULL;
+    if (!e) {
+        s_misses++;
+        return NULL;
+    }
+    s_hits++;
+    e->last_use = ++s_use_clock;
+    if (out_samples) {
+        *out_samples = e->samples;
+    }
+    return e->pcm;
+}
+
+esp_err_t app_prompt_cache_load(const char *name, const char *path, const int16_t **out_pcm, size_t *out_samples)
+{
+    if (!name || strlen(name) >= PROMPT_NAME_MAX || !out_pcm || !out_samples) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    app_wav_stream_t *stream = NULL;
+    esp_err_t ret = app_wav_stream_open(path, &stream);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    size_t bytes = app_wav_stream_out_samples(stream) * sizeof(int16_t);
+    if (bytes > PROMPT_CACHE_BUDGET) {
+        app_wav_stream_close(stream);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    prompt_entry_t *old = find_entry(name);
+    if (old) {
+        free_entry(old);
+    }
+    prompt_entry_t *e = make_room(bytes);
+    int16_t *pcm = e ? heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : NULL;
+    if (!pcm) {
+        app_wav_stream_close(stream);
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t total = 0;
+    const int16_t *block = NULL;
+    size_t n;
+    while ((n = app_wav_stream_read(stream, &block)) > 0 && total + n <= bytes / sizeof(int16_t)) {
+        memcpy(pcm + total, block, n * sizeof(int16_t));
+        total += n;
+    }
+    app_wav_stream_close(stream);
+
+    strlcpy(e->name, name, sizeof(e->name));
+    e->pcm = pcm;
+    e->samples = total;
+    e->last_use = ++s_use_clock;
+    s_bytes_used += total * sizeof(int16_t);
+    ESP_LOGI(TAG, "Cached %s from %s: %u bytes (%u/%u used)", name, path,
+             (unsigned)(total * sizeof(int16_t)), (unsigned)s_bytes_used, (unsigned)PROMPT_CACHE_BUDGET);
+
+    *out_pcm = pcm;
+    *out_samples = total;
+    return ESP_OK;
+}
+
+void app_prompt_cache_clear(void)
+{
+    for (size_t i = 0; i < PROMPT_CACHE_MAX_ENTRIES; i++) {
+        if (s_entries[i].pcm) {
+            free_entry(&s_entries[i]);
+        }
+    }
+}
+
+void app_prompt_cache_get_stats(app_prompt_cache_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    out->hits = s_hits;
+    out->misses = s_misses;
+    out->evictions = s_evictions;
+    out->bytes_used = s_bytes_used;
+    out->bytes_budget = PROMPT_CACHE_BUDGET;
+}
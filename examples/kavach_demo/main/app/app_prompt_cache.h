@@ -0,0 +1,45 @@
+/*
+ * Decoded prompt cache: keeps wake beep and confirmation prompts as ready-to-write 48 kHz PCM
+ * in PSRAM so playback goes straight to bsp_i2s_write(). LRU eviction under a byte budget
+ * (CONFIG_KAVACH_PROMPT_CACHE_KB). Not thread-safe: use from the playback task only.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    size_t bytes_used;
+    size_t bytes_budget;
+} app_prompt_cache_stats_t;
+
+/**
+ * Return cached PCM for a prompt name (e.g. "beep.wav"), or NULL on miss.
+ * The buffer stays valid until the next app_prompt_cache_load() call.
+ */
+const int16_t *app_prompt_cache_get(const char *name, size_t *out_samples);
+
+/**
+ * Decode the WAV at path and store it under name, evicting least recently used prompts as needed.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE (larger than the whole budget), or the open/alloc error
+ */
+esp_err_t app_prompt_cache_load(const char *name, const char *path, const int16_t **out_pcm, size_t *out_samples);
+
+/** Drop all cached prompts (e.g. after prompt files changed). */
+void app_prompt_cache_clear(void);
+
+/** Hit/miss/eviction counters and memory use. */
+void app_prompt_cache_get_stats(app_prompt_cache_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
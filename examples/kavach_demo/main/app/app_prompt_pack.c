@@ -0,0 +1,119 @@
+/*
+ * Prompt pack reader: esp_partition_mmap() of the "prompts" partition plus a linear name lookup
+ * over its (small) index. Layout must match tools/prompt_pack.py.
+ */
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "app_prompt_pack.h"
+
+static const char *TAG = "prompt_pack";
+
+#define PACK_MAGIC          "KVPK"
+#define PACK_VERSION        1
+#define PACK_SAMPLE_RATE    48000
+#define PACK_NAME_MAX       32
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint16_t version;
+    uint16_t count;
+    uint32_t sample_rate;
+    uint32_t data_offset;
+} pack_header_t;
+
+typedef struct __attribute__((packed)) {
+    char name[PACK_NAME_MAX];
+    uint32_t offset;
+    uint32_t samples;
+    uint32_t crc32;
+    uint32_t reserved;
+} pack_entry_t;
+
+static const uint8_t *s_base = NULL;
+static const pack_entry_t *s_entries = NULL;
+static size_t s_count = 0;
+static esp_partition_mmap_handle_t s_mmap_handle;
+
+static esp_err_t validate(const uint8_t *base, size_t size)
+{
+    const pack_header_t *hdr = (const pack_header_t *)base;
+    if (memcmp(hdr->magic, PACK_MAGIC, 4) != 0) {
+        ESP_LOGW(TAG, "Partition holds no prompt pack (flash it with idf.py flash)");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (hdr->version != PACK_VERSION || hdr->sample_rate != PACK_SAMPLE_RATE) {
+        ESP_LOGE(TAG, "Unsupported pack v%u at %lu Hz", hdr->version, (unsigned long)hdr->sample_rate);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (hdr->data_offset != sizeof(pack_header_t) + (size_t)hdr->count * sizeof(pack_entry_t) ||
+        hdr->data_offset > size) {
+        ESP_LOGE(TAG, "Corrupt pack index");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const pack_entry_t *e = (const pack_entry_t *)(base + sizeof(pack_header_t));
+    for (size_t i = 0; i < hdr->count; i++) {
+        size_t bytes = (size_t)e[i].samples * sizeof(int16_t);
+        if (e[i].offset < hdr->data_offset || (e[i].offset & 3u) || e[i].offset + bytes > size ||
+            memchr(e[i].name, '\0', PACK_NAME_MAX) == NULL) {
+            ESP_LOGE(TAG, "Corrupt pack entry %u", (unsigned)i);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (esp_rom_crc32_le(0, base + e[i].offset, bytes) != e[i].crc32) {
+            ESP_LOGE(TAG, "CRC mismatch for %.*s", PACK_NAME_MAX, e[i].name);
+            return ESP_ERR_INVALID_CRC;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t app_prompt_pack_init(void)
+{
+    if (s_base) {
+        return ESP_OK;
+    }
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           APP_PROMPT_PACK_SUBTYPE, "prompts");
+    if (!part) {
+        ESP_LOGW(TAG, "No \"prompts\" partition; prompts play from SPIFFS");
+        return ESP_ERR_NOT_FOUND;
+    }
+    const void *map = NULL;
+    esp_err_t ret = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &map, &s_mmap_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "mmap failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = validate(map, part->size);
+    if (ret != ESP_OK) {
+        esp_partition_munmap(s_mmap_handle);
+        return ret;
+    }
+    s_base = map;
+    s_count = ((const pack_header_t *)map)->count;
+    s_entries = (const pack_entry_t *)(s_base + sizeof(pack_header_t));
+    ESP_LOGI(TAG, "Mapped %u prompts from partition at 0x%lx", (unsigned)s_count, (unsigned long)part->address);
+    return ESP_OK;
+}
+
+const int16_t *app_prompt_pack_get(const char *name, size_t *out_samples)
+{
+    if (!s_base || !name) {
+        return NULL;
+    }
+    for (size_t i = 0; i < s_count; i++) {
+        if (strncmp(s_entries[i].name, name, PACK_NAME_MAX) == 0) {
+            if (out_samples) {
+                *out_samples = s_entries[i].samples;
+            }
+            return (const int16_t *)(s_base + s_entries[i].offset);
+        }
+    }
+    return NULL;
+}
+
+size_t app_prompt_pack_count(void)
+{
+    return s_count;
+}
@@ -0,0 +1,37 @@
+/*
+ * Prompt pack: voice prompts pre-converted at build time (tools/prompt_pack.py) to 48 kHz PCM and
+ * flashed to the "prompts" data partition. The partition is memory-mapped once, so playback writes
+ * straight from flash to I2S with no file system, stdio buffering or heap copy in between.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Data partition subtype of the "prompts" partition (custom range, see partitions.csv). */
+#define APP_PROMPT_PACK_SUBTYPE 0x40
+
+/**
+ * Map the prompts partition and validate its index and CRCs.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND (no partition), ESP_ERR_INVALID_VERSION / ESP_ERR_INVALID_CRC (bad pack)
+ */
+esp_err_t app_prompt_pack_init(void);
+
+/**
+ * Return the mapped PCM of a prompt (e.g. "echo_en_ok.wav"), or NULL if it is not in the pack.
+ * The pointer is into flash and stays valid for the lifetime of the application.
+ */
+const int16_t *app_prompt_pack_get(const char *name, size_t *out_samples);
+
+/** Number of prompts in the mapped pack (0 if not initialised). */
+size_t app_prompt_pack_count(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,204 @@
+/*
+ * Polyphase resampler: a Kaiser-windowed sinc prototype of APP_RESAMPLE_TAPS * L taps is split into
+ * L branches; each output is one 16-tap dot product over a contiguous window of input history, so the
+ * inner loop maps directly onto esp-dsp's dsps_dotprod_s16 (ESP32-S3 SIMD) or a plain C loop.
+ */
+#include <math.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#include "app_resample.h"
+#if CONFIG_KAVACH_RESAMPLE_ESP_DSP
+#include "dsps_dotprod.h"
+#endif
+
+static const char *TAG = "resample";
+
+#define MAX_UP              640         /* 11.025 kHz -> 48 kHz = 640/147 */
+#define KAISER_BETA         6.0
+#define PASSBAND            0.90        /* cutoff as a fraction of the lower Nyquist frequency */
+/* Unity gain is 1 << COEF_UNITY_SHIFT: Q15 with one bit of headroom, so a 16-bit dot product
+ * result (esp-dsp) cannot wrap on filter overshoot; the final doubling saturates instead. */
+#define COEF_UNITY_SHIFT    14
+
+/* Shared table: only one prompt stream decodes at a time */
+static int16_t *s_coefs = NULL;
+static uint32_t s_coefs_cap = 0;    /* phases allocated */
+static uint32_t s_coefs_up = 0;
+static uint32_t s_coefs_down = 0;
+
+static uint32_t gcd_u32(uint32_t a, uint32_t b)
+{
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* Zeroth-order modified Bessel function (series), for the Kaiser window. */
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 20; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-7 * sum) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static esp_err_t build_coefs(uint32_t up, uint32_t down)
+{
+    if (s_coefs && s_coefs_up == up && s_coefs_down == down) {
+        return ESP_OK;
+    }
+    if (s_coefs_cap < up) {
+        heap_caps_free(s_coefs);
+        s_coefs_cap = 0;
+        s_coefs_up = 0;
+        s_coefs = heap_caps_malloc(up * APP_RESAMPLE_TAPS * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_coefs) {
+            s_coefs = heap_caps_malloc(up * APP_RESAMPLE_TAPS * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (!s_coefs) {
+            return ESP_ERR_NO_MEM;
+        }
+        s_coefs_cap = up;
+    }
+
+    /* Prototype runs at up * in_rate; cutoff relative to that rate. Computed in double, as
+     * tools/prompt_pack.py does, so prompts in the pack match the ones resampled here bit for bit. */
+    const size_t n_taps = (size_t)up * APP_RESAMPLE_TAPS;
+    const double cutoff = PASSBAND * 0.5 / (double)((up > down) ? up : down);
+    const double center = (double)(n_taps - 1) * 0.5;
+    const double i0_beta = bessel_i0(KAISER_BETA);
+    double branch[APP_RESAMPLE_TAPS];
+    for (uint32_t p = 0; p < up; p++) {
+        double sum = 0.0;
+        for (int w = 0; w < APP_RESAMPLE_TAPS; w++) {
+            /* Window slot w (oldest first) sees input x[newest - (TAPS - 1 - w)] */
+            size_t k = p + (size_t)(APP_RESAMPLE_TAPS - 1 - w) * up;
+            double t = (double)k - center;
+            double r = t / center;
+            double x = 2.0 * cutoff * t;
+            double sinc = (fabs(x) < 1e-6) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            branch[w] = sinc * bessel_i0(KAISER_BETA * sqrt(fmax(0.0, 1.0 - r * r))) / i0_beta;
+            sum += branch[w];
+        }
+        /* Normalise each branch to unity DC gain so no phase is louder than another */
+        for (int w = 0; w < APP_RESAMPLE_TAPS; w++) {
+            double q = branch[w] / sum * (double)(1 << COEF_UNITY_SHIFT);
+            s_coefs[p * APP_RESAMPLE_TAPS + w] = (int16_t)lrint(q);
+        }
+    }
+    s_coefs_up = up;
+    s_coefs_down = down;
+    ESP_LOGD(TAG, "Built %lu-phase filter for ratio %lu/%lu", (unsigned long)up, (unsigned long)up, (unsigned long)down);
+    return ESP_OK;
+}
+
+esp_err_t app_resample_init(app_resample_t *rs, uint32_t in_rate, uint32_t out_rate, uint8_t channels)
+{
+    if (!rs || in_rate == 0 || out_rate == 0 || channels < 1 || channels > 2) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint32_t g = gcd_u32(in_rate, out_rate);
+    uint32_t up = out_rate / g;
+    uint32_t down = in_rate / g;
+    if (up > MAX_UP || up > APP_RESAMPLE_MAX_RATIO * down || down > up) {
+        return ESP_ERR_NOT_SUPPORTED;  /* downsampling would need a different cutoff per input rate; not used */
+    }
+    memset(rs, 0, sizeof(*rs));
+    rs->up = up;
+    rs->down = down;
+    rs->channels = channels;
+    rs->bypass = (up == down);
+    if (rs->bypass) {
+        return ESP_OK;
+    }
+    esp_err_t ret = build_coefs(up, down);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    rs->coefs = s_coefs;
+    /* Prototype delay is (TAPS * up - 1) / 2 high-rate samples; one output every `down` of them */
+    rs->skip = ((uint32_t)APP_RESAMPLE_TAPS * up - 1) / (2 * down);
+    return ESP_OK;
+}
+
+static inline int16_t dot_branch(const int16_t *window, const int16_t *coefs)
+{
+#if CONFIG_KAVACH_RESAMPLE_ESP_DSP
+    int16_t half;
+    dsps_dotprod_s16(window, coefs, &half, APP_RESAMPLE_TAPS, 0);
+    int32_t acc = (int32_t)half << (15 - COEF_UNITY_SHIFT);
+#else
+    int32_t acc = 0;
+    for (int w = 0; w < APP_RESAMPLE_TAPS; w++) {
+        acc += (int32_t)window[w] * coefs[w];
+    }
+    acc = (acc + (1 << (COEF_UNITY_SHIFT - 1))) >> COEF_UNITY_SHIFT;
+#endif
+    return (int16_t)(acc > INT16_MAX ? INT16_MAX : (acc < INT16_MIN ? INT16_MIN : acc));
+}
+
+/* Push one mono sample and emit the outputs that fall before the next one. */
+static size_t push_sample(app_resample_t *rs, int16_t x, int16_t *out, size_t out_cap)
+{
+    rs->pos = (rs->pos + 1) % APP_RESAMPLE_TAPS;
+    rs->hist[rs->pos] = x;
+    rs->hist[rs->pos + APP_RESAMPLE_TAPS] = x;
+    const int16_t *window = &rs->hist[rs->pos + 1];
+
+    size_t n = 0;
+    while (rs->phase < rs->up) {
+        if (rs->skip) {
+            rs->skip--;
+        } else if (n < out_cap) {
+            out[n++] = dot_branch(window, rs->coefs + rs->phase * APP_RESAMPLE_TAPS);
+        }
+        rs->phase += rs->down;
+    }
+    rs->phase -= rs->up;
+    return n;
+}
+
+size_t app_resample_process(app_resample_t *rs, const int16_t *in, size_t in_frames, int16_t *out, size_t out_cap)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < in_frames && n < out_cap; i++) {
+        int16_t x = (rs->channels == 2) ? (int16_t)(((int32_t)in[2 * i] + in[2 * i + 1]) >> 1) : in[i];
+        if (rs->bypass) {
+            out[n++] = x;
+        } else {
+            n += push_sample(rs, x, out + n, out_cap - n);
+        }
+    }
+    return n;
+}
+
+size_t app_resample_flush(app_resample_t *rs, int16_t *out, size_t out_cap)
+{
+    size_t n = 0;
+    if (rs->bypass) {
+        return 0;
+    }
+    for (int i = 0; i < APP_RESAMPLE_TAPS / 2 && n < out_cap; i++) {
+        n += push_sample(rs, 0, out + n, out_cap - n);
+    }
+    return n;
+}
+
+size_t app_resample_out_frames(const app_resample_t *rs, size_t in_frames)
+{
+    if (rs->bypass) {
+        return in_frames;
+    }
+    return ((in_frames + APP_RESAMPLE_TAPS / 2) * rs->up + rs->down - 1) / rs->down + 1;
+}
@@ -0,0 +1,56 @@
+/*
+ * Polyphase FIR resampler for voice prompts: 16-bit mono or stereo input at 8 ... 48 kHz, mono
+ * output at the codec rate. Exact rational ratio L/M (e.g. 44.1 -> 48 kHz is 160/147), 16 taps per
+ * phase, Q15 coefficients. Stereo is downmixed before filtering.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Filter taps per polyphase branch (input samples per output sample). */
+#define APP_RESAMPLE_TAPS       16
+
+/** Largest out/in ratio supported (8 kHz -> 48 kHz); use it to size output buffers. */
+#define APP_RESAMPLE_MAX_RATIO  6
+
+typedef struct {
+    uint32_t up;            /* L: interpolation factor */
+    uint32_t down;          /* M: decimation factor */
+    uint32_t phase;         /* position of the next output between the last two inputs, in 1/L steps */
+    uint8_t channels;
+    bool bypass;            /* in_rate == out_rate: downmix only */
+    uint32_t skip;          /* outputs still to drop for the filter's group delay */
+    size_t pos;             /* index of the newest sample in hist[] */
+    const int16_t *coefs;   /* up * APP_RESAMPLE_TAPS, one oldest-first branch per phase */
+    int16_t hist[2 * APP_RESAMPLE_TAPS] __attribute__((aligned(16)));  /* mirrored so each window is contiguous */
+} app_resample_t;
+
+/**
+ * Prepare a resampler. The coefficient table is shared and rebuilt only when the ratio changes.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED (rate, ratio or channel count), ESP_ERR_NO_MEM
+ */
+esp_err_t app_resample_init(app_resample_t *rs, uint32_t in_rate, uint32_t out_rate, uint8_t channels);
+
+/**
+ * Resample interleaved input frames. Writes at most out_cap samples; size out_cap with
+ * app_resample_out_frames() so no input is lost. Returns the number of output samples.
+ */
+size_t app_resample_process(app_resample_t *rs, const int16_t *in, size_t in_frames, int16_t *out, size_t out_cap);
+
+/** Drain the filter tail after the last input. Returns the number of output samples. */
+size_t app_resample_flush(app_resample_t *rs, int16_t *out, size_t out_cap);
+
+/** Upper bound of output samples for in_frames more input frames (flush tail included). */
+size_t app_resample_out_frames(const app_resample_t *rs, size_t in_frames);
+
+#ifdef __cplusplus
+}
+#endif
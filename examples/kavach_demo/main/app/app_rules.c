@@ -0,0 +1,759 @@
+/*
+ * Rule tables: the JSON text is compiled into fixed arrays (triggers, rules, conditions, actions) with
+ * every string (topic filter, field key, constant, action argument) copied once into the table's
+ * arena, so firing a rule is one kjson_scan_object() per message plus integer / string compares, with
+ * no allocation. Each distinct "on" filter is one router registration; its handler scans the message
+ * for the keys its rules use, then checks the rules of that trigger in order.
+ *
+ * Two tables: an update is compiled into the spare one and swapped in only if it compiled, so a bad
+ * rule set never leaves the box without its previous rules. Trigger handlers, updates and the swap all
+ * run on the MQTT task (app_rules_start() runs before the client starts), so the tables need no lock.
+ *
+ * Actions are issued from the MQTT task: appliance and help messages go to the outbox (sent at once
+ * when connected), IR and prompts are queued to their tasks.
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "app_rules.h"
+#include "app_assets.h"
+#include "app_ir.h"
+#include "app_mqtt.h"
+#include "app_mqtt_router.h"
+#include "app_sr_handler.h"
+#include "kjson.h"
+
+static const char *TAG = "rules";
+
+#define RULES_MAX               16
+#define RULE_COND_MAX           32      /* conditions, all rules */
+#define RULE_ACTION_MAX         32      /* actions, all rules */
+#define TRIGGER_MAX             8       /* distinct "on" filters */
+#define TRIGGER_KEY_MAX         8       /* distinct fields tested per filter */
+#define ARENA_SIZE              1536
+#define RULE_STR_MAX            128     /* one decoded string */
+#define COOLDOWN_DEFAULT_SEC    10
+#define RULES_SRC_MAX           CONFIG_KAVACH_RULES_MAX_BYTES
+#define STATUS_JSON_MAX         160
+
+#define NVS_NAMESPACE           "rules"
+#define NVS_KEY                 "set"
+#define TOPIC_SET               CONFIG_KAVACH_MQTT_TOPIC_RULES "/set"
+
+typedef enum { OP_EQ = 0, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE } rule_op_t;
+typedef enum { VAL_NUM = 0, VAL_STR, VAL_BOOL } rule_val_t;
+typedef enum { ACT_APPLIANCE = 0, ACT_IR_AC_ON, ACT_IR_AC_OFF, ACT_PROMPT, ACT_HELP } rule_act_t;
+
+typedef struct {
+    uint16_t key;           /* arena offset of the field name (while compiling) */
+    uint8_t field;          /* index into the trigger's keys */
+    uint8_t op;
+    uint8_t type;
+    uint16_t str;           /* VAL_STR: arena offset */
+    int64_t num;            /* VAL_NUM: value * 1000; VAL_BOOL: 0 / 1 */
+} rule_cond_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t asset;          /* ACT_PROMPT */
+    uint16_t arg;           /* arena offsets: device / help text */
+    uint16_t arg2;          /* state */
+} rule_action_t;
+
+typedef struct {
+    uint16_t name;
+    uint8_t trigger;
+    uint8_t cond_first, cond_num;
+    uint8_t act_first, act_num;
+    uint32_t cooldown_us;
+    int64_t last_us;        /* last firing, 0 = never */
+} rule_t;
+
+typedef struct {
+    uint16_t filter;
+    uint8_t key_num;
+    uint16_t keys[TRIGGER_KEY_MAX];
+} rule_trigger_t;
+
+typedef struct {
+    rule_trigger_t triggers[TRIGGER_MAX];
+    rule_t rules[RULES_MAX];
+    rule_cond_t conds[RULE_COND_MAX];
+    rule_action_t acts[RULE_ACTION_MAX];
+    uint8_t trigger_num, rule_num, cond_num, act_num;
+    uint16_t arena_used;
+    uint32_t src_crc;
+    char arena[ARENA_SIZE];
+} rule_table_t;
+
+typedef struct {
+    const char *msg;
+    size_t at;              /* byte offset in the rule text */
+} compile_err_t;
+
+static rule_table_t *s_tables = NULL;   /* [2] */
+static rule_table_t *s_active = NULL;   /* NULL until a rule set compiled */
+static app_rules_sink_t s_status_sink = NULL;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static app_rules_stats_t s_stats;
+
+static void on_trigger(const app_mqtt_msg_t *msg, void *arg);
+
+/* ---- compiling ---- */
+
+static bool fail_at(compile_err_t *err, const char *src, const kjson_token_t *tok, const char *msg)
+{
+    err->msg = (tok->type == KJSON_ERROR) ? "invalid JSON" : msg;
+    err->at = (size_t)(tok->ptr - src);
+    return false;
+}
+
+/* Decimal number as value * 1000 (digits past the third decimal are dropped); no exponents. */
+static bool to_milli(const char *s, size_t len, int64_t *out)
+{
+    const char *end = s + len;
+    bool neg = (s < end && *s == '-');
+    s += neg;
+    int64_t v = 0;
+    int digits = 0;
+    while (s < end && *s >= '0' && *s <= '9') {
+        if (++digits > 15) {
+            return false;
+        }
+        v = v * 10 + (*s++ - '0');
+    }
+    v *= 1000;
+    if (s < end && *s == '.') {
+        int64_t scale = 100;
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++) {
+            v += (*s - '0') * scale;
+            scale /= 10;
+        }
+    }
+    if (s != end || digits == 0) {
+        return false;
+    }
+    *out = neg ? -v : v;
+    return true;
+}
+
+/* Decode a string token into the arena (shared with an identical earlier string). Returns the offset, -1 if full. */
+static int arena_add(rule_table_t *tab, const kjson_token_t *tok)
+{
+    char buf[RULE_STR_MAX];
+    int len = kjson_str_copy(tok, buf, sizeof(buf));
+    if (len < 0) {
+        return -1;
+    }
+    for (size_t off = 0; off < tab->arena_used; off += strlen(tab->arena + off) + 1) {
+        if (strcmp(tab->arena + off, buf) == 0) {
+            return (int)off;
+        }
+    }
+    if (tab->arena_used + len + 1 > ARENA_SIZE) {
+        return -1;
+    }
+    int off = tab->arena_used;
+    memcpy(tab->arena + off, buf, len + 1);
+    tab->arena_used += len + 1;
+    return off;
+}
+
+/* Strings that go into the appliance JSON unescaped */
+static bool plain_str(const char *s)
+{
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\' || (unsigned char)*s < 0x20) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int find_asset(const char *name)
+{
+    size_t len = strlen(name);
+    for (int id = 0; id < APP_ASSET_MAX; id++) {
+        const char *file = app_assets_file_name((app_asset_id_t)id);
+        if (strcasecmp(file, name) == 0 ||
+                (strncasecmp(file, name, len) == 0 && strcasecmp(file + len, ".wav") == 0)) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+/* One condition: ["field", "op", value]; the '[' has been read. */
+static bool parse_cond(rule_table_t *tab, kjson_t *p, const char *src, compile_err_t *err)
+{
+    static const char *const ops[] = { "==", "!=", "<", "<=", ">", ">=" };
+    kjson_token_t tok = { .type = KJSON_ARRAY, .ptr = p->buf + p->pos - 1 };
+    if (tab->cond_num >= RULE_COND_MAX) {
+        return fail_at(err, src, &tok, "too many conditions");
+    }
+    rule_cond_t *c = &tab->conds[tab->cond_num];
+    int key = -1;
+    if (kjson_next(p, &tok) != KJSON_STRING || (key = arena_add(tab, &tok)) < 0) {
+        return fail_at(err, src, &tok, key < 0 && tok.type == KJSON_STRING ? "out of string space" :
+                       "condition: expected a field name");
+    }
+    c->key = (uint16_t)key;
+    if (kjson_next(p, &tok) != KJSON_STRING) {
+        return fail_at(err, src, &tok, "condition: expected an operator");
+    }
+    int op = -1;
+    for (int i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++) {
+        if (kjson_str_eq(&tok, ops[i])) {
+            op = i;
+        }
+    }
+    if (op < 0) {
+        return fail_at(err, src, &tok, "condition: unknown operator");
+    }
+    c->op = (uint8_t)op;
+    switch (kjson_next(p, &tok)) {
+    case KJSON_NUMBER:
+        c->type = VAL_NUM;
+        if (!to_milli(tok.ptr, tok.len, &c->num)) {
+            return fail_at(err, src, &tok, "condition: number out of range");
+        }
+        break;
+    case KJSON_STRING: {
+        int off = arena_add(tab, &tok);
+        if (off < 0) {
+            return fail_at(err, src, &tok, "out of string space");
+        }
+        c->type = VAL_STR;
+        c->str = (uint16_t)off;
+        break;
+    }
+    case KJSON_TRUE:
+    case KJSON_FALSE:
+        c->type = VAL_BOOL;
+        c->num = (tok.type == KJSON_TRUE);
+        break;
+    default:
+        return fail_at(err, src, &tok, "condition: expected a number, string or true/false");
+    }
+    if (c->type != VAL_NUM && c->op != OP_EQ && c->op != OP_NE) {
+        return fail_at(err, src, &tok, "condition: only == and != for strings and true/false");
+    }
+    if (kjson_next(p, &tok) != KJSON_ARRAY_END) {
+        return fail_at(err, src, &tok, "condition: expected [field, op, value]");
+    }
+    tab->cond_num++;
+    return true;
+}
+
+/* One action object; the '{' has been read. */
+static bool parse_action(rule_table_t *tab, kjson_t *p, const char *src, compile_err_t *err)
+{
+    kjson_token_t tok, start;
+    kjson_token_t appliance = { .type = KJSON_END }, state = { .type = KJSON_END };
+    kjson_token_t ir = { .type = KJSON_END }, prompt = { .type = KJSON_END }, help = { .type = KJSON_END };
+    start.ptr = p->buf + p->pos - 1;
+    start.type = KJSON_OBJECT;
+    while (kjson_next(p, &tok) == KJSON_KEY) {
+        kjson_token_t *slot = kjson_str_eq(&tok, "appliance") ? &appliance : kjson_str_eq(&tok, "state") ? &state :
+                              kjson_str_eq(&tok, "ir") ? &ir : kjson_str_eq(&tok, "prompt") ? &prompt :
+                              kjson_str_eq(&tok, "help") ? &help : NULL;
+        if (kjson_next(p, &tok) == KJSON_ERROR || kjson_skip(p, &tok) == KJSON_ERROR) {
+            return fail_at(err, src, &tok, "invalid JSON");
+        }
+        if (slot) {
+            if (tok.type != KJSON_STRING) {
+                return fail_at(err, src, &tok, "action: expected a string");
+            }
+            *slot = tok;
+        }
+    }
+    if (tok.type != KJSON_OBJECT_END) {
+        return fail_at(err, src, &tok, "invalid JSON");
+    }
+    if (tab->act_num >= RULE_ACTION_MAX) {
+        return fail_at(err, src, &start, "too many actions");
+    }
+    rule_action_t *a = &tab->acts[tab->act_num];
+    int arg = -1, arg2 = -1;
+    if (appliance.type == KJSON_STRING) {
+        if (state.type != KJSON_STRING) {
+            return fail_at(err, src, &start, "action: appliance needs a state");
+        }
+        arg = arena_add(tab, &appliance);
+        arg2 = arena_add(tab, &state);
+        if (arg < 0 || arg2 < 0) {
+            return fail_at(err, src, &start, "out of string space");
+        }
+        if (!plain_str(tab->arena + arg) || !plain_str(tab->arena + arg2)) {
+            return fail_at(err, src, &start, "action: quotes or control characters in appliance / state");
+        }
+        a->type = ACT_APPLIANCE;
+    } else if (ir.type == KJSON_STRING) {
+        if (kjson_str_caseeq(&ir, "ac_on")) {
+            a->type = ACT_IR_AC_ON;
+        } else if (kjson_str_caseeq(&ir, "ac_off")) {
+            a->type = ACT_IR_AC_OFF;
+        } else {
+            return fail_at(err, src, &ir, "action: ir must be ac_on or ac_off");
+        }
+    } else if (prompt.type == KJSON_STRING) {
+        char name[RULE_STR_MAX];
+        int id = (kjson_str_copy(&prompt, name, sizeof(name)) < 0) ? -1 : find_asset(name);
+        if (id < 0) {
+            return fail_at(err, src, &prompt, "action: unknown prompt");
+        }
+        a->type = ACT_PROMPT;
+        a->asset = (uint8_t)id;
+    } else if (help.type == KJSON_STRING) {
+        if ((arg = arena_add(tab, &help)) < 0) {
+            return fail_at(err, src, &help, "out of string space");
+        }
+        a->type = ACT_HELP;
+    } else {
+        return fail_at(err, src, &start, "action: expected appliance, ir, prompt or help");
+    }
+    a->arg = (uint16_t)(arg < 0 ? 0 : arg);
+    a->arg2 = (uint16_t)(arg2 < 0 ? 0 : arg2);
+    tab->act_num++;
+    return true;
+}
+
+static int trigger_for(rule_table_t *tab, uint16_t filter)
+{
+    for (int t = 0; t < tab->trigger_num; t++) {
+        if (tab->triggers[t].filter == filter) {    /* arena strings are unique */
+            return t;
+        }
+    }
+    if (tab->trigger_num >= TRIGGER_MAX) {
+        return -1;
+    }
+    tab->triggers[tab->trigger_num].filter = filter;
+    tab->triggers[tab->trigger_num].key_num = 0;
+    return tab->trigger_num++;
+}
+
+/* Map the rule's condition fields to the trigger's key list. */
+static bool bind_keys(rule_table_t *tab, rule_t *r)
+{
+    rule_trigger_t *trig = &tab->triggers[r->trigger];
+    for (int i = r->cond_first; i < r->cond_first + r->cond_num; i++) {
+        rule_cond_t *c = &tab->conds[i];
+        int k = 0;
+        while (k < trig->key_num && trig->keys[k] != c->key) {
+            k++;
+        }
+        if (k == trig->key_num) {
+            if (trig->key_num >= TRIGGER_KEY_MAX) {
+                return false;
+            }
+            trig->keys[trig->key_num++] = c->key;
+        }
+        c->field = (uint8_t)k;
+    }
+    return true;
+}
+
+/* One rule object; the '{' has been read. */
+static bool parse_rule(rule_table_t *tab, kjson_t *p, const char *src, compile_err_t *err)
+{
+    kjson_token_t tok, start;
+    start.ptr = p->buf + p->pos - 1;
+    start.type = KJSON_OBJECT;
+    if (tab->rule_num >= RULES_MAX) {
+        return fail_at(err, src, &start, "too many rules");
+    }
+    rule_t *r = &tab->rules[tab->rule_num];
+    *r = (rule_t) {
+        .cond_first = tab->cond_num, .act_first = tab->act_num,
+        .cooldown_us = COOLDOWN_DEFAULT_SEC * 1000000u,
+    };
+    int filter = -1;
+    int name = -1;
+    while (kjson_next(p, &tok) == KJSON_KEY) {
+        kjson_token_t key = tok;
+        if (kjson_next(p, &tok) == KJSON_ERROR) {
+            return fail_at(err, src, &tok, "invalid JSON");
+        }
+        if (kjson_str_eq(&key, "on") || kjson_str_eq(&key, "name")) {
+            int off = (tok.type == KJSON_STRING && tok.len > 0) ? arena_add(tab, &tok) : -1;
+            if (off < 0) {
+                return fail_at(err, src, &tok, tok.type == KJSON_STRING ? "out of string space" : "expected a string");
+            }
+            *(kjson_str_eq(&key, "on") ? &filter : &name) = off;
+        } else if (kjson_str_eq(&key, "if")) {
+            if (tok.type != KJSON_ARRAY) {
+                return fail_at(err, src, &tok, "if: expected a list of conditions");
+            }
+            while (kjson_next(p, &tok) == KJSON_ARRAY) {
+                if (!parse_cond(tab, p, src, err)) {
+                    return false;
+                }
+            }
+            if (tok.type != KJSON_ARRAY_END) {
+                return fail_at(err, src, &tok, "if: expected [field, op, value]");
+            }
+        } else if (kjson_str_eq(&key, "do")) {
+            if (tok.type != KJSON_ARRAY) {
+                return fail_at(err, src, &tok, "do: expected a list of actions");
+            }
+            while (kjson_next(p, &tok) == KJSON_OBJECT) {
+                if (!parse_action(tab, p, src, err)) {
+                    return false;
+                }
+            }
+            if (tok.type != KJSON_ARRAY_END) {
+                return fail_at(err, src, &tok, "do: expected an action object");
+            }
+        } else if (kjson_str_eq(&key, "cooldown")) {
+            int32_t sec = -1;
+            if (!kjson_get_int(&tok, &sec) || sec < 0 || sec > 86400) {
+                return fail_at(err, src, &tok, "cooldown: expected seconds (0-86400)");
+            }
+            r->cooldown_us = (uint32_t)sec * 1000000u;
+        } else if (kjson_skip(p, &tok) == KJSON_ERROR) {
+            return fail_at(err, src, &tok, "invalid JSON");
+        }
+    }
+    if (tok.type != KJSON_OBJECT_END) {
+        return fail_at(err, src, &tok, "invalid JSON");
+    }
+    r->cond_num = tab->cond_num - r->cond_first;
+    r->act_num = tab->act_num - r->act_first;
+    if (filter < 0) {
+        return fail_at(err, src, &start, "rule without \"on\"");
+    }
+    if (r->act_num == 0) {
+        return fail_at(err, src, &start, "rule without actions");
+    }
+    int t = trigger_for(tab, (uint16_t)filter);
+    if (t < 0) {
+        return fail_at(err, src, &start, "too many different topics");
+    }
+    r->trigger = (uint8_t)t;
+    r->name = (uint16_t)(name < 0 ? filter : name);
+    if (!bind_keys(tab, r)) {
+        return fail_at(err, src, &start, "too many different fields on one topic");
+    }
+    tab->rule_num++;
+    return true;
+}
+
+/* Compile {"rules":[...]} into tab. An empty text gives an empty table. */
+static bool compile(rule_table_t *tab, const char *src, size_t len, compile_err_t *err)
+{
+    memset(tab, 0, offsetof(rule_table_t, arena));
+    tab->src_crc = esp_rom_crc32_le(0, (const uint8_t *)src, len);
+    if (len == 0) {
+        return true;
+    }
+    kjson_t p;
+    kjson_token_t tok;
+    kjson_init(&p, src, len);
+    if (kjson_next(&p, &tok) != KJSON_OBJECT) {
+        return fail_at(err, src, &tok, "expected {\"rules\":[...]}");
+    }
+    while (kjson_next(&p, &tok) == KJSON_KEY) {
+        bool rules = kjson_str_eq(&tok, "rules");
+        if (kjson_next(&p, &tok) == KJSON_ERROR) {
+            break;
+        }
+        if (!rules) {
+            if (kjson_skip(&p, &tok) == KJSON_ERROR) {
+                break;
+            }
+            continue;
+        }
+        if (tok.type != KJSON_ARRAY) {
+            return fail_at(err, src, &tok, "rules: expected a list");
+        }
+        while (kjson_next(&p, &tok) == KJSON_OBJECT) {
+            if (!parse_rule(tab, &p, src, err)) {
+                return false;
+            }
+        }
+        if (tok.type != KJSON_ARRAY_END) {
+            return fail_at(err, src, &tok, "rules: expected a rule object");
+        }
+    }
+    if (tok.type != KJSON_OBJECT_END || kjson_next(&p, &tok) != KJSON_END) {
+        return fail_at(err, src, &tok, "invalid JSON");
+    }
+    return true;
+}
+
+/* ---- running ---- */
+
+static bool cond_holds(const rule_table_t *tab, const rule_cond_t *c, const kjson_token_t *val)
+{
+    bool eq;
+    switch (c->type) {
+    case VAL_STR:
+        if (val->type != KJSON_STRING) {
+            return false;
+        }
+        eq = kjson_str_caseeq(val, tab->arena + c->str);
+        return c->op == OP_EQ ? eq : !eq;
+    case VAL_BOOL: {
+        bool b;
+        if (!kjson_get_bool(val, &b)) {
+            return false;
+        }
+        eq = (b == (c->num != 0));
+        return c->op == OP_EQ ? eq : !eq;
+    }
+    default: {
+        int64_t n;
+        if (val->type != KJSON_NUMBER || !to_milli(val->ptr, val->len, &n)) {
+            return false;
+        }
+        switch (c->op) {
+        case OP_EQ: return n == c->num;
+        case OP_NE: return n != c->num;
+        case OP_LT: return n < c->num;
+        case OP_LE: return n <= c->num;
+        case OP_GT: return n > c->num;
+        default:    return n >= c->num;
+        }
+    }
+    }
+}
+
+/* Actions do not stamp the voice trace: a rule firing while a command's span is open must not end it */
+static void run_action(const rule_table_t *tab, const rule_action_t *a)
+{
+    switch (a->type) {
+    case ACT_APPLIANCE:
+        app_mqtt_publish_appliance_json_ex(tab->arena + a->arg, tab->arena + a->arg2, false);
+        break;
+    case ACT_IR_AC_ON:
+        app_ir_send_ac_ex(true, false);
+        break;
+    case ACT_IR_AC_OFF:
+        app_ir_send_ac_ex(false, false);
+        break;
+    case ACT_PROMPT:
+        sr_handler_play_asset((app_asset_id_t)a->asset);
+        break;
+    case ACT_HELP:
+        app_mqtt_publish_help_ex(tab->arena + a->arg, false);
+        break;
+    }
+}
+
+static void on_trigger(const app_mqtt_msg_t *msg, void *arg)
+{
+    int64_t t0 = esp_timer_get_time();
+    rule_table_t *tab = s_active;
+    size_t t = (size_t)(uintptr_t)arg;
+    if (!tab || t >= tab->trigger_num) {
+        return;
+    }
+    const rule_trigger_t *trig = &tab->triggers[t];
+    kjson_field_t fields[TRIGGER_KEY_MAX];
+    for (int k = 0; k < trig->key_num; k++) {
+        fields[k].key = tab->arena + trig->keys[k];
+    }
+    if (kjson_scan_object(msg->data, msg->data_len, fields, trig->key_num) < 0) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.messages++;
+        s_stats.malformed++;
+        portEXIT_CRITICAL(&s_stats_lock);
+        return;
+    }
+    uint32_t fired = 0, suppressed = 0;
+    for (int i = 0; i < tab->rule_num; i++) {
+        rule_t *r = &tab->rules[i];
+        if (r->trigger != t) {
+            continue;
+        }
+        bool match = true;
+        for (int c = r->cond_first; c < r->cond_first + r->cond_num && match; c++) {
+            match = cond_holds(tab, &tab->conds[c], &fields[tab->conds[c].field].val);
+        }
+        if (!match) {
+            continue;
+        }
+        if (r->last_us != 0 && t0 - r->last_us < (int64_t)r->cooldown_us) {
+            suppressed++;
+            continue;
+        }
+        r->last_us = t0;
+        for (int a = r->act_first; a < r->act_first + r->act_num; a++) {
+            run_action(tab, &tab->acts[a]);
+        }
+        fired++;
+        ESP_LOGI(TAG, "Rule %s fired", tab->arena + r->name);
+    }
+    uint32_t react = (uint32_t)(esp_timer_get_time() - t0);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.messages++;
+    s_stats.fired += fired;
+    s_stats.suppressed += suppressed;
+    if (fired) {
+        s_stats.last_react_us = react;
+        if (react > s_stats.max_react_us) {
+            s_stats.max_react_us = react;
+        }
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/* ---- loading and updates ---- */
+
+static void register_triggers(const rule_table_t *tab, bool on)
+{
+    for (int t = 0; t < tab->trigger_num; t++) {
+        const char *filter = tab->arena + tab->triggers[t].filter;
+        void *arg = (void *)(uintptr_t)t;
+        if (!on) {
+            app_mqtt_router_unregister(filter, on_trigger, arg);
+        } else if (app_mqtt_router_register(filter, 1, on_trigger, arg) != ESP_OK) {
+            ESP_LOGW(TAG, "Could not subscribe rule topic %s", filter);
+        }
+    }
+}
+
+/* Make tab the active rule set. */
+static void activate(rule_table_t *tab)
+{
+    if (s_active) {
+        register_triggers(s_active, false);
+    }
+    s_active = tab;
+    register_triggers(tab, true);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.rules = tab->rule_num;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static esp_err_t save(const char *src, size_t len)
+{
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = (len > 0) ? nvs_set_blob(h, NVS_KEY, src, len) : nvs_erase_key(h, NVS_KEY);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        ret = ESP_OK;   /* nothing stored to erase */
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(h);
+    }
+    nvs_close(h);
+    return ret;
+}
+
+static void status(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void status(const char *fmt, ...)
+{
+    char json[STATUS_JSON_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(json, sizeof(json), fmt, ap);
+    va_end(ap);
+    if (s_status_sink && n > 0 && (size_t)n < sizeof(json)) {
+        s_status_sink(json);
+    }
+}
+
+/* New rule set: compile into the spare table, store it, swap it in. */
+static void on_rules_set(const app_mqtt_msg_t *msg, void *arg)
+{
+    (void)arg;
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)msg->data, msg->data_len);
+    if (s_active && s_active->src_crc == crc) {
+        status("{\"ok\":true,\"rules\":%u,\"unchanged\":true}", s_active->rule_num);   /* e.g. retained set after reconnect */
+        return;
+    }
+    rule_table_t *tab = (s_active == &s_tables[0]) ? &s_tables[1] : &s_tables[0];
+    compile_err_t err = { 0 };
+    if (!compile(tab, msg->data, msg->data_len, &err)) {
+        ESP_LOGW(TAG, "Rule set rejected: %s at byte %u", err.msg, (unsigned)err.at);
+        status("{\"ok\":false,\"error\":\"%s\",\"at\":%u}", err.msg, (unsigned)err.at);
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.rejected++;
+        portEXIT_CRITICAL(&s_stats_lock);
+        return;
+    }
+    esp_err_t ret = save(msg->data, msg->data_len);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Rule set not saved (%s), active until reboot", esp_err_to_name(ret));
+    }
+    activate(tab);
+    ESP_LOGI(TAG, "Rule set updated: %u rules on %u topics", tab->rule_num, tab->trigger_num);
+    status("{\"ok\":true,\"rules\":%u,\"topics\":%u,\"saved\":%s}", tab->rule_num, tab->trigger_num,
+           ret == ESP_OK ? "true" : "false");
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.updates++;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/* Rule text stored in NVS, in a heap buffer (caller frees); NULL if none. */
+static char *load(size_t *len)
+{
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) {
+        return NULL;
+    }
+    char *src = NULL;
+    if (nvs_get_blob(h, NVS_KEY, NULL, len) == ESP_OK && *len > 0 && *len <= RULES_SRC_MAX) {
+        src = malloc(*len);
+        if (src && nvs_get_blob(h, NVS_KEY, src, len) != ESP_OK) {
+            free(src);
+            src = NULL;
+        }
+    }
+    nvs_close(h);
+    return src;
+}
+
+esp_err_t app_rules_start(app_rules_sink_t status_sink)
+{
+    if (s_tables) {
+        return ESP_OK;
+    }
+    s_tables = heap_caps_calloc(2, sizeof(rule_table_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_tables) {
+        s_tables = heap_caps_calloc(2, sizeof(rule_table_t), MALLOC_CAP_DEFAULT);
+    }
+    if (!s_tables) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_status_sink = status_sink;
+
+    size_t len = 0;
+    char *src = load(&len);
+    if (src) {
+        int64_t t0 = esp_timer_get_time();
+        compile_err_t err = { 0 };
+        if (compile(&s_tables[0], src, len, &err)) {
+            activate(&s_tables[0]);
+            ESP_LOGI(TAG, "%u rules on %u topics loaded (%u bytes, compiled in %lu us)", s_tables[0].rule_num,
+                     s_tables[0].trigger_num, (unsigned)len, (unsigned long)(esp_timer_get_time() - t0));
+        } else {
+            ESP_LOGE(TAG, "Stored rule set does not compile: %s at byte %u", err.msg, (unsigned)err.at);
+        }
+        free(src);
+    }
+
+    const app_mqtt_route_opts_t opts = { .max_len = RULES_SRC_MAX };
+    return app_mqtt_router_register_ex(TOPIC_SET, 1, &opts, on_rules_set, NULL);
+}
+
+void app_rules_get_stats(app_rules_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
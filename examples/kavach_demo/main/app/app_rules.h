@@ -0,0 +1,59 @@
+/*
+ * Local rule engine: reactions that must not wait for the phone (cut the gas valve on a leak, switch
+ * on the lights on motion) run on the box as soon as the node's message arrives.
+ *
+ * A rule set is JSON, kept in NVS and replaced by publishing it to CONFIG_KAVACH_MQTT_TOPIC_RULES/set
+ * (an empty payload removes all rules); the result is published to <topic>/status.
+ *
+ *   {"rules":[
+ *     {"name":"gas_valve", "on":"fabacademy/kavach/gas",
+ *      "if":[["state","==","LEAK"], ["gas",">=",400]],
+ *      "do":[{"appliance":"gas_valve","state":"OFF"}, {"help":"Gas leak, valve closed"}],
+ *      "cooldown":30}
+ *   ]}
+ *
+ * "on" is a topic filter ('+' and '#' allowed). "if" conditions (all must hold) compare a top-level
+ * field of the message with a number (== != < <= > >=, decimals to 0.001), a string (== != ignoring
+ * case) or true/false (== !=); a missing field fails the condition. "do" actions: {"appliance":
+ * <device>,"state":<state>} (app_mqtt_publish_appliance_json), {"ir":"ac_on"|"ac_off"}, {"prompt":
+ * <file name, e.g. "echo_en_alerted.wav">}, {"help":<text>} (app_mqtt_publish_help). A rule fires at
+ * most once per "cooldown" seconds (default 10).
+ *
+ * The text is compiled once into a table (topic filters, field keys, constants, resolved actions);
+ * rules on the same topic share one parse of the message.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Publish a status reply (JSON text). */
+typedef esp_err_t (*app_rules_sink_t)(const char *json);
+
+typedef struct {
+    uint32_t rules;             /* rules in the active set */
+    uint32_t messages;          /* trigger messages evaluated */
+    uint32_t fired;             /* rules whose actions ran */
+    uint32_t suppressed;        /* matches skipped by the cooldown */
+    uint32_t malformed;         /* trigger messages that were not a JSON object */
+    uint32_t updates;           /* rule sets accepted over MQTT */
+    uint32_t rejected;          /* rule sets that did not compile */
+    uint32_t last_react_us;     /* message received to last action issued, last firing */
+    uint32_t max_react_us;
+} app_rules_stats_t;
+
+/**
+ * Load and compile the rule set stored in NVS and register its topics and the update topic with the
+ * router. Call from app_mqtt_start(), before the client starts. status_sink publishes update results.
+ */
+esp_err_t app_rules_start(app_rules_sink_t status_sink);
+
+void app_rules_get_stats(app_rules_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -14,6 +14,8 @@
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
 #include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "esp_check.h"
 #include "esp_err.h"
 #include "esp_log.h"
@@ -29,6 +31,9 @@
 #include "esp_afe_sr_iface.h"
 #include "esp_mn_iface.h"
 #include "app_sr_handler.h"
+#include "app_aec_ref.h"
+#include "app_trace.h"
+#include "sr_cmd_table.h"
 #include "model_path.h"
 #include "bsp_board.h"
 #include "settings.h"
@@ -37,17 +42,28 @@
 
 static const char *TAG = "app_sr";
 
+/* One multinet instance and its commands; both languages may be resident at once */
 typedef struct {
     sr_language_t lang;
     char *mn_name;
-    model_iface_data_t *model_data;
+    model_iface_data_t *model_data;     /* NULL when not loaded */
     const esp_mn_iface_t *multinet;
+    const sr_cmd_table_t *table;        /* built-in commands (flash) */
+    const sr_cmd_t **by_id;             /* id -> command in table or overlay, NULL for a removed id */
+    sr_cmd_t *overlay;                  /* added/modified commands; free slots have lang == SR_LANG_MAX */
+    uint16_t id_cap;                    /* table->num + SR_CMD_OVERLAY_MAX */
+    uint16_t cmd_num;                   /* ids in use are below this */
+} sr_lang_ctx_t;
+
+typedef struct {
+    sr_language_t lang;
+    sr_lang_ctx_t lang_ctx[SR_LANG_MAX];
+    sr_lang_ctx_t *volatile mn;         /* active language; the detect task samples it once per chunk */
+    char *wn_name;
     const esp_afe_sr_iface_t *afe_handle;
     esp_afe_sr_data_t *afe_data;
     int16_t *afe_in_buffer;
     int16_t *afe_out_buffer;
-    SLIST_HEAD(sr_cmd_list_t, sr_cmd_t) cmd_list;
-    uint8_t cmd_num;
     TaskHandle_t feed_task;
     TaskHandle_t detect_task;
     TaskHandle_t handle_task;
@@ -67,88 +83,78 @@ static sr_data_t *g_sr_data = NULL;
 #define NEED_DELETE BIT0
 #define FEED_DELETED BIT1
 #define DETECT_DELETED BIT2
+#define FEED_OPEN BIT3      /* no feed gate set; feed task waits on this bit while gated */
+#define DETECT_PARKED BIT4  /* detect task saw no active model and will not touch one until set */
+#define SR_CMD_OVERLAY_MAX  CONFIG_KAVACH_SR_CMD_OVERLAY_MAX
+
+/* Feed gates live outside g_sr_data so they can be set before app_sr_start() */
+static portMUX_TYPE s_gate_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t s_gate_mask = 0;
+static int64_t s_gated_since_us = 0;
+static int64_t s_opened_at_us = 0;
+static sr_feed_stats_t s_feed_stats;
+
+/* Mirror the gate mask into FEED_OPEN. Re-checks after applying so concurrent callers converge. */
+static void feed_gate_apply(void)
+{
+    EventGroupHandle_t eg = g_sr_data ? g_sr_data->event_group : NULL;
+    if (!eg) {
+        return;
+    }
+    for (;;) {
+        bool open = (s_gate_mask == 0);
+        if (open) {
+            xEventGroupSetBits(eg, FEED_OPEN);
+        } else {
+            xEventGroupClearBits(eg, FEED_OPEN);
+        }
+        if ((s_gate_mask == 0) == open) {
+            break;
+        }
+    }
+}
 
-/**
- * @brief all default commands
- */
-static const sr_cmd_t g_default_cmd_info[] = {
-    // English
-    {SR_CMD_LIGHT_ON, SR_LANG_EN, 0, "Turn On the Light", "TkN nN jc LiT", {NULL}},
-    {SR_CMD_LIGHT_ON, SR_LANG_EN, 0, "Switch On the Light", "SWgp nN jc LiT", {NULL}},
-    {SR_CMD_LIGHT_ON, SR_LANG_EN, 0, "Light on", "LiT nN", {NULL}},
-    {SR_CMD_LIGHT_ON, SR_LANG_EN, 0, "Light", "LiT", {NULL}},
-    {SR_CMD_LIGHT_OFF, SR_LANG_EN, 0, "Switch Off the Light", "SWgp eF jc LiT", {NULL}},
-    {SR_CMD_LIGHT_OFF, SR_LANG_EN, 0, "Turn Off the Light", "TkN eF jc LiT", {NULL}},
-    {SR_CMD_LIGHT_OFF, SR_LANG_EN, 0, "Light off", "LiT eF", {NULL}},
-    {SR_CMD_SET_RED, SR_LANG_EN, 0, "Turn Red", "TkN RfD", {NULL}},
-    {SR_CMD_SET_GREEN, SR_LANG_EN, 0, "Turn Green", "TkN GRmN", {NULL}},
-    {SR_CMD_SET_BLUE, SR_LANG_EN, 0, "Turn Blue", "TkN BLo", {NULL}},
-    {SR_CMD_CUSTOMIZE_COLOR, SR_LANG_EN, 0, "Customize Color", "KcSTcMiZ KcLk", {NULL}},
-    {SR_CMD_PLAY, SR_LANG_EN, 0, "Sing a song", "Sgl c Sel", {NULL}},
-    {SR_CMD_PLAY, SR_LANG_EN, 0, "Play Music", "PLd MYoZgK", {NULL}},
-    {SR_CMD_NEXT, SR_LANG_EN, 0, "Next Song", "NfKST Sel", {NULL}},
-    {SR_CMD_PAUSE, SR_LANG_EN, 0, "Pause Playing", "PeZ PLdgl", {NULL}},
-
-    {SR_CMD_AC_ON, SR_LANG_EN, 0, "Turn on the Air", "TkN nN jc fR", {NULL}},
-    {SR_CMD_AC_OFF, SR_LANG_EN, 0, "Turn off the Air", "TkN eF jc fR", {NULL}},
-    {SR_CMD_AC_ON, SR_LANG_EN, 0, "AC on", "AC nN", {NULL}},
-    {SR_CMD_AC_OFF, SR_LANG_EN, 0, "AC off", "AC eF", {NULL}},
-    {SR_CMD_AC_ON, SR_LANG_EN, 0, "AC", "AC", {NULL}},
-
-    {SR_CMD_FAN_ON, SR_LANG_EN, 0, "Fan on", "fAN nN", {NULL}},
-    {SR_CMD_FAN_OFF, SR_LANG_EN, 0, "Fan off", "fAN eF", {NULL}},
-    {SR_CMD_FAN_ON, SR_LANG_EN, 0, "Fan", "fAN", {NULL}},
-
-    /* Kavach: help, alert, call (English) */
-    {SR_CMD_HELP_ALERT, SR_LANG_EN, 0, "I need help", "aI nEd hfLp", {NULL}},
-    {SR_CMD_HELP_ALERT, SR_LANG_EN, 0, "Send alert", "SfND aLfRT", {NULL}},
-    {SR_CMD_HELP_ALERT, SR_LANG_EN, 0, "Emergency", "cMfRjNcE", {NULL}},
-    {SR_CMD_CALL_FAMILY, SR_LANG_EN, 0, "Call family", "KeL fAMlE", {NULL}},
-    {SR_CMD_CALL_FAMILY, SR_LANG_EN, 0, "Call my son", "KeL maI sUN", {NULL}},
-    {SR_CMD_CALL_FAMILY, SR_LANG_EN, 0, "Call home", "KeL hOm", {NULL}},
-    {SR_CMD_CALL_FAMILY, SR_LANG_EN, 0, "Call", "KeL", {NULL}},
-    {SR_CMD_HELP, SR_LANG_EN, 0, "Help", "hfLp", {NULL}},
-    {SR_CMD_HELP, SR_LANG_EN, 0, "What can you do", "WcT kAN yU dU", {NULL}},
-
-    // Chinese
-    {SR_CMD_LIGHT_ON, SR_LANG_CN, 0, "打开电灯", "da kai dian deng", {NULL}},
-    {SR_CMD_LIGHT_OFF, SR_LANG_CN, 0, "关闭电灯", "guan bi dian deng", {NULL}},
-    {SR_CMD_SET_RED, SR_LANG_CN, 0, "调成红色", "tiao cheng hong se", {NULL}},
-    {SR_CMD_SET_GREEN, SR_LANG_CN, 0, "调成绿色", "tiao cheng lv se", {NULL}},
-    {SR_CMD_SET_BLUE, SR_LANG_CN, 0, "调成蓝色", "tiao cheng lan se", {NULL}},
-    {SR_CMD_CUSTOMIZE_COLOR, SR_LANG_CN, 0, "自定义颜色", "zi ding yi yan se", {NULL}},
-    {SR_CMD_PLAY, SR_LANG_CN, 0, "播放音乐", "bo fang yin yue", {NULL}},
-    {SR_CMD_NEXT, SR_LANG_CN, 0, "切歌", "qie ge", {NULL}},
-    {SR_CMD_NEXT, SR_LANG_CN, 0, "下一曲", "xia yi qu", {NULL}},
-    {SR_CMD_PAUSE, SR_LANG_CN, 0, "暂停", "zan ting", {NULL}},
-    {SR_CMD_PAUSE, SR_LANG_CN, 0, "暂停播放", "zan ting bo fang", {NULL}},
-    {SR_CMD_PAUSE, SR_LANG_CN, 0, "停止播放", "ting zhi bo fang", {NULL}},
-
-    {SR_CMD_AC_ON, SR_LANG_CN, 0, "打开空调", "da kai kong tiao", {NULL}},
-    {SR_CMD_AC_OFF, SR_LANG_CN, 0, "关闭空调", "guan bi kong tiao", {NULL}},
-    {SR_CMD_FAN_ON, SR_LANG_CN, 0, "打开风扇", "da kai feng shan", {NULL}},
-    {SR_CMD_FAN_OFF, SR_LANG_CN, 0, "关闭风扇", "guan bi feng shan", {NULL}},
-    {SR_CMD_FAN_ON, SR_LANG_CN, 0, "风扇", "feng shan", {NULL}},
-
-    /* Kavach: help, alert, call (Chinese) */
-    {SR_CMD_HELP_ALERT, SR_LANG_CN, 0, "我需要帮助", "wo xu yao bang zhu", {NULL}},
-    {SR_CMD_HELP_ALERT, SR_LANG_CN, 0, "发送警报", "fa song jing bao", {NULL}},
-    {SR_CMD_HELP_ALERT, SR_LANG_CN, 0, "紧急情况", "jin ji qing kuang", {NULL}},
-    {SR_CMD_CALL_FAMILY, SR_LANG_CN, 0, "打电话给家人", "da dian hua gei jia ren", {NULL}},
-    {SR_CMD_CALL_FAMILY, SR_LANG_CN, 0, "打电话给儿子", "da dian hua gei er zi", {NULL}},
-    {SR_CMD_CALL_FAMILY, SR_LANG_CN, 0, "打电话回家", "da dian hua hui jia", {NULL}},
-    {SR_CMD_HELP, SR_LANG_CN, 0, "帮助", "bang zhu", {NULL}},
-    {SR_CMD_HELP, SR_LANG_CN, 0, "你能做什么", "ni neng zuo shen me", {NULL}},
-
-    {SR_CMD_MAX, SR_LANG_CN, 0, "舒适模式", "shu shi mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "制冷模式", "zhi leng mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "制热模式", "zhi re mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "加热模式", "jia re mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "除湿模式", "chu shi mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "送风模式", "song feng mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "升高温度", "sheng gao wen du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "降低温度", "jiang di wen du", {NULL}},
-};
+void app_sr_feed_gate_set(sr_feed_gate_t gate, bool gated)
+{
+    int64_t now = esp_timer_get_time();
+    bool changed = false;
+    portENTER_CRITICAL(&s_gate_lock);
+    uint32_t old = s_gate_mask;
+    s_gate_mask = gated ? (old | gate) : (old & ~(uint32_t)gate);
+    if (old == 0 && s_gate_mask != 0) {
+        s_gated_since_us = now;
+        s_feed_stats.gated_count++;
+        changed = true;
+    } else if (old != 0 && s_gate_mask == 0) {
+        s_feed_stats.gated_audio_ms += (uint32_t)((now - s_gated_since_us) / 1000);
+        s_opened_at_us = now;
+        changed = true;
+    }
+    s_feed_stats.gate_mask = s_gate_mask;
+    portEXIT_CRITICAL(&s_gate_lock);
+
+    if (changed) {
+        ESP_LOGI(TAG, "Audio feed %s (gates 0x%lx)", s_gate_mask ? "gated" : "resumed", (unsigned long)s_gate_mask);
+        feed_gate_apply();
+    }
+}
+
+void app_sr_get_feed_stats(sr_feed_stats_t *stats)
+{
+    if (!stats) {
+        return;
+    }
+    portENTER_CRITICAL(&s_gate_lock);
+    *stats = s_feed_stats;
+    portEXIT_CRITICAL(&s_gate_lock);
+}
+
+/* BSP sensor monitor task: gate before the codec stops for sleep, open after it resumes */
+static void sleep_changed_cb(bool sleeping, void *arg)
+{
+    (void)arg;
+    app_sr_feed_gate_set(SR_FEED_GATE_SLEEP, sleeping);
+}
 
 static void audio_feed_task(void *arg)
 {
@@ -164,25 +170,24 @@ static void audio_feed_task(void *arg)
         esp_system_abort("No mem for audio buffer");
     }
     g_sr_data->afe_in_buffer = audio_buffer;
+    int16_t *ref_buffer = heap_caps_malloc(audio_chunksize * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (NULL == ref_buffer) {
+        esp_system_abort("No mem for reference buffer");
+    }
 
+    bool resumed = false;
     while (true) {
-        if (NEED_DELETE && xEventGroupGetBits(g_sr_data->event_group)) {
+        EventBits_t bits = xEventGroupGetBits(g_sr_data->event_group);
+        if (bits & NEED_DELETE) {
+            heap_caps_free(ref_buffer);
             xEventGroupSetBits(g_sr_data->event_group, FEED_DELETED);
             vTaskDelete(NULL);
         }
 
-        if (true == bsp_board_get_sensor_handle()->get_sleep_mode()) {
-            vTaskDelay(pdMS_TO_TICKS(500));
-            continue;
-        }
-
-        if (false == get_mute_play_flag()) {
-            vTaskDelay(pdMS_TO_TICKS(500));
-            continue;
-        }
-
-        if (true == sensor_ir_learn_enable()) {
-            vTaskDelay(pdMS_TO_TICKS(100));
+        /* Gated (sleep, mute, IR learn): block until a gate change or stop, no polling */
+        if (!(bits & FEED_OPEN)) {
+            xEventGroupWaitBits(g_sr_data->event_group, FEED_OPEN | NEED_DELETE, pdFALSE, pdFALSE, portMAX_DELAY);
+            resumed = true;
             continue;
         }
 
@@ -194,14 +199,29 @@ static void audio_feed_task(void *arg)
             fwrite(audio_buffer, 1, audio_chunksize * I2S_CHANNEL_NUM * sizeof(int16_t), g_sr_data->fp);
         }
 
+        /* Playback reference for AEC: what the speaker played while this chunk was captured */
+        app_aec_ref_read(ref_buffer, audio_chunksize);
+
         /* Channel Adjust */
         for (int  i = audio_chunksize - 1; i >= 0; i--) {
-            audio_buffer[i * 3 + 2] = 0;
+            audio_buffer[i * 3 + 2] = ref_buffer[i];
             audio_buffer[i * 3 + 1] = audio_buffer[i * 2 + 1];
             audio_buffer[i * 3 + 0] = audio_buffer[i * 2 + 0];
         }
         /* Feed samples of an audio stream to the AFE_SR */
         afe_handle->feed(afe_data, audio_buffer);
+        app_trace_feed(audio_chunksize);
+
+        if (resumed) {
+            resumed = false;
+            uint32_t latency_ms = (uint32_t)((esp_timer_get_time() - s_opened_at_us) / 1000);
+            portENTER_CRITICAL(&s_gate_lock);
+            s_feed_stats.resume_latency_last_ms = latency_ms;
+            if (latency_ms > s_feed_stats.resume_latency_max_ms) {
+                s_feed_stats.resume_latency_max_ms = latency_ms;
+            }
+            portEXIT_CRITICAL(&s_gate_lock);
+        }
     }
 }
 
@@ -212,12 +232,13 @@ static void audio_detect_task(void *arg)
     int afe_chunksize = afe_handle->get_fetch_chunksize(afe_data);
     //int nch = afe_handle->get_channel_num(afe_data);
 
-    int mu_chunksize = g_sr_data->multinet->get_samp_chunksize(g_sr_data->model_data);
+    sr_lang_ctx_t *last_mn = g_sr_data->mn;
+    int mu_chunksize = last_mn->multinet->get_samp_chunksize(last_mn->model_data);
     assert(mu_chunksize == afe_chunksize);
     ESP_LOGI(TAG, "------------detect start------------\n");
 
     while (true) {
-        if (NEED_DELETE && xEventGroupGetBits(g_sr_data->event_group)) {
+        if (NEED_DELETE & xEventGroupGetBits(g_sr_data->event_group)) {
             xEventGroupSetBits(g_sr_data->event_group, DETECT_DELETED);
             vTaskDelete(g_sr_data->handle_task);
             vTaskDelete(NULL);
@@ -227,6 +248,21 @@ static void audio_detect_task(void *arg)
         if (!res || res->ret_value == ESP_FAIL) {
             continue;
         }
+        app_trace_fetch(afe_chunksize);
+
+        /* Language switches take effect here, between chunks; an utterance in progress is dropped */
+        sr_lang_ctx_t *mn = g_sr_data->mn;
+        if (mn != last_mn) {
+            if (detect_flag) {
+                g_sr_data->afe_handle->enable_wakenet(afe_data);
+                detect_flag = false;
+            }
+            last_mn = mn;
+        }
+        if (NULL == mn) {
+            xEventGroupSetBits(g_sr_data->event_group, DETECT_PARKED);
+            continue;
+        }
 
         if (res->wakeup_state == WAKENET_DETECTED) {
             ESP_LOGI(TAG,  "wakeword detected");
@@ -234,6 +270,7 @@ static void audio_detect_task(void *arg)
                 .wakenet_mode = WAKENET_DETECTED,
                 .state = ESP_MN_STATE_DETECTING,
                 .command_id = 0,
+                .lang = mn->lang,
             };
             xQueueSend(g_sr_data->result_que, &result, 0);
         } else if (res->wakeup_state == WAKENET_CHANNEL_VERIFIED) {
@@ -249,11 +286,13 @@ static void audio_detect_task(void *arg)
             }
 
             esp_mn_state_t mn_state = ESP_MN_STATE_DETECTING;
-            if (false == sr_echo_is_playing()) {
-                mn_state = g_sr_data->multinet->detect(g_sr_data->model_data, res->data);
-            } else {
+#if !CONFIG_KAVACH_AEC
+            /* Without echo cancellation prompts would be heard as commands */
+            if (true == sr_echo_is_playing()) {
                 continue;
             }
+#endif
+            mn_state = mn->multinet->detect(mn->model_data, res->data);
 
             if (ESP_MN_STATE_DETECTING == mn_state) {
                 continue;
@@ -265,6 +304,7 @@ static void audio_detect_task(void *arg)
                     .wakenet_mode = WAKENET_NO_DETECT,
                     .state = mn_state,
                     .command_id = 0,
+                    .lang = mn->lang,
                 };
                 xQueueSend(g_sr_data->result_que, &result, 0);
                 g_sr_data->afe_handle->enable_wakenet(afe_data);
@@ -273,7 +313,8 @@ static void audio_detect_task(void *arg)
             }
 
             if (ESP_MN_STATE_DETECTED == mn_state) {
-                esp_mn_results_t *mn_result = g_sr_data->multinet->get_results(g_sr_data->model_data);
+                app_trace_begin();
+                esp_mn_results_t *mn_result = mn->multinet->get_results(mn->model_data);
                 for (int i = 0; i < mn_result->num; i++) {
                     printf("TOP %d, command_id: %d, phrase_id: %d, prob: %f\n",
                            i + 1, mn_result->command_id[i], mn_result->phrase_id[i], mn_result->prob[i]);
@@ -285,8 +326,10 @@ static void audio_detect_task(void *arg)
                     .wakenet_mode = WAKENET_NO_DETECT,
                     .state = mn_state,
                     .command_id = sr_command_id,
+                    .lang = mn->lang,
                 };
                 xQueueSend(g_sr_data->result_que, &result, 0);
+                app_trace_stamp(APP_TRACE_RESULT_SEND);
 #if !SR_CONTINUE_DET
                 g_sr_data->afe_handle->enable_wakenet(afe_data);
                 detect_flag = false;
@@ -306,27 +349,153 @@ static void audio_detect_task(void *arg)
     vTaskDelete(NULL);
 }
 
-esp_err_t app_sr_set_language(sr_language_t new_lang)
+static bool mn_takes_text(const sr_lang_ctx_t *ctx)
 {
-    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    return strstr(ctx->mn_name, "mn6_en") || strstr(ctx->mn_name, "mn7_en");
+}
 
-    if (new_lang == g_sr_data->lang) {
-        ESP_LOGW(TAG, "nothing to do");
-        return ESP_OK;
-    } else {
-        g_sr_data->lang = new_lang;
+static bool is_overlay(const sr_lang_ctx_t *ctx, const sr_cmd_t *cmd)
+{
+    return ctx->overlay && cmd >= ctx->overlay && cmd < ctx->overlay + SR_CMD_OVERLAY_MAX;
+}
+
+/* Free overlay slot, allocating the overlay on first use; NULL when full. */
+static sr_cmd_t *overlay_take(sr_lang_ctx_t *ctx)
+{
+    if (!ctx->overlay) {
+        ctx->overlay = heap_caps_calloc(SR_CMD_OVERLAY_MAX, sizeof(sr_cmd_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!ctx->overlay) {
+            return NULL;
+        }
+        for (int i = 0; i < SR_CMD_OVERLAY_MAX; i++) {
+            ctx->overlay[i].lang = SR_LANG_MAX;
+        }
     }
+    for (int i = 0; i < SR_CMD_OVERLAY_MAX; i++) {
+        if (SR_LANG_MAX == ctx->overlay[i].lang) {
+            return &ctx->overlay[i];
+        }
+    }
+    return NULL;
+}
 
-    ESP_LOGW(TAG, "Set language to %s", SR_LANG_EN == g_sr_data->lang ? "EN" : "CN");
-    if (g_sr_data->model_data) {
-        g_sr_data->multinet->destroy(g_sr_data->model_data);
+static esp_err_t lang_ctx_add_cmd(sr_lang_ctx_t *ctx, const sr_cmd_t *cmd)
+{
+    /* Reuse the lowest removed id, so ids stay below table->num + SR_CMD_OVERLAY_MAX */
+    uint16_t id = 0;
+    while (id < ctx->cmd_num && ctx->by_id[id]) {
+        id++;
+    }
+    ESP_RETURN_ON_FALSE(id < ctx->id_cap && id < ESP_MN_MAX_PHRASE_NUM, ESP_ERR_INVALID_STATE, TAG, "cmd is full");
+    sr_cmd_t *item = overlay_take(ctx);
+    ESP_RETURN_ON_FALSE(NULL != item, ESP_ERR_NO_MEM, TAG, "memory for sr cmd is not enough");
+    memcpy(item, cmd, sizeof(sr_cmd_t));
+    item->id = id;
+    ctx->by_id[id] = item;
+    if (id == ctx->cmd_num) {
+        ctx->cmd_num++;
     }
 
-    g_sr_data->cmd_num = 0;
+    esp_mn_commands_add(id, mn_takes_text(ctx) ? item->str : item->phoneme);
+    return ESP_OK;
+}
+
+/*
+ * esp_mn_commands_* keeps one global phrase list that modify/update act on. Each model holds its own
+ * copy once updated, so switching to a resident model only needs the global list rebuilt to match.
+ */
+static void lang_ctx_restore_phrases(sr_lang_ctx_t *ctx)
+{
+    if (strstr(ctx->mn_name, "mn6") || strstr(ctx->mn_name, "mn7")) {
+        esp_mn_commands_clear();
+    }
+    for (uint16_t id = 0; id < ctx->cmd_num; id++) {
+        const sr_cmd_t *it = ctx->by_id[id];
+        if (it) {
+            esp_mn_commands_add(id, (char *)(mn_takes_text(ctx) ? it->str : it->phoneme));
+        }
+    }
+}
 
+static esp_err_t lang_ctx_update(sr_lang_ctx_t *ctx)
+{
+    lang_ctx_restore_phrases(ctx);  /* drops removed commands */
+    esp_mn_error_t *err_id = esp_mn_commands_update(ctx->multinet, ctx->model_data);
+    if (err_id) {
+        for (int i = 0; i < err_id->num; i++) {
+            ESP_LOGE(TAG, "err cmd id:%d", err_id->phrases[i]);
+        }
+    }
+    esp_mn_commands_print();
+
+    return ESP_OK;
+}
+
+static void lang_ctx_unload(sr_lang_ctx_t *ctx)
+{
+    if (ctx->model_data) {
+        ctx->multinet->destroy(ctx->model_data);
+        ctx->model_data = NULL;
+    }
+    heap_caps_free(ctx->by_id);
+    ctx->by_id = NULL;
+    heap_caps_free(ctx->overlay);
+    ctx->overlay = NULL;
+    ctx->cmd_num = 0;
+}
+
+/* Create the multinet for lang and register its default commands with it. */
+static esp_err_t lang_ctx_load(sr_lang_ctx_t *ctx, sr_language_t lang)
+{
+    size_t psram_before = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    size_t internal_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    int64_t start_us = esp_timer_get_time();
+
+    char *mn_name = esp_srmodel_filter(models, ESP_MN_PREFIX, ((SR_LANG_EN == lang) ? ESP_MN_ENGLISH : ESP_MN_CHINESE));
+    ESP_RETURN_ON_FALSE(NULL != mn_name, ESP_ERR_INVALID_ARG, TAG, "Modifications to the code are required to support the relevant configuration");
+    esp_mn_iface_t *multinet = esp_mn_handle_from_name(mn_name);
+    model_iface_data_t *model_data = multinet->create(mn_name, 5760);
+    ESP_RETURN_ON_FALSE(NULL != model_data, ESP_ERR_NO_MEM, TAG, "Failed create multinet %s", mn_name);
+    ctx->lang = lang;
+    ctx->multinet = multinet;
+    ctx->model_data = model_data;
+    ctx->mn_name = mn_name;
+    ESP_LOGI(TAG, "load multinet:%s", ctx->mn_name);
+
+    /* Built-in commands stay in flash; only the id index is allocated */
+    ctx->table = &g_sr_cmd_table[lang];
+    ctx->id_cap = ctx->table->num + SR_CMD_OVERLAY_MAX;
+    ctx->by_id = heap_caps_calloc(ctx->id_cap, sizeof(ctx->by_id[0]), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(NULL != ctx->by_id, ESP_ERR_NO_MEM, TAG, "memory for sr cmd is not enough");
+    for (uint16_t id = 0; id < ctx->table->num; id++) {
+        ctx->by_id[id] = &ctx->table->cmds[id];
+    }
+    ctx->cmd_num = ctx->table->num;
+    ESP_LOGI(TAG, "cmd_number=%d", ctx->cmd_num);
+
+    esp_err_t ret = lang_ctx_update(ctx);
+    ESP_LOGI(TAG, "%s ready in %d ms, %d KB PSRAM, %d KB internal", mn_name,
+             (int)((esp_timer_get_time() - start_us) / 1000),
+             (int)(psram_before - heap_caps_get_free_size(MALLOC_CAP_SPIRAM)) / 1024,
+             (int)(internal_before - heap_caps_get_free_size(MALLOC_CAP_INTERNAL)) / 1024);
+    return ret;
+}
+
+/* Keep the detect task off the active model so it can be destroyed. */
+static void detect_park(void)
+{
+    xEventGroupClearBits(g_sr_data->event_group, DETECT_PARKED);
+    g_sr_data->mn = NULL;
+    if (g_sr_data->detect_task) {
+        xEventGroupWaitBits(g_sr_data->event_group, DETECT_PARKED, pdFALSE, pdFALSE, pdMS_TO_TICKS(1000));
+    }
+}
+
+static char *select_wakenet(sr_language_t lang)
+{
     /* Select wakenet model from Kconfig (Hi ESP / Alexa / Both) */
     const char *wn_filter = "hilexin";
-    if (SR_LANG_EN == g_sr_data->lang) {
+    if (SR_LANG_EN == lang) {
 #if defined(CONFIG_KAVACH_WAKE_WORD_ALEXA)
         wn_filter = "alexa";
 #elif defined(CONFIG_KAVACH_WAKE_WORD_BOTH)
@@ -340,7 +509,7 @@ esp_err_t app_sr_set_language(sr_language_t new_lang)
         wn_name = esp_srmodel_filter(models, ESP_WN_PREFIX, wn_filter);
     }
 #if defined(CONFIG_KAVACH_WAKE_WORD_BOTH)
-    if (!wn_name && SR_LANG_EN == g_sr_data->lang) {
+    if (!wn_name && SR_LANG_EN == lang) {
         const char *try_order[] = { "hiesp_alexa", "alexa_hiesp", "hiesp", NULL };
         for (int i = 0; try_order[i] != NULL && !wn_name; i++) {
             wn_name = esp_srmodel_filter(models, ESP_WN_PREFIX, (char *)try_order[i]);
@@ -348,43 +517,85 @@ esp_err_t app_sr_set_language(sr_language_t new_lang)
     }
 #endif
 #if defined(CONFIG_KAVACH_WAKE_WORD_ALEXA)
-    if (!wn_name && SR_LANG_EN == g_sr_data->lang) {
+    if (!wn_name && SR_LANG_EN == lang) {
         wn_name = esp_srmodel_filter(models, ESP_WN_PREFIX, "hiesp");
         if (wn_name) {
             ESP_LOGW(TAG, "Alexa wakenet not in partition, using Hi ESP");
         }
     }
 #endif
-    ESP_RETURN_ON_FALSE(NULL != wn_name, ESP_ERR_INVALID_ARG, TAG, "Modifications to the code are required to support the relevant configuration");
-    g_sr_data->afe_handle->set_wakenet(g_sr_data->afe_data, wn_name);
-    ESP_LOGI(TAG, "load wakenet:%s", wn_name);
+    return wn_name;
+}
 
-    char *mn_name = esp_srmodel_filter(models, ESP_MN_PREFIX, ((SR_LANG_EN == g_sr_data->lang) ? ESP_MN_ENGLISH : ESP_MN_CHINESE));
-    ESP_RETURN_ON_FALSE(NULL != mn_name, ESP_ERR_INVALID_ARG, TAG, "Modifications to the code are required to support the relevant configuration");
-    esp_mn_iface_t *multinet = esp_mn_handle_from_name(mn_name);
-    model_iface_data_t *model_data = multinet->create(mn_name, 5760);
-    g_sr_data->multinet = multinet;
-    g_sr_data->model_data = model_data;
-    g_sr_data->mn_name = mn_name;
-    ESP_LOGI(TAG, "load multinet:%s", g_sr_data->mn_name);
-
-    // remove all command
-    app_sr_remove_all_cmd();
-    if (strstr(g_sr_data->mn_name, "mn6") || strstr(g_sr_data->mn_name, "mn7")) {
-        esp_mn_commands_clear();
+#if CONFIG_KAVACH_SR_PRELOAD_LANGS
+/* Load every other language's multinet up front so set_language is a pointer swap. */
+static void lang_preload_others(void)
+{
+    const size_t min_free = (size_t)CONFIG_KAVACH_SR_PRELOAD_MIN_FREE_KB * 1024;
+    for (int lang = 0; lang < SR_LANG_MAX; lang++) {
+        sr_lang_ctx_t *ctx = &g_sr_data->lang_ctx[lang];
+        if (ctx->model_data) {
+            continue;
+        }
+        if (heap_caps_get_free_size(MALLOC_CAP_SPIRAM) < min_free) {
+            ESP_LOGW(TAG, "PSRAM low, %s model not preloaded; switching will reload", SR_LANG_EN == lang ? "EN" : "CN");
+            break;
+        }
+        if (ESP_OK != lang_ctx_load(ctx, (sr_language_t)lang) ||
+                heap_caps_get_free_size(MALLOC_CAP_SPIRAM) < min_free) {
+            ESP_LOGW(TAG, "Not enough PSRAM to keep %s model resident; switching will reload", SR_LANG_EN == lang ? "EN" : "CN");
+            lang_ctx_unload(ctx);
+        }
+    }
+    /* Loading registered the other language's phrases globally; put the active ones back */
+    lang_ctx_restore_phrases(g_sr_data->mn);
+}
+#endif
+
+esp_err_t app_sr_set_language(sr_language_t new_lang)
+{
+    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    ESP_RETURN_ON_FALSE(new_lang < SR_LANG_MAX, ESP_ERR_INVALID_ARG, TAG, "language incorrect");
+
+    if (new_lang == g_sr_data->lang) {
+        ESP_LOGW(TAG, "nothing to do");
+        return ESP_OK;
     }
 
-    uint8_t cmd_number = 0;
-    // count command number
-    for (size_t i = 0; i < sizeof(g_default_cmd_info) / sizeof(sr_cmd_t); i++) {
-        if (g_default_cmd_info[i].lang == g_sr_data->lang) {
-            app_sr_add_cmd(&g_default_cmd_info[i]);
-            cmd_number++;
+    ESP_LOGW(TAG, "Set language to %s", SR_LANG_EN == new_lang ? "EN" : "CN");
+    int64_t start_us = esp_timer_get_time();
+    sr_lang_ctx_t *ctx = &g_sr_data->lang_ctx[new_lang];
+    bool resident = (NULL != ctx->model_data);
+
+    char *wn_name = select_wakenet(new_lang);
+    ESP_RETURN_ON_FALSE(NULL != wn_name, ESP_ERR_INVALID_ARG, TAG, "Modifications to the code are required to support the relevant configuration");
+    if (!g_sr_data->wn_name || strcmp(wn_name, g_sr_data->wn_name) != 0) {
+        g_sr_data->afe_handle->set_wakenet(g_sr_data->afe_data, wn_name);
+        g_sr_data->wn_name = wn_name;
+        ESP_LOGI(TAG, "load wakenet:%s", wn_name);
+    }
+
+    if (resident) {
+        lang_ctx_restore_phrases(ctx);
+    } else {
+        /* Not preloaded: free the current model before creating the new one */
+        sr_lang_ctx_t *old = g_sr_data->mn;
+        detect_park();
+        if (old) {
+            lang_ctx_unload(old);
+        }
+        g_sr_data->lang = SR_LANG_MAX;
+        esp_err_t ret = lang_ctx_load(ctx, new_lang);
+        if (ESP_OK != ret) {
+            lang_ctx_unload(ctx);
+            return ret;
         }
     }
-    ESP_LOGI(TAG, "cmd_number=%d", cmd_number);
+    g_sr_data->lang = new_lang;
+    g_sr_data->mn = ctx;
 
-    return app_sr_update_cmds();/* Reset command list */
+    ESP_LOGI(TAG, "Language switch took %d us (%s)", (int)(esp_timer_get_time() - start_us), resident ? "resident" : "reloaded");
+    return ESP_OK;
 }
 
 const char *app_sr_get_wake_prompt(void)
@@ -412,8 +623,6 @@ esp_err_t app_sr_start(bool record_en)
     g_sr_data->event_group = xEventGroupCreate();
     ESP_GOTO_ON_FALSE(NULL != g_sr_data->event_group, ESP_ERR_NO_MEM, err, TAG, "Failed create event_group");
 
-    SLIST_INIT(&g_sr_data->cmd_list);
-
     /* Create file if record to SD card enabled*/
     g_sr_data->b_record_en = record_en;
     if (record_en) {
@@ -438,7 +647,14 @@ esp_err_t app_sr_start(bool record_en)
     afe_config_t afe_config = AFE_CONFIG_DEFAULT();
 
     afe_config.wakenet_model_name = esp_srmodel_filter(models, ESP_WN_PREFIX, NULL);
+#if CONFIG_KAVACH_AEC
+    /* Channel 3 of every feed chunk carries the playback reference (app_aec_ref) */
+    ret = app_aec_ref_init();
+    ESP_GOTO_ON_FALSE(ESP_OK == ret, ret, err, TAG, "Failed create AEC reference ring");
+    afe_config.aec_init = true;
+#else
     afe_config.aec_init = false;
+#endif
 
     esp_afe_sr_data_t *afe_data = afe_handle->create_from_config(&afe_config);
     g_sr_data->afe_handle = afe_handle;
@@ -448,6 +664,17 @@ esp_err_t app_sr_start(bool record_en)
     g_sr_data->lang = SR_LANG_MAX;
     ret = app_sr_set_language(param->sr_lang);
     ESP_GOTO_ON_FALSE(ESP_OK == ret, ESP_FAIL, err, TAG,  "Failed to set language");
+#if CONFIG_KAVACH_SR_PRELOAD_LANGS
+    lang_preload_others();
+#endif
+
+    /* Mute and IR-learn flags are fixed in this build (stubs); the BSP reports sleep changes */
+    app_sr_feed_gate_set(SR_FEED_GATE_MUTE, !get_mute_play_flag());
+    app_sr_feed_gate_set(SR_FEED_GATE_IR_LEARN, sensor_ir_learn_enable());
+    bsp_bottom_property_t *bottom = bsp_board_get_sensor_handle();
+    bottom->set_sleep_cb(sleep_changed_cb, NULL);
+    app_sr_feed_gate_set(SR_FEED_GATE_SLEEP, bottom->get_sleep_mode());
+    feed_gate_apply();
 
     ret_val = xTaskCreatePinnedToCore(&audio_feed_task, "Feed Task", 4 * 1024, (void *)afe_data, 5, &g_sr_data->feed_task, 0);
     ESP_GOTO_ON_FALSE(pdPASS == ret_val, ESP_FAIL, err, TAG,  "Failed create audio feed task");
@@ -472,6 +699,8 @@ esp_err_t app_sr_stop(void)
      * Waiting for all task stopped
      * TODO: A task creation failure cannot be handled correctly now
      * */
+    bsp_board_get_sensor_handle()->set_sleep_cb(NULL, NULL);
+
     xEventGroupSetBits(g_sr_data->event_group, NEED_DELETE);
     xEventGroupWaitBits(g_sr_data->event_group, NEED_DELETE | FEED_DELETED | DETECT_DELETED, 1, 1, portMAX_DELAY);
 
@@ -490,21 +719,15 @@ esp_err_t app_sr_stop(void)
         g_sr_data->fp = NULL;
     }
 
-    if (g_sr_data->model_data) {
-        g_sr_data->multinet->destroy(g_sr_data->model_data);
+    g_sr_data->mn = NULL;
+    for (int i = 0; i < SR_LANG_MAX; i++) {
+        lang_ctx_unload(&g_sr_data->lang_ctx[i]);
     }
 
     if (g_sr_data->afe_data) {
         g_sr_data->afe_handle->destroy(g_sr_data->afe_data);
     }
 
-    sr_cmd_t *it;
-    while (!SLIST_EMPTY(&g_sr_data->cmd_list)) {
-        it = SLIST_FIRST(&g_sr_data->cmd_list);
-        SLIST_REMOVE_HEAD(&g_sr_data->cmd_list, next);
-        heap_caps_free(it);
-    }
-
     if (g_sr_data->afe_in_buffer) {
         heap_caps_free(g_sr_data->afe_in_buffer);
     }
@@ -526,131 +749,97 @@ esp_err_t app_sr_get_result(sr_result_t *result, TickType_t xTicksToWait)
     return ESP_OK;
 }
 
+/* Commands of the active language; NULL when SR is not running. */
+static sr_lang_ctx_t *active_ctx(void)
+{
+    return g_sr_data ? g_sr_data->mn : NULL;
+}
+
 esp_err_t app_sr_add_cmd(const sr_cmd_t *cmd)
 {
-    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    sr_lang_ctx_t *ctx = active_ctx();
+    ESP_RETURN_ON_FALSE(NULL != ctx, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
     ESP_RETURN_ON_FALSE(NULL != cmd, ESP_ERR_INVALID_ARG, TAG, "pointer of cmd is invalid");
-    ESP_RETURN_ON_FALSE(cmd->lang == g_sr_data->lang, ESP_ERR_INVALID_ARG, TAG, "cmd lang error");
-    ESP_RETURN_ON_FALSE(ESP_MN_MAX_PHRASE_NUM >= g_sr_data->cmd_num, ESP_ERR_INVALID_STATE, TAG, "cmd is full");
-
-    sr_cmd_t *item = (sr_cmd_t *)heap_caps_calloc(1, sizeof(sr_cmd_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    ESP_RETURN_ON_FALSE(NULL != item, ESP_ERR_NO_MEM, TAG, "memory for sr cmd is not enough");
-    memcpy(item, cmd, sizeof(sr_cmd_t));
-    item->next.sle_next = NULL;
-#if 1 // insert after
-    sr_cmd_t *last = SLIST_FIRST(&g_sr_data->cmd_list);
-    if (last == NULL) {
-        SLIST_INSERT_HEAD(&g_sr_data->cmd_list, item, next);
-    } else {
-        sr_cmd_t *it;
-        while ((it = SLIST_NEXT(last, next)) != NULL) {
-            last = it;
-        }
-        SLIST_INSERT_AFTER(last, item, next);
-    }
-#else  // insert head
-    SLIST_INSERT_HEAD(&g_sr_data->cmd_list, it, next);
-#endif
-
-    if (strstr(g_sr_data->mn_name, "mn6_en") || strstr(g_sr_data->mn_name, "mn7_en")) {
-        esp_mn_commands_add(g_sr_data->cmd_num, (char *)cmd->str);
-    } else {
-        esp_mn_commands_add(g_sr_data->cmd_num, (char *)cmd->phoneme);
-    }
-    g_sr_data->cmd_num++;
-    return ESP_OK;
+    ESP_RETURN_ON_FALSE(cmd->lang == ctx->lang, ESP_ERR_INVALID_ARG, TAG, "cmd lang error");
+    return lang_ctx_add_cmd(ctx, cmd);
 }
-
 esp_err_t app_sr_modify_cmd(uint32_t id, const sr_cmd_t *cmd)
 {
-    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    sr_lang_ctx_t *ctx = active_ctx();
+    ESP_RETURN_ON_FALSE(NULL != ctx, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
     ESP_RETURN_ON_FALSE(NULL != cmd, ESP_ERR_INVALID_ARG, TAG, "pointer of cmd is invalid");
-    ESP_RETURN_ON_FALSE(id < g_sr_data->cmd_num, ESP_ERR_INVALID_ARG, TAG, "cmd id out of range");
-    ESP_RETURN_ON_FALSE(cmd->lang == g_sr_data->lang, ESP_ERR_INVALID_ARG, TAG, "cmd lang error");
-
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (it->id == id) {
-            ESP_LOGI(TAG, "modify cmd [%d] from %s to %s", id, it->str, cmd->str);
-            if (strstr(g_sr_data->mn_name, "mn6_en") || strstr(g_sr_data->mn_name, "mn7_en")) {
-                esp_mn_commands_modify(it->str, (char *)cmd->str);
-            } else {
-                esp_mn_commands_modify(it->phoneme, (char *)cmd->phoneme);
-            }
-            memcpy(it, cmd, sizeof(sr_cmd_t));
-            break;
-        }
+    ESP_RETURN_ON_FALSE(id < ctx->cmd_num, ESP_ERR_INVALID_ARG, TAG, "cmd id out of range");
+    ESP_RETURN_ON_FALSE(cmd->lang == ctx->lang, ESP_ERR_INVALID_ARG, TAG, "cmd lang error");
+
+    const sr_cmd_t *it = ctx->by_id[id];
+    ESP_RETURN_ON_FALSE(NULL != it, ESP_ERR_NOT_FOUND, TAG, "can't find cmd id:%d", id);
+    /* Built-in commands are read-only: the modified copy goes to the overlay */
+    sr_cmd_t *item = is_overlay(ctx, it) ? (sr_cmd_t *)it : overlay_take(ctx);
+    ESP_RETURN_ON_FALSE(NULL != item, ESP_ERR_NO_MEM, TAG, "memory for sr cmd is not enough");
+
+    ESP_LOGI(TAG, "modify cmd [%d] from %s to %s", id, it->str, cmd->str);
+    if (mn_takes_text(ctx)) {
+        esp_mn_commands_modify((char *)it->str, (char *)cmd->str);
+    } else {
+        esp_mn_commands_modify((char *)it->phoneme, (char *)cmd->phoneme);
     }
-    ESP_RETURN_ON_FALSE(NULL != it, ESP_ERR_NOT_FOUND, TAG, "can't find cmd id:%d", cmd->id);
+    memcpy(item, cmd, sizeof(sr_cmd_t));
+    item->id = id;
+    ctx->by_id[id] = item;
     return ESP_OK;
 }
 
 esp_err_t app_sr_remove_cmd(uint32_t id)
 {
-    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
-    ESP_RETURN_ON_FALSE(id < g_sr_data->cmd_num, ESP_ERR_INVALID_ARG, TAG, "cmd id out of range");
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (it->id == id) {
-            ESP_LOGI(TAG, "remove cmd id [%d]", it->id);
-            SLIST_REMOVE(&g_sr_data->cmd_list, it, sr_cmd_t, next);
-            heap_caps_free(it);
-            g_sr_data->cmd_num--;
-            break;
-        }
-    }
+    sr_lang_ctx_t *ctx = active_ctx();
+    ESP_RETURN_ON_FALSE(NULL != ctx, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    ESP_RETURN_ON_FALSE(id < ctx->cmd_num, ESP_ERR_INVALID_ARG, TAG, "cmd id out of range");
+    const sr_cmd_t *it = ctx->by_id[id];
     ESP_RETURN_ON_FALSE(NULL != it, ESP_ERR_NOT_FOUND, TAG, "can't find cmd id:%d", id);
+
+    ESP_LOGI(TAG, "remove cmd id [%d]", id);
+    if (is_overlay(ctx, it)) {
+        ((sr_cmd_t *)it)->lang = SR_LANG_MAX;
+    }
+    ctx->by_id[id] = NULL;
+    while (ctx->cmd_num > 0 && NULL == ctx->by_id[ctx->cmd_num - 1]) {
+        ctx->cmd_num--;
+    }
     return ESP_OK;
 }
 
 esp_err_t app_sr_remove_all_cmd(void)
 {
-    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
-    sr_cmd_t *it;
-    while (!SLIST_EMPTY(&g_sr_data->cmd_list)) {
-        it = SLIST_FIRST(&g_sr_data->cmd_list);
-        SLIST_REMOVE_HEAD(&g_sr_data->cmd_list, next);
-        heap_caps_free(it);
+    sr_lang_ctx_t *ctx = active_ctx();
+    ESP_RETURN_ON_FALSE(NULL != ctx, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    memset(ctx->by_id, 0, ctx->id_cap * sizeof(ctx->by_id[0]));
+    for (int i = 0; ctx->overlay && i < SR_CMD_OVERLAY_MAX; i++) {
+        ctx->overlay[i].lang = SR_LANG_MAX;
     }
-    SLIST_INIT(&g_sr_data->cmd_list);
+    ctx->cmd_num = 0;
     return ESP_OK;
 }
 
 esp_err_t app_sr_update_cmds(void)
 {
-    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
-
-    uint32_t count = 0;
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        it->id = count++;
-    }
-
-    esp_mn_error_t *err_id = esp_mn_commands_update(g_sr_data->multinet, g_sr_data->model_data);
-    if (err_id) {
-        for (int i = 0; i < err_id->num; i++) {
-            ESP_LOGE(TAG, "err cmd id:%d", err_id->phrases[i]);
-        }
-    }
-    esp_mn_commands_print();
-
-    return ESP_OK;
+    sr_lang_ctx_t *ctx = active_ctx();
+    ESP_RETURN_ON_FALSE(NULL != ctx, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    return lang_ctx_update(ctx);
 }
 
 uint8_t app_sr_search_cmd_from_user_cmd(sr_user_cmd_t user_cmd, uint8_t *id_list, uint16_t max_len)
 {
-    ESP_RETURN_ON_FALSE(NULL != g_sr_data, 0, TAG, "SR is not running");
+    sr_lang_ctx_t *ctx = active_ctx();
+    ESP_RETURN_ON_FALSE(NULL != ctx, 0, TAG, "SR is not running");
 
     uint8_t cmd_num = 0;
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (user_cmd == it->cmd) {
+    for (uint16_t id = 0; id < ctx->cmd_num && cmd_num < max_len; id++) {
+        const sr_cmd_t *it = ctx->by_id[id];
+        if (it && user_cmd == it->cmd) {
             if (id_list) {
-                id_list[cmd_num] = it->id;
-            }
-            if (++cmd_num >= max_len) {
-                break;
+                id_list[cmd_num] = id;
             }
+            cmd_num++;
         }
     }
     return cmd_num;
@@ -658,34 +847,51 @@ uint8_t app_sr_search_cmd_from_user_cmd(sr_user_cmd_t user_cmd, uint8_t *id_list
 
 uint8_t app_sr_search_cmd_from_phoneme(const char *phoneme, uint8_t *id_list, uint16_t max_len)
 {
-    ESP_RETURN_ON_FALSE(NULL != g_sr_data, 0, TAG, "SR is not running");
+    sr_lang_ctx_t *ctx = active_ctx();
+    ESP_RETURN_ON_FALSE(NULL != ctx, 0, TAG, "SR is not running");
 
     uint8_t cmd_num = 0;
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (0 == strcmp(phoneme, it->phoneme)) {
+    /* Built-in phonemes are unique: one hash probe, valid unless that id was modified or removed */
+    int id = sr_cmd_table_find(ctx->table, phoneme);
+    if (id >= 0 && ctx->by_id[id] == &ctx->table->cmds[id] && cmd_num < max_len) {
+        if (id_list) {
+            id_list[cmd_num] = id;
+        }
+        cmd_num++;
+    }
+    for (int i = 0; ctx->overlay && i < SR_CMD_OVERLAY_MAX && cmd_num < max_len; i++) {
+        const sr_cmd_t *it = &ctx->overlay[i];
+        if (SR_LANG_MAX != it->lang && 0 == strcmp(phoneme, it->phoneme)) {
             if (id_list) {
                 id_list[cmd_num] = it->id;
             }
-            if (++cmd_num >= max_len) {
-                break;
-            }
+            cmd_num++;
         }
     }
     return cmd_num;
 }
 
+static const sr_cmd_t *lang_ctx_get_cmd(const sr_lang_ctx_t *ctx, uint32_t id)
+{
+    ESP_RETURN_ON_FALSE(id < ctx->cmd_num, NULL, TAG, "cmd id out of range");
+    ESP_RETURN_ON_FALSE(NULL != ctx->by_id[id], NULL, TAG, "can't find cmd id:%d", id);
+    return ctx->by_id[id];
+}
+
 const sr_cmd_t *app_sr_get_cmd_from_id(uint32_t id)
 {
-    ESP_RETURN_ON_FALSE(NULL != g_sr_data, NULL, TAG, "SR is not running");
-    ESP_RETURN_ON_FALSE(id < g_sr_data->cmd_num, NULL, TAG, "cmd id out of range");
+    sr_lang_ctx_t *ctx = active_ctx();
+    ESP_RETURN_ON_FALSE(NULL != ctx, NULL, TAG, "SR is not running");
+    return lang_ctx_get_cmd(ctx, id);
+}
 
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (id == it->id) {
-            return it;
-        }
-    }
-    ESP_RETURN_ON_FALSE(NULL != it, NULL, TAG, "can't find cmd id:%d", id);
-    return NULL;
+const sr_cmd_t *app_sr_get_cmd_from_result(const sr_result_t *result)
+{
+    ESP_RETURN_ON_FALSE(NULL != g_sr_data, NULL, TAG, "SR is not running");
+    ESP_RETURN_ON_FALSE(NULL != result && result->lang < SR_LANG_MAX, NULL, TAG, "result language incorrect");
+    /* A result queued just before a language switch still resolves against its own model's ids */
+    const sr_lang_ctx_t *ctx = &g_sr_data->lang_ctx[result->lang];
+    ESP_RETURN_ON_FALSE(NULL != ctx->by_id, NULL, TAG, "%s model unloaded, dropping cmd id:%d",
+                        SR_LANG_EN == result->lang ? "EN" : "CN", result->command_id);
+    return lang_ctx_get_cmd(ctx, (uint32_t)result->command_id);
 }
@@ -7,7 +7,6 @@
 #pragma once
 
 #include <stdbool.h>
-#include <sys/queue.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_err.h"
@@ -30,12 +29,6 @@ extern "C" {
 #define SR_CMD_STR_LEN_MAX 64
 #define SR_CMD_PHONEME_LEN_MAX 64
 
-typedef struct {
-    wakenet_state_t wakenet_mode;
-    esp_mn_state_t state;
-    int command_id;
-} sr_result_t;
-
 /**
  * @brief User defined command list (Kavach: elderly-focused voice commands)
  */
@@ -66,15 +59,43 @@ typedef enum {
     SR_LANG_MAX,
 } sr_language_t;
 
+typedef struct {
+    wakenet_state_t wakenet_mode;
+    esp_mn_state_t state;
+    int command_id;
+    sr_language_t lang;             /* language of the model that produced command_id */
+} sr_result_t;
+
+/**
+ * A recognisable phrase. Built-in commands (sr_commands.txt) live in a flash table; ids are stable:
+ * removing a command leaves a hole that the next app_sr_add_cmd() reuses.
+ */
 typedef struct sr_cmd_t {
     sr_user_cmd_t cmd;
     sr_language_t lang;
     uint32_t id;
     char str[SR_CMD_STR_LEN_MAX];
     char phoneme[SR_CMD_PHONEME_LEN_MAX];
-    SLIST_ENTRY(sr_cmd_t) next;
 } sr_cmd_t;
 
+/**
+ * Reasons to stop feeding microphone audio to the AFE. The feed task blocks (no polling) while any
+ * gate is set and resumes with the next audio chunk once all are cleared.
+ */
+typedef enum {
+    SR_FEED_GATE_SLEEP    = 1 << 0,     /* board sleep mode (set from the BSP sleep callback) */
+    SR_FEED_GATE_MUTE     = 1 << 1,     /* voice input muted */
+    SR_FEED_GATE_IR_LEARN = 1 << 2,     /* IR learning in progress */
+} sr_feed_gate_t;
+
+typedef struct {
+    uint32_t gate_mask;             /* currently set sr_feed_gate_t bits */
+    uint32_t gated_count;           /* times feeding stopped */
+    uint32_t resume_latency_last_ms;/* last gate clear -> first chunk fed */
+    uint32_t resume_latency_max_ms;
+    uint32_t gated_audio_ms;        /* total audio not fed while gated */
+} sr_feed_stats_t;
+
 esp_err_t app_sr_start(bool record_en);
 esp_err_t app_sr_stop(void);
 esp_err_t app_sr_get_result(sr_result_t *result, TickType_t xTicksToWait);
@@ -84,10 +105,17 @@ esp_err_t app_sr_modify_cmd(uint32_t id, const sr_cmd_t *cmd);
 esp_err_t app_sr_remove_cmd(uint32_t id);
 esp_err_t app_sr_remove_all_cmd(void);
 const sr_cmd_t *app_sr_get_cmd_from_id(uint32_t id);
+/** Command of a detection result, looked up in the language model that produced it (NULL if since unloaded). */
+const sr_cmd_t *app_sr_get_cmd_from_result(const sr_result_t *result);
 uint8_t app_sr_search_cmd_from_user_cmd(sr_user_cmd_t user_cmd, uint8_t *id_list, uint16_t max_len);
 uint8_t app_sr_search_cmd_from_phoneme(const char *phoneme, uint8_t *id_list, uint16_t max_len);
 esp_err_t app_sr_update_cmds(void);
 
+/** Set or clear a feed gate. Safe from any task; may be called before app_sr_start(). */
+void app_sr_feed_gate_set(sr_feed_gate_t gate, bool gated);
+
+void app_sr_get_feed_stats(sr_feed_stats_t *stats);
+
 /** Idle prompt shown on UI (e.g. "Say Hi ESP", "Say Alexa"). Depends on Kconfig wake word. */
 const char *app_sr_get_wake_prompt(void);
 
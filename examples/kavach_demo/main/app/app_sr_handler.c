@@ -11,9 +11,16 @@
 #include "freertos/queue.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 #include "esp_heap_caps.h"
 #include "app_sr.h"
 #include "app_sr_handler.h"
+#include "app_wav_stream.h"
+#include "app_prompt_cache.h"
+#include "app_prompt_pack.h"
+#include "app_aec_ref.h"
+#include "app_trace.h"
+#include "app_assets.h"
 #include "app_ir.h"
 #include "ui_kavach.h"
 #include "settings.h"
@@ -30,39 +37,6 @@ bool sr_echo_is_playing(void)
     return s_echo_playing;
 }
 
-/* Find "data" chunk in WAV and return pointer + length; *data_len 4-byte aligned. */
-static bool wav_find_data(uint8_t *buf, size_t buf_len, uint8_t **out_pcm, size_t *out_len,
-                          uint32_t *sample_rate, uint16_t *bits_per_sample)
-{
-    if (buf_len < 12 || memcmp(buf, "RIFF", 4) != 0 || memcmp(buf + 8, "WAVE", 4) != 0) {
-        return false;
-    }
-    size_t pos = 12;
-    uint32_t sr = 16000;
-    uint16_t bps = 16;
-
-    while (pos + 8 <= buf_len) {
-        uint32_t chunk_len = (uint32_t)buf[pos + 4] | ((uint32_t)buf[pos + 5] << 8)
-                             | ((uint32_t)buf[pos + 6] << 16) | ((uint32_t)buf[pos + 7] << 24);
-        if (pos + 8 + chunk_len > buf_len) {
-            break;
-        }
-        if (memcmp(buf + pos, "fmt ", 4) == 0 && chunk_len >= 16) {
-            sr = (uint32_t)buf[pos + 12] | ((uint32_t)buf[pos + 13] << 8)
-                 | ((uint32_t)buf[pos + 14] << 16) | ((uint32_t)buf[pos + 15] << 24);
-            bps = (uint16_t)buf[pos + 22] | ((uint16_t)buf[pos + 23] << 8);
-        } else if (memcmp(buf + pos, "data", 4) == 0) {
-            *out_pcm = buf + pos + 8;
-            *out_len = chunk_len & (size_t)~3u;
-            *sample_rate = sr;
-            *bits_per_sample = bps ? bps : 16;
-            return true;
-        }
-        pos += 8 + chunk_len;
-    }
-    return false;
-}
-
 /**
  * Confirmation message type: different voice per command.
  * Add WAVs to spiffs: echo_en_<suffix>.wav / echo_cn_<suffix>.wav
@@ -76,147 +50,189 @@ typedef enum {
     CONFIRM_MAX
 } confirm_type_t;
 
-static const char *confirm_suffix_en[] = { "ok", "alerted", "calling", "help" };
-static const char *confirm_suffix_cn[] = { "ok", "alerted", "calling", "help" };
-
-/* Paths to try for WAV files: SD card first (user-provided), then SPIFFS/storage. */
-static const char *wav_prefixes[] = { "/sdcard/", "/spiffs/", "/storage/" };
-#define WAV_PREFIX_NUM (sizeof(wav_prefixes) / sizeof(wav_prefixes[0]))
+/* Confirmation prompt asset for the current language (echo_<lang>_<suffix>.wav). */
+static app_asset_id_t confirm_asset(confirm_type_t type)
+{
+    bool is_cn = (settings_get_parameter()->sr_lang == SR_LANG_CN);
+    return (app_asset_id_t)((is_cn ? APP_ASSET_ECHO_CN_OK : APP_ASSET_ECHO_EN_OK) + type);
+}
 
 /* Playback request: run in a separate task so SR handler and AFE feed are not blocked. */
 typedef struct {
     bool is_beep;
     bool is_gas_alarm;
+    bool is_asset;
     confirm_type_t confirm_type;
+    app_asset_id_t asset;       /* is_asset */
 } play_req_t;
 
 #define PLAY_QUEUE_LEN  4
 static QueueHandle_t s_play_queue = NULL;
 static TaskHandle_t s_play_task_handle = NULL;
 static bool s_play_task_created = false;
-/** Set by UI when gas alert overlay is dismissed; run_gas_alarm_playback checks this and stops. */
+/** Set when the gas alert ends or is dismissed; run_gas_alarm_playback checks this and stops. */
 static volatile bool s_gas_alert_dismissed = false;
+/** Gas alarm queued or looping; later play requests only keep it going. Guarded by s_gas_alarm_lock. */
+static bool s_gas_alarm_running = false;
+static portMUX_TYPE s_gas_alarm_lock = portMUX_INITIALIZER_UNLOCKED;
 
-/* Play a WAV file by path. Returns true if played, false if file missing/invalid. */
-static bool play_wav_by_path(const char *path)
+/* Prepare codec for a prompt: full volume, short mute to avoid a pop on the first samples. */
+static void playback_begin(void)
 {
-    if (!path || !path[0]) {
-        return false;
-    }
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        return false;
-    }
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    if (fsize <= 44 || fsize > 128 * 1024) {
-        fclose(f);
+    bsp_codec_volume_set(100, NULL);
+    bsp_codec_mute_set(true);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    bsp_codec_mute_set(false);
+    vTaskDelay(pdMS_TO_TICKS(50));
+    app_aec_ref_begin();
+    s_echo_playing = true;
+}
+
+/* Restore user volume after a prompt. */
+static void playback_end(void)
+{
+    s_echo_playing = false;
+    vTaskDelay(pdMS_TO_TICKS(30));
+    bsp_codec_volume_set(settings_get_parameter()->volume, NULL);
+}
+
+/* Stream a WAV file by path to I2S block by block; stops early when *stop becomes true.
+ * Returns true if played, false if file missing/invalid. */
+static bool play_wav_by_path(const char *path, volatile bool *stop)
+{
+    app_wav_stream_t *stream = NULL;
+    if (app_wav_stream_open(path, &stream) != ESP_OK) {
         return false;
     }
-    uint8_t *buf = heap_caps_malloc((size_t)fsize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!buf) {
-        buf = heap_caps_malloc((size_t)fsize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-    }
-    if (!buf) {
-        fclose(f);
-        return false;
+
+    playback_begin();
+    const int16_t *pcm = NULL;
+    size_t samples;
+    while ((stop == NULL || !*stop) && (samples = app_wav_stream_read(stream, &pcm)) > 0) {
+        size_t written = 0;
+        app_aec_ref_write(pcm, samples);    /* before the write: the speaker starts during it */
+        bsp_i2s_write((void *)pcm, samples * sizeof(int16_t), &written, portMAX_DELAY);
     }
-    if (fread(buf, 1, (size_t)fsize, f) != (size_t)fsize) {
-        heap_caps_free(buf);
-        fclose(f);
-        return false;
+    playback_end();
+
+    app_wav_stream_close(stream);
+    return true;
+}
+
+/* 48 kHz samples per I2S write of in-memory PCM; bounds how late a stop request is honoured (~32 ms). */
+#define PCM_WRITE_CHUNK  1536
+
+/* Write already decoded 48 kHz PCM to I2S between playback_begin/end; stops early when *stop becomes true. */
+static void write_pcm(const int16_t *pcm, size_t samples, volatile bool *stop)
+{
+    for (size_t pos = 0; pos < samples && (stop == NULL || !*stop); pos += PCM_WRITE_CHUNK) {
+        size_t n = (samples - pos < PCM_WRITE_CHUNK) ? samples - pos : PCM_WRITE_CHUNK;
+        size_t written = 0;
+        app_aec_ref_write(pcm + pos, n);
+        bsp_i2s_write((void *)(pcm + pos), n * sizeof(int16_t), &written, portMAX_DELAY);
     }
-    fclose(f);
-
-    uint8_t *pcm = NULL;
-    size_t pcm_len = 0;
-    uint32_t sample_rate = 16000;
-    uint16_t bits_per_sample = 16;
-    if (!wav_find_data(buf, (size_t)fsize, &pcm, &pcm_len, &sample_rate, &bits_per_sample)) {
-        heap_caps_free(buf);
-        return false;
+}
+
+/* Play already decoded 48 kHz PCM (prompt pack or cache); stops early when *stop becomes true. */
+static void play_pcm(const int16_t *pcm, size_t samples, volatile bool *stop)
+{
+    playback_begin();
+    write_pcm(pcm, samples, stop);
+    playback_end();
+}
+
+/* Prompt mapped from the prompts partition, unless a file on the SD card overrides it. */
+static const int16_t *pack_prompt(app_asset_id_t id, size_t *samples)
+{
+    if (app_assets_is_override(id)) {
+        return NULL;
     }
+    return app_prompt_pack_get(app_assets_file_name(id), samples);
+}
 
-    /* Do NOT reconfigure codec sample rate: AFE capture runs at 16 kHz. Changing it causes
-     * I2S conflict ("Pending out channel for in channel running") and "rb_out slow" / crash.
-     * Only play 16 kHz WAVs so we leave the codec at 16 kHz. */
-    if (sample_rate != 16000) {
-        ESP_LOGW(TAG, "Skip %s: need 16 kHz WAV (file is %lu Hz). Re-export as 16 kHz.", path, (unsigned long)sample_rate);
-        heap_caps_free(buf);
+/* Resolve an asset via the index and decode it into the prompt cache.
+ * If it does not fit the cache budget and play_if_uncacheable is set, stream it instead. */
+static bool load_prompt(app_asset_id_t id, bool play_if_uncacheable, const int16_t **pcm, size_t *samples)
+{
+    char path[64];
+    if (!app_assets_get_path(id, path, sizeof(path))) {
         return false;
     }
-    if (bits_per_sample != 16) {
-        ESP_LOGW(TAG, "Skip %s: need 16-bit WAV (file is %u-bit).", path, (unsigned)bits_per_sample);
-        heap_caps_free(buf);
-        return false;
+    esp_err_t err = app_prompt_cache_load(app_assets_file_name(id), path, pcm, samples);
+    if (err == ESP_OK) {
+        return true;
     }
+    *pcm = NULL;
+    return play_if_uncacheable && (err == ESP_ERR_INVALID_SIZE || err == ESP_ERR_NO_MEM) &&
+           play_wav_by_path(path, NULL);
+}
 
-    /* I2S/codec often runs at 48 kHz. Our WAV is 16 kHz; if we send it raw, it plays 3x fast.
-     * Upsample 16k -> 48k with linear interpolation so it sounds natural (not blocky/creepy). */
-    const unsigned int upsample_factor = 3;
-    size_t num_in = pcm_len / 2;
-    size_t num_out = num_in * upsample_factor;
-    size_t out_len = num_out * 2;
-    uint8_t *out_buf = heap_caps_malloc(out_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!out_buf) {
-        out_buf = heap_caps_malloc(out_len, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-    }
-    if (out_buf) {
-        for (size_t o_samp = 0; o_samp < num_out; o_samp++) {
-            size_t idx = o_samp / upsample_factor;
-            unsigned int frac = o_samp % upsample_factor;
-            int16_t v0 = (int16_t)((uint16_t)pcm[idx * 2] | ((uint16_t)pcm[idx * 2 + 1] << 8));
-            int16_t v1 = (idx + 1 < num_in)
-                         ? (int16_t)((uint16_t)pcm[(idx + 1) * 2] | ((uint16_t)pcm[(idx + 1) * 2 + 1] << 8))
-                         : v0;
-            int32_t interp = (v0 * (int32_t)(upsample_factor - frac) + v1 * (int32_t)frac) / (int32_t)upsample_factor;
-            if (interp > 32767) {
-                interp = 32767;
-            } else if (interp < -32768) {
-                interp = -32768;
-            }
-            uint16_t u = (uint16_t)(int16_t)interp;
-            out_buf[o_samp * 2] = (uint8_t)(u & 0xff);
-            out_buf[o_samp * 2 + 1] = (uint8_t)(u >> 8);
+/* Play a prompt asset: SD override, then prompt pack, then cached PCM, else load then play. */
+static bool play_prompt(app_asset_id_t id)
+{
+    static uint32_t s_asset_generation = 0;
+    uint32_t gen = app_assets_generation();
+    if (gen != s_asset_generation) {
+        app_prompt_cache_clear();  /* files moved (e.g. SD card inserted): cached PCM may be stale */
+        s_asset_generation = gen;
+    }
+
+    /* Time and internal RAM spent getting the PCM ready, per source, for comparing pack vs SPIFFS */
+    int64_t t0 = esp_timer_get_time();
+    size_t heap0 = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    const char *source = "pack";
+    size_t samples = 0;
+    const int16_t *pcm = pack_prompt(id, &samples);
+    if (!pcm) {
+        source = "cache";
+        pcm = app_prompt_cache_get(app_assets_file_name(id), &samples);
+    }
+    if (!pcm) {
+        source = "file";
+        if (!load_prompt(id, true, &pcm, &samples)) {
+            return false;
         }
     }
+    if (pcm) {
+        ESP_LOGD(TAG, "Prompt %s from %s: ready in %lu us, internal heap %+d bytes", app_assets_file_name(id), source,
+                 (unsigned long)(esp_timer_get_time() - t0), (int)heap_caps_get_free_size(MALLOC_CAP_INTERNAL) - (int)heap0);
+        play_pcm(pcm, samples, NULL);
+    }
+    return true;
+}
 
-    bsp_codec_volume_set(100, NULL);
-    bsp_codec_mute_set(true);
-    vTaskDelay(pdMS_TO_TICKS(20));
-    bsp_codec_mute_set(false);
-    vTaskDelay(pdMS_TO_TICKS(50));
-
-    s_echo_playing = true;
-    size_t written = 0;
-    if (out_buf) {
-        esp_err_t err = bsp_i2s_write((char *)out_buf, out_len, &written, portMAX_DELAY);
-        heap_caps_free(out_buf);
-        (void)err;
-    } else {
-        bsp_i2s_write((char *)pcm, pcm_len, &written, portMAX_DELAY);
+/* Decode a prompt into the cache ahead of use; prompts in the pack are already playable from flash. */
+static void preload_prompt(app_asset_id_t id)
+{
+    const int16_t *pcm = NULL;
+    size_t samples = 0;
+    if (!pack_prompt(id, &samples)) {
+        load_prompt(id, false, &pcm, &samples);
     }
-    s_echo_playing = false;
+}
 
-    vTaskDelay(pdMS_TO_TICKS(30));
-    bsp_codec_volume_set(settings_get_parameter()->volume, NULL);
-    heap_caps_free(buf);
-    return true;
+/* Decode wake beep and the current language's confirmations before the first wake word. */
+static void preload_prompts(void)
+{
+#if CONFIG_KAVACH_PROMPT_CACHE_PRELOAD
+    preload_prompt(APP_ASSET_BEEP);
+    for (int t = 0; t < CONFIRM_MAX; t++) {
+        preload_prompt(confirm_asset((confirm_type_t)t));
+    }
+    app_prompt_cache_stats_t st;
+    app_prompt_cache_get_stats(&st);
+    ESP_LOGI(TAG, "Prompt cache preloaded: %u/%u bytes", (unsigned)st.bytes_used, (unsigned)st.bytes_budget);
+#endif
 }
 
 /* Run wake beep playback (called from playback task only). */
 static void run_wake_beep_playback(void)
 {
-    static const char *beep_names[] = { "beep.wav", "wake.wav" };
-    for (size_t n = 0; n < sizeof(beep_names) / sizeof(beep_names[0]); n++) {
-        for (size_t i = 0; i < WAV_PREFIX_NUM; i++) {
-            char path[64];
-            snprintf(path, sizeof(path), "%s%s", wav_prefixes[i], beep_names[n]);
-            if (play_wav_by_path(path)) {
-                ESP_LOGI(TAG, "Wake beep played: %s", path);
-                return;
-            }
+    static const app_asset_id_t beep_assets[] = { APP_ASSET_BEEP, APP_ASSET_WAKE };
+    for (size_t n = 0; n < sizeof(beep_assets) / sizeof(beep_assets[0]); n++) {
+        if (play_prompt(beep_assets[n])) {
+            ESP_LOGI(TAG, "Wake beep played: %s", app_assets_file_name(beep_assets[n]));
+            return;
         }
     }
     ESP_LOGW(TAG, "No wake beep WAV found. Add beep.wav to project spiffs/ folder and reflash (see spiffs/README.txt)");
@@ -228,130 +244,55 @@ static void run_confirm_playback(confirm_type_t type)
     if (type >= CONFIRM_MAX) {
         type = CONFIRM_OK;
     }
-    bool is_cn = (settings_get_parameter()->sr_lang == SR_LANG_CN);
-    const char **suffixes = is_cn ? confirm_suffix_cn : confirm_suffix_en;
-    const char *suffix = suffixes[type];
-    const char *name_fmt = is_cn ? "echo_cn_%s.wav" : "echo_en_%s.wav";
-    static char path_used[64];
-
-    for (size_t i = 0; i < WAV_PREFIX_NUM; i++) {
-        snprintf(path_used, sizeof(path_used), "%s", wav_prefixes[i]);
-        snprintf(path_used + strlen(path_used), (size_t)(sizeof(path_used) - strlen(path_used)), name_fmt, suffix);
-        if (play_wav_by_path(path_used)) {
-            return;
-        }
+    if (play_prompt(confirm_asset(type))) {
+        return;
     }
-    if (type != CONFIRM_OK) {
-        for (size_t i = 0; i < WAV_PREFIX_NUM; i++) {
-            snprintf(path_used, sizeof(path_used), "%s", wav_prefixes[i]);
-            snprintf(path_used + strlen(path_used), (size_t)(sizeof(path_used) - strlen(path_used)), name_fmt, "ok");
-            if (play_wav_by_path(path_used)) {
-                return;
-            }
-        }
+    if (type != CONFIRM_OK && play_prompt(confirm_asset(CONFIRM_OK))) {
+        return;
     }
     ESP_LOGW(TAG, "Confirmation WAV not found. Add echo_en_ok.wav (and beep.wav) to project spiffs/ folder and reflash");
 }
 
-#define GAS_ALARM_CHUNK  4096u
+/* Gas alarm loop is over unless a play request came in meanwhile (then keep looping). */
+static bool gas_alarm_finished(void)
+{
+    portENTER_CRITICAL(&s_gas_alarm_lock);
+    bool done = s_gas_alert_dismissed;
+    if (done) {
+        s_gas_alarm_running = false;
+    }
+    portEXIT_CRITICAL(&s_gas_alarm_lock);
+    return done;
+}
 
-/* Run gas alarm WAV with chunked write so we can stop when overlay is dismissed. */
+/* Loop the gas alarm WAV as one stream until the alert ends or is dismissed (stops at the next block). */
 static void run_gas_alarm_playback(void)
 {
-    s_gas_alert_dismissed = false;
-    static const char *name = "gas_alarm.wav";
-    FILE *f = NULL;
+    size_t samples = 0;
+    const int16_t *pcm = pack_prompt(APP_ASSET_GAS_ALARM, &samples);
     char path[64];
-    for (size_t i = 0; i < WAV_PREFIX_NUM; i++) {
-        snprintf(path, sizeof(path), "%s%s", wav_prefixes[i], name);
-        f = fopen(path, "rb");
-        if (f) {
-            break;
-        }
-    }
-    if (!f) {
-        ESP_LOGW(TAG, "Gas alarm WAV not found. Add gas_alarm.wav (16 kHz, 16-bit) to spiffs/ folder.");
-        return;
-    }
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    if (fsize <= 44 || fsize > 128 * 1024) {
-        fclose(f);
-        return;
-    }
-    uint8_t *buf = heap_caps_malloc((size_t)fsize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!buf) {
-        buf = heap_caps_malloc((size_t)fsize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-    }
-    if (!buf || fread(buf, 1, (size_t)fsize, f) != (size_t)fsize) {
-        if (buf) {
-            heap_caps_free(buf);
-        }
-        fclose(f);
-        return;
-    }
-    fclose(f);
-
-    uint8_t *pcm = NULL;
-    size_t pcm_len = 0;
-    uint32_t sample_rate = 16000;
-    uint16_t bits_per_sample = 16;
-    if (!wav_find_data(buf, (size_t)fsize, &pcm, &pcm_len, &sample_rate, &bits_per_sample) ||
-        sample_rate != 16000 || bits_per_sample != 16) {
-        heap_caps_free(buf);
-        return;
-    }
-
-    const unsigned int upsample_factor = 3;
-    size_t num_in = pcm_len / 2;
-    size_t num_out = num_in * upsample_factor;
-    size_t out_len = num_out * 2;
-    uint8_t *out_buf = heap_caps_malloc(out_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!out_buf) {
-        out_buf = heap_caps_malloc(out_len, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-    }
-    if (!out_buf) {
-        heap_caps_free(buf);
-        return;
-    }
-    for (size_t o_samp = 0; o_samp < num_out; o_samp++) {
-        size_t idx = o_samp / upsample_factor;
-        unsigned int frac = o_samp % upsample_factor;
-        int16_t v0 = (int16_t)((uint16_t)pcm[idx * 2] | ((uint16_t)pcm[idx * 2 + 1] << 8));
-        int16_t v1 = (idx + 1 < num_in)
-                     ? (int16_t)((uint16_t)pcm[(idx + 1) * 2] | ((uint16_t)pcm[(idx + 1) * 2 + 1] << 8))
-                     : v0;
-        int32_t interp = (v0 * (int32_t)(upsample_factor - frac) + v1 * (int32_t)frac) / (int32_t)upsample_factor;
-        if (interp > 32767) {
-            interp = 32767;
-        } else if (interp < -32768) {
-            interp = -32768;
-        }
-        uint16_t u = (uint16_t)(int16_t)interp;
-        out_buf[o_samp * 2] = (uint8_t)(u & 0xff);
-        out_buf[o_samp * 2 + 1] = (uint8_t)(u >> 8);
-    }
-    heap_caps_free(buf);
-
-    bsp_codec_volume_set(100, NULL);
-    bsp_codec_mute_set(true);
-    vTaskDelay(pdMS_TO_TICKS(20));
-    bsp_codec_mute_set(false);
-    vTaskDelay(pdMS_TO_TICKS(50));
-    s_echo_playing = true;
-
-    for (size_t offset = 0; offset < out_len && !s_gas_alert_dismissed; offset += GAS_ALARM_CHUNK) {
-        size_t chunk = (out_len - offset) < GAS_ALARM_CHUNK ? (out_len - offset) : GAS_ALARM_CHUNK;
-        size_t written = 0;
-        bsp_i2s_write((char *)out_buf + offset, chunk, &written, portMAX_DELAY);
+    int loops = 0;
+    if (pcm) {
+        playback_begin();
+        do {
+            write_pcm(pcm, samples, &s_gas_alert_dismissed);
+            loops++;
+        } while (!gas_alarm_finished());
+        playback_end();
+    } else {
+        do {
+            if (!app_assets_get_path(APP_ASSET_GAS_ALARM, path, sizeof(path)) ||
+                    !play_wav_by_path(path, &s_gas_alert_dismissed)) {
+                ESP_LOGW(TAG, "Gas alarm WAV not found. Add gas_alarm.wav (16-bit, 8-48 kHz) to spiffs/ folder.");
+                portENTER_CRITICAL(&s_gas_alarm_lock);
+                s_gas_alarm_running = false;
+                portEXIT_CRITICAL(&s_gas_alarm_lock);
+                return;
+            }
+            loops++;
+        } while (!gas_alarm_finished());
     }
-
-    s_echo_playing = false;
-    vTaskDelay(pdMS_TO_TICKS(30));
-    bsp_codec_volume_set(settings_get_parameter()->volume, NULL);
-    heap_caps_free(out_buf);
-    ESP_LOGI(TAG, "Gas alarm %s", s_gas_alert_dismissed ? "stopped (alert dismissed)" : "played");
+    ESP_LOGI(TAG, "Gas alarm stopped after %d plays", loops);
 }
 
 /* Dedicated task: plays WAVs so SR handler and AFE feed task are not blocked (avoids "rb_out slow" / crash). */
@@ -359,12 +300,17 @@ static void playback_task(void *pvParam)
 {
     (void)pvParam;
     play_req_t req;
+    preload_prompts();
     for (;;) {
         if (xQueueReceive(s_play_queue, &req, portMAX_DELAY) != pdTRUE) {
             continue;
         }
         if (req.is_gas_alarm) {
             run_gas_alarm_playback();
+        } else if (req.is_asset) {
+            if (!play_prompt(req.asset)) {
+                ESP_LOGW(TAG, "Prompt %s not found", app_assets_file_name(req.asset));
+            }
         } else if (req.is_beep) {
             run_wake_beep_playback();
         } else {
@@ -414,28 +360,50 @@ static void play_confirmation_wav(confirm_type_t type)
     play_req_t req = { .is_beep = false, .is_gas_alarm = false, .confirm_type = type };
     if (s_play_queue != NULL) {
         xQueueSend(s_play_queue, &req, 0);
+        app_trace_stamp(APP_TRACE_PLAY_POST);
     }
 }
 
-/** Play gas alarm WAV (spiffs/gas_alarm.wav) when gas leak is detected. Safe to call from any task. */
+/** Loop gas alarm WAV (spiffs/gas_alarm.wav) until stopped; repeated calls keep the one loop going. Any task. */
 void sr_handler_play_gas_alarm(void)
 {
     ensure_playback_task();
+    portENTER_CRITICAL(&s_gas_alarm_lock);
+    s_gas_alert_dismissed = false;
+    bool post = !s_gas_alarm_running;
+    s_gas_alarm_running = true;
+    portEXIT_CRITICAL(&s_gas_alarm_lock);
+    if (!post) {
+        return;
+    }
     play_req_t req = { .is_beep = false, .is_gas_alarm = true, .confirm_type = CONFIRM_OK };
-    if (s_play_queue != NULL) {
-        xQueueSend(s_play_queue, &req, 0);
+    if (s_play_queue == NULL || xQueueSend(s_play_queue, &req, 0) != pdTRUE) {
+        portENTER_CRITICAL(&s_gas_alarm_lock);
+        s_gas_alarm_running = false;
+        portEXIT_CRITICAL(&s_gas_alarm_lock);
     }
 }
 
-/** Stop gas alarm playback (call when gas alert overlay is dismissed). */
+/** Stop gas alarm playback (gas incident over or alert dismissed). */
 void sr_handler_stop_gas_alarm(void)
 {
     s_gas_alert_dismissed = true;
 }
 
+/** Play a prompt once on the playback task (e.g. from a local rule). Any task; dropped if the queue is full. */
+void sr_handler_play_asset(app_asset_id_t id)
+{
+    ensure_playback_task();
+    play_req_t req = { .is_asset = true, .asset = id };
+    if (s_play_queue == NULL || xQueueSend(s_play_queue, &req, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Playback queue full, prompt %s dropped", app_assets_file_name(id));
+    }
+}
+
 void sr_handler_task(void *pvParam)
 {
     (void)pvParam;
+    ensure_playback_task();  /* start now so prompts are preloaded before the first wake word */
 
     while (true) {
         sr_result_t result;
@@ -457,10 +425,12 @@ void sr_handler_task(void *pvParam)
         }
 
         if (result.state == ESP_MN_STATE_DETECTED) {
-            const sr_cmd_t *cmd = app_sr_get_cmd_from_id(result.command_id);
+            app_trace_stamp(APP_TRACE_RESULT_RECV);
+            const sr_cmd_t *cmd = app_sr_get_cmd_from_result(&result);
             if (!cmd) {
                 continue;
             }
+            app_trace_stamp(APP_TRACE_DISPATCH);
             ESP_LOGI(TAG, "command: %s, id: %d", cmd->str, (int)cmd->cmd);
 
             switch (cmd->cmd) {
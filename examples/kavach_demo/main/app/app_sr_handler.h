@@ -8,6 +8,7 @@
 
 #include <stdbool.h>
 #include "esp_err.h"
+#include "app_assets.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,10 +16,12 @@ extern "C" {
 
 bool sr_echo_is_playing(void);
 
-/** Play gas alarm WAV (e.g. /spiffs/gas_alarm.wav). Call when gas leak is detected. */
+/** Loop gas alarm WAV (e.g. /spiffs/gas_alarm.wav) until stopped; repeated calls keep the one loop going. */
 void sr_handler_play_gas_alarm(void);
-/** Stop gas alarm playback when the alert overlay is dismissed. */
+/** Stop gas alarm playback (gas incident over or alert dismissed). */
 void sr_handler_stop_gas_alarm(void);
+/** Play a prompt once on the playback task (e.g. from a local rule). Any task; dropped if the queue is full. */
+void sr_handler_play_asset(app_asset_id_t id);
 
 void sr_handler_task(void *pvParam);
 
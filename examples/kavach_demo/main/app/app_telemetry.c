@@ -0,0 +1,269 @@
+/*
+ * Telemetry sampling and batch encoding. The sample timer runs whether or not MQTT is connected;
+ * batches go to the sink (app_mqtt -> outbox) which holds them while offline.
+ *
+ * Sizes: a sample is 3 small integers (dt <= heartbeat, deltas of a few tenths), so a CBOR batch
+ * costs ~3-4 bytes per sample plus ~25 bytes of keys; the JSON variant is about three times that.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "bsp_board.h"
+#include "app_telemetry.h"
+
+static const char *TAG = "telemetry";
+
+#define BATCH_MAX           CONFIG_KAVACH_TELEMETRY_BATCH_MAX
+#define BATCH_AGE_SEC       CONFIG_KAVACH_MQTT_SENSOR_INTERVAL_SEC
+#define HEARTBEAT_SEC       CONFIG_KAVACH_TELEMETRY_HEARTBEAT_SEC
+#define TEMP_DEADBAND       CONFIG_KAVACH_TELEMETRY_TEMP_DEADBAND   /* 0.1 C */
+#define HUM_DEADBAND        CONFIG_KAVACH_TELEMETRY_HUM_DEADBAND    /* 0.1 % */
+#define ENCODE_MAX          512     /* fits an outbox record (APP_OUTBOX_PAYLOAD_MAX) */
+#define EPOCH_2016          1451606400
+
+#if CONFIG_KAVACH_TELEMETRY_JSON
+#define TELEMETRY_CBOR      false
+#else
+#define TELEMETRY_CBOR      true
+#endif
+
+typedef struct {
+    uint32_t up_s;          /* seconds since boot */
+    int16_t temp;           /* 0.1 C */
+    int16_t hum;            /* 0.1 % */
+} sample_t;
+
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+    bool ok;
+} enc_t;
+
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_timer = NULL;
+static app_telemetry_sink_t s_sink = NULL;
+static sample_t s_batch[BATCH_MAX];
+static size_t s_batch_num = 0;
+static sample_t s_last_kept;
+static bool s_have_last = false;
+static uint8_t s_buf[ENCODE_MAX];
+static app_telemetry_stats_t s_stats;
+
+static void put_bytes(enc_t *e, const void *data, size_t len)
+{
+    if (!e->ok || (size_t)(e->end - e->p) < len) {
+        e->ok = false;
+        return;
+    }
+    memcpy(e->p, data, len);
+    e->p += len;
+}
+
+/* CBOR head (RFC 8949 3.1): major type and argument, shortest form. */
+static void cbor_head(enc_t *e, uint8_t major, uint32_t val)
+{
+    uint8_t b[5];
+    size_t n;
+    major <<= 5;
+    if (val < 24) {
+        b[0] = major | val;
+        n = 1;
+    } else if (val <= 0xff) {
+        b[0] = major | 24;
+        b[1] = val;
+        n = 2;
+    } else if (val <= 0xffff) {
+        b[0] = major | 25;
+        b[1] = val >> 8;
+        b[2] = val;
+        n = 3;
+    } else {
+        b[0] = major | 26;
+        b[1] = val >> 24;
+        b[2] = val >> 16;
+        b[3] = val >> 8;
+        b[4] = val;
+        n = 5;
+    }
+    put_bytes(e, b, n);
+}
+
+static void cbor_int(enc_t *e, int32_t v)
+{
+    if (v >= 0) {
+        cbor_head(e, 0, (uint32_t)v);
+    } else {
+        cbor_head(e, 1, (uint32_t)(-1 - v));
+    }
+}
+
+static void cbor_key(enc_t *e, const char *key)
+{
+    size_t len = strlen(key);
+    cbor_head(e, 3, len);
+    put_bytes(e, key, len);
+}
+
+/* Value i of field (0 = dt, 1 = temp, 2 = hum), delta coded. */
+static int32_t field_value(const sample_t *s, size_t i, int field)
+{
+    switch (field) {
+    case 0:
+        return i ? (int32_t)(s[i].up_s - s[i - 1].up_s) : 0;
+    case 1:
+        return i ? s[i].temp - s[i - 1].temp : s[i].temp;
+    default:
+        return i ? s[i].hum - s[i - 1].hum : s[i].hum;
+    }
+}
+
+static const char *const s_field_keys[3] = { "dt", "temp", "hum" };
+
+static size_t encode_cbor(const sample_t *s, size_t n, uint32_t t0, bool epoch, uint8_t *buf, size_t len)
+{
+    enc_t e = { .p = buf, .end = buf + len, .ok = true };
+    cbor_head(&e, 5, 5);            /* map of 5 pairs */
+    cbor_key(&e, "v");
+    cbor_int(&e, 1);
+    cbor_key(&e, epoch ? "t0" : "up");
+    cbor_head(&e, 0, t0);
+    for (int f = 0; f < 3; f++) {
+        cbor_key(&e, s_field_keys[f]);
+        cbor_head(&e, 4, n);        /* array */
+        for (size_t i = 0; i < n; i++) {
+            cbor_int(&e, field_value(s, i, f));
+        }
+    }
+    return e.ok ? (size_t)(e.p - buf) : 0;
+}
+
+static size_t encode_json(const sample_t *s, size_t n, uint32_t t0, bool epoch, uint8_t *buf, size_t len)
+{
+    char *out = (char *)buf;
+    int w = snprintf(out, len, "{\"v\":1,\"%s\":%lu", epoch ? "t0" : "up", (unsigned long)t0);
+    for (int f = 0; f < 3 && w > 0 && (size_t)w < len; f++) {
+        w += snprintf(out + w, len - w, ",\"%s\":[", s_field_keys[f]);
+        for (size_t i = 0; i < n && (size_t)w < len; i++) {
+            w += snprintf(out + w, len - w, i ? ",%ld" : "%ld", (long)field_value(s, i, f));
+        }
+        if ((size_t)w < len) {
+            w += snprintf(out + w, len - w, "]");
+        }
+    }
+    if (w > 0 && (size_t)w < len) {
+        w += snprintf(out + w, len - w, "}");
+    }
+    return (w > 0 && (size_t)w < len) ? (size_t)w : 0;
+}
+
+/* Encode and publish the batch. Caller holds s_lock. */
+static void flush_locked(uint32_t now_up)
+{
+    if (s_batch_num == 0) {
+        return;
+    }
+    /* Wall clock if SNTP has set it, otherwise uptime */
+    time_t now = time(NULL);
+    bool epoch = now >= EPOCH_2016;
+    uint32_t t0 = epoch ? (uint32_t)(now - (now_up - s_batch[0].up_s)) : s_batch[0].up_s;
+    size_t len = TELEMETRY_CBOR ? encode_cbor(s_batch, s_batch_num, t0, epoch, s_buf, sizeof(s_buf))
+                                : encode_json(s_batch, s_batch_num, t0, epoch, s_buf, sizeof(s_buf));
+    if (len == 0) {
+        ESP_LOGW(TAG, "Batch of %u samples does not fit %u bytes, dropped", (unsigned)s_batch_num, ENCODE_MAX);
+    } else if (s_sink && s_sink(s_buf, len, TELEMETRY_CBOR) == ESP_OK) {
+        s_stats.batches++;
+        s_stats.bytes += len;
+        ESP_LOGD(TAG, "Published %u samples in %u bytes", (unsigned)s_batch_num, (unsigned)len);
+    }
+    s_batch_num = 0;
+}
+
+static void sample_timer_cb(void *arg)
+{
+    (void)arg;
+    float temp = 0, hum = 0;
+    if (bsp_board_get_sensor_handle()->get_humiture(&temp, &hum) != ESP_OK) {
+        return;
+    }
+    const sample_t s = {
+        .up_s = (uint32_t)(esp_timer_get_time() / 1000000),
+        .temp = (int16_t)lroundf(temp * 10),
+        .hum = (int16_t)lroundf(hum * 10),
+    };
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.samples++;
+    bool keep = !s_have_last || abs(s.temp - s_last_kept.temp) >= TEMP_DEADBAND ||
+                abs(s.hum - s_last_kept.hum) >= HUM_DEADBAND || s.up_s - s_last_kept.up_s >= HEARTBEAT_SEC;
+    if (keep) {
+        if (s_batch_num == BATCH_MAX) {
+            flush_locked(s.up_s);
+        }
+        s_batch[s_batch_num++] = s;
+        s_last_kept = s;
+        s_have_last = true;
+        s_stats.kept++;
+    }
+    if (s_batch_num == BATCH_MAX || (s_batch_num && s.up_s - s_batch[0].up_s >= BATCH_AGE_SEC)) {
+        flush_locked(s.up_s);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t app_telemetry_start(app_telemetry_sink_t sink)
+{
+    if (s_timer) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_sink = sink;
+    const esp_timer_create_args_t timer_args = {
+        .callback = &sample_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "telemetry",
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &s_timer);
+    if (ret == ESP_OK) {
+        ret = esp_timer_start_periodic(s_timer, (uint64_t)CONFIG_KAVACH_TELEMETRY_SAMPLE_SEC * 1000000);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Sample timer failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "Sampling every %ds, deadband %d.%d C / %d.%d %%, heartbeat %ds, batches of <= %d (%s)",
+             CONFIG_KAVACH_TELEMETRY_SAMPLE_SEC, TEMP_DEADBAND / 10, TEMP_DEADBAND % 10,
+             HUM_DEADBAND / 10, HUM_DEADBAND % 10, HEARTBEAT_SEC, BATCH_MAX,
+             TELEMETRY_CBOR ? "CBOR" : "JSON");
+    return ESP_OK;
+}
+
+void app_telemetry_flush(void)
+{
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    flush_locked((uint32_t)(esp_timer_get_time() / 1000000));
+    xSemaphoreGive(s_lock);
+}
+
+void app_telemetry_get_stats(app_telemetry_stats_t *stats)
+{
+    if (!s_lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
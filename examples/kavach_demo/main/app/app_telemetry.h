@@ -0,0 +1,42 @@
+/*
+ * Sensor telemetry: temperature/humidity sampled every CONFIG_KAVACH_TELEMETRY_SAMPLE_SEC, kept only
+ * when it moved past the deadband (or the heartbeat interval passed), and published in batches
+ * (CBOR by default, JSON optional) instead of one message per reading.
+ *
+ * Batch format, same keys in CBOR and JSON:
+ *   {"v":1, "t0":<unix s of first sample> | "up":<s since boot, clock not set>,
+ *    "dt":[<s since previous sample>, ...], "temp":[<0.1 C>, ...], "hum":[<0.1 %>, ...]}
+ * dt[0] is 0; temp and hum hold the first value and then the change from the previous sample.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Publish one encoded batch (binary for CBOR, text without NUL for JSON). */
+typedef esp_err_t (*app_telemetry_sink_t)(const uint8_t *data, size_t len, bool cbor);
+
+typedef struct {
+    uint32_t samples;       /* sensor reads */
+    uint32_t kept;          /* samples outside the deadband or due to the heartbeat */
+    uint32_t batches;       /* batches handed to the sink */
+    uint32_t bytes;         /* encoded bytes handed to the sink */
+} app_telemetry_stats_t;
+
+/** Start sampling; batches go to sink. */
+esp_err_t app_telemetry_start(app_telemetry_sink_t sink);
+
+/** Publish the samples collected so far now (not from the MQTT task: the sink publishes). */
+void app_telemetry_flush(void);
+
+void app_telemetry_get_stats(app_telemetry_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
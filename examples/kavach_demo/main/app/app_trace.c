@@ -0,0 +1,230 @@
+/*
+ * Latency spans and histograms. Stamps come from the feed, detect, handler, playback, MQTT and IR
+ * tasks, so all state is behind one spinlock; each stamp is a few loads/stores.
+ *
+ * The AFE buffers audio between feed() and fetch(), so the feed time of the command's last chunk is
+ * recovered from a small ring of (cumulative samples fed, time) pairs matched against samples fetched.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "app_trace.h"
+
+static const char *TAG = "trace";
+
+#define FEED_RING_LEN       64
+#define HIST_MIN_SHIFT      7       /* first bucket: < 128 us */
+#define HIST_SUB_BUCKETS    4       /* per power of two: ~19% resolution */
+#define HIST_MAX_SHIFT      24      /* last bucket: >= ~16.7 s */
+#define HIST_BUCKETS        ((HIST_MAX_SHIFT - HIST_MIN_SHIFT) * HIST_SUB_BUCKETS + 1)
+/* A command acts well within this of its detection; a span still open later never reached an action
+ * (e.g. "say again"), so a later unrelated publish or IR send must not end it. */
+#define SPAN_TIMEOUT_US     (3 * 1000 * 1000)
+
+typedef struct {
+    uint64_t end_sample;    /* cumulative samples fed after this chunk */
+    int64_t time_us;
+} feed_mark_t;
+
+typedef struct {
+    uint16_t count[HIST_BUCKETS];
+    uint32_t total;
+    uint32_t max_us;
+} hist_t;
+
+static const char *s_stage_names[APP_TRACE_STAGE_MAX] = {
+    "feed", "fetch", "detect", "result_send", "result_recv", "dispatch", "play_post", "action",
+};
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static feed_mark_t s_feed_ring[FEED_RING_LEN];
+static uint32_t s_feed_idx = 0;
+static uint64_t s_fed_samples = 0;
+static uint64_t s_fetched_samples = 0;
+static int64_t s_last_fetch_us = 0;
+
+static bool s_span_open = false;
+static int64_t s_span[APP_TRACE_STAGE_MAX];
+static hist_t s_hist[APP_TRACE_STAGE_MAX];  /* latency of each stage relative to APP_TRACE_FEED */
+static uint32_t s_spans = 0;
+static uint32_t s_expired = 0;     /* spans closed without an action (timed out or superseded) */
+
+static int bucket_of(uint32_t us)
+{
+    if (us < (1u << HIST_MIN_SHIFT)) {
+        return 0;
+    }
+    int msb = 31 - __builtin_clz(us);
+    if (msb >= HIST_MAX_SHIFT) {
+        return HIST_BUCKETS - 1;
+    }
+    int sub = (us >> (msb - 2)) & (HIST_SUB_BUCKETS - 1);
+    return 1 + (msb - HIST_MIN_SHIFT) * HIST_SUB_BUCKETS + sub;
+}
+
+/* Midpoint of a bucket's range in microseconds. */
+static uint32_t bucket_value(int b)
+{
+    if (b == 0) {
+        return (1u << HIST_MIN_SHIFT) / 2;
+    }
+    int msb = (b - 1) / HIST_SUB_BUCKETS + HIST_MIN_SHIFT;
+    int sub = (b - 1) % HIST_SUB_BUCKETS;
+    uint32_t step = 1u << (msb - 2);
+    return (1u << msb) + sub * step + step / 2;
+}
+
+static uint32_t hist_percentile(const hist_t *h, uint32_t pct)
+{
+    if (h->total == 0) {
+        return 0;
+    }
+    uint32_t rank = (h->total * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->count[b];
+        if (seen >= rank) {
+            uint32_t v = bucket_value(b);
+            return v < h->max_us ? v : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+/* Add the open span to the histograms. Caller holds s_lock. */
+static void commit_span_locked(void)
+{
+    if (!s_span_open) {
+        return;
+    }
+    s_span_open = false;
+    s_spans++;
+    for (int st = APP_TRACE_FETCH; st < APP_TRACE_STAGE_MAX; st++) {
+        if (s_span[st] == 0 || s_span[st] < s_span[APP_TRACE_FEED]) {
+            continue;  /* stage not reached (e.g. no playback or no action for this command) */
+        }
+        uint32_t us = (uint32_t)(s_span[st] - s_span[APP_TRACE_FEED]);
+        hist_t *h = &s_hist[st];
+        int b = bucket_of(us);
+        if (h->count[b] < UINT16_MAX) {
+            h->count[b]++;
+        }
+        h->total++;
+        if (us > h->max_us) {
+            h->max_us = us;
+        }
+    }
+}
+
+void app_trace_feed(size_t samples)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    s_fed_samples += samples;
+    s_feed_ring[s_feed_idx].end_sample = s_fed_samples;
+    s_feed_ring[s_feed_idx].time_us = now;
+    s_feed_idx = (s_feed_idx + 1) % FEED_RING_LEN;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void app_trace_fetch(size_t samples)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    s_fetched_samples += samples;
+    s_last_fetch_us = now;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void app_trace_begin(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    if (s_span_open) {
+        s_expired++;
+    }
+    commit_span_locked();
+    memset(s_span, 0, sizeof(s_span));
+    /* Feed time of the chunk holding the last fetched sample: oldest mark that ends at or after it */
+    int64_t feed_us = s_last_fetch_us;
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < FEED_RING_LEN; i++) {
+        const feed_mark_t *m = &s_feed_ring[i];
+        if (m->time_us && m->end_sample >= s_fetched_samples && m->end_sample < best) {
+            best = m->end_sample;
+            feed_us = m->time_us;
+        }
+    }
+    s_span[APP_TRACE_FEED] = feed_us;
+    s_span[APP_TRACE_FETCH] = s_last_fetch_us;
+    s_span[APP_TRACE_DETECT] = now;
+    s_span_open = true;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void app_trace_stamp(app_trace_stage_t stage)
+{
+    if (stage >= APP_TRACE_STAGE_MAX) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    if (s_span_open && now - s_span[APP_TRACE_DETECT] > SPAN_TIMEOUT_US) {
+        /* Keep the stages it reached; this stamp belongs to something else */
+        commit_span_locked();
+        s_expired++;
+    }
+    if (s_span_open && s_span[stage] == 0) {
+        s_span[stage] = now;
+        if (stage == APP_TRACE_ACTION) {
+            commit_span_locked();
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+int app_trace_format_json(char *buf, size_t len)
+{
+    static hist_t snap[APP_TRACE_STAGE_MAX];  /* static: ~1 KB, off the caller's stack */
+    uint32_t spans, expired;
+    portENTER_CRITICAL(&s_lock);
+    memcpy(snap, s_hist, sizeof(snap));
+    spans = s_spans;
+    expired = s_expired;
+    portEXIT_CRITICAL(&s_lock);
+
+    int n = snprintf(buf, len, "{\"spans\":%lu,\"expired\":%lu", (unsigned long)spans, (unsigned long)expired);
+    for (int st = APP_TRACE_FETCH; st < APP_TRACE_STAGE_MAX && n > 0 && (size_t)n < len; st++) {
+        const hist_t *h = &snap[st];
+        n += snprintf(buf + n, len - n, ",\"%s\":{\"n\":%lu,\"p50\":%.1f,\"p95\":%.1f,\"p99\":%.1f,\"max\":%.1f}",
+                      s_stage_names[st], (unsigned long)h->total,
+                      hist_percentile(h, 50) / 1000.0, hist_percentile(h, 95) / 1000.0,
+                      hist_percentile(h, 99) / 1000.0, h->max_us / 1000.0);
+    }
+    if (n > 0 && (size_t)n < len) {
+        n += snprintf(buf + n, len - n, "}");
+    }
+    return ((size_t)n < len) ? n : -1;
+}
+
+void app_trace_dump(void)
+{
+    static hist_t snap[APP_TRACE_STAGE_MAX];
+    portENTER_CRITICAL(&s_lock);
+    memcpy(snap, s_hist, sizeof(snap));
+    uint32_t spans = s_spans;
+    uint32_t expired = s_expired;
+    portEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "Wake-to-action latency, ms since feed (%lu spans, %lu without action)", (unsigned long)spans,
+             (unsigned long)expired);
+    ESP_LOGI(TAG, "%-12s %6s %8s %8s %8s %8s", "stage", "n", "p50", "p95", "p99", "max");
+    for (int st = APP_TRACE_FETCH; st < APP_TRACE_STAGE_MAX; st++) {
+        const hist_t *h = &snap[st];
+        ESP_LOGI(TAG, "%-12s %6lu %8.1f %8.1f %8.1f %8.1f", s_stage_names[st], (unsigned long)h->total,
+                 hist_percentile(h, 50) / 1000.0, hist_percentile(h, 95) / 1000.0,
+                 hist_percentile(h, 99) / 1000.0, h->max_us / 1000.0);
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ * Wake-to-action latency tracing: one span per recognised command, stamped with esp_timer_get_time()
+ * at each pipeline stage (AFE feed -> fetch -> multinet -> result queue -> handler -> playback post ->
+ * MQTT publish / IR send). Completed spans feed per-stage log-bucket histograms (p50/p95/p99).
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    APP_TRACE_FEED = 0,     /* afe_handle->feed() of the chunk that completed the command */
+    APP_TRACE_FETCH,        /* afe_handle->fetch() returned that audio */
+    APP_TRACE_DETECT,       /* multinet->detect() reported the command */
+    APP_TRACE_RESULT_SEND,  /* result queued to the handler */
+    APP_TRACE_RESULT_RECV,  /* handler dequeued the result */
+    APP_TRACE_DISPATCH,     /* handler resolved the command and starts acting on it */
+    APP_TRACE_PLAY_POST,    /* confirmation prompt posted to the playback task */
+    APP_TRACE_ACTION,       /* esp_mqtt_client_publish() or rmt_transmit(); ends the span */
+    APP_TRACE_STAGE_MAX,
+} app_trace_stage_t;
+
+/** Record that samples of microphone audio were fed to the AFE (called per feed chunk). */
+void app_trace_feed(size_t samples);
+
+/** Record that samples of processed audio were fetched from the AFE (called per fetch). */
+void app_trace_fetch(size_t samples);
+
+/** A command was detected in the last fetched chunk: start a span (ends any unfinished one). */
+void app_trace_begin(void);
+
+/**
+ * Stamp a stage of the current span; first stamp wins. APP_TRACE_ACTION completes the span. A span
+ * not completed within 3 s of detection is closed without an action, and the stamp is ignored.
+ */
+void app_trace_stamp(app_trace_stage_t stage);
+
+/**
+ * Format completed-span statistics as JSON: span count, spans closed without an action ("expired"),
+ * per-stage p50/p95/p99/max ms since feed. Returns length.
+ */
+int app_trace_format_json(char *buf, size_t len);
+
+/** Log a per-stage latency table. */
+void app_trace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
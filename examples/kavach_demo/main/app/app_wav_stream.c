@@ -0,0 +1,197 @@
+/*
+ * Streaming WAV reader: RIFF parse + polyphase resample to 48 kHz mono, one block at a time.
+ * Peak memory is two fixed block buffers (allocated once, reused by every prompt), so the first
+ * sample reaches I2S after one block read instead of after the whole file is loaded.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "app_resample.h"
+#include "app_wav_stream.h"
+
+static const char *TAG = "wav_stream";
+
+#define OUT_SAMPLE_RATE     48000   /* I2S/codec rate used for playback */
+#define MAX_CHANNELS        2
+#define OUT_BUF_SAMPLES     ((WAV_STREAM_BLOCK_SAMPLES + APP_RESAMPLE_TAPS) * APP_RESAMPLE_MAX_RATIO + 1)
+
+struct app_wav_stream {
+    FILE *f;
+    size_t remaining;       /* bytes left in the "data" chunk */
+    size_t frame_bytes;     /* channels * 2 */
+    bool flushed;           /* resampler tail already emitted */
+    app_resample_t rs;
+};
+
+static app_wav_stream_t s_stream;
+static bool s_stream_open = false;
+static int16_t *s_in_buf = NULL;     /* WAV_STREAM_BLOCK_SAMPLES interleaved input frames */
+static int16_t *s_out_buf = NULL;    /* one block at the largest ratio, plus the flush tail */
+
+static void *alloc_prefer_psram(size_t size)
+{
+    void *p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p) {
+        p = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return p;
+}
+
+static bool ensure_buffers(void)
+{
+    if (!s_in_buf) {
+        s_in_buf = alloc_prefer_psram(WAV_STREAM_BLOCK_SAMPLES * MAX_CHANNELS * sizeof(int16_t));
+    }
+    if (!s_out_buf) {
+        s_out_buf = alloc_prefer_psram(OUT_BUF_SAMPLES * sizeof(int16_t));
+    }
+    return s_in_buf && s_out_buf;
+}
+
+static inline uint32_t rd_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint16_t rd_le16(const uint8_t *p)
+{
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+/* Walk RIFF chunks from the current position until "data"; fills format fields from "fmt ". */
+static bool wav_seek_data(FILE *f, uint32_t *data_len, uint32_t *sample_rate, uint16_t *bits_per_sample,
+                          uint16_t *channels)
+{
+    uint8_t hdr[12];
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) ||
+        memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    uint32_t sr = 16000;
+    uint16_t bps = 16;
+    uint16_t ch = 1;
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), f) == sizeof(chunk)) {
+        uint32_t chunk_len = rd_le32(chunk + 4);
+        if (memcmp(chunk, "data", 4) == 0) {
+            *data_len = chunk_len;
+            *sample_rate = sr;
+            *bits_per_sample = bps ? bps : 16;
+            *channels = ch ? ch : 1;
+            return true;
+        }
+        uint32_t skip = chunk_len + (chunk_len & 1u);  /* RIFF chunks are word aligned */
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunk_len >= 16) {
+            uint8_t fmt[16];
+            if (fread(fmt, 1, sizeof(fmt), f) != sizeof(fmt)) {
+                return false;
+            }
+            ch = rd_le16(fmt + 2);
+            sr = rd_le32(fmt + 4);
+            bps = rd_le16(fmt + 14);
+            skip -= sizeof(fmt);
+        }
+        if (skip && fseek(f, (long)skip, SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+esp_err_t app_wav_stream_open(const char *path, app_wav_stream_t **out_stream)
+{
+    if (!path || !path[0] || !out_stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_stream_open) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t data_len = 0;
+    uint32_t sample_rate = 16000;
+    uint16_t bits_per_sample = 16;
+    uint16_t channels = 1;
+    if (!wav_seek_data(f, &data_len, &sample_rate, &bits_per_sample, &channels)) {
+        fclose(f);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (bits_per_sample != 16 || channels > MAX_CHANNELS) {
+        ESP_LOGW(TAG, "Skip %s: need 16-bit mono or stereo WAV (file is %u-bit, %u ch).", path,
+                 (unsigned)bits_per_sample, (unsigned)channels);
+        fclose(f);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (!ensure_buffers()) {
+        fclose(f);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Do NOT reconfigure codec sample rate: AFE capture runs at 16 kHz. Changing it causes
+     * I2S conflict ("Pending out channel for in channel running") and "rb_out slow" / crash.
+     * Resample every prompt to the playback rate instead. */
+    memset(&s_stream, 0, sizeof(s_stream));
+    esp_err_t ret = app_resample_init(&s_stream.rs, sample_rate, OUT_SAMPLE_RATE, (uint8_t)channels);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Skip %s: cannot resample %lu Hz to %d Hz. Re-export as 16 kHz WAV.", path,
+                 (unsigned long)sample_rate, OUT_SAMPLE_RATE);
+        fclose(f);
+        return ret;
+    }
+    s_stream.f = f;
+    s_stream.frame_bytes = channels * sizeof(int16_t);
+    s_stream.remaining = data_len - data_len % s_stream.frame_bytes;
+    s_stream_open = true;
+    *out_stream = &s_stream;
+    return ESP_OK;
+}
+
+size_t app_wav_stream_read(app_wav_stream_t *stream, const int16_t **out_pcm)
+{
+    if (!stream || !stream->f || !out_pcm) {
+        return 0;
+    }
+    size_t block_bytes = WAV_STREAM_BLOCK_SAMPLES * stream->frame_bytes;
+    size_t want = stream->remaining < block_bytes ? stream->remaining : block_bytes;
+    /* Little-endian PCM is read straight into int16_t frames (ESP32 is little-endian) */
+    size_t got = want ? fread(s_in_buf, 1, want, stream->f) : 0;
+    got -= got % stream->frame_bytes;
+    stream->remaining = (got < want) ? 0 : stream->remaining - got;
+
+    /* I2S/codec runs at 48 kHz; sending 16 kHz raw would play 3x fast. The resampler keeps its
+     * filter history between calls, so blocks join without a seam. */
+    size_t n_out = app_resample_process(&stream->rs, s_in_buf, got / stream->frame_bytes, s_out_buf, OUT_BUF_SAMPLES);
+
+    /* End of data: drain the filter so the last input samples are heard. */
+    if (stream->remaining == 0 && !stream->flushed) {
+        n_out += app_resample_flush(&stream->rs, s_out_buf + n_out, OUT_BUF_SAMPLES - n_out);
+        stream->flushed = true;
+    }
+    *out_pcm = s_out_buf;
+    return n_out;
+}
+
+size_t app_wav_stream_out_samples(const app_wav_stream_t *stream)
+{
+    if (!stream || !stream->f) {
+        return 0;
+    }
+    return app_resample_out_frames(&stream->rs, stream->remaining / stream->frame_bytes);
+}
+
+void app_wav_stream_close(app_wav_stream_t *stream)
+{
+    if (!stream) {
+        return;
+    }
+    if (stream->f) {
+        fclose(stream->f);
+        stream->f = NULL;
+    }
+    s_stream_open = false;
+}
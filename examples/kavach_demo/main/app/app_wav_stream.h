@@ -0,0 +1,42 @@
+/*
+ * Streaming WAV reader for voice prompts: parses the RIFF header, then reads, downmixes and
+ * resamples the "data" chunk in fixed-size blocks so memory use does not depend on file length.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Input frames read from the file per block; a block yields up to 6x as many output samples. */
+#define WAV_STREAM_BLOCK_SAMPLES  512
+
+typedef struct app_wav_stream app_wav_stream_t;
+
+/**
+ * Open a 16-bit mono/stereo WAV (8 ... 48 kHz, see app_resample.h) and position at its "data" chunk.
+ * Only one stream can be open at a time (block buffers are shared and reused).
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND (no file), ESP_ERR_NOT_SUPPORTED (format), ESP_ERR_INVALID_STATE (busy)
+ */
+esp_err_t app_wav_stream_open(const char *path, app_wav_stream_t **out_stream);
+
+/**
+ * Decode the next block. *out_pcm points into the stream's own buffer and stays valid until the
+ * next read/close. Returns the number of 48 kHz samples in the block, 0 at end of data.
+ */
+size_t app_wav_stream_read(app_wav_stream_t *stream, const int16_t **out_pcm);
+
+/** Upper bound of the 48 kHz samples still to come (for sizing a decode buffer). */
+size_t app_wav_stream_out_samples(const app_wav_stream_t *stream);
+
+/** Close the stream. Block buffers are kept for the next prompt. */
+void app_wav_stream_close(app_wav_stream_t *stream);
+
+#ifdef __cplusplus
+}
+#endif
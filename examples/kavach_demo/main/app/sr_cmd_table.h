@@ -0,0 +1,53 @@
+/*
+ * Built-in voice command table, generated at build time from sr_commands.txt by
+ * tools/gen_sr_cmd_table.py. Per language: an id-indexed array of commands in flash and a minimal
+ * perfect hash (hash and displace, FNV-1a) from phoneme string to id.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "app_sr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const sr_cmd_t *cmds;       /* cmds[i].id == i */
+    uint16_t num;
+    uint16_t buckets;           /* length of seed[] */
+    const uint16_t *seed;       /* per-bucket hash seed, chosen so every phoneme gets its own slot */
+    const uint8_t *slot_id;     /* num entries: hash slot -> command id */
+} sr_cmd_table_t;
+
+extern const sr_cmd_table_t g_sr_cmd_table[SR_LANG_MAX];
+
+/** Seeded FNV-1a; keep in sync with tools/gen_sr_cmd_table.py. */
+static inline uint32_t sr_cmd_hash(const char *key, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    while (*key) {
+        h ^= (uint8_t)*key++;
+        h *= 16777619u;
+    }
+    /* Mix high bits down: FNV's low bits ignore the high bits of each byte (bad for % 2^k) */
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    return h ^ (h >> 13);
+}
+
+/** Id of the built-in command with this phoneme, or -1. */
+static inline int sr_cmd_table_find(const sr_cmd_table_t *table, const char *phoneme)
+{
+    if (table->num == 0) {
+        return -1;
+    }
+    uint16_t seed = table->seed[sr_cmd_hash(phoneme, 0) % table->buckets];
+    uint8_t id = table->slot_id[sr_cmd_hash(phoneme, seed) % table->num];
+    return (0 == strcmp(table->cmds[id].phoneme, phoneme)) ? id : -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
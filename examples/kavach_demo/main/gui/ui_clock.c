@@ -0,0 +1,140 @@
+/*
+ * Sprite clock (see ui_clock.h). One PSRAM allocation holds all sprites back to back. A sprite is as
+ * wide as its glyph's advance (digits and '-' all take the widest digit advance, so the time never
+ * shifts) and as tall as the ink of all CLOCK_GLYPHS together, so a digit's sprite always covers the
+ * one it replaces and the invalidated area is no larger than the digit.
+ */
+#include "ui_clock.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char *TAG = "ui_clock";
+
+#define CLOCK_GLYPHS    "0123456789-:"  /* sprite i shows CLOCK_GLYPHS[i]; digits are their own index */
+#define SPRITE_DASH     10
+#define SPRITE_COLON    11
+#define SPRITE_COUNT    12
+#define CLOCK_CELLS     5               /* H H : M M */
+
+static lv_img_dsc_t g_sprites[SPRITE_COUNT];
+static lv_color_t *g_atlas = NULL;
+static lv_obj_t *g_cells[CLOCK_CELLS];
+static uint8_t g_shown[CLOCK_CELLS];    /* sprite index per cell */
+
+/* Coverage of pixel i of a glyph bitmap (rows packed back to back, MSB first) */
+static lv_opa_t glyph_opa(const uint8_t *bitmap, uint8_t bpp, uint32_t i)
+{
+    uint32_t bit = i * bpp;
+    uint32_t mask = (1u << bpp) - 1;
+    uint32_t v = (bitmap[bit >> 3] >> (8 - bpp - (bit & 7))) & mask;
+    return (lv_opa_t)(v * 255 / mask);
+}
+
+/* Blend the glyph into its sprite, centered in the cell horizontally, on the shared baseline. */
+static void sprite_render(lv_img_dsc_t *sprite, const lv_font_t *font, uint32_t letter,
+                          const lv_font_glyph_dsc_t *g, lv_coord_t ink_top, lv_color_t fg, lv_color_t bg)
+{
+    lv_coord_t w = sprite->header.w;
+    lv_coord_t h = sprite->header.h;
+    lv_color_t *px = (lv_color_t *)sprite->data;
+    for (int32_t i = 0; i < (int32_t)w * h; i++) {
+        px[i] = bg;
+    }
+    const uint8_t *bitmap = g->box_w ? lv_font_get_glyph_bitmap(font, letter) : NULL;
+    if (!bitmap) {
+        return;
+    }
+    lv_coord_t x0 = (w - g->adv_w) / 2 + g->ofs_x;
+    lv_coord_t y0 = (font->line_height - font->base_line) - g->box_h - g->ofs_y - ink_top;
+    for (lv_coord_t y = 0; y < g->box_h; y++) {
+        for (lv_coord_t x = 0; x < g->box_w; x++) {
+            lv_coord_t dx = x0 + x, dy = y0 + y;
+            if (dx >= 0 && dx < w && dy >= 0 && dy < h) {
+                px[dy * w + dx] = lv_color_mix(fg, bg, glyph_opa(bitmap, g->bpp, (uint32_t)y * g->box_w + x));
+            }
+        }
+    }
+}
+
+lv_obj_t *ui_clock_create(lv_obj_t *parent, const lv_font_t *font, lv_color_t fg, lv_color_t bg)
+{
+    lv_font_glyph_dsc_t glyphs[SPRITE_COUNT];
+    lv_coord_t digit_w = 0;
+    lv_coord_t ink_top = LV_COORD_MAX, ink_bottom = LV_COORD_MIN;   /* from the top of the line */
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        lv_font_glyph_dsc_t *g = &glyphs[i];
+        if (!lv_font_get_glyph_dsc(font, g, (uint8_t)CLOCK_GLYPHS[i], 0) ||
+            (g->bpp != 1 && g->bpp != 2 && g->bpp != 4 && g->bpp != 8)) {
+            ESP_LOGW(TAG, "font has no plain '%c' glyph", CLOCK_GLYPHS[i]);
+            return NULL;
+        }
+        if (i != SPRITE_COLON && g->adv_w > digit_w) {
+            digit_w = g->adv_w;
+        }
+        if (g->box_h) {
+            lv_coord_t top = (font->line_height - font->base_line) - g->box_h - g->ofs_y;
+            ink_top = LV_MIN(ink_top, top);
+            ink_bottom = LV_MAX(ink_bottom, top + g->box_h);
+        }
+    }
+    lv_coord_t h = ink_bottom - ink_top;
+    lv_coord_t colon_w = glyphs[SPRITE_COLON].adv_w;
+
+    size_t cell_bytes = (size_t)digit_w * h * sizeof(lv_color_t);
+    size_t total = (SPRITE_COUNT - 1) * cell_bytes + (size_t)colon_w * h * sizeof(lv_color_t);
+    g_atlas = heap_caps_malloc(total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!g_atlas) {
+        ESP_LOGW(TAG, "no PSRAM for %u bytes of clock sprites", (unsigned)total);
+        return NULL;
+    }
+
+    uint8_t *next = (uint8_t *)g_atlas;
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        lv_img_dsc_t *s = &g_sprites[i];
+        s->header.always_zero = 0;
+        s->header.cf = LV_IMG_CF_TRUE_COLOR;
+        s->header.w = i == SPRITE_COLON ? colon_w : digit_w;
+        s->header.h = h;
+        s->data_size = (uint32_t)s->header.w * h * sizeof(lv_color_t);
+        s->data = next;
+        next += s->data_size;
+        sprite_render(s, font, (uint8_t)CLOCK_GLYPHS[i], &glyphs[i], ink_top, fg, bg);
+    }
+
+    lv_obj_t *clock = lv_obj_create(parent);
+    lv_obj_remove_style_all(clock);
+    lv_obj_clear_flag(clock, LV_OBJ_FLAG_SCROLLABLE | LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_set_size(clock, 4 * digit_w + colon_w, h);
+    lv_obj_center(clock);
+    lv_coord_t x = 0;
+    for (int c = 0; c < CLOCK_CELLS; c++) {
+        g_shown[c] = c == 2 ? SPRITE_COLON : SPRITE_DASH;
+        g_cells[c] = lv_img_create(clock);
+        lv_img_set_src(g_cells[c], &g_sprites[g_shown[c]]);
+        lv_obj_set_pos(g_cells[c], x, 0);
+        x += g_sprites[g_shown[c]].header.w;
+    }
+    ESP_LOGI(TAG, "%d sprites, %dx%d px digits, %u bytes of PSRAM", SPRITE_COUNT, (int)digit_w, (int)h,
+             (unsigned)total);
+    return clock;
+}
+
+void ui_clock_set(int hour, int min)
+{
+    if (!g_atlas) {
+        return;
+    }
+    uint8_t want[CLOCK_CELLS] = { SPRITE_DASH, SPRITE_DASH, SPRITE_COLON, SPRITE_DASH, SPRITE_DASH };
+    if (hour >= 0) {
+        want[0] = (uint8_t)(hour / 10 % 10);
+        want[1] = (uint8_t)(hour % 10);
+        want[3] = (uint8_t)(min / 10 % 10);
+        want[4] = (uint8_t)(min % 10);
+    }
+    for (int c = 0; c < CLOCK_CELLS; c++) {
+        if (want[c] != g_shown[c]) {
+            lv_img_set_src(g_cells[c], &g_sprites[want[c]]);   /* invalidates this cell only */
+            g_shown[c] = want[c];
+        }
+    }
+}
@@ -0,0 +1,29 @@
+/*
+ * Sprite clock: HH:MM drawn from digit images rasterised once from a font into PSRAM, instead of a
+ * label that goes through the font renderer on every redraw. Setting a new time swaps the image of
+ * the digits that changed only, so a minute rollover usually redraws and flushes one digit cell.
+ *
+ * Sprites are opaque RGB565 (lv_color_t, so byte-swapped under CONFIG_LV_COLOR_16_SWAP like the
+ * framebuffer), pre-blended over the background colour they are shown on. LVGL task only.
+ */
+#pragma once
+
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Rasterise 0-9, '-' and ':' of font in fg over bg, and create the clock (showing "--:--") centered
+ * in parent. One clock per firmware.
+ * @return the clock object, or NULL if the font lacks a glyph or PSRAM is short (nothing created)
+ */
+lv_obj_t *ui_clock_create(lv_obj_t *parent, const lv_font_t *font, lv_color_t fg, lv_color_t bg);
+
+/** Show hour:min (hour < 0: "--:--"). Invalidates only the digits that change. */
+void ui_clock_set(int hour, int min);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,21 +1,27 @@
 /*
  * Kavach UI: desktop clock when idle (big time + temp/hum); voice mode when wake word
  * detected (time moves to top-right, status and indicator center).
+ *
+ * Other tasks never touch LVGL objects: every kavach_ui_* setter copies a ui_cmd_t into a lock-free
+ * queue (kmpsc) and the LVGL task applies the commands in order in ui_cmd_drain_cb(). The first
+ * command after a drain makes the drain timer due, so it runs on the next LVGL pass.
  */
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/time.h>
 #include "ui_kavach.h"
+#include "ui_theme.h"
+#include "ui_clock.h"
 #include "app_sr_handler.h"
+#include "app_alert.h"
+#include "kmpsc.h"
 #include "lvgl.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "bsp_board.h"
 
-LV_FONT_DECLARE(font_en_12);
-LV_FONT_DECLARE(font_en_24);
-LV_FONT_DECLARE(font_en_64);
-LV_FONT_DECLARE(font_en_bold_36);
-
 static const char *TAG = "ui_kavach";
 
 static lv_obj_t *g_status_label = NULL;
@@ -25,230 +31,292 @@ static lv_obj_t *g_temp_label = NULL;
 static lv_obj_t *g_hum_label = NULL;
 static lv_obj_t *g_time_label = NULL;
 static lv_obj_t *g_time_panel = NULL;
+static lv_obj_t *g_clock = NULL;            /* sprite clock (clock layout); NULL: g_time_label in both */
+static time_t g_clock_minute = -1;          /* minute (epoch / 60) on g_time_label and g_clock */
 static lv_obj_t *g_temp_card = NULL;
 static lv_obj_t *g_hum_card = NULL;
 static lv_timer_t *g_temp_hum_timer = NULL;
 static lv_timer_t *g_clock_timer = NULL;
-static lv_timer_t *g_flash_poll_timer = NULL;
+static lv_timer_t *g_cmd_drain_timer = NULL;
 static bool g_voice_mode = false;
-static volatile bool g_trigger_alert_flash = false;
-static volatile bool g_trigger_gas_alert = false;
-static volatile bool g_trigger_intruder_alert = false;
-#define PENDING_STATUS_LEN 64
-#define IR_STATUS_MAX_WIDTH 280
-#define OVERLAY_LABEL_MAX_W 280  /* max width for overlay labels so text wraps on screen */
-static char g_pending_status_buf[PENDING_STATUS_LEN];
-static volatile bool g_pending_status_ready = false;
-static volatile bool g_pending_status_ir_style = false;  /* use small font + wrap for IR messages */
-static volatile int g_pending_light = -1;  /* -1 = none, else kavach_light_t */
+static ui_layout_t g_layout = UI_LAYOUT_CLOCK;
+static lv_style_t *g_status_font = NULL;    /* ui_theme.status_big or status_small */
+static kavach_light_t g_light_state = KAVACH_LIGHT_IDLE;
+#define STATUS_TEXT_LEN 64
+
+/* UI commands from any task, applied by the LVGL task in order */
+typedef enum {
+    UI_CMD_STATUS,          /* text, flags */
+    UI_CMD_LIGHT,           /* arg: kavach_light_t, flags */
+    UI_CMD_MODE,            /* arg: 1 = voice mode, 0 = clock mode */
+    UI_CMD_ALERT_SHOW,      /* arg: ui_alert_t */
+    UI_CMD_ALERT_HIDE,      /* arg: ui_alert_t */
+} ui_cmd_type_t;
+
+typedef enum {
+    UI_ALERT_EMERGENCY,     /* red flash, 1.2 s */
+    UI_ALERT_GAS,           /* gas leak, until cleared or tapped */
+    UI_ALERT_INTRUDER,      /* motion outside, 3 s */
+    UI_ALERT_MAX,
+} ui_alert_t;
+
+#define UI_CMD_F_REVEAL     0x01    /* switch to voice mode first, so status and light are visible */
+#define UI_CMD_F_IR_STYLE   0x02    /* status: small font + wrap for long IR learn messages */
+
+typedef struct {
+    uint8_t type;
+    uint8_t arg;
+    uint8_t flags;
+    int64_t posted_us;      /* when posted (on-screen latency log) */
+    char text[STATUS_TEXT_LEN];
+} ui_cmd_t;
+
+#define UI_CMD_QUEUE_LEN    16      /* a voice command posts 3; bursts come from SR + MQTT + IR learn */
+#define UI_CMD_IDLE_MS      500     /* drain timer period when no wake-up got through (safety net) */
+#define UI_WAKE_LOCK_MS     20      /* longest a producer waits for the LVGL lock to wake the drain */
+
+static KMPSC_STORAGE(g_cmd_storage, UI_CMD_QUEUE_LEN, sizeof(ui_cmd_t));
+static kmpsc_t g_cmd_queue = KMPSC_INITIALIZER(g_cmd_storage, UI_CMD_QUEUE_LEN, sizeof(ui_cmd_t));
+static atomic_bool g_cmd_wake_pending = false;  /* drain already made due; later producers skip the lock */
+static uint32_t g_cmd_overflows_logged = 0;
 
 static void temp_hum_timer_cb(lv_timer_t *timer);
 static void clock_timer_cb(lv_timer_t *timer);
-static void apply_clock_mode(void);
-static void apply_voice_mode(void);
-static void alert_flash_restore_cb(lv_timer_t *timer);
-static void alert_flash_poll_cb(lv_timer_t *timer);
-
-/* Dark theme with teal accent: readable and visually distinct. */
-#define COLOR_BG            0x1A2332u   /* dark blue-grey background */
-#define COLOR_ALERT_FLASH   0x9B0000u   /* deep red for alerts */
-#define COLOR_CARD          0x243447u   /* card: slightly lighter than bg */
-#define COLOR_CARD_BORDER   0x26A69Au   /* teal accent border */
-#define COLOR_ACCENT        0x4DD0E1u   /* bright cyan for highlights */
-#define COLOR_TEXT          0xFFFFFFu   /* primary text */
-#define COLOR_TEXT_DIM      0xB0BEC5u   /* secondary: soft grey, still readable */
-#define COLOR_CLOCK         0x4DD0E1u   /* time in cyan – stands out, not harsh */
-#define COLOR_TITLE         0x80DEEAu   /* title: light cyan */
-
-static const uint32_t light_colors[KAVACH_LIGHT_MAX] = {
-    [KAVACH_LIGHT_IDLE]       = 0x78909Cu,  /* blue-grey */
-    [KAVACH_LIGHT_LISTENING]  = 0x69F0AEu,  /* bright teal-green */
-    [KAVACH_LIGHT_COMMAND_OK] = 0x40C4FFu,  /* bright cyan-blue */
-    [KAVACH_LIGHT_ALERT]      = 0xFF5252u,  /* bright red */
-};
+static void alerts_build(lv_obj_t *scr);
+static void ui_cmd_drain_cb(lv_timer_t *timer);
 
-void kavach_ui_set_voice_mode(bool voice_mode)
+/*
+ * On-screen latency: from the request (posted_us) to the end of the first flush that drew the
+ * change (display monitor_cb), logged with LVGL's render time and the internal heap state
+ * (LV_MEM_CUSTOM: LVGL objects are in the internal heap, below SPIRAM_MALLOC_ALWAYSINTERNAL).
+ */
+static int64_t g_measure_us = 0;            /* 0: nothing to measure */
+static const char *g_measure_what = NULL;
+static void (*g_prev_monitor_cb)(lv_disp_drv_t *drv, uint32_t time_ms, uint32_t px);
+
+static void measure_start(const char *what, int64_t posted_us)
 {
-    if (g_voice_mode == voice_mode) {
-        return;
-    }
-    g_voice_mode = voice_mode;
-    if (voice_mode) {
-        apply_voice_mode();
-    } else {
-        apply_clock_mode();
-    }
+    g_measure_us = posted_us;
+    g_measure_what = what;
 }
 
-static void apply_clock_mode(void)
+/*
+ * Clock mode cost, logged for every hour spent in clock mode: CPU time of LVGL's display refresh
+ * timer (render and flush, wrapped in measure_init()) and of clock_timer_cb(), and the bytes sent
+ * to the panel (monitor_cb pixels, RGB565).
+ */
+#define CLOCK_STATS_PERIOD_US   (3600LL * 1000 * 1000)
+
+static struct {
+    int64_t start_us;           /* 0: not in clock mode */
+    int64_t refresh_us;
+    int64_t tick_us;
+    uint64_t flush_px;
+    uint32_t refreshes;
+} g_clock_stats;
+static lv_timer_cb_t g_refr_timer_cb = NULL;
+
+static void clock_stats_start(bool clock_mode)
 {
-    /* Desktop clock: big time center, temp/hum below */
-    if (g_time_panel) {
-        lv_obj_set_size(g_time_panel, 260, 110);
-        lv_obj_align(g_time_panel, LV_ALIGN_CENTER, 0, -30);
-    }
-    if (g_time_label) {
-        lv_obj_set_style_text_font(g_time_label, &font_en_64, LV_PART_MAIN);
-        lv_obj_center(g_time_label);
-    }
-    if (g_status_label) {
-        lv_obj_add_flag(g_status_label, LV_OBJ_FLAG_HIDDEN);
+    memset(&g_clock_stats, 0, sizeof(g_clock_stats));
+    g_clock_stats.start_us = clock_mode ? esp_timer_get_time() : 0;
+}
+
+static void clock_stats_refr_cb(lv_timer_t *timer)
+{
+    int64_t t0 = esp_timer_get_time();
+    g_refr_timer_cb(timer);
+    if (g_clock_stats.start_us) {
+        g_clock_stats.refresh_us += esp_timer_get_time() - t0;
     }
-    if (g_light_indicator) {
-        lv_obj_add_flag(g_light_indicator, LV_OBJ_FLAG_HIDDEN);
+}
+
+static void clock_stats_log_if_due(int64_t now_us)
+{
+    if (!g_clock_stats.start_us || now_us - g_clock_stats.start_us < CLOCK_STATS_PERIOD_US) {
+        return;
     }
-    if (g_title_label) {
-        lv_obj_clear_flag(g_title_label, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_set_style_text_font(g_title_label, &font_en_24, LV_PART_MAIN);
-        lv_obj_align(g_title_label, LV_ALIGN_TOP_MID, 0, 10);
+    int64_t cpu_us = g_clock_stats.refresh_us + g_clock_stats.tick_us;
+    ESP_LOGI(TAG, "clock mode, last hour: %lu.%d ms CPU (display refresh %lu ms, clock tick %lu ms), "
+             "%u refreshes, %lu KiB flushed",
+             (unsigned long)(cpu_us / 1000), (int)(cpu_us % 1000) / 100,
+             (unsigned long)(g_clock_stats.refresh_us / 1000), (unsigned long)(g_clock_stats.tick_us / 1000),
+             (unsigned)g_clock_stats.refreshes,
+             (unsigned long)(g_clock_stats.flush_px * sizeof(lv_color_t) / 1024));
+    clock_stats_start(true);
+}
+
+static void measure_monitor_cb(lv_disp_drv_t *drv, uint32_t time_ms, uint32_t px)
+{
+    if (g_prev_monitor_cb) {
+        g_prev_monitor_cb(drv, time_ms, px);
     }
-    if (g_temp_card) {
-        lv_obj_clear_flag(g_temp_card, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_align(g_temp_card, LV_ALIGN_CENTER, -75, 72);
+    if (g_clock_stats.start_us) {
+        g_clock_stats.refreshes++;
+        g_clock_stats.flush_px += px;
     }
-    if (g_hum_card) {
-        lv_obj_clear_flag(g_hum_card, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_align(g_hum_card, LV_ALIGN_CENTER, 75, 72);
+    if (!g_measure_us) {
+        return;
     }
+    int64_t us = esp_timer_get_time() - g_measure_us;
+    g_measure_us = 0;
+    size_t free_b = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_LOGI(TAG, "%s on screen %lu.%d ms after request (render %u ms, %u px); "
+             "internal heap %u free, largest block %u (%u%% fragmented)",
+             g_measure_what, (unsigned long)(us / 1000), (int)(us % 1000) / 100, (unsigned)time_ms,
+             (unsigned)px, (unsigned)free_b, (unsigned)largest,
+             free_b ? (unsigned)(100 - largest * 100 / free_b) : 0u);
 }
 
-static void apply_voice_mode(void)
+static void measure_init(void)
 {
-    /* Voice mode: time top-right small, status and indicator center */
-    if (g_time_panel) {
-        lv_obj_set_size(g_time_panel, 100, 44);
-        lv_obj_align(g_time_panel, LV_ALIGN_TOP_RIGHT, -12, 10);
-    }
-    if (g_time_label) {
-        lv_obj_set_style_text_font(g_time_label, &font_en_24, LV_PART_MAIN);
-        lv_obj_center(g_time_label);
-    }
-    if (g_status_label) {
-        lv_obj_clear_flag(g_status_label, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_set_style_text_align(g_status_label, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-        lv_obj_align(g_status_label, LV_ALIGN_CENTER, 0, -28);
+    lv_disp_t *disp = lv_disp_get_default();
+    if (disp && disp->driver) {
+        g_prev_monitor_cb = disp->driver->monitor_cb;
+        disp->driver->monitor_cb = measure_monitor_cb;
     }
-    if (g_light_indicator) {
-        lv_obj_clear_flag(g_light_indicator, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_align(g_light_indicator, LV_ALIGN_CENTER, 0, 28);
+    if (disp && disp->refr_timer) {
+        g_refr_timer_cb = disp->refr_timer->timer_cb;
+        disp->refr_timer->timer_cb = clock_stats_refr_cb;
     }
-    if (g_title_label) {
-        lv_obj_clear_flag(g_title_label, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_set_style_text_font(g_title_label, &font_en_24, LV_PART_MAIN);
-        lv_obj_align(g_title_label, LV_ALIGN_TOP_LEFT, 12, 10);
+    clock_stats_start(!g_voice_mode);
+}
+
+static void set_hidden(lv_obj_t *obj, bool hidden)
+{
+    if (hidden) {
+        lv_obj_add_flag(obj, LV_OBJ_FLAG_HIDDEN);
+    } else {
+        lv_obj_clear_flag(obj, LV_OBJ_FLAG_HIDDEN);
     }
-    /* Hide temp and humidity in voice mode */
-    if (g_temp_card) {
-        lv_obj_add_flag(g_temp_card, LV_OBJ_FLAG_HIDDEN);
+}
+
+/* Replace one of obj's shared styles with another (a no-op if they are the same). */
+static void swap_style(lv_obj_t *obj, lv_style_t *from, lv_style_t *to)
+{
+    if (from != to) {
+        lv_obj_remove_style(obj, from, LV_PART_MAIN);
+        lv_obj_add_style(obj, to, LV_PART_MAIN);
     }
-    if (g_hum_card) {
-        lv_obj_add_flag(g_hum_card, LV_OBJ_FLAG_HIDDEN);
+}
+
+/* Clock: big time center, temp/hum below. Voice: time top-right small, status and indicator center. */
+static void apply_layout(ui_layout_t layout)
+{
+    ui_layout_styles_t *from = &ui_theme.layout[g_layout];
+    ui_layout_styles_t *to = &ui_theme.layout[layout];
+    swap_style(g_title_label, &from->title, &to->title);
+    swap_style(g_time_panel, &from->time_panel, &to->time_panel);
+    swap_style(g_time_label, &from->time_label, &to->time_label);
+    g_layout = layout;
+
+    bool voice = layout == UI_LAYOUT_VOICE;
+    if (g_clock) {
+        set_hidden(g_clock, voice);
+        set_hidden(g_time_label, !voice);
+    }
+    set_hidden(g_status_label, !voice);
+    set_hidden(g_light_indicator, !voice);
+    set_hidden(g_temp_card, voice);
+    set_hidden(g_hum_card, voice);
+}
+
+/* posted_us: when the change was asked for, for the on-screen latency log */
+static void set_mode(bool voice_mode, int64_t posted_us)
+{
+    if (g_voice_mode == voice_mode) {
+        return;
     }
+    g_voice_mode = voice_mode;
+    apply_layout(voice_mode ? UI_LAYOUT_VOICE : UI_LAYOUT_CLOCK);
+    measure_start(voice_mode ? "voice mode" : "clock mode", posted_us);
+    clock_stats_start(!voice_mode);
+}
+
+/* Temp / humidity card: value on top, small caption directly under */
+static lv_obj_t *card_create(lv_obj_t *scr, lv_style_t *pos, const char *caption, lv_obj_t **value)
+{
+    lv_obj_t *card = lv_obj_create(scr);
+    lv_obj_add_style(card, &ui_theme.card, LV_PART_MAIN);
+    lv_obj_add_style(card, pos, LV_PART_MAIN);
+    lv_obj_set_scrollbar_mode(card, LV_SCROLLBAR_MODE_OFF);
+
+    *value = lv_label_create(card);
+    lv_obj_add_style(*value, &ui_theme.card_value, LV_PART_MAIN);
+
+    lv_obj_t *lab = lv_label_create(card);
+    lv_label_set_text_static(lab, caption);
+    lv_obj_add_style(lab, &ui_theme.card_caption, LV_PART_MAIN);
+    return card;
 }
 
 void kavach_ui_start(void)
 {
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ui_theme_init();
+
     lv_obj_t *scr = lv_scr_act();
-    lv_obj_set_style_bg_color(scr, lv_color_hex(COLOR_BG), LV_PART_MAIN);
+    lv_obj_add_style(scr, &ui_theme.screen, LV_PART_MAIN);
     lv_obj_set_scrollbar_mode(scr, LV_SCROLLBAR_MODE_OFF);
     lv_obj_set_scroll_dir(scr, LV_DIR_NONE);
 
-    /* Title – same font (en_24) in both clock and voice mode; position set in apply_*_mode */
+    /* Objects that move get the clock layout style here; apply_layout() swaps it */
+    ui_layout_styles_t *clock = &ui_theme.layout[UI_LAYOUT_CLOCK];
+    g_layout = UI_LAYOUT_CLOCK;
+
     g_title_label = lv_label_create(scr);
     lv_label_set_text_static(g_title_label, "Kavach");
-    lv_obj_set_style_text_font(g_title_label, &font_en_24, LV_PART_MAIN);
-    lv_obj_set_style_text_color(g_title_label, lv_color_hex(COLOR_TITLE), LV_PART_MAIN);
+    lv_obj_add_style(g_title_label, &ui_theme.title, LV_PART_MAIN);
+    lv_obj_add_style(g_title_label, &clock->title, LV_PART_MAIN);
 
-    /* Time panel – size/position set by mode */
     g_time_panel = lv_obj_create(scr);
     lv_obj_set_scrollbar_mode(g_time_panel, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_bg_color(g_time_panel, lv_color_hex(COLOR_CARD), LV_PART_MAIN);
-    lv_obj_set_style_radius(g_time_panel, 16, LV_PART_MAIN);
-    lv_obj_set_style_shadow_width(g_time_panel, 12, LV_PART_MAIN);
-    lv_obj_set_style_shadow_color(g_time_panel, lv_color_hex(0x000000), LV_PART_MAIN);
-    lv_obj_set_style_shadow_opa(g_time_panel, LV_OPA_20, LV_PART_MAIN);
-    lv_obj_set_style_border_width(g_time_panel, 2, LV_PART_MAIN);
-    lv_obj_set_style_border_color(g_time_panel, lv_color_hex(COLOR_CARD_BORDER), LV_PART_MAIN);
+    lv_obj_add_style(g_time_panel, &ui_theme.time_panel, LV_PART_MAIN);
+    lv_obj_add_style(g_time_panel, &clock->time_panel, LV_PART_MAIN);
 
     g_time_label = lv_label_create(g_time_panel);
     lv_label_set_text_static(g_time_label, "--:--");
-    lv_obj_set_style_text_color(g_time_label, lv_color_hex(COLOR_CLOCK), LV_PART_MAIN);
-    g_clock_timer = lv_timer_create(clock_timer_cb, 1000, (void *)g_time_label);
+    lv_obj_add_style(g_time_label, &ui_theme.time_label, LV_PART_MAIN);
+    lv_obj_add_style(g_time_label, &clock->time_label, LV_PART_MAIN);
+    /* Big clock from pre-rendered digits; without PSRAM for them the label stays in both layouts */
+    g_clock = ui_clock_create(g_time_panel, ui_theme.clock_font, lv_color_hex(COLOR_CLOCK),
+                              lv_color_hex(COLOR_CARD));
+    g_clock_timer = lv_timer_create(clock_timer_cb, 1000, NULL);
     lv_timer_set_repeat_count(g_clock_timer, -1);
     clock_timer_cb(g_clock_timer);
 
     /* Status and light – shown only in voice mode */
     g_status_label = lv_label_create(scr);
     lv_label_set_text_static(g_status_label, "Ready");
-    lv_obj_set_style_text_font(g_status_label, &font_en_bold_36, LV_PART_MAIN);
-    lv_obj_set_style_text_color(g_status_label, lv_color_hex(COLOR_TEXT), LV_PART_MAIN);
-    lv_obj_set_style_text_align(g_status_label, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
+    lv_label_set_long_mode(g_status_label, LV_LABEL_LONG_WRAP);
+    lv_obj_add_style(g_status_label, &ui_theme.status, LV_PART_MAIN);
+    g_status_font = &ui_theme.status_big;
+    lv_obj_add_style(g_status_label, g_status_font, LV_PART_MAIN);
 
     g_light_indicator = lv_obj_create(scr);
-    lv_obj_set_size(g_light_indicator, 52, 52);
-    lv_obj_set_style_radius(g_light_indicator, LV_RADIUS_CIRCLE, LV_PART_MAIN);
-    lv_obj_set_style_bg_color(g_light_indicator, lv_color_hex(light_colors[KAVACH_LIGHT_IDLE]), LV_PART_MAIN);
-    lv_obj_set_style_border_width(g_light_indicator, 0, LV_PART_MAIN);
-    lv_obj_set_style_shadow_width(g_light_indicator, 14, LV_PART_MAIN);
-    lv_obj_set_style_shadow_color(g_light_indicator, lv_color_hex(light_colors[KAVACH_LIGHT_IDLE]), LV_PART_MAIN);
-
-    /* Temp card: numbers on top, small label directly under */
-    g_temp_card = lv_obj_create(scr);
-    lv_obj_set_size(g_temp_card, 110, 64);
-    lv_obj_set_style_bg_color(g_temp_card, lv_color_hex(COLOR_CARD), LV_PART_MAIN);
-    lv_obj_set_style_radius(g_temp_card, 12, LV_PART_MAIN);
-    lv_obj_set_style_shadow_width(g_temp_card, 6, LV_PART_MAIN);
-    lv_obj_set_style_shadow_color(g_temp_card, lv_color_hex(0x000000), LV_PART_MAIN);
-    lv_obj_set_style_shadow_opa(g_temp_card, LV_OPA_20, LV_PART_MAIN);
-    lv_obj_set_style_border_width(g_temp_card, 2, LV_PART_MAIN);
-    lv_obj_set_style_border_color(g_temp_card, lv_color_hex(COLOR_CARD_BORDER), LV_PART_MAIN);
-    lv_obj_set_scrollbar_mode(g_temp_card, LV_SCROLLBAR_MODE_OFF);
-
-    g_temp_label = lv_label_create(g_temp_card);
-    lv_label_set_text_static(g_temp_label, "-- °C");
-    lv_obj_set_style_text_font(g_temp_label, &font_en_24, LV_PART_MAIN);
-    lv_obj_set_style_text_color(g_temp_label, lv_color_hex(COLOR_TEXT), LV_PART_MAIN);
-    lv_obj_align(g_temp_label, LV_ALIGN_TOP_MID, 0, 4);
-
-    lv_obj_t *temp_lab = lv_label_create(g_temp_card);
-    lv_label_set_text_static(temp_lab, "Temp");
-    lv_obj_set_style_text_font(temp_lab, &font_en_12, LV_PART_MAIN);
-    lv_obj_set_style_text_color(temp_lab, lv_color_hex(COLOR_TEXT_DIM), LV_PART_MAIN);
-    lv_obj_align(temp_lab, LV_ALIGN_TOP_MID, 0, 34);
-
-    /* Hum card: numbers on top, small label directly under */
-    g_hum_card = lv_obj_create(scr);
-    lv_obj_set_size(g_hum_card, 110, 64);
-    lv_obj_set_style_bg_color(g_hum_card, lv_color_hex(COLOR_CARD), LV_PART_MAIN);
-    lv_obj_set_style_radius(g_hum_card, 12, LV_PART_MAIN);
-    lv_obj_set_style_shadow_width(g_hum_card, 6, LV_PART_MAIN);
-    lv_obj_set_style_shadow_color(g_hum_card, lv_color_hex(0x000000), LV_PART_MAIN);
-    lv_obj_set_style_shadow_opa(g_hum_card, LV_OPA_20, LV_PART_MAIN);
-    lv_obj_set_style_border_width(g_hum_card, 2, LV_PART_MAIN);
-    lv_obj_set_style_border_color(g_hum_card, lv_color_hex(COLOR_CARD_BORDER), LV_PART_MAIN);
-    lv_obj_set_scrollbar_mode(g_hum_card, LV_SCROLLBAR_MODE_OFF);
-
-    g_hum_label = lv_label_create(g_hum_card);
-    lv_label_set_text_static(g_hum_label, "--%");
-    lv_obj_set_style_text_font(g_hum_label, &font_en_24, LV_PART_MAIN);
-    lv_obj_set_style_text_color(g_hum_label, lv_color_hex(COLOR_TEXT), LV_PART_MAIN);
-    lv_obj_align(g_hum_label, LV_ALIGN_TOP_MID, 0, 4);
-
-    lv_obj_t *hum_lab = lv_label_create(g_hum_card);
-    lv_label_set_text_static(hum_lab, "Humidity");
-    lv_obj_set_style_text_font(hum_lab, &font_en_12, LV_PART_MAIN);
-    lv_obj_set_style_text_color(hum_lab, lv_color_hex(COLOR_TEXT_DIM), LV_PART_MAIN);
-    lv_obj_align(hum_lab, LV_ALIGN_TOP_MID, 0, 34);
+    lv_obj_add_style(g_light_indicator, &ui_theme.light, LV_PART_MAIN);
+    g_light_state = KAVACH_LIGHT_IDLE;
+    lv_obj_add_style(g_light_indicator, &ui_theme.light_state[g_light_state], LV_PART_MAIN);
+
+    g_temp_card = card_create(scr, &ui_theme.card_left, "Temp", &g_temp_label);
+    g_hum_card = card_create(scr, &ui_theme.card_right, "Humidity", &g_hum_label);
 
     g_temp_hum_timer = lv_timer_create(temp_hum_timer_cb, 3000, NULL);
     lv_timer_set_repeat_count(g_temp_hum_timer, -1);
     temp_hum_timer_cb(g_temp_hum_timer);
 
     g_voice_mode = false;
-    apply_clock_mode();
+    apply_layout(UI_LAYOUT_CLOCK);
+
+    /* Alert overlays, hidden until triggered */
+    alerts_build(scr);
+    measure_init();
 
-    g_flash_poll_timer = lv_timer_create(alert_flash_poll_cb, 150, NULL);
-    lv_timer_set_repeat_count(g_flash_poll_timer, -1);
+    /* Commands posted before this point are waiting in the queue: run the first drain right away */
+    g_cmd_drain_timer = lv_timer_create(ui_cmd_drain_cb, UI_CMD_IDLE_MS, NULL);
+    lv_timer_set_repeat_count(g_cmd_drain_timer, -1);
+    lv_timer_ready(g_cmd_drain_timer);
 
     /* ========== TEMPORARY: display one image from SPIFFS ==========
      * Put img1.png in spiffs/ folder, then: idf.py build flash (full flash).
@@ -258,7 +326,9 @@ void kavach_ui_start(void)
     lv_obj_align(img1, LV_ALIGN_CENTER, 0, 0);
     /* ========== END TEMPORARY ========== */
 
-    ESP_LOGI(TAG, "Kavach UI started (clock + voice modes)");
+    size_t heap_after = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_LOGI(TAG, "Kavach UI started (clock + voice modes), %d bytes of internal heap",
+             (int)(heap_before - heap_after));
 }
 
 void kavach_ui_splash_finish(void)
@@ -266,271 +336,320 @@ void kavach_ui_splash_finish(void)
     /* Splash removed; no-op for compatibility with main.c */
 }
 
+/* Every second (SNTP may step the time), but the time is only redrawn when the minute changes.
+ * Time zone offsets are whole minutes, so epoch minutes roll over with local ones. */
 static void clock_timer_cb(lv_timer_t *timer)
 {
-    lv_obj_t *lab_time = (lv_obj_t *)timer->user_data;
-    if (!lab_time) {
+    (void)timer;
+    int64_t t0 = esp_timer_get_time();
+    time_t now = time(NULL);
+    if (now / 60 != g_clock_minute) {
+        g_clock_minute = now / 60;
+        struct tm timeinfo;
+        localtime_r(&now, &timeinfo);
+        lv_label_set_text_fmt(g_time_label, "%02u:%02u", (unsigned)timeinfo.tm_hour, (unsigned)timeinfo.tm_min);
+        ui_clock_set(timeinfo.tm_hour, timeinfo.tm_min);
+    }
+    if (g_clock_stats.start_us) {
+        int64_t t1 = esp_timer_get_time();
+        g_clock_stats.tick_us += t1 - t0;
+        clock_stats_log_if_due(t1);
+    }
+}
+
+/*
+ * Alert overlays: one full-screen red panel per alert, built hidden by alerts_build() and only
+ * shown / hidden afterwards, so an alert costs no allocation or style setup. Background, fonts,
+ * colour and wrap widths are ui_theme styles; only positions are per label.
+ */
+#define ALERT_LINES_MAX     4
+
+typedef struct {
+    lv_style_t *font;           /* ui_theme.alert_36 / _24 / _12 */
+    lv_style_t *width;          /* wrap width; NULL: one line at natural width */
+    lv_align_t align;
+    lv_coord_t y;
+    const char *text;
+} alert_line_t;
+
+typedef struct {
+    const char *name;
+    uint32_t hide_ms;           /* 0: until kavach_ui_clear_*() or tapped */
+    bool back_to_clock;         /* clock mode when it goes away */
+    alert_line_t lines[ALERT_LINES_MAX];
+} alert_spec_t;
+
+static const alert_spec_t alert_specs[UI_ALERT_MAX] = {
+    [UI_ALERT_EMERGENCY] = { "emergency alert", 1200, false, {
+        { &ui_theme.alert_36, &ui_theme.alert_w_wide, LV_ALIGN_TOP_MID, 50, "Emergency" },
+        { &ui_theme.alert_36, &ui_theme.alert_w_wide, LV_ALIGN_CENTER, -10, "Message sent" },
+        { &ui_theme.alert_24, &ui_theme.alert_w_wide, LV_ALIGN_CENTER, 32, "Help has been notified" },
+    } },
+    [UI_ALERT_GAS] = { "gas alert", 0, true, {
+        { &ui_theme.alert_36, &ui_theme.alert_w_narrow, LV_ALIGN_TOP_MID, 24, "GAS LEAK!" },
+        { &ui_theme.alert_24, &ui_theme.alert_w_narrow, LV_ALIGN_CENTER, -4, "Clear the kitchen" },
+        { &ui_theme.alert_24, &ui_theme.alert_w_narrow, LV_ALIGN_CENTER, 28, "Ventilate now! Open windows." },
+        { &ui_theme.alert_12, NULL, LV_ALIGN_BOTTOM_MID, -12, "Tap to silence" },
+    } },
+    [UI_ALERT_INTRUDER] = { "intruder alert", 3000, true, {
+        { &ui_theme.alert_24, &ui_theme.alert_w_narrow, LV_ALIGN_TOP_MID, 24, "INTRUDER ALERT" },
+        { &ui_theme.alert_24, &ui_theme.alert_w_narrow, LV_ALIGN_CENTER, -4, "Motion detected outside" },
+    } },
+};
+
+typedef struct {
+    lv_obj_t *obj;
+    lv_timer_t *hide_timer;     /* paused while hidden; NULL if hide_ms is 0 */
+} alert_overlay_t;
+
+static alert_overlay_t g_alerts[UI_ALERT_MAX];
+
+static void alert_hide(ui_alert_t kind, int64_t posted_us)
+{
+    alert_overlay_t *ov = &g_alerts[kind];
+    if (!ov->obj || lv_obj_has_flag(ov->obj, LV_OBJ_FLAG_HIDDEN)) {
         return;
     }
-    time_t now;
-    struct tm timeinfo;
-    time(&now);
-    localtime_r(&now, &timeinfo);
-    lv_label_set_text_fmt(lab_time, "%02u:%02u", (unsigned)timeinfo.tm_hour, (unsigned)timeinfo.tm_min);
+    lv_obj_add_flag(ov->obj, LV_OBJ_FLAG_HIDDEN);
+    if (ov->hide_timer) {
+        lv_timer_pause(ov->hide_timer);
+    }
+    if (alert_specs[kind].back_to_clock) {
+        set_mode(false, posted_us);
+    }
+}
+
+/* Shown for hide_ms: hide (paused again until the next show) */
+static void alert_hide_timer_cb(lv_timer_t *timer)
+{
+    alert_hide((ui_alert_t)(uintptr_t)timer->user_data, esp_timer_get_time());
+}
+
+/* Tap on the gas overlay: silence the alarm; the alert manager then hides the overlay. */
+static void gas_alert_clicked_cb(lv_event_t *e)
+{
+    (void)e;
+    app_alert_dismiss(APP_ALERT_GAS);
 }
 
-static void alert_flash_restore_cb(lv_timer_t *timer)
+/* Shown again while up: to the front, and its hide_ms starts over. */
+static void alert_show(ui_alert_t kind, int64_t posted_us)
 {
-    lv_obj_t *overlay = (lv_obj_t *)timer->user_data;
-    if (overlay) {
-        lv_obj_del(overlay);
+    alert_overlay_t *ov = &g_alerts[kind];
+    if (!ov->obj) {
+        return;
+    }
+    lv_obj_clear_flag(ov->obj, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_move_foreground(ov->obj);
+    if (ov->hide_timer) {
+        lv_timer_reset(ov->hide_timer);
+        lv_timer_resume(ov->hide_timer);
     }
-    lv_timer_del(timer);
+    measure_start(alert_specs[kind].name, posted_us);
 }
 
-/* Gas overlay dismiss: stop alarm audio, remove overlay, return to clock mode. */
-static void gas_alert_restore_cb(lv_timer_t *timer)
+static void alerts_build(lv_obj_t *scr)
 {
-    sr_handler_stop_gas_alarm();  /* stop gas_alarm.wav so it only plays while screen is up */
-    lv_obj_t *overlay = (lv_obj_t *)timer->user_data;
-    if (overlay) {
-        lv_obj_del(overlay);
+    for (int kind = 0; kind < UI_ALERT_MAX; kind++) {
+        const alert_spec_t *spec = &alert_specs[kind];
+        lv_obj_t *overlay = lv_obj_create(scr);
+        lv_obj_add_style(overlay, &ui_theme.alert_bg, LV_PART_MAIN);
+        lv_obj_clear_flag(overlay, LV_OBJ_FLAG_SCROLLABLE);
+        lv_obj_add_flag(overlay, LV_OBJ_FLAG_HIDDEN);
+
+        for (int i = 0; i < ALERT_LINES_MAX && spec->lines[i].text; i++) {
+            const alert_line_t *line = &spec->lines[i];
+            lv_obj_t *label = lv_label_create(overlay);
+            lv_obj_add_style(label, line->font, LV_PART_MAIN);
+            if (line->width) {
+                lv_obj_add_style(label, line->width, LV_PART_MAIN);
+                lv_label_set_long_mode(label, LV_LABEL_LONG_WRAP);
+            }
+            lv_label_set_text_static(label, line->text);
+            lv_obj_align(label, line->align, 0, line->y);
+        }
+
+        if (kind == UI_ALERT_GAS) {
+            lv_obj_add_event_cb(overlay, gas_alert_clicked_cb, LV_EVENT_CLICKED, NULL);
+        }
+        g_alerts[kind].obj = overlay;
+        if (spec->hide_ms) {
+            lv_timer_t *t = lv_timer_create(alert_hide_timer_cb, spec->hide_ms, (void *)(uintptr_t)kind);
+            lv_timer_set_repeat_count(t, -1);
+            lv_timer_pause(t);
+            g_alerts[kind].hide_timer = t;
+        }
     }
-    g_voice_mode = false;
-    apply_clock_mode();
-    lv_timer_del(timer);
 }
 
-/* Intruder overlay dismiss: remove overlay, return to clock mode. */
-static void intruder_alert_restore_cb(lv_timer_t *timer)
+static void apply_status(const char *text, bool ir_style)
 {
-    lv_obj_t *overlay = (lv_obj_t *)timer->user_data;
-    if (overlay) {
-        lv_obj_del(overlay);
+    /* IR learn messages and the "Say command" prompt are long: smaller font; the rest bold 36 */
+    lv_style_t *font = (ir_style || strcmp(text, "Say command") == 0) ? &ui_theme.status_small
+                                                                      : &ui_theme.status_big;
+    swap_style(g_status_label, g_status_font, font);
+    g_status_font = font;
+    lv_label_set_text(g_status_label, text);
+}
+
+static void apply_light(kavach_light_t state)
+{
+    swap_style(g_light_indicator, &ui_theme.light_state[g_light_state], &ui_theme.light_state[state]);
+    g_light_state = state;
+}
+
+static void ui_cmd_apply(ui_cmd_t *cmd)
+{
+    if (cmd->flags & UI_CMD_F_REVEAL) {
+        set_mode(true, cmd->posted_us);
+    }
+    switch (cmd->type) {
+    case UI_CMD_STATUS:
+        cmd->text[STATUS_TEXT_LEN - 1] = '\0';
+        apply_status(cmd->text, (cmd->flags & UI_CMD_F_IR_STYLE) != 0);
+        break;
+    case UI_CMD_LIGHT:
+        apply_light(cmd->arg < KAVACH_LIGHT_MAX ? (kavach_light_t)cmd->arg : KAVACH_LIGHT_IDLE);
+        break;
+    case UI_CMD_MODE:
+        set_mode(cmd->arg != 0, cmd->posted_us);
+        break;
+    case UI_CMD_ALERT_SHOW:
+        if (cmd->arg < UI_ALERT_MAX) {
+            alert_show((ui_alert_t)cmd->arg, cmd->posted_us);
+        }
+        break;
+    case UI_CMD_ALERT_HIDE:
+        if (cmd->arg < UI_ALERT_MAX) {
+            alert_hide((ui_alert_t)cmd->arg, cmd->posted_us);
+        }
+        break;
     }
-    g_voice_mode = false;
-    apply_clock_mode();
-    lv_timer_del(timer);
 }
 
-static void alert_flash_poll_cb(lv_timer_t *timer)
+/* LVGL task: apply everything queued. Made due by ui_cmd_post(); also runs every UI_CMD_IDLE_MS. */
+static void ui_cmd_drain_cb(lv_timer_t *timer)
 {
     (void)timer;
-    /* When async status/light is pending from another task (e.g. IR learn), switch to voice mode
-     * so status and light indicator are visible (they are hidden in clock mode). */
-    if ((g_pending_status_ready || g_pending_light >= 0) && !g_voice_mode) {
-        g_voice_mode = true;
-        apply_voice_mode();
+    /* Clear before draining: a command queued after the last pop below wakes us again */
+    atomic_store(&g_cmd_wake_pending, false);
+    ui_cmd_t cmd;
+    while (kmpsc_pop(&g_cmd_queue, &cmd)) {
+        ui_cmd_apply(&cmd);
+    }
+    uint32_t overflows = kmpsc_overflows(&g_cmd_queue);
+    if (overflows != g_cmd_overflows_logged) {
+        ESP_LOGW(TAG, "UI command queue full: %u command(s) dropped (%u total)",
+                 (unsigned)(overflows - g_cmd_overflows_logged), (unsigned)overflows);
+        g_cmd_overflows_logged = overflows;
     }
-    /* Apply pending status/light from other tasks (e.g. IR learn callback) */
-    if (g_pending_status_ready && g_status_label) {
-        g_pending_status_ready = false;
-        g_pending_status_buf[PENDING_STATUS_LEN - 1] = '\0';
-        if (g_pending_status_ir_style) {
-            g_pending_status_ir_style = false;
-            lv_obj_set_style_text_font(g_status_label, &font_en_24, LV_PART_MAIN);
-            lv_obj_set_style_text_align(g_status_label, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-            lv_obj_set_width(g_status_label, IR_STATUS_MAX_WIDTH);
-            lv_label_set_long_mode(g_status_label, LV_LABEL_LONG_WRAP);
-        } else if (strcmp(g_pending_status_buf, "Say command") == 0) {
-            lv_obj_set_style_text_font(g_status_label, &font_en_24, LV_PART_MAIN);
-            lv_obj_set_style_text_align(g_status_label, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-            lv_obj_set_width(g_status_label, IR_STATUS_MAX_WIDTH);
-            lv_label_set_long_mode(g_status_label, LV_LABEL_LONG_WRAP);
-        } else {
-            lv_obj_set_style_text_font(g_status_label, &font_en_bold_36, LV_PART_MAIN);
-            lv_obj_set_style_text_align(g_status_label, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-            lv_obj_set_width(g_status_label, IR_STATUS_MAX_WIDTH);
-            lv_label_set_long_mode(g_status_label, LV_LABEL_LONG_WRAP);
-        }
-        lv_label_set_text(g_status_label, g_pending_status_buf);
-    }
-    if (g_pending_light >= 0 && g_pending_light < KAVACH_LIGHT_MAX && g_light_indicator) {
-        int s = g_pending_light;
-        g_pending_light = -1;
-        uint32_t c = light_colors[s];
-        lv_obj_set_style_bg_color(g_light_indicator, lv_color_hex(c), LV_PART_MAIN);
-        lv_obj_set_style_shadow_color(g_light_indicator, lv_color_hex(c), LV_PART_MAIN);
+}
+
+/* Any task: queue cmd and make the drain timer due, unless an earlier command already did. */
+static void ui_cmd_post(ui_cmd_t *cmd)
+{
+    cmd->posted_us = esp_timer_get_time();
+    if (!kmpsc_push(&g_cmd_queue, cmd)) {
+        return;     /* counted; logged by the next drain */
     }
-    if (g_trigger_gas_alert) {
-        g_trigger_gas_alert = false;
-        lv_obj_t *scr = lv_scr_act();
-        lv_obj_t *overlay = lv_obj_create(scr);
-        lv_obj_set_size(overlay, LV_PCT(100), LV_PCT(100));
-        lv_obj_set_pos(overlay, 0, 0);
-        lv_obj_set_style_bg_color(overlay, lv_color_hex(COLOR_ALERT_FLASH), LV_PART_MAIN);
-        lv_obj_set_style_bg_opa(overlay, LV_OPA_COVER, LV_PART_MAIN);
-        lv_obj_set_style_border_width(overlay, 0, LV_PART_MAIN);
-        lv_obj_set_style_radius(overlay, 0, LV_PART_MAIN);
-        lv_obj_set_style_pad_all(overlay, 0, LV_PART_MAIN);
-        lv_obj_clear_flag(overlay, LV_OBJ_FLAG_SCROLLABLE);
-        lv_obj_move_foreground(overlay);
-
-#define GAS_LABEL_W 220
-        lv_obj_t *title = lv_label_create(overlay);
-        lv_label_set_text_static(title, "GAS LEAK!");
-        lv_obj_set_style_text_font(title, &font_en_bold_36, LV_PART_MAIN);
-        lv_obj_set_style_text_color(title, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-        lv_obj_set_style_text_align(title, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-        lv_obj_set_width(title, GAS_LABEL_W);
-        lv_label_set_long_mode(title, LV_LABEL_LONG_WRAP);
-        lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 24);
-
-        lv_obj_t *msg = lv_label_create(overlay);
-        lv_label_set_text_static(msg, "Clear the kitchen");
-        lv_obj_set_style_text_font(msg, &font_en_24, LV_PART_MAIN);
-        lv_obj_set_style_text_color(msg, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-        lv_obj_set_style_text_align(msg, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-        lv_obj_set_width(msg, GAS_LABEL_W);
-        lv_label_set_long_mode(msg, LV_LABEL_LONG_WRAP);
-        lv_obj_align(msg, LV_ALIGN_CENTER, 0, -4);
-
-        lv_obj_t *sub = lv_label_create(overlay);
-        lv_label_set_text_static(sub, "Ventilate now! Open windows.");
-        lv_obj_set_style_text_font(sub, &font_en_24, LV_PART_MAIN);
-        lv_obj_set_style_text_color(sub, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-        lv_obj_set_style_text_align(sub, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-        lv_obj_set_width(sub, GAS_LABEL_W);
-        lv_label_set_long_mode(sub, LV_LABEL_LONG_WRAP);
-        lv_obj_align(sub, LV_ALIGN_CENTER, 0, 28);
-
-        lv_timer_t *restore = lv_timer_create(gas_alert_restore_cb, 3000, overlay);
-        lv_timer_set_repeat_count(restore, 1);
+    if (atomic_exchange(&g_cmd_wake_pending, true)) {
         return;
     }
-
-    if (g_trigger_intruder_alert) {
-        g_trigger_intruder_alert = false;
-        lv_obj_t *scr = lv_scr_act();
-        lv_obj_t *overlay = lv_obj_create(scr);
-        lv_obj_set_size(overlay, LV_PCT(100), LV_PCT(100));
-        lv_obj_set_pos(overlay, 0, 0);
-        lv_obj_set_style_bg_color(overlay, lv_color_hex(COLOR_ALERT_FLASH), LV_PART_MAIN);
-        lv_obj_set_style_bg_opa(overlay, LV_OPA_COVER, LV_PART_MAIN);
-        lv_obj_set_style_border_width(overlay, 0, LV_PART_MAIN);
-        lv_obj_set_style_radius(overlay, 0, LV_PART_MAIN);
-        lv_obj_set_style_pad_all(overlay, 0, LV_PART_MAIN);
-        lv_obj_clear_flag(overlay, LV_OBJ_FLAG_SCROLLABLE);
-        lv_obj_move_foreground(overlay);
-
-#define INTRUDER_LABEL_W 220
-        lv_obj_t *title = lv_label_create(overlay);
-        lv_label_set_text_static(title, "INTRUDER ALERT");
-        lv_obj_set_style_text_font(title, &font_en_24, LV_PART_MAIN);
-        lv_obj_set_style_text_color(title, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-        lv_obj_set_style_text_align(title, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-        lv_obj_set_width(title, INTRUDER_LABEL_W);
-        lv_label_set_long_mode(title, LV_LABEL_LONG_WRAP);
-        lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 24);
-
-        lv_obj_t *msg = lv_label_create(overlay);
-        lv_label_set_text_static(msg, "Motion detected outside");
-        lv_obj_set_style_text_font(msg, &font_en_24, LV_PART_MAIN);
-        lv_obj_set_style_text_color(msg, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-        lv_obj_set_style_text_align(msg, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-        lv_obj_set_width(msg, INTRUDER_LABEL_W);
-        lv_label_set_long_mode(msg, LV_LABEL_LONG_WRAP);
-        lv_obj_align(msg, LV_ALIGN_CENTER, 0, -4);
-
-        lv_timer_t *restore = lv_timer_create(intruder_alert_restore_cb, 3000, overlay);
-        lv_timer_set_repeat_count(restore, 1);
-        return;
+    /* Bounded wait: a producer may hold a lock that an LVGL event callback takes (app_alert_dismiss).
+     * If the LVGL task keeps the lock that long, the idle period picks the command up. */
+    if (g_cmd_drain_timer && bsp_display_lock(UI_WAKE_LOCK_MS)) {
+        lv_timer_ready(g_cmd_drain_timer);
+        bsp_display_unlock();
     }
+}
+
+static void post_alert(ui_cmd_type_t type, ui_alert_t kind)
+{
+    ui_cmd_t cmd = { .type = type, .arg = (uint8_t)kind };
+    ui_cmd_post(&cmd);
+}
 
-    if (!g_trigger_alert_flash) {
+static void post_status(const char *text, uint8_t flags)
+{
+    if (!text) {
         return;
     }
-    g_trigger_alert_flash = false;
+    ui_cmd_t cmd = { .type = UI_CMD_STATUS, .flags = flags };
+    strlcpy(cmd.text, text, sizeof(cmd.text));
+    ui_cmd_post(&cmd);
+}
 
-    lv_obj_t *scr = lv_scr_act();
-    lv_obj_t *overlay = lv_obj_create(scr);
-    lv_obj_set_size(overlay, LV_PCT(100), LV_PCT(100));
-    lv_obj_set_pos(overlay, 0, 0);
-    lv_obj_set_style_bg_color(overlay, lv_color_hex(COLOR_ALERT_FLASH), LV_PART_MAIN);
-    lv_obj_set_style_bg_opa(overlay, LV_OPA_COVER, LV_PART_MAIN);
-    lv_obj_set_style_border_width(overlay, 0, LV_PART_MAIN);
-    lv_obj_set_style_radius(overlay, 0, LV_PART_MAIN);
-    lv_obj_set_style_pad_all(overlay, 0, LV_PART_MAIN);
-    lv_obj_clear_flag(overlay, LV_OBJ_FLAG_SCROLLABLE);
-    lv_obj_move_foreground(overlay);
-
-    /* Title: "Emergency" */
-    lv_obj_t *title = lv_label_create(overlay);
-    lv_label_set_text_static(title, "Emergency");
-    lv_obj_set_style_text_font(title, &font_en_bold_36, LV_PART_MAIN);
-    lv_obj_set_style_text_color(title, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-    lv_obj_set_style_text_align(title, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-    lv_obj_set_width(title, OVERLAY_LABEL_MAX_W);
-    lv_label_set_long_mode(title, LV_LABEL_LONG_WRAP);
-    lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 50);
-
-    /* Confirmation: "Message sent" */
-    lv_obj_t *msg = lv_label_create(overlay);
-    lv_label_set_text_static(msg, "Message sent");
-    lv_obj_set_style_text_font(msg, &font_en_bold_36, LV_PART_MAIN);
-    lv_obj_set_style_text_color(msg, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-    lv_obj_set_style_text_align(msg, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-    lv_obj_set_width(msg, OVERLAY_LABEL_MAX_W);
-    lv_label_set_long_mode(msg, LV_LABEL_LONG_WRAP);
-    lv_obj_align(msg, LV_ALIGN_CENTER, 0, -10);
-
-    /* Subtext: "Help has been notified" */
-    lv_obj_t *sub = lv_label_create(overlay);
-    lv_label_set_text_static(sub, "Help has been notified");
-    lv_obj_set_style_text_font(sub, &font_en_24, LV_PART_MAIN);
-    lv_obj_set_style_text_color(sub, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-    lv_obj_set_style_text_align(sub, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-    lv_obj_set_width(sub, OVERLAY_LABEL_MAX_W);
-    lv_label_set_long_mode(sub, LV_LABEL_LONG_WRAP);
-    lv_obj_align(sub, LV_ALIGN_CENTER, 0, 32);
-
-    lv_timer_t *restore = lv_timer_create(alert_flash_restore_cb, 1200, overlay);
-    lv_timer_set_repeat_count(restore, 1);
+static void post_light(kavach_light_t state, uint8_t flags)
+{
+    if (state >= KAVACH_LIGHT_MAX) {
+        state = KAVACH_LIGHT_IDLE;
+    }
+    ui_cmd_t cmd = { .type = UI_CMD_LIGHT, .arg = (uint8_t)state, .flags = flags };
+    ui_cmd_post(&cmd);
 }
 
 void kavach_ui_trigger_alert_flash(void)
 {
-    g_trigger_alert_flash = true;
+    post_alert(UI_CMD_ALERT_SHOW, UI_ALERT_EMERGENCY);
 }
 
 void kavach_ui_trigger_gas_leak_alert(void)
 {
-    g_trigger_gas_alert = true;
+    post_alert(UI_CMD_ALERT_SHOW, UI_ALERT_GAS);
+}
+
+void kavach_ui_clear_gas_leak_alert(void)
+{
+    post_alert(UI_CMD_ALERT_HIDE, UI_ALERT_GAS);
 }
 
 void kavach_ui_trigger_intruder_alert(void)
 {
-    g_trigger_intruder_alert = true;
+    post_alert(UI_CMD_ALERT_SHOW, UI_ALERT_INTRUDER);
+}
+
+void kavach_ui_set_status(const char *text)
+{
+    post_status(text, 0);
 }
 
 void kavach_ui_set_status_async(const char *text)
 {
-    if (!text) {
-        return;
-    }
-    strncpy(g_pending_status_buf, text, PENDING_STATUS_LEN - 1);
-    g_pending_status_buf[PENDING_STATUS_LEN - 1] = '\0';
-    g_pending_status_ir_style = false;
-    g_pending_status_ready = true;
+    post_status(text, UI_CMD_F_REVEAL);
 }
 
 void kavach_ui_set_status_async_ir(const char *text)
 {
-    if (!text) {
-        return;
-    }
-    strncpy(g_pending_status_buf, text, PENDING_STATUS_LEN - 1);
-    g_pending_status_buf[PENDING_STATUS_LEN - 1] = '\0';
-    g_pending_status_ir_style = true;
-    g_pending_status_ready = true;
+    post_status(text, UI_CMD_F_REVEAL | UI_CMD_F_IR_STYLE);
+}
+
+void kavach_ui_set_light(kavach_light_t state)
+{
+    post_light(state, 0);
 }
 
 void kavach_ui_set_light_async(kavach_light_t state)
 {
-    if (state >= KAVACH_LIGHT_MAX) {
-        state = KAVACH_LIGHT_IDLE;
+    post_light(state, UI_CMD_F_REVEAL);
+}
+
+void kavach_ui_set_voice_mode(bool voice_mode)
+{
+    ui_cmd_t cmd = { .type = UI_CMD_MODE, .arg = voice_mode ? 1 : 0 };
+    ui_cmd_post(&cmd);
+}
+
+uint32_t kavach_ui_cmd_overflows(void)
+{
+    return kmpsc_overflows(&g_cmd_queue);
+}
+
+/* lv_label_set_text() redraws the label even when the text is the same */
+static void label_update(lv_obj_t *label, const char *text)
+{
+    if (strcmp(lv_label_get_text(label), text) != 0) {
+        lv_label_set_text(label, text);
     }
-    g_pending_light = (int)state;
 }
 
 #define TEMP_HUM_BUF_SIZE 16
@@ -543,40 +662,11 @@ static void temp_hum_timer_cb(lv_timer_t *timer)
     if (bsp_board_get_sensor_handle()->get_humiture(&temp, &hum) == ESP_OK) {
         char buf[TEMP_HUM_BUF_SIZE];
         snprintf(buf, sizeof(buf), "%.1f °C", (double)temp);
-        lv_label_set_text(g_temp_label, buf);
+        label_update(g_temp_label, buf);
         snprintf(buf, sizeof(buf), "%.0f%%", (double)hum);
-        lv_label_set_text(g_hum_label, buf);
-    } else {
-        lv_label_set_text_static(g_temp_label, "-- °C");
-        lv_label_set_text_static(g_hum_label, "--%");
-    }
-}
-
-void kavach_ui_set_status(const char *text)
-{
-    if (!g_status_label || !text) {
-        return;
-    }
-    lv_obj_set_width(g_status_label, IR_STATUS_MAX_WIDTH);
-    lv_label_set_long_mode(g_status_label, LV_LABEL_LONG_WRAP);
-    if (strcmp(text, "Say command") == 0) {
-        lv_obj_set_style_text_font(g_status_label, &font_en_24, LV_PART_MAIN);
-        lv_obj_set_style_text_align(g_status_label, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
+        label_update(g_hum_label, buf);
     } else {
-        lv_obj_set_style_text_font(g_status_label, &font_en_bold_36, LV_PART_MAIN);
-        lv_obj_set_style_text_align(g_status_label, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-    }
-    lv_label_set_text(g_status_label, text);
-}
-
-void kavach_ui_set_light(kavach_light_t state)
-{
-    if (state >= KAVACH_LIGHT_MAX) {
-        state = KAVACH_LIGHT_IDLE;
-    }
-    if (g_light_indicator) {
-        uint32_t c = light_colors[state];
-        lv_obj_set_style_bg_color(g_light_indicator, lv_color_hex(c), LV_PART_MAIN);
-        lv_obj_set_style_shadow_color(g_light_indicator, lv_color_hex(c), LV_PART_MAIN);
+        label_update(g_temp_label, "-- °C");
+        label_update(g_hum_label, "--%");
     }
 }
@@ -1,11 +1,15 @@
 /*
  * Kavach minimal UI: text + on-screen light only (no buttons, no factory UI).
  * For wake word detected, command recognised, and alert sent.
+ *
+ * All setters below are safe from any task: they queue a command that the LVGL task applies on its
+ * next pass, in the order the calling task made them.
  */
 #pragma once
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,7 +29,7 @@ void kavach_ui_start(void);
 /** Hide splash and show main UI. Call when initialisation (WiFi, MQTT, SR, etc.) is done. */
 void kavach_ui_splash_finish(void);
 
-/** Set the status line (e.g. "Listening...", command text, "Alert sent"). */
+/** Set the status line (e.g. "Listening...", command text, "Alert sent"); up to 63 characters. */
 void kavach_ui_set_status(const char *text);
 
 /** Set the on-screen indicator: IDLE / LISTENING / COMMAND_OK / ALERT. */
@@ -34,22 +38,28 @@ void kavach_ui_set_light(kavach_light_t state);
 /** true = voice command mode (time top-right, status center); false = desktop clock mode (big clock center). */
 void kavach_ui_set_voice_mode(bool voice_mode);
 
-/** Trigger a full-screen red flash (e.g. when emergency button is pressed). Safe to call from any task. */
+/** Trigger a full-screen red flash (e.g. when emergency button is pressed). */
 void kavach_ui_trigger_alert_flash(void);
 
-/** Trigger full-screen gas leak alert (e.g. when MQTT gas topic reports LEAK). Safe to call from any task. */
+/** Show the full-screen gas leak alert until cleared or tapped (app_alert). */
 void kavach_ui_trigger_gas_leak_alert(void);
 
-/** Trigger full-screen intruder/motion alert (e.g. when MQTT intruder topic reports motion). Safe to call from any task. */
+/** Remove the gas leak alert (incident over or dismissed). */
+void kavach_ui_clear_gas_leak_alert(void);
+
+/** Trigger full-screen intruder/motion alert (e.g. when MQTT intruder topic reports motion). */
 void kavach_ui_trigger_intruder_alert(void);
 
-/** Set status from any task. Applied on LVGL task. Uses normal voice-mode font/size. */
+/** Like kavach_ui_set_status(), and switch to voice mode so it is visible (e.g. from IR learn). */
 void kavach_ui_set_status_async(const char *text);
-/** Set status for IR learn messages: smaller font + wrap so long text fits. Does not affect voice mode. */
+/** Set status for IR learn messages: smaller font + wrap so long text fits; switches to voice mode. */
 void kavach_ui_set_status_async_ir(const char *text);
-/** Set light from any task. Applied on LVGL task. */
+/** Like kavach_ui_set_light(), and switch to voice mode so it is visible. */
 void kavach_ui_set_light_async(kavach_light_t state);
 
+/** UI commands dropped because the queue was full (also logged by the LVGL task). */
+uint32_t kavach_ui_cmd_overflows(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,135 @@
+/*
+ * Kavach UI style sheet (see ui_theme.h). Values are the ones ui_kavach.c used to set per object.
+ */
+#include "ui_theme.h"
+
+LV_FONT_DECLARE(font_en_12);
+LV_FONT_DECLARE(font_en_24);
+LV_FONT_DECLARE(font_en_64);
+LV_FONT_DECLARE(font_en_bold_36);
+
+ui_theme_t ui_theme;
+
+static const uint32_t light_colors[KAVACH_LIGHT_MAX] = {
+    [KAVACH_LIGHT_IDLE]       = 0x78909Cu,  /* blue-grey */
+    [KAVACH_LIGHT_LISTENING]  = 0x69F0AEu,  /* bright teal-green */
+    [KAVACH_LIGHT_COMMAND_OK] = 0x40C4FFu,  /* bright cyan-blue */
+    [KAVACH_LIGHT_ALERT]      = 0xFF5252u,  /* bright red */
+};
+
+static void text_style(lv_style_t *s, const lv_font_t *font, uint32_t color)
+{
+    lv_style_init(s);
+    lv_style_set_text_font(s, font);
+    lv_style_set_text_color(s, lv_color_hex(color));
+}
+
+static void pos_style(lv_style_t *s, lv_align_t align, lv_coord_t x, lv_coord_t y)
+{
+    lv_style_set_align(s, align);
+    lv_style_set_x(s, x);
+    lv_style_set_y(s, y);
+}
+
+/* Raised card: card colour, teal border, soft shadow */
+static void card_style(lv_style_t *s, lv_coord_t radius, lv_coord_t shadow)
+{
+    lv_style_init(s);
+    lv_style_set_bg_color(s, lv_color_hex(COLOR_CARD));
+    lv_style_set_radius(s, radius);
+    lv_style_set_shadow_width(s, shadow);
+    lv_style_set_shadow_color(s, lv_color_hex(0x000000));
+    lv_style_set_shadow_opa(s, LV_OPA_20);
+    lv_style_set_border_width(s, 2);
+    lv_style_set_border_color(s, lv_color_hex(COLOR_CARD_BORDER));
+}
+
+static void layouts_init(void)
+{
+    ui_layout_styles_t *clock = &ui_theme.layout[UI_LAYOUT_CLOCK];
+    lv_style_init(&clock->title);
+    pos_style(&clock->title, LV_ALIGN_TOP_MID, 0, 10);
+    lv_style_init(&clock->time_panel);
+    lv_style_set_width(&clock->time_panel, 260);
+    lv_style_set_height(&clock->time_panel, 110);
+    pos_style(&clock->time_panel, LV_ALIGN_CENTER, 0, -30);
+    text_style(&clock->time_label, &font_en_64, COLOR_CLOCK);
+
+    ui_layout_styles_t *voice = &ui_theme.layout[UI_LAYOUT_VOICE];
+    lv_style_init(&voice->title);
+    pos_style(&voice->title, LV_ALIGN_TOP_LEFT, 12, 10);
+    lv_style_init(&voice->time_panel);
+    lv_style_set_width(&voice->time_panel, 100);
+    lv_style_set_height(&voice->time_panel, 44);
+    pos_style(&voice->time_panel, LV_ALIGN_TOP_RIGHT, -12, 10);
+    text_style(&voice->time_label, &font_en_24, COLOR_CLOCK);
+}
+
+void ui_theme_init(void)
+{
+    lv_style_init(&ui_theme.screen);
+    lv_style_set_bg_color(&ui_theme.screen, lv_color_hex(COLOR_BG));
+
+    text_style(&ui_theme.title, &font_en_24, COLOR_TITLE);
+    card_style(&ui_theme.time_panel, 16, 12);
+    lv_style_init(&ui_theme.time_label);
+    lv_style_set_text_color(&ui_theme.time_label, lv_color_hex(COLOR_CLOCK));
+    pos_style(&ui_theme.time_label, LV_ALIGN_CENTER, 0, 0);
+
+    lv_style_init(&ui_theme.status);
+    lv_style_set_text_color(&ui_theme.status, lv_color_hex(COLOR_TEXT));
+    lv_style_set_text_align(&ui_theme.status, LV_TEXT_ALIGN_CENTER);
+    lv_style_set_width(&ui_theme.status, UI_STATUS_WIDTH);
+    pos_style(&ui_theme.status, LV_ALIGN_CENTER, 0, -28);
+    lv_style_init(&ui_theme.status_big);
+    lv_style_set_text_font(&ui_theme.status_big, &font_en_bold_36);
+    lv_style_init(&ui_theme.status_small);
+    lv_style_set_text_font(&ui_theme.status_small, &font_en_24);
+
+    lv_style_init(&ui_theme.light);
+    lv_style_set_width(&ui_theme.light, 52);
+    lv_style_set_height(&ui_theme.light, 52);
+    lv_style_set_radius(&ui_theme.light, LV_RADIUS_CIRCLE);
+    lv_style_set_border_width(&ui_theme.light, 0);
+    lv_style_set_shadow_width(&ui_theme.light, 14);
+    pos_style(&ui_theme.light, LV_ALIGN_CENTER, 0, 28);
+    for (int i = 0; i < KAVACH_LIGHT_MAX; i++) {
+        lv_style_init(&ui_theme.light_state[i]);
+        lv_style_set_bg_color(&ui_theme.light_state[i], lv_color_hex(light_colors[i]));
+        lv_style_set_shadow_color(&ui_theme.light_state[i], lv_color_hex(light_colors[i]));
+    }
+
+    card_style(&ui_theme.card, 12, 6);
+    lv_style_set_width(&ui_theme.card, 110);
+    lv_style_set_height(&ui_theme.card, 64);
+    lv_style_init(&ui_theme.card_left);
+    pos_style(&ui_theme.card_left, LV_ALIGN_CENTER, -75, 72);
+    lv_style_init(&ui_theme.card_right);
+    pos_style(&ui_theme.card_right, LV_ALIGN_CENTER, 75, 72);
+    text_style(&ui_theme.card_value, &font_en_24, COLOR_TEXT);
+    pos_style(&ui_theme.card_value, LV_ALIGN_TOP_MID, 0, 4);
+    text_style(&ui_theme.card_caption, &font_en_12, COLOR_TEXT_DIM);
+    pos_style(&ui_theme.card_caption, LV_ALIGN_TOP_MID, 0, 34);
+
+    lv_style_init(&ui_theme.alert_bg);
+    lv_style_set_width(&ui_theme.alert_bg, LV_PCT(100));
+    lv_style_set_height(&ui_theme.alert_bg, LV_PCT(100));
+    lv_style_set_bg_color(&ui_theme.alert_bg, lv_color_hex(COLOR_ALERT_FLASH));
+    lv_style_set_bg_opa(&ui_theme.alert_bg, LV_OPA_COVER);
+    lv_style_set_border_width(&ui_theme.alert_bg, 0);
+    lv_style_set_radius(&ui_theme.alert_bg, 0);
+    lv_style_set_pad_all(&ui_theme.alert_bg, 0);
+    text_style(&ui_theme.alert_36, &font_en_bold_36, 0xFFFFFF);
+    text_style(&ui_theme.alert_24, &font_en_24, 0xFFFFFF);
+    text_style(&ui_theme.alert_12, &font_en_12, 0xFFFFFF);
+    lv_style_set_text_align(&ui_theme.alert_36, LV_TEXT_ALIGN_CENTER);
+    lv_style_set_text_align(&ui_theme.alert_24, LV_TEXT_ALIGN_CENTER);
+    lv_style_set_text_align(&ui_theme.alert_12, LV_TEXT_ALIGN_CENTER);
+    lv_style_init(&ui_theme.alert_w_narrow);
+    lv_style_set_width(&ui_theme.alert_w_narrow, UI_ALERT_WIDTH);
+    lv_style_init(&ui_theme.alert_w_wide);
+    lv_style_set_width(&ui_theme.alert_w_wide, UI_ALERT_WIDTH_WIDE);
+
+    layouts_init();
+    ui_theme.clock_font = &font_en_64;
+}
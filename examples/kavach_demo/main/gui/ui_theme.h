@@ -0,0 +1,77 @@
+/*
+ * Kavach UI style sheet: every lv_style_t the screen uses, built once by ui_theme_init().
+ * Objects get shared styles (lv_obj_add_style) instead of per-object local properties, and a mode
+ * switch swaps the layout[] style of the few objects that move instead of re-setting their fonts,
+ * sizes and positions.
+ */
+#pragma once
+
+#include "lvgl.h"
+#include "ui_kavach.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Dark theme with teal accent: readable and visually distinct. */
+#define COLOR_BG            0x1A2332u   /* dark blue-grey background */
+#define COLOR_ALERT_FLASH   0x9B0000u   /* deep red for alerts */
+#define COLOR_CARD          0x243447u   /* card: slightly lighter than bg */
+#define COLOR_CARD_BORDER   0x26A69Au   /* teal accent border */
+#define COLOR_ACCENT        0x4DD0E1u   /* bright cyan for highlights */
+#define COLOR_TEXT          0xFFFFFFu   /* primary text */
+#define COLOR_TEXT_DIM      0xB0BEC5u   /* secondary: soft grey, still readable */
+#define COLOR_CLOCK         0x4DD0E1u   /* time in cyan – stands out, not harsh */
+#define COLOR_TITLE         0x80DEEAu   /* title: light cyan */
+
+#define UI_STATUS_WIDTH     280     /* status text wraps at this width */
+#define UI_ALERT_WIDTH      220     /* gas / intruder alert text width */
+#define UI_ALERT_WIDTH_WIDE 280     /* emergency alert text width */
+
+typedef enum {
+    UI_LAYOUT_CLOCK = 0,    /* desktop clock: big time center, temp/hum cards below */
+    UI_LAYOUT_VOICE,        /* voice command: time top-right, status and light center */
+    UI_LAYOUT_MAX
+} ui_layout_t;
+
+/* Size, position and font of the objects that move between layouts */
+typedef struct {
+    lv_style_t title;
+    lv_style_t time_panel;
+    lv_style_t time_label;
+} ui_layout_styles_t;
+
+typedef struct {
+    lv_style_t screen;
+    lv_style_t title;                   /* font, colour */
+    lv_style_t time_panel;              /* card look, radius 16 */
+    lv_style_t time_label;              /* colour, centered */
+    lv_style_t status;                  /* colour, wrap width, position (voice layout only) */
+    lv_style_t status_big;              /* bold 36: command text, "Alert sent" */
+    lv_style_t status_small;            /* 24: "Say command", IR learn messages */
+    lv_style_t light;                   /* round indicator, position (voice layout only) */
+    lv_style_t light_state[KAVACH_LIGHT_MAX];   /* fill and glow colour */
+    lv_style_t card;                    /* temp / humidity card */
+    lv_style_t card_left;               /* temp card position (clock layout only) */
+    lv_style_t card_right;              /* humidity card position */
+    lv_style_t card_value;
+    lv_style_t card_caption;
+    lv_style_t alert_bg;                /* full-screen red alert panel */
+    lv_style_t alert_36;                /* alert text: font, white, centered */
+    lv_style_t alert_24;
+    lv_style_t alert_12;
+    lv_style_t alert_w_narrow;          /* alert text wrap widths */
+    lv_style_t alert_w_wide;
+    ui_layout_styles_t layout[UI_LAYOUT_MAX];
+    const lv_font_t *clock_font;        /* sprite clock digits (ui_clock.c), COLOR_CLOCK on COLOR_CARD */
+} ui_theme_t;
+
+/** The styles; valid after ui_theme_init(). LVGL keeps pointers to them, so they are never freed. */
+extern ui_theme_t ui_theme;
+
+/** Build all styles. Call once from the LVGL task (kavach_ui_start()) before creating objects. */
+void ui_theme_init(void);
+
+#ifdef __cplusplus
+}
+#endif
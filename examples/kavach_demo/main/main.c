@@ -12,7 +12,10 @@
 #include "app_wifi_simple.h"
 #include "app_sntp.h"
 #include "app_mqtt.h"
+#include "app_outbox.h"
 #include "app_ir.h"
+#include "app_assets.h"
+#include "app_prompt_pack.h"
 #include "gui/ui_kavach.h"
 #include "bsp_board.h"
 #include "bsp/esp-bsp.h"
@@ -73,6 +76,7 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(err);
     ESP_ERROR_CHECK(settings_read_parameter_from_nvs());
+    app_outbox_init();  /* MQTT messages queued while offline (or before a restart) are kept here */
 
     /* WiFi then SNTP (for correct time) and MQTT (broker on PC) */
     err = app_wifi_simple_start();
@@ -88,6 +92,8 @@ void app_main(void)
 
     bsp_spiffs_mount();
     /* Voice WAVs: use /spiffs/ or /storage/ (this board BSP has no SD card driver; put beep.wav, echo_en_ok.wav in SPIFFS) */
+    app_assets_init();  /* index prompt WAVs once; playback resolves them without fopen probing */
+    app_prompt_pack_init();  /* built-in prompts as mapped 48 kHz PCM; SPIFFS files are the fallback */
     bsp_i2c_init();
 
     bsp_display_cfg_t cfg = {
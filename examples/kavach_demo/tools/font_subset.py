@@ -0,0 +1,586 @@
+#!/usr/bin/env python3
+"""
+Subset the LVGL fonts (main/gui/font/full/*.c, lv_font_conv output) to the glyphs the UI can draw,
+as listed in main/gui/font/fonts.txt, and check that every character the UI uses is in its font.
+
+  font_subset.py build fonts.txt --src-dir main -o build/fonts [--compress]
+  font_subset.py report fonts.txt --src-dir main [--compress]
+  font_subset.py inputs|outputs fonts.txt --src-dir main [-o build/fonts]
+
+Manifest lines (paths relative to --src-dir; '#' starts a comment):
+
+  font <name> [compress]          subset gui/font/full/<name>.c into <out>/<name>.c
+  chars <name> <chars>|ascii      keep these characters (text built at run time: digits, units)
+  text <name> <file> <regex>      keep the characters of every STR in every match; STR matches a C
+                                  string literal (use (?:...) for other groups); no match is an error
+  fallback <name> <lvgl font> <chars>
+                                  draw these from a built-in LVGL font (LVGL >= 8.2 font fallback)
+
+A character from a text rule that is neither in the full font nor in a fallback fails the build with
+the file:line that uses it. Fonts marked 'compress' are emitted in LVGL's compressed bitmap format
+(bitmap_format 1: RLE with an XOR-previous-row prefilter, LV_USE_FONT_COMPRESSED) when --compress is
+given; every compressed glyph is decoded again here and compared with the original.
+"""
+import argparse
+import copy
+import os
+import re
+import sys
+
+STR_RE = r'"((?:[^"\\]|\\.)*)"'
+FULL_DIR = 'gui/font/full'
+BPP = 4
+GLYPH_DSC_BYTES = 8     # lv_font_fmt_txt_glyph_dsc_t (bit fields, LV_FONT_FMT_TXT_LARGE 0)
+CMAP_BYTES = 20         # lv_font_fmt_txt_cmap_t on a 32-bit target
+TINY_MIN_RUN = 10       # shorter runs of consecutive code points go into a sparse cmap (a cmap costs
+                        # about as much flash as 10 unicode_list entries, and LVGL scans cmaps linearly)
+C_ESCAPES = {'n': '\n', 't': '\t', 'r': '\r', '0': '\0', '"': '"', "'": "'", '\\': '\\', '?': '?'}
+
+
+def c_unescape(s):
+    return re.sub(r'\\(x[0-9a-fA-F]+|.)',
+                  lambda m: chr(int(m.group(1)[1:], 16)) if m.group(1)[0] == 'x' else C_ESCAPES.get(m.group(1), m.group(1)),
+                  s)
+
+
+def cp_name(cp):
+    return f"'{chr(cp)}' (U+{cp:04X})" if cp >= 32 else f'U+{cp:04X}'
+
+
+# ---------------------------------------------------------------------------------------------------------------------
+# lv_font_conv C output
+
+
+class Font:
+    pass
+
+
+def c_block(src, path, decl):
+    m = re.search(re.escape(decl) + r'\s*=\s*\{(.*?)\n\};', src, re.S)
+    if not m:
+        sys.exit(f'{path}: no "{decl}" (not lv_font_conv output?)')
+    return re.sub(r'/\*.*?\*/', '', m.group(1), flags=re.S)
+
+
+def c_field(src, path, name):
+    m = re.search(r'\.' + name + r'\s*=\s*([^,\s}]+)', src)
+    if not m:
+        sys.exit(f'{path}: no .{name}')
+    return m.group(1)
+
+
+def parse_font(path):
+    with open(path, encoding='utf-8') as f:
+        src = f.read()
+    font = Font()
+    font.path = path
+    m = re.search(r'Size: (\d+) px', src)
+    font.size = int(m.group(1)) if m else 0
+    if int(c_field(src, path, 'bpp')) != BPP or int(c_field(src, path, 'bitmap_format')) != 0:
+        sys.exit(f'{path}: only plain {BPP} bpp fonts are supported')
+    if int(c_field(src, path, 'kern_classes')) != 0:
+        sys.exit(f'{path}: class kerning is not supported')
+    font.bitmap = bytes(int(x, 0) for x in c_block(src, path, 'glyph_bitmap[]').replace(',', ' ').split())
+    font.glyphs = []
+    for g in re.finditer(r'\{([^{}]*bitmap_index[^{}]*)\}', c_block(src, path, 'glyph_dsc[]')):
+        font.glyphs.append({k: int(v) for k, v in re.findall(r'\.(\w+)\s*=\s*(-?\d+)', g.group(1))})
+    for i, g in enumerate(font.glyphs[1:], 1):
+        g['bytes'] = (g['box_w'] * g['box_h'] * BPP + 7) // 8
+        if g['bitmap_index'] + g['bytes'] > len(font.bitmap):
+            sys.exit(f'{path}: glyph {i} runs past the bitmap')
+    font.cmap = {}
+    for c in re.finditer(r'\{([^{}]*range_start[^{}]*)\}', c_block(src, path, 'cmaps[]')):
+        c = c.group(1)
+        if 'FORMAT0_TINY' not in c:
+            sys.exit(f'{path}: only FORMAT0_TINY cmaps are supported')
+        start, length, gid = (int(c_field(c, path, k)) for k in ('range_start', 'range_length', 'glyph_id_start'))
+        for i in range(length):
+            font.cmap[start + i] = gid + i
+    font.kern = []
+    if 'kern_pair_glyph_ids[]' in src:
+        ids = [int(x) for x in c_block(src, path, 'kern_pair_glyph_ids[]').replace(',', ' ').split()]
+        vals = [int(x) for x in c_block(src, path, 'kern_pair_values[]').replace(',', ' ').split()]
+        font.kern = [(ids[2 * i], ids[2 * i + 1], v) for i, v in enumerate(vals)]
+    font.params = {k: c_field(src, path, k) for k in ('kern_scale', 'line_height', 'base_line', 'subpx',
+                                                      'underline_position', 'underline_thickness')}
+    return font
+
+
+def glyph_pixels(font, g):
+    data = font.bitmap[g['bitmap_index']:g['bitmap_index'] + g['bytes']]
+    return [(data[i // 2] >> (4 if i % 2 == 0 else 0)) & 0xF for i in range(g['box_w'] * g['box_h'])]
+
+
+# ---------------------------------------------------------------------------------------------------------------------
+# LVGL 8 compressed bitmaps (lv_font_fmt_txt.c decompress() / rle_next())
+
+
+class BitWriter:
+    def __init__(self):
+        self.bits = []
+
+    def put(self, value, n):
+        self.bits.extend((value >> (n - 1 - i)) & 1 for i in range(n))
+
+    def bytes(self):
+        bits = self.bits + [0] * (-len(self.bits) % 8)
+        return bytes(int(''.join(map(str, bits[i:i + 8])), 2) for i in range(0, len(bits), 8))
+
+
+def rle_encode(vals):
+    """Inverse of rle_next(): a literal equal to the previous one starts a repeat state where each
+    1-bit repeats it; the 11th repeat is followed by a 6-bit count c (c - 1 more repeats, then a literal)."""
+    out = BitWriter()
+    i, n = 0, len(vals)
+    single, prev, cnt = True, None, 0
+    while i < n:
+        if single:
+            out.put(vals[i], BPP)
+            if i > 0 and vals[i] == prev:
+                single, cnt = False, 0
+            prev = vals[i]
+            i += 1
+            continue
+        if vals[i] != prev:
+            out.put(0, 1)
+            out.put(vals[i], BPP)
+            prev, single = vals[i], True
+            i += 1
+            continue
+        out.put(1, 1)
+        cnt += 1
+        if cnt < 11:
+            i += 1
+            continue
+        run = 1
+        while i + run < n and vals[i + run] == prev and run < 63:
+            run += 1
+        out.put(run, 6)
+        i += run
+        if i < n:
+            out.put(vals[i], BPP)
+            prev = vals[i]
+            i += 1
+        single = True
+    return out.bytes()
+
+
+def rle_decode(data, count):
+    """Port of rle_next(), to check rle_encode()."""
+    def bits(pos, n):
+        v = 0
+        for k in range(pos, pos + n):
+            v = (v << 1) | ((data[k // 8] >> (7 - k % 8)) & 1 if k // 8 < len(data) else 0)
+        return v
+
+    out, rdp, state, prev, cnt = [], 0, 'single', 0, 0
+    for _ in range(count):
+        if state == 'single':
+            ret = bits(rdp, BPP)
+            if rdp != 0 and prev == ret:
+                cnt, state = 0, 'repeat'
+            prev = ret
+            rdp += BPP
+        elif state == 'repeat':
+            v = bits(rdp, 1)
+            cnt += 1
+            rdp += 1
+            if v == 1:
+                ret = prev
+                if cnt == 11:
+                    cnt = bits(rdp, 6)
+                    rdp += 6
+                    if cnt != 0:
+                        state = 'counter'
+                    else:
+                        ret = prev = bits(rdp, BPP)
+                        rdp += BPP
+                        state = 'single'
+            else:
+                ret = prev = bits(rdp, BPP)
+                rdp += BPP
+                state = 'single'
+        else:
+            ret = prev
+            cnt -= 1
+            if cnt == 0:
+                ret = prev = bits(rdp, BPP)
+                rdp += BPP
+                state = 'single'
+        out.append(ret)
+    return out
+
+
+def compress_glyph(font, g):
+    px = glyph_pixels(font, g)
+    w = g['box_w']
+    filtered = px[:w] + [px[i] ^ px[i - w] for i in range(w, len(px))]
+    data = rle_encode(filtered)
+    back = rle_decode(data, len(px))
+    for i in range(w, len(back)):
+        back[i] ^= back[i - w]
+    if back != px:
+        sys.exit(f'{font.path}: compressed glyph does not decode back (encoder bug)')
+    return data
+
+
+# ---------------------------------------------------------------------------------------------------------------------
+# Manifest
+
+
+class Rule:
+    def __init__(self, name):
+        self.name = name
+        self.compress = False
+        self.chars = {}       # code point -> [where it is used]
+        self.fallback = None  # (lvgl font, code points)
+        self.texts = []       # source files scanned
+
+
+def parse_manifest(path, src_dir):
+    rules = {}
+    with open(path, encoding='utf-8') as f:
+        lines = list(enumerate(f, 1))
+    for lineno, line in lines:
+        line = line.rstrip('\n')
+        if not line.strip() or line.lstrip().startswith('#'):
+            continue
+        where = f'{path}:{lineno}'
+        kind, _, rest = line.strip().partition(' ')
+        if kind == 'font':
+            name, *opts = rest.split()
+            if name in rules or any(o != 'compress' for o in opts):
+                sys.exit(f'{where}: duplicate font or unknown option')
+            rules[name] = Rule(name)
+            rules[name].compress = bool(opts)
+            continue
+        name, _, rest = rest.strip().partition(' ')
+        rule = rules.get(name)
+        if rule is None:
+            sys.exit(f'{where}: "{name}" has no font line above')
+        rest = rest.strip()
+        if kind == 'chars':
+            chars = ''.join(map(chr, range(32, 127))) if rest == 'ascii' else rest
+            for ch in chars:
+                rule.chars.setdefault(ord(ch), []).append(where)
+        elif kind == 'text':
+            file, _, regex = rest.partition(' ')
+            regex = regex.strip().replace('STR', STR_RE)
+            text_path = os.path.join(src_dir, file)
+            try:
+                with open(text_path, encoding='utf-8') as f:
+                    text = f.read()
+            except OSError as e:
+                sys.exit(f'{where}: {e}')
+            matches = list(re.finditer(regex, text))
+            if not matches:
+                sys.exit(f'{where}: "{regex}" matches nothing in {file}')
+            rule.texts.append(text_path)
+            for m in matches:
+                use = f'{text_path}:{text.count(chr(10), 0, m.start()) + 1}'
+                for s in m.groups():
+                    for ch in c_unescape(s or ''):
+                        rule.chars.setdefault(ord(ch), []).append(use)
+        elif kind == 'fallback':
+            lv_font, _, chars = rest.partition(' ')
+            if not re.fullmatch(r'lv_font_\w+', lv_font) or not chars.strip():
+                sys.exit(f'{where}: expected "fallback <name> lv_font_<built-in> <chars>"')
+            rule.fallback = (lv_font, sorted(set(map(ord, chars.strip()))))
+        else:
+            sys.exit(f'{where}: unknown line "{kind}"')
+    return rules
+
+
+# ---------------------------------------------------------------------------------------------------------------------
+# Subset
+
+
+def subset(rule, font, compress):
+    fallback = set(rule.fallback[1]) if rule.fallback else set()
+    missing = sorted(cp for cp in rule.chars if cp not in font.cmap and cp not in fallback)
+    if missing:
+        for cp in missing:
+            for use in dict.fromkeys(rule.chars[cp]):
+                print(f'{use}: {cp_name(cp)} is not in {font.path} (add it there or declare a fallback)',
+                      file=sys.stderr)
+        sys.exit(f'error: {rule.name}: {len(missing)} glyph(s) missing')
+    cps = sorted(cp for cp in rule.chars if cp in font.cmap)
+    new_id = {font.cmap[cp]: i for i, cp in enumerate(cps, 1)}
+    out = {'cps': cps, 'glyphs': [], 'bitmap': bytearray(), 'compressed': compress and rule.compress}
+    for cp in cps:
+        g = dict(font.glyphs[font.cmap[cp]])
+        data = font.bitmap[g['bitmap_index']:g['bitmap_index'] + g['bytes']]
+        if out['compressed'] and g['bytes']:
+            data = compress_glyph(font, g)
+        g['bitmap_index'] = len(out['bitmap'])
+        out['bitmap'] += data
+        out['glyphs'].append((cp, g))
+    if out['compressed']:
+        out['bitmap'] += b'\0'  # get_bits() reads one byte ahead at the end of the last glyph
+    out['kern'] = [(new_id[l], new_id[r], v) for l, r, v in font.kern if l in new_id and r in new_id]
+    out['cmaps'] = make_cmaps(cps)
+    return out
+
+
+def make_cmaps(cps):
+    """Runs of TINY_MIN_RUN+ consecutive code points -> FORMAT0_TINY; the code points between two runs ->
+    one SPARSE_TINY (or a 1-long FORMAT0_TINY). LVGL stops at the first cmap whose range holds the
+    letter, so ranges must not overlap. Glyph ids follow code point order."""
+    runs = []
+    for cp in cps:
+        if runs and cp == runs[-1][-1] + 1:
+            runs[-1].append(cp)
+        else:
+            runs.append([cp])
+    cmaps, pending, gid = [], [], 1
+
+    def flush():
+        nonlocal gid
+        if len(pending) == 1 or (pending and pending[-1] - pending[0] + 1 == len(pending)):
+            cmaps.append((pending[0], len(pending), gid, None))
+        elif pending:
+            cmaps.append((pending[0], pending[-1] - pending[0] + 1, gid, [cp - pending[0] for cp in pending]))
+        gid += len(pending)
+        pending.clear()
+
+    for run in runs:
+        if len(run) >= TINY_MIN_RUN:
+            flush()
+            pending.extend(run)
+            flush()
+        else:
+            if pending and run[-1] - pending[0] > 0xFFFF:
+                flush()
+            pending.extend(run)
+    flush()
+    return cmaps
+
+
+def flash_bytes(bitmap, glyphs, kern, cmaps):
+    lists = sum(2 * len(c[3]) for c in cmaps if c[3])
+    return len(bitmap) + GLYPH_DSC_BYTES * (glyphs + 1) + 3 * len(kern) + CMAP_BYTES * len(cmaps) + lists
+
+
+# ---------------------------------------------------------------------------------------------------------------------
+# Output
+
+
+def emit(rule, font, sub, manifest):
+    name, guard = rule.name, rule.name.upper()
+    out = [
+        '/*******************************************************************************',
+        f' * Size: {font.size} px',
+        f' * Bpp: {BPP}',
+        f' * Opts: subset of {FULL_DIR}/{name}.c by tools/font_subset.py ({manifest}); do not edit.',
+        f' * Glyphs: {len(sub["glyphs"])}' + (', compressed' if sub['compressed'] else ''),
+        ' ******************************************************************************/',
+        '',
+        '#ifdef LV_LVGL_H_INCLUDE_SIMPLE',
+        '#include "lvgl.h"',
+        '#else',
+        '#include "lvgl/lvgl.h"',
+        '#endif',
+        '',
+        f'#ifndef {guard}',
+        f'#define {guard} 1',
+        '#endif',
+        '',
+        f'#if {guard}',
+        '',
+    ]
+    if sub['compressed']:
+        out += ['#if !LV_USE_FONT_COMPRESSED',
+                f'#error "{name} is compressed: enable LV_USE_FONT_COMPRESSED (CONFIG_LV_USE_FONT_COMPRESSED)"',
+                '#endif', '']
+    if rule.fallback:
+        lv_font = rule.fallback[0]
+        out += [f'#if !LV_VERSION_CHECK(8, 2, 0) || !{lv_font.upper()}',
+                f'#error "{name} draws {"".join(map(chr, rule.fallback[1]))} with {lv_font}: needs LVGL 8.2+ and '
+                f'CONFIG_{lv_font.upper()}"',
+                '#endif', '', f'LV_FONT_DECLARE({lv_font});', '']
+
+    out += ['/*Store the image of the glyphs*/',
+            'static LV_ATTRIBUTE_LARGE_CONST const uint8_t glyph_bitmap[] = {']
+    ends = [g['bitmap_index'] for _, g in sub['glyphs'][1:]] + [len(sub['bitmap'])]
+    for (cp, g), end in zip(sub['glyphs'], ends):
+        label = chr(cp).replace('\\', '\\\\').replace('"', '\\"')
+        out.append(f'    /* U+{cp:04X} "{label}" */')
+        data = sub['bitmap'][g['bitmap_index']:end]
+        for i in range(0, len(data), 8):
+            out.append('    ' + ', '.join(f'0x{b:x}' for b in data[i:i + 8]) + ',')
+        out.append('')
+    if out[-1] == '':
+        out.pop()
+    if not sub['bitmap']:
+        out.append('    0')
+    out += ['};', '', '/*Glyph descriptors; id = 0 reserved*/',
+            'static const lv_font_fmt_txt_glyph_dsc_t glyph_dsc[] = {',
+            '    {.bitmap_index = 0, .adv_w = 0, .box_w = 0, .box_h = 0, .ofs_x = 0, .ofs_y = 0},']
+    for cp, g in sub['glyphs']:
+        out.append(f'    {{.bitmap_index = {g["bitmap_index"]}, .adv_w = {g["adv_w"]}, .box_w = {g["box_w"]}, '
+                   f'.box_h = {g["box_h"]}, .ofs_x = {g["ofs_x"]}, .ofs_y = {g["ofs_y"]}}}, /* U+{cp:04X} */')
+    out += ['};', '']
+
+    for i, (start, length, gid, ulist) in enumerate(sub['cmaps']):
+        if ulist:
+            out.append(f'static const uint16_t unicode_list_{i}[] = {{')
+            for j in range(0, len(ulist), 8):
+                out.append('    ' + ', '.join(f'0x{u:x}' for u in ulist[j:j + 8]) + ',')
+            out += ['};', '']
+    out += ['/*Collect the unicode lists and glyph_id offsets*/',
+            'static const lv_font_fmt_txt_cmap_t cmaps[] =', '{']
+    entries = []
+    for i, (start, length, gid, ulist) in enumerate(sub['cmaps']):
+        if ulist:
+            lst = f'.unicode_list = unicode_list_{i}, .glyph_id_ofs_list = NULL, .list_length = {len(ulist)}, ' \
+                  '.type = LV_FONT_FMT_TXT_CMAP_SPARSE_TINY'
+        else:
+            lst = '.unicode_list = NULL, .glyph_id_ofs_list = NULL, .list_length = 0, ' \
+                  '.type = LV_FONT_FMT_TXT_CMAP_FORMAT0_TINY'
+        entries.append(f'    {{\n        .range_start = {start}, .range_length = {length}, .glyph_id_start = {gid},\n'
+                       f'        {lst}\n    }}')
+    out += [',\n'.join(entries), '};', '']
+
+    if sub['kern']:
+        out += ['/*Pair left and right glyphs for kerning*/', 'static const uint8_t kern_pair_glyph_ids[] =', '{']
+        out.append(',\n'.join(f'    {l}, {r}' for l, r, _ in sub['kern']))
+        out += ['};', '', '/* Kerning between the respective left and right glyphs',
+                ' * 4.4 format which needs to scaled with `kern_scale`*/',
+                'static const int8_t kern_pair_values[] =', '{']
+        vals = [v for _, _, v in sub['kern']]
+        out.append(',\n'.join('    ' + ', '.join(map(str, vals[i:i + 8])) for i in range(0, len(vals), 8)))
+        out += ['};', '', '/*Collect the kern pair\'s data in one place*/',
+                'static const lv_font_fmt_txt_kern_pair_t kern_pairs =', '{',
+                '    .glyph_ids = kern_pair_glyph_ids,', '    .values = kern_pair_values,',
+                f'    .pair_cnt = {len(sub["kern"])},', '    .glyph_ids_size = 0', '};', '']
+
+    p = font.params
+    out += [
+        '#if LV_VERSION_CHECK(8, 0, 0)',
+        'static  lv_font_fmt_txt_glyph_cache_t cache;',
+        'static const lv_font_fmt_txt_dsc_t font_dsc = {',
+        '#else',
+        'static lv_font_fmt_txt_dsc_t font_dsc = {',
+        '#endif',
+        '    .glyph_bitmap = glyph_bitmap,',
+        '    .glyph_dsc = glyph_dsc,',
+        '    .cmaps = cmaps,',
+        '    .kern_dsc = ' + ('&kern_pairs,' if sub['kern'] else 'NULL,'),
+        f'    .kern_scale = {p["kern_scale"] if sub["kern"] else 0},',
+        f'    .cmap_num = {len(sub["cmaps"])},',
+        f'    .bpp = {BPP},',
+        '    .kern_classes = 0,',
+        f'    .bitmap_format = {1 if sub["compressed"] else 0},',
+        '#if LV_VERSION_CHECK(8, 0, 0)',
+        '    .cache = &cache',
+        '#endif',
+        '};',
+        '',
+        '#if LV_VERSION_CHECK(8, 0, 0)',
+        f'const lv_font_t {name} = {{',
+        '#else',
+        f'lv_font_t {name} = {{',
+        '#endif',
+        '    .get_glyph_dsc = lv_font_get_glyph_dsc_fmt_txt,    /*Function pointer to get glyph\'s data*/',
+        '    .get_glyph_bitmap = lv_font_get_bitmap_fmt_txt,    /*Function pointer to get glyph\'s bitmap*/',
+        f'    .line_height = {p["line_height"]},          /*The maximum line height required by the font*/',
+        f'    .base_line = {p["base_line"]},             /*Baseline measured from the bottom of the line*/',
+        '#if !(LVGL_VERSION_MAJOR == 6 && LVGL_VERSION_MINOR == 0)',
+        f'    .subpx = {p["subpx"]},',
+        '#endif',
+        '#if LV_VERSION_CHECK(7, 4, 0)',
+        f'    .underline_position = {p["underline_position"]},',
+        f'    .underline_thickness = {p["underline_thickness"]},',
+        '#endif',
+    ]
+    if rule.fallback:
+        out.append(f'    .fallback = &{rule.fallback[0]},')
+    out += ['    .dsc = &font_dsc           /*The custom font data. Will be accessed by `get_glyph_bitmap/dsc` */',
+            '};', '', f'#endif /*#if {guard}*/']
+    return '\n'.join(out) + '\n'
+
+
+def report_lines(results):
+    rows = [f'{"font":<18}{"glyphs":>14}{"bitmap bytes":>20}{"kern pairs":>14}{"flash bytes":>20}'
+            f'{"compressed":>12}']
+    total = [0, 0]
+    for rule, font, sub, packed in results:
+        full_flash = flash_bytes(font.bitmap, len(font.glyphs) - 1, font.kern, [(0, 0, 0, None)])
+        sub_flash = flash_bytes(sub['bitmap'], len(sub['glyphs']), sub['kern'], sub['cmaps'])
+        total[0] += full_flash
+        total[1] += sub_flash
+        rows.append(f'{rule.name:<18}{len(font.glyphs) - 1:>6} -> {len(sub["glyphs"]):<5}'
+                    f'{len(font.bitmap):>9} -> {len(sub["bitmap"]):<8}{len(font.kern):>5} -> {len(sub["kern"]):<5}'
+                    f'{full_flash:>9} -> {sub_flash:<8}{packed:>12}' + (' (used)' if sub['compressed'] else ''))
+    rows.append(f'{"total":<18}{"":>54}{total[0]:>9} -> {total[1]:<8}')
+    rows.append('flash bytes: bitmaps + glyph descriptors + kern pairs + cmaps; "compressed": subset bitmap '
+                'bytes in LVGL compressed format')
+    return rows
+
+
+def run(args, emit_files):
+    rules = parse_manifest(args.manifest, args.src_dir)
+    manifest = os.path.relpath(args.manifest, args.src_dir).replace('\\', '/')
+    results = []
+    for rule in rules.values():
+        font = parse_font(os.path.join(args.src_dir, FULL_DIR, rule.name + '.c'))
+        sub = subset(rule, font, args.compress)
+        packed = sub
+        if not sub['compressed']:
+            as_compressed = copy.copy(rule)
+            as_compressed.compress = True
+            packed = subset(as_compressed, font, True)
+        results.append((rule, font, sub, len(packed['bitmap'])))
+        if emit_files:
+            write_if_changed(os.path.join(args.output, rule.name + '.c'), emit(rule, font, sub, manifest))
+    return results
+
+
+def write_if_changed(path, text):
+    try:
+        with open(path, encoding='utf-8') as f:
+            if f.read() == text:
+                return
+    except OSError:
+        pass
+    with open(path, 'w', encoding='utf-8') as f:
+        f.write(text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Subset the LVGL fonts to the glyphs the UI uses')
+    sub = parser.add_subparsers(dest='cmd', required=True)
+    for name, help_text in (('build', 'write the subset fonts and font_report.txt'),
+                            ('report', 'check and print the size report'),
+                            ('inputs', 'print the files the fonts depend on (CMake list)'),
+                            ('outputs', 'print the generated font files (CMake list)')):
+        p = sub.add_parser(name, help=help_text)
+        p.add_argument('manifest')
+        p.add_argument('--src-dir', required=True, help='main/ (manifest paths are relative to it)')
+        p.add_argument('-o', '--output', required=name in ('build', 'outputs'), help='output directory')
+        p.add_argument('--compress', action='store_true', help="compress fonts marked 'compress'")
+    args = parser.parse_args()
+
+    if args.cmd in ('inputs', 'outputs'):
+        rules = parse_manifest(args.manifest, args.src_dir)
+        if args.cmd == 'inputs':
+            files = [args.manifest] + [os.path.join(args.src_dir, FULL_DIR, n + '.c') for n in rules]
+            files += sorted({t for r in rules.values() for t in r.texts})
+        else:
+            files = [os.path.join(args.output, n + '.c') for n in rules]
+        print(';'.join(f.replace('\\', '/') for f in files), end='')
+        return 0
+
+    if args.cmd == 'build':
+        os.makedirs(args.output, exist_ok=True)
+    rows = report_lines(run(args, args.cmd == 'build'))
+    if args.cmd == 'build':
+        write_if_changed(os.path.join(args.output, 'font_report.txt'), '\n'.join(rows) + '\n')
+        print(f'{args.output}: ' + rows[-2].split()[-1] + ' font bytes (' + rows[-2].split()[-3] + ' unsubsetted)')
+    else:
+        print('\n'.join(rows))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
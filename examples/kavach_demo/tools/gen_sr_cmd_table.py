@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""
+Generate the built-in voice command table (main/app/sr_cmd_table.h) from main/app/sr_commands.txt.
+
+  gen_sr_cmd_table.py sr_commands.txt -o sr_cmd_table.c [--header app_sr.h]
+
+Each language gets an id-indexed const array (ids are line order) and a minimal perfect hash from
+phoneme to id: keys are split into buckets by hash(key, 0); each bucket, largest first, gets the
+smallest seed that places all its keys in free slots of hash(key, seed) % count.
+"""
+import argparse
+import re
+import sys
+
+LANGS = ('en', 'cn')
+STR_MAX = 64  # SR_CMD_STR_LEN_MAX / SR_CMD_PHONEME_LEN_MAX
+SEED_MAX = 0xFFFF
+MASK32 = 0xFFFFFFFF
+
+
+def sr_cmd_hash(key, seed):
+    """Seeded FNV-1a over UTF-8 bytes, as sr_cmd_hash() in sr_cmd_table.h."""
+    h = 2166136261 ^ ((seed * 0x9E3779B9) & MASK32)
+    for b in key.encode():
+        h = ((h ^ b) * 16777619) & MASK32
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK32
+    return h ^ (h >> 13)
+
+
+def perfect_hash(keys):
+    """Returns (seeds, slot_id) such that slot_id[hash(k, seeds[hash(k, 0) % B]) % n] == index of k."""
+    n = len(keys)
+    if n == 0:
+        return [], []
+    n_buckets = max(1, (n + 1) // 2)
+    buckets = [[] for _ in range(n_buckets)]
+    for i, k in enumerate(keys):
+        buckets[sr_cmd_hash(k, 0) % n_buckets].append(i)
+    seeds = [0] * n_buckets
+    slot_id = [None] * n
+    for b in sorted(range(n_buckets), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            continue
+        for seed in range(1, SEED_MAX + 1):
+            slots = [sr_cmd_hash(keys[i], seed) % n for i in buckets[b]]
+            if len(set(slots)) == len(slots) and all(slot_id[s] is None for s in slots):
+                break
+        else:
+            sys.exit('error: no perfect hash seed found; change SEED_MAX or the bucket count')
+        seeds[b] = seed
+        for i, s in zip(buckets[b], slots):
+            slot_id[s] = i
+    return seeds, slot_id
+
+
+def parse(path, known_cmds):
+    table = {lang: [] for lang in LANGS}
+    with open(path, encoding='utf-8') as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            fields = [x.strip() for x in line.split('|')]
+            where = f'{path}:{lineno}'
+            if len(fields) != 4:
+                sys.exit(f'{where}: expected "lang | command | text | phoneme"')
+            lang, cmd, text, phoneme = fields
+            if lang not in LANGS:
+                sys.exit(f'{where}: unknown language "{lang}"')
+            if known_cmds and f'SR_CMD_{cmd}' not in known_cmds:
+                sys.exit(f'{where}: SR_CMD_{cmd} is not in sr_user_cmd_t')
+            for s in (text, phoneme):
+                if len(s.encode()) >= STR_MAX or '"' in s or '\\' in s:
+                    sys.exit(f'{where}: "{s}" too long or contains quotes/backslashes')
+            if any(phoneme == p for _, _, p in table[lang]):
+                sys.exit(f'{where}: duplicate {lang} phoneme "{phoneme}"')
+            table[lang].append((cmd, text, phoneme))
+    for lang in LANGS:
+        if len(table[lang]) > 255:
+            sys.exit(f'error: {lang} has {len(table[lang])} commands, ids are 8-bit')
+    return table
+
+
+def c_array(ctype, name, values, per_line=16):
+    rows = [', '.join(str(v) for v in values[i:i + per_line]) for i in range(0, len(values), per_line)]
+    return f'static const {ctype} {name}[] = {{\n' + ''.join(f'    {r},\n' for r in rows) + '};\n'
+
+
+def emit(table, src):
+    out = [f'/* Generated by tools/gen_sr_cmd_table.py from {src}; do not edit. */',
+           '#include "sr_cmd_table.h"', '']
+    inits = []
+    for lang in LANGS:
+        cmds = table[lang]
+        up = lang.upper()
+        if not cmds:
+            inits.append(f'    [SR_LANG_{up}] = {{ 0 }},')
+            continue
+        seeds, slot_id = perfect_hash([p for _, _, p in cmds])
+        out.append(f'static const sr_cmd_t s_cmds_{lang}[] = {{')
+        for i, (cmd, text, phoneme) in enumerate(cmds):
+            out.append(f'    {{SR_CMD_{cmd}, SR_LANG_{up}, {i}, "{text}", "{phoneme}"}},')
+        out.append('};')
+        out.append('')
+        out.append(c_array('uint16_t', f's_seed_{lang}', seeds))
+        out.append(c_array('uint8_t', f's_slot_id_{lang}', slot_id))
+        inits.append(f'    [SR_LANG_{up}] = {{ s_cmds_{lang}, {len(cmds)}, {len(seeds)}, s_seed_{lang}, s_slot_id_{lang} }},')
+    out.append('const sr_cmd_table_t g_sr_cmd_table[SR_LANG_MAX] = {')
+    out.extend(inits)
+    out.append('};')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate the built-in voice command table')
+    parser.add_argument('commands')
+    parser.add_argument('-o', '--output', required=True)
+    parser.add_argument('--header', help='app_sr.h, to check command names against sr_user_cmd_t')
+    args = parser.parse_args()
+
+    known = None
+    if args.header:
+        with open(args.header, encoding='utf-8') as f:
+            known = set(re.findall(r'\b(SR_CMD_\w+)', f.read()))
+    table = parse(args.commands, known)
+    code = emit(table, args.commands.replace('\\', '/').split('/')[-1])
+    with open(args.output, 'w', encoding='utf-8') as f:
+        f.write(code)
+    print(f'{args.output}: ' + ', '.join(f'{len(table[l])} {l}' for l in LANGS) + ' commands')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+"""
+Kavach prompt pack: converts prompt WAVs to the 48 kHz mono PCM the playback task writes to I2S
+and packs them into one indexed blob for the "prompts" data partition (see partitions.csv).
+The device memory-maps the partition (main/app/app_prompt_pack.c) and plays from flash directly.
+
+  prompt_pack.py build  -o prompts.bin [--max-size N] spiffs/*.wav
+  prompt_pack.py verify [--max-size N] prompts.bin [spiffs/*.wav]
+
+Prompts that do not fit in --max-size are left out with a warning; the device plays those from
+SPIFFS as before.
+  prompt_pack.py list   prompts.bin
+  prompt_pack.py coefs  -o coefs.bin 8000 11025 ...
+
+coefs writes this tool's resampler branch tables, one record per rate: u32 rate, u32 up, u32 down,
+then up x TAPS int16 (host/resample_test.c compares them with app_resample.c's).
+
+Layout (little endian, keep in sync with app_prompt_pack.c):
+  header  : magic "KVPK", u16 version, u16 count, u32 sample_rate, u32 data_offset
+  entries : count x { char name[32], u32 offset, u32 samples, u32 crc32, u32 reserved }
+  data    : int16 PCM per entry, each starting on a 4-byte boundary
+"""
+import argparse
+import math
+import os
+import struct
+import sys
+import wave
+import zlib
+
+MAGIC = b'KVPK'
+VERSION = 1
+OUT_RATE = 48000
+NAME_MAX = 32
+# Resampler parameters, keep in sync with main/app/app_resample.c
+TAPS = 16
+MAX_UP = 640
+MAX_RATIO = 6
+KAISER_BETA = 6.0
+PASSBAND = 0.90
+COEF_UNITY_SHIFT = 14
+HEADER_FMT = '<4sHHII'
+ENTRY_FMT = '<32sIIII'
+HEADER_SIZE = struct.calcsize(HEADER_FMT)
+ENTRY_SIZE = struct.calcsize(ENTRY_FMT)
+
+
+def bessel_i0(x):
+    total = term = 1.0
+    for k in range(1, 20):
+        term *= (x / (2.0 * k)) ** 2
+        total += term
+        if term < 1e-7 * total:
+            break
+    return total
+
+
+def polyphase_coefs(up, down):
+    """Branch table as built by app_resample.c: up branches of TAPS oldest-first Q15 coefficients."""
+    n_taps = up * TAPS
+    cutoff = PASSBAND * 0.5 / max(up, down)
+    center = (n_taps - 1) * 0.5
+    i0_beta = bessel_i0(KAISER_BETA)
+    table = []
+    for p in range(up):
+        branch = []
+        for w in range(TAPS):
+            t = p + (TAPS - 1 - w) * up - center
+            r = t / center
+            x = 2.0 * cutoff * t
+            sinc = 1.0 if abs(x) < 1e-6 else math.sin(math.pi * x) / (math.pi * x)
+            branch.append(sinc * bessel_i0(KAISER_BETA * math.sqrt(max(0.0, 1.0 - r * r))) / i0_beta)
+        total = sum(branch)
+        table.append([int(round(c / total * (1 << COEF_UNITY_SHIFT))) for c in branch])
+    return table
+
+
+def resample(src, rate):
+    """Polyphase resample of mono int16 samples to OUT_RATE, matching app_resample.c."""
+    g = math.gcd(rate, OUT_RATE)
+    up, down = OUT_RATE // g, rate // g
+    if up == down:
+        return list(src)
+    table = polyphase_coefs(up, down)
+    skip = (TAPS * up - 1) // (2 * down)
+    hist = [0] * TAPS
+    out = []
+    phase = 0
+    half = 1 << (COEF_UNITY_SHIFT - 1)
+    for x in list(src) + [0] * (TAPS // 2):
+        hist.append(x)
+        del hist[0]
+        while phase < up:
+            if skip:
+                skip -= 1
+            else:
+                acc = (sum(h * c for h, c in zip(hist, table[phase])) + half) >> COEF_UNITY_SHIFT
+                out.append(max(-32768, min(32767, acc)))
+            phase += down
+        phase -= up
+    return out
+
+
+def supported(rate):
+    g = math.gcd(rate, OUT_RATE)
+    up, down = OUT_RATE // g, rate // g
+    return down <= up <= min(MAX_UP, MAX_RATIO * down)
+
+
+def convert(path):
+    """Decode a WAV like app_wav_stream.c does (downmix + resample); returns PCM bytes or None."""
+    with wave.open(path, 'rb') as w:
+        rate, channels = w.getframerate(), w.getnchannels()
+        if w.getsampwidth() != 2 or channels > 2 or not supported(rate):
+            print(f'skip {path}: need 16-bit mono/stereo at 8...48 kHz '
+                  f'(file is {rate} Hz {w.getsampwidth() * 8}-bit {channels} ch)')
+            return None
+        raw = w.readframes(w.getnframes())
+    src = struct.unpack(f'<{len(raw) // 2}h', raw[:len(raw) & ~1])
+    if channels == 2:
+        src = [(l + r) >> 1 for l, r in zip(src[0::2], src[1::2])]
+    if not src:
+        return None
+    out = resample(src, rate)
+    return struct.pack(f'<{len(out)}h', *out)
+
+
+def padded(pcm):
+    return len(pcm) + (-len(pcm) % 4)
+
+
+def build(args):
+    items = []
+    size = HEADER_SIZE
+    for path in sorted(args.wavs):
+        name = os.path.basename(path)
+        if len(name.encode()) >= NAME_MAX:
+            sys.exit(f'error: name too long for pack index: {name}')
+        pcm = convert(path)
+        if pcm is None:
+            continue
+        if args.max_size and size + ENTRY_SIZE + padded(pcm) > args.max_size:
+            print(f'warning: {name} ({len(pcm)} bytes) does not fit in the partition, plays from SPIFFS')
+            continue
+        items.append((name, pcm))
+        size += ENTRY_SIZE + padded(pcm)
+
+    data_offset = HEADER_SIZE + ENTRY_SIZE * len(items)
+    entries = b''
+    data = b''
+    for name, pcm in items:
+        offset = data_offset + len(data)
+        entries += struct.pack(ENTRY_FMT, name.encode(), offset, len(pcm) // 2, zlib.crc32(pcm), 0)
+        data += pcm + b'\0' * (-len(pcm) % 4)
+    blob = struct.pack(HEADER_FMT, MAGIC, VERSION, len(items), OUT_RATE, data_offset) + entries + data
+    with open(args.output, 'wb') as f:
+        f.write(blob)
+    print(f'{args.output}: {len(items)} prompts, {len(blob)} bytes'
+          + (f' ({100 * len(blob) // args.max_size}% of partition)' if args.max_size else ''))
+
+
+def read_pack(path):
+    with open(path, 'rb') as f:
+        blob = f.read()
+    magic, version, count, rate, data_offset = struct.unpack_from(HEADER_FMT, blob)
+    if magic != MAGIC or version != VERSION:
+        sys.exit(f'error: {path}: not a v{VERSION} prompt pack')
+    entries = []
+    for i in range(count):
+        name, offset, samples, crc, _ = struct.unpack_from(ENTRY_FMT, blob, HEADER_SIZE + i * ENTRY_SIZE)
+        entries.append((name.rstrip(b'\0').decode(), offset, samples, crc))
+    return blob, rate, data_offset, entries
+
+
+def verify(args):
+    blob, rate, data_offset, entries = read_pack(args.pack)
+    errors = 0
+    if rate != OUT_RATE:
+        print(f'sample rate {rate}, expected {OUT_RATE}')
+        errors += 1
+    by_name = {}
+    for name, offset, samples, crc in entries:
+        pcm = blob[offset:offset + samples * 2]
+        if offset < data_offset or offset % 4 or len(pcm) != samples * 2:
+            print(f'{name}: bad offset/length')
+            errors += 1
+        elif zlib.crc32(pcm) != crc:
+            print(f'{name}: CRC mismatch')
+            errors += 1
+        by_name[name] = pcm
+    for path in args.wavs:
+        name = os.path.basename(path)
+        expected = convert(path)
+        if expected is None:
+            continue
+        if name not in by_name:
+            # Left out by build only if it did not fit (build adds prompts in name order)
+            if args.max_size and len(blob) + ENTRY_SIZE + padded(expected) > args.max_size:
+                print(f'{name}: not in pack (does not fit), plays from SPIFFS')
+            else:
+                print(f'{name}: missing from pack')
+                errors += 1
+        elif by_name[name] != expected:
+            print(f'{name}: PCM differs from source')
+            errors += 1
+    print(f'{args.pack}: {len(entries)} prompts, {errors} error(s)')
+    return 1 if errors else 0
+
+
+def list_pack(args):
+    _, rate, _, entries = read_pack(args.pack)
+    for name, offset, samples, crc in entries:
+        print(f'{name:32s} offset {offset:8d}  {samples:8d} samples  {samples * 1000 // rate:6d} ms  crc {crc:08x}')
+
+
+def dump_coefs(args):
+    with open(args.output, 'wb') as f:
+        for rate in args.rates:
+            if not supported(rate):
+                sys.exit(f'error: {rate} Hz is not a supported input rate')
+            g = math.gcd(rate, OUT_RATE)
+            up, down = OUT_RATE // g, rate // g
+            table = polyphase_coefs(up, down) if up != down else []
+            f.write(struct.pack('<III', rate, up, down))
+            for branch in table:
+                f.write(struct.pack(f'<{TAPS}h', *branch))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build and check the Kavach prompt pack')
+    sub = parser.add_subparsers(dest='cmd', required=True)
+    p = sub.add_parser('build', help='convert WAVs and write a pack')
+    p.add_argument('-o', '--output', required=True)
+    p.add_argument('--max-size', type=lambda s: int(s, 0), default=0, help='partition size in bytes')
+    p.add_argument('wavs', nargs='+')
+    p.set_defaults(func=build)
+    p = sub.add_parser('verify', help='check CRCs and compare against source WAVs')
+    p.add_argument('pack')
+    p.add_argument('--max-size', type=lambda s: int(s, 0), default=0,
+                   help='partition size in bytes: sources that do not fit may be missing')
+    p.add_argument('wavs', nargs='*')
+    p.set_defaults(func=verify)
+    p = sub.add_parser('list', help='print the pack index')
+    p.add_argument('pack')
+    p.set_defaults(func=list_pack)
+    p = sub.add_parser('coefs', help='write the resampler branch tables of the given input rates')
+    p.add_argument('-o', '--output', required=True)
+    p.add_argument('rates', nargs='+', type=int)
+    p.set_defaults(func=dump_coefs)
+    args = parser.parse_args()
+    return args.func(args) or 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+TLS broker stand-in for host/tls_resume_bench: answers each connection's MQTT CONNECT with a CONNACK
+over TLS and waits for the client to close. Sessions can be resumed by ticket, or by session ID only
+(--no-tickets, as brokers that issue no tickets do).
+
+  tls_broker_stub.py serve --cert srv.crt --key srv.key [--port N] [--no-tickets]
+  tls_broker_stub.py bench path/to/tls_resume_bench [--connects N]
+
+serve prints "READY <port>" once listening (--port 0, the default, takes a free port).
+
+bench makes a throwaway CA and server certificate per key type (P-256, RSA-2048) with the openssl
+command in a temporary directory, and runs the benchmark against a server for each key type, with
+tickets and with session IDs only. It fails if one of the runs does.
+"""
+import argparse
+import asyncio
+import os
+import ssl
+import subprocess
+import sys
+import tempfile
+
+KEYS = (('P-256', ['-newkey', 'ec', '-pkeyopt', 'ec_paramgen_curve:P-256']),
+        ('RSA-2048', ['-newkey', 'rsa:2048']))
+
+
+def serve(args):
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    ctx.load_cert_chain(args.cert, args.key)
+    if args.no_tickets:
+        ctx.options |= ssl.OP_NO_TICKET
+
+    async def client(reader, writer):
+        try:
+            hdr = await reader.readexactly(2)
+            await reader.readexactly(hdr[1])
+            writer.write(b'\x20\x02\x00\x00')
+            await writer.drain()
+            await reader.read(1)
+        except (OSError, asyncio.IncompleteReadError, ssl.SSLError):
+            pass
+        writer.close()
+
+    async def main():
+        server = await asyncio.start_server(client, '127.0.0.1', args.port, ssl=ctx)
+        print('READY', server.sockets[0].getsockname()[1], flush=True)
+        async with server:
+            await server.serve_forever()
+
+    asyncio.run(main())
+
+
+def openssl(*argv):
+    subprocess.run(['openssl', *argv], check=True, capture_output=True)
+
+
+def make_certs(d, name, newkey):
+    """CA and a server certificate for localhost; returns (ca, cert, key) paths."""
+    ca_crt, ca_key = os.path.join(d, name + '_ca.crt'), os.path.join(d, name + '_ca.key')
+    crt, key, csr = (os.path.join(d, name + ext) for ext in ('.crt', '.key', '.csr'))
+    ext = os.path.join(d, 'ext.cnf')
+    with open(ext, 'w') as f:
+        f.write('subjectAltName=DNS:localhost\n')
+    openssl('req', '-x509', *newkey, '-nodes', '-keyout', ca_key, '-out', ca_crt, '-days', '2',
+            '-subj', '/CN=kavach bench CA')
+    openssl('req', *newkey, '-nodes', '-keyout', key, '-out', csr, '-subj', '/CN=localhost')
+    openssl('x509', '-req', '-in', csr, '-CA', ca_crt, '-CAkey', ca_key, '-CAcreateserial', '-out', crt,
+            '-days', '2', '-extfile', ext)
+    return ca_crt, crt, key
+
+
+def bench(args):
+    failed = False
+    with tempfile.TemporaryDirectory() as d:
+        for name, newkey in KEYS:
+            ca, crt, key = make_certs(d, name, newkey)
+            for tickets in (True, False):
+                cmd = [sys.executable, os.path.abspath(__file__), 'serve', '--cert', crt, '--key', key]
+                server = subprocess.Popen(cmd + ([] if tickets else ['--no-tickets']), stdout=subprocess.PIPE,
+                                          text=True)
+                try:
+                    ready = server.stdout.readline().split()
+                    if len(ready) != 2 or ready[0] != 'READY':
+                        sys.exit('server did not start')
+                    print(f'--- {name} certificate, resumed by {"ticket" if tickets else "session ID"}',
+                          flush=True)
+                    run = subprocess.run([args.bench, ca, ready[1], str(args.connects)])
+                    failed |= run.returncode != 0
+                finally:
+                    server.terminate()
+                    server.wait()
+    return 1 if failed else 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest='cmd', required=True)
+    p = sub.add_parser('serve')
+    p.add_argument('--cert', required=True)
+    p.add_argument('--key', required=True)
+    p.add_argument('--port', type=int, default=0)
+    p.add_argument('--no-tickets', action='store_true')
+    p = sub.add_parser('bench')
+    p.add_argument('bench')
+    p.add_argument('--connects', type=int, default=400)
+    args = ap.parse_args()
+    if args.cmd == 'serve':
+        serve(args)
+        return 0
+    return bench(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
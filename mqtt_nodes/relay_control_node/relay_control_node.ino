@@ -4,7 +4,7 @@
  * like "Turn on the light" or JSON {"device":"light1","state":"ON"}, toggles relay GPIO.
  *
  * Hardware: ESP32/ESP8266, relay module on RELAY_PIN (e.g. GPIO5).
- * Libraries: WiFi, PubSubClient.
+ * Libraries: WiFi, PubSubClient; kjson from components/kavach_json (see README).
  *
  * Set WIFI_SSID, WIFI_PASS, MQTT_BROKER and RELAY_PIN. Optionally subscribe to
  * fabacademy/kavach/appliances if your Kavach uses that topic.
@@ -12,7 +12,7 @@
 
 #include <WiFi.h>
 #include <PubSubClient.h>
-#include <ArduinoJson.h>
+#include "kjson.h"   // components/kavach_json: copy include/kjson.h and kjson.c next to this sketch
 
 // --- Configure these ---
 #define WIFI_SSID       "your_ssid"
@@ -52,6 +52,23 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
   (void)topic;
   if (length == 0) return;
 
+  // JSON from app e.g. {"device":"light1","state":"ON"}: parsed in place, any length
+  kjson_field_t fields[] = { { "state" }, { "device" } };
+  if (kjson_scan_object((const char*)payload, length, fields, 2) >= 0 && fields[0].val.type != KJSON_END) {
+    const kjson_token_t* state = &fields[0].val;
+    bool on = false;
+    if (state->type == KJSON_STRING) {
+      on = kjson_str_caseeq(state, "ON") || kjson_str_eq(state, "1");
+    } else {
+      kjson_get_bool(state, &on);
+    }
+    char device[32] = "";
+    kjson_str_copy(&fields[1].val, device, sizeof(device));
+    Serial.printf("Appliances JSON: device=%s state=%.*s\n", device, (int)state->len, state->ptr);
+    set_relay(on);
+    return;
+  }
+
   // Copy payload as null-terminated string
   char msg[256];
   size_t copy_len = length < sizeof(msg) - 1 ? length : sizeof(msg) - 1;
@@ -60,23 +77,12 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
 
   Serial.printf("Appliances message: %s\n", msg);
 
-  // Option 1: Plain text from voice (e.g. "Turn on the light", "Turn off the light")
+  // Plain text from voice (e.g. "Turn on the light", "Turn off the light")
   String s = String(msg);
   s.toLowerCase();
   bool turn_on = (s.indexOf("on") >= 0 && s.indexOf("off") < 0) ||
                  (s.indexOf("turn on") >= 0);
 
-  // Option 2: JSON from app e.g. {"device":"light1","state":"ON"}
-  if (strchr(msg, '{') != NULL) {
-    StaticJsonDocument<128> doc;
-    if (deserializeJson(doc, msg) == DeserializationError::Ok) {
-      const char* state = doc["state"];
-      if (state != NULL) {
-        turn_on = (strcasecmp(state, "ON") == 0 || strcasecmp(state, "1") == 0);
-      }
-    }
-  }
-
   set_relay(turn_on);
 }
 
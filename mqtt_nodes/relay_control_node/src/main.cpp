@@ -4,7 +4,7 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
-#include <ArduinoJson.h>
+#include "kjson.h"
 
 #define WIFI_SSID       "your_ssid"
 #define WIFI_PASS       "your_password"
@@ -36,6 +36,18 @@ void set_relay(bool on) {
 void mqtt_callback(char* topic, byte* payload, unsigned int length) {
   (void)topic;
   if (length == 0) return;
+  kjson_field_t fields[] = { { "state" }, { "device" } };
+  if (kjson_scan_object((const char*)payload, length, fields, 2) >= 0 && fields[0].val.type != KJSON_END) {
+    const kjson_token_t* state = &fields[0].val;
+    bool on = false;
+    if (state->type == KJSON_STRING) on = kjson_str_caseeq(state, "ON") || kjson_str_eq(state, "1");
+    else kjson_get_bool(state, &on);
+    char device[32] = "";
+    kjson_str_copy(&fields[1].val, device, sizeof(device));
+    Serial.printf("Appliances JSON: device=%s state=%.*s\n", device, (int)state->len, state->ptr);
+    set_relay(on);
+    return;
+  }
   char msg[256];
   size_t copy_len = length < sizeof(msg) - 1 ? length : sizeof(msg) - 1;
   memcpy(msg, payload, copy_len);
@@ -44,13 +56,6 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
   String s = String(msg);
   s.toLowerCase();
   bool turn_on = (s.indexOf("on") >= 0 && s.indexOf("off") < 0) || (s.indexOf("turn on") >= 0);
-  if (strchr(msg, '{') != NULL) {
-    StaticJsonDocument<128> doc;
-    if (deserializeJson(doc, msg) == DeserializationError::Ok) {
-      const char* state = doc["state"];
-      if (state != NULL) turn_on = (strcasecmp(state, "ON") == 0 || strcasecmp(state, "1") == 0);
-    }
-  }
   set_relay(turn_on);
 }
 